@@ -0,0 +1,1370 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+
+#include <spawn.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+
+#include "feapclient.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/*@T
+ * \section{A C client library}
+ *
+ * The MATLAB client keeps the MATFEAP protocol in MATLAB scripts and
+ * moves bytes with the Java helper or the MEX file.  Programs that
+ * drive FEAP without MATLAB -- batch codes running many sessions, or
+ * drivers written in C or C++ -- use this library instead.  It has no
+ * dependencies beyond the C library, and it comes in two layers:
+ * \begin{itemize}
+ * \item The {\em wire layer} connects to a server and moves lines and
+ *   arrays over a file descriptor, converting between host byte order
+ *   and the big-endian wire format.  It keeps no state of its own, so
+ *   it can be mixed freely with other code reading the same
+ *   descriptor; the MEX file's [[matsock]] routines are thin wrappers
+ *   around it.
+ * \item The {\em session layer} runs the same conversations as the
+ *   MATLAB routines: the [[feapsrv]] prompt and parameters, the file
+ *   name dialog, synchronization, scalars, arrays, sparse matrices,
+ *   and the quit dialog.  A session reads through a buffer of its own,
+ *   so only the session routines should read its descriptor.
+ * \end{itemize}
+ *
+ * Every routine returns [[FEAPC_OK]] or one of the negative error
+ * codes in [[feapclient.h]] (the wire layer's connect routines return
+ * a descriptor on success); [[feapc_strerror]] turns a code into a
+ * message.  Nothing is printed, and nothing exits.
+ *
+ * Arrays go to and from buffers owned by the caller.  Received data
+ * are read straight into the caller's buffer and converted in place,
+ * so even a gigabyte array is never copied.  Since the length of an
+ * array is only known once the server answers, the array routines take
+ * the capacity of the buffer; if the array does not fit, the routine
+ * cancels the transfer, reports the needed length, and returns
+ * [[FEAPC_ESIZE]], so the caller can grow the buffer and ask again.
+ *
+ * A typical driver looks like
+ * \begin{verbatim}
+ *   feapc_t* c;
+ *   size_t n;
+ *   if (feapc_open_tcp(&c, "127.0.0.1", 3490) ||
+ *       feapc_start(c, "Iblock"))
+ *       ...
+ *   feapc_cmd(c, "tang,,1");
+ *   feapc_getm(c, "U", u, ucap, &n);
+ *   feapc_quit(c);
+ * \end{verbatim}
+ * Sessions are independent of each other, so different threads can
+ * drive different sessions.
+ *
+ *@c*/
+#define FEAPC_RBUF   65536
+#define FEAPC_LINE   1024
+#define FEAPC_CHUNK  4096
+#define FEAPC_SPAWN_BUF (1 << 20)
+#define FEAPC_SPAWN_ARGS 64
+
+extern char** environ;
+
+typedef char feapc_int_is_32_bits[sizeof(int) == 4 ? 1 : -1];
+
+struct feapc_t {
+    int    rfd, wfd;         /* Read and write descriptors            */
+    pid_t  pid;              /* Server process, if we started it      */
+    int    started;          /* Past the initial feapsrv prompt       */
+    int    cd_done;          /* Directory set before start            */
+    feapc_echo_t echo;       /* Where to show FEAP's output           */
+    void*  echo_ctx;
+    feapc_push_t push;       /* Where to deliver pushed arrays        */
+    void*  push_ctx;
+    double* pbuf;            /* Pushed array data                     */
+    size_t pcap;
+    size_t rpos, rlen;       /* Unconsumed part of rbuf               */
+    char   rbuf[FEAPC_RBUF];
+    char   line[FEAPC_LINE]; /* Last line received since a send       */
+};
+
+
+const char* feapc_strerror(int err)
+{
+    switch (err) {
+    case FEAPC_OK:        return "Success";
+    case FEAPC_ESYS:      return strerror(errno);
+    case FEAPC_ECLOSED:   return "Connection closed by server";
+    case FEAPC_EPROTO:    return "Unexpected reply from server";
+    case FEAPC_ENOTFOUND: return "Not found";
+    case FEAPC_ETYPE:     return "Array has a different type";
+    case FEAPC_ESIZE:     return "Array size does not match";
+    case FEAPC_EDECK:     return "Input deck rejected";
+    case FEAPC_EHOST:     return "Unknown host";
+    case FEAPC_ESTATE:    return "Not allowed in this state";
+    default:              return "Unknown error";
+    }
+}
+
+
+/*@T
+ * \subsection{Connecting}
+ *
+ * We turn off Nagle's algorithm on TCP connections.  The protocol is a
+ * series of short lines, often two in a row from the client (a
+ * command and then the data it announces), and waiting to coalesce
+ * them costs a delayed acknowledgement each time.
+ *
+ *@c*/
+int feapc_connect_tcp(const char* hostname, int port)
+{
+    struct addrinfo hints, *res, *ai;
+    char service[16];
+    int fd = -1, one = 1, rc;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    sprintf(service, "%d", port);
+    if ((rc = getaddrinfo(hostname, service, &hints, &res)) != 0)
+        return (rc == EAI_SYSTEM) ? FEAPC_ESYS : FEAPC_EHOST;
+
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        if ((fd = socket(ai->ai_family, ai->ai_socktype,
+                         ai->ai_protocol)) < 0)
+            continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0)
+        return FEAPC_ESYS;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+
+int feapc_connect_unix(const char* sockname)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(sockname) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return FEAPC_ESYS;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sockname);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return FEAPC_ESYS;
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return FEAPC_ESYS;
+    }
+    return fd;
+}
+
+
+/*@T
+ * \subsection{Starting a private server}
+ *
+ * The pipe server [[feapp]] talks over its standard input and output.
+ * The [[feapc_spawn]] routine starts one as a child process and returns
+ * a descriptor connected to it, so a client needs neither a daemon nor
+ * Java to run a private session.  The command is split into words at
+ * white space, as Java's [[Runtime.exec]] does, and the program is
+ * looked up in the [[PATH]].
+ *
+ * We use [[posix_spawn]] rather than [[fork]], since the client may be
+ * a large multithreaded process such as MATLAB.  Instead of two pipes
+ * the child gets one end of a UNIX-domain socket pair as both its
+ * standard input and standard output, so the connection is a single
+ * descriptor like any other and the socket writes cannot raise
+ * [[SIGPIPE]].  Both ends get socket buffers of [[FEAPC_SPAWN_BUF]]
+ * bytes, so large arrays move in big blocks rather than a default
+ * pipe's worth at a time.  The child's standard error is left alone.
+ *
+ *@c*/
+static int feapc_split(char* s, char** argv)
+{
+    int argc = 0;
+    char* word = strtok(s, " \t\n\r\f");
+    while (word != NULL && argc < FEAPC_SPAWN_ARGS) {
+        argv[argc++] = word;
+        word = strtok(NULL, " \t\n\r\f");
+    }
+    argv[argc] = NULL;
+    return argc;
+}
+
+
+int feapc_spawn(const char* command, pid_t* pid)
+{
+    posix_spawn_file_actions_t actions;
+    char* argv[FEAPC_SPAWN_ARGS+1];
+    char* cmd = strdup(command);
+    int sv[2], size = FEAPC_SPAWN_BUF, k, rc;
+
+    if (cmd == NULL)
+        return FEAPC_ESYS;
+    if (feapc_split(cmd, argv) == 0) {
+        free(cmd);
+        errno = ENOENT;
+        return FEAPC_ESYS;
+    }
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        free(cmd);
+        return FEAPC_ESYS;
+    }
+    for (k = 0; k < 2; ++k) {
+        fcntl(sv[k], F_SETFD, FD_CLOEXEC);
+        setsockopt(sv[k], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        setsockopt(sv[k], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, sv[1], 0);
+    posix_spawn_file_actions_adddup2(&actions, sv[1], 1);
+    rc = posix_spawnp(pid, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    free(cmd);
+    close(sv[1]);
+    if (rc != 0) {
+        close(sv[0]);
+        errno = rc;
+        return FEAPC_ESYS;
+    }
+    return sv[0];
+}
+
+
+/*@T
+ * Once the connection to a spawned server is closed, the server should
+ * see end of file and exit.  The [[feapc_reap]] routine gives it a
+ * second to do so and then kills it, so that it never leaves a zombie
+ * or a stray FEAP behind.
+ *
+ *@c*/
+int feapc_reap(pid_t pid)
+{
+    int k, status;
+    for (k = 0; k < 100; ++k) {
+        pid_t r = waitpid(pid, &status, WNOHANG);
+        if (r == pid || (r < 0 && errno != EINTR))
+            return FEAPC_OK;
+        usleep(10000);
+    }
+    kill(pid, SIGKILL);
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    return FEAPC_OK;
+}
+
+
+/*@T
+ * \subsection{Moving bytes}
+ *
+ * The wire routines work on sockets and on pipes alike, so they use
+ * [[read]] and [[write]] rather than [[recv]] and [[send]] -- except
+ * that writes to a socket go through [[send]] with [[MSG_NOSIGNAL]]
+ * where the system has it, so that a server that goes away shows up as
+ * an error rather than as a [[SIGPIPE]].  Short transfers and
+ * interrupted calls are retried until the whole block is through.
+ *
+ *@c*/
+int feapc_readall(int fd, void* buf, size_t n)
+{
+    char* p = (char*) buf;
+    while (n > 0) {
+        ssize_t m = read(fd, p, n);
+        if (m < 0 && errno == EINTR)
+            continue;
+        if (m < 0)
+            return FEAPC_ESYS;
+        if (m == 0)
+            return FEAPC_ECLOSED;
+        p += m;
+        n -= m;
+    }
+    return FEAPC_OK;
+}
+
+
+int feapc_writeall(int fd, const void* buf, size_t n)
+{
+    const char* p = (const char*) buf;
+    while (n > 0) {
+        ssize_t m = send(fd, p, n, MSG_NOSIGNAL);
+        if (m < 0 && errno == ENOTSOCK)
+            m = write(fd, p, n);
+        if (m < 0 && errno == EINTR)
+            continue;
+        if (m < 0)
+            return (errno == EPIPE) ? FEAPC_ECLOSED : FEAPC_ESYS;
+        p += m;
+        n -= m;
+    }
+    return FEAPC_OK;
+}
+
+
+/*@T
+ * The unbuffered [[feapc_readline]] reads a byte at a time, so that it
+ * never takes bytes that belong to a following binary transfer.  It
+ * strips the line terminator and drops whatever does not fit in the
+ * buffer; it returns the length of the line.
+ *
+ *@c*/
+int feapc_readline(int fd, char* buf, size_t n)
+{
+    size_t k = 0;
+    char c;
+    for (;;) {
+        int rc = feapc_readall(fd, &c, 1);
+        if (rc < 0)
+            return rc;
+        if (c == '\n')
+            break;
+        if (c != '\r' && k+1 < n)
+            buf[k++] = c;
+    }
+    if (n > 0)
+        buf[k] = 0;
+    return (int) k;
+}
+
+
+/*@T
+ * \subsection{Byte order}
+ *
+ * Doubles and integers travel in big-endian order.  Conversion is done
+ * in place, in either direction.  Sends convert a chunk at a time into
+ * a scratch buffer, so that the caller's data are left alone.
+ * Clients that receive a payload into their own buffer (for example,
+ * while multiplexing several sessions) convert it with [[feapc_ntoh]],
+ * which takes the number of values and the size of each.
+ *
+ *@c*/
+static int feapc_little()
+{
+    const unsigned short one = 1;
+    return *((const char*) &one) == 1;
+}
+
+
+static void feapc_swap(void* buf, size_t n, size_t size)
+{
+    char* p = (char*) buf;
+    size_t i, k;
+    if (!feapc_little())
+        return;
+    for (i = 0; i < n; ++i, p += size)
+        for (k = 0; k < size/2; ++k) {
+            char t = p[k];
+            p[k] = p[size-1-k];
+            p[size-1-k] = t;
+        }
+}
+
+
+void feapc_ntoh(void* buf, size_t n, size_t size)
+{
+    feapc_swap(buf, n, size);
+}
+
+
+static int feapc_read_array(int fd, void* buf, size_t len, size_t size)
+{
+    int rc = feapc_readall(fd, buf, len * size);
+    if (rc == FEAPC_OK)
+        feapc_swap(buf, len, size);
+    return rc;
+}
+
+
+static int feapc_write_array(int fd, const void* buf, size_t len,
+                             size_t size)
+{
+    char tmp[FEAPC_CHUNK * 8];
+    const char* p = (const char*) buf;
+    while (len > 0) {
+        size_t n = (len < FEAPC_CHUNK) ? len : FEAPC_CHUNK;
+        int rc;
+        memcpy(tmp, p, n * size);
+        feapc_swap(tmp, n, size);
+        if ((rc = feapc_writeall(fd, tmp, n * size)) < 0)
+            return rc;
+        p   += n * size;
+        len -= n;
+    }
+    return FEAPC_OK;
+}
+
+
+int feapc_read_darray(int fd, double* buf, size_t len)
+{
+    return feapc_read_array(fd, buf, len, sizeof(double));
+}
+
+
+int feapc_read_iarray(int fd, int* buf, size_t len)
+{
+    return feapc_read_array(fd, buf, len, sizeof(int));
+}
+
+
+int feapc_read_larray(int fd, int64_t* buf, size_t len)
+{
+    return feapc_read_array(fd, buf, len, sizeof(int64_t));
+}
+
+
+int feapc_write_darray(int fd, const double* buf, size_t len)
+{
+    return feapc_write_array(fd, buf, len, sizeof(double));
+}
+
+
+int feapc_write_iarray(int fd, const int* buf, size_t len)
+{
+    return feapc_write_array(fd, buf, len, sizeof(int));
+}
+
+
+int feapc_write_larray(int fd, const int64_t* buf, size_t len)
+{
+    return feapc_write_array(fd, buf, len, sizeof(int64_t));
+}
+
+
+/*@T
+ * \subsection{Session input}
+ *
+ * A session reads lines through its buffer.  Binary data first use up
+ * whatever is left in the buffer and then go directly from the
+ * descriptor into the caller's memory.
+ *
+ *@c*/
+static int c_fill(feapc_t* c)
+{
+    ssize_t m;
+    do
+        m = read(c->rfd, c->rbuf, FEAPC_RBUF);
+    while (m < 0 && errno == EINTR);
+    if (m <= 0)
+        return (m == 0) ? FEAPC_ECLOSED : FEAPC_ESYS;
+    c->rpos = 0;
+    c->rlen = m;
+    return FEAPC_OK;
+}
+
+
+static int c_getline1(feapc_t* c)
+{
+    size_t k = 0;
+    for (;;) {
+        char* nl;
+        size_t n;
+        int rc;
+        if (c->rpos == c->rlen && (rc = c_fill(c)) < 0)
+            return rc;
+        nl = memchr(c->rbuf + c->rpos, '\n', c->rlen - c->rpos);
+        n  = (nl ? (size_t) (nl - c->rbuf) : c->rlen) - c->rpos;
+        if (n > FEAPC_LINE - 1 - k)
+            n = FEAPC_LINE - 1 - k;
+        memcpy(c->line + k, c->rbuf + c->rpos, n);
+        k += n;
+        if (nl) {
+            c->rpos = nl - c->rbuf + 1;
+            break;
+        }
+        c->rpos = c->rlen;
+    }
+    if (k > 0 && c->line[k-1] == '\r')
+        --k;
+    c->line[k] = 0;
+    if (c->echo)
+        c->echo(c->echo_ctx, c->line);
+    return FEAPC_OK;
+}
+
+
+static int c_read(feapc_t* c, void* buf, size_t n)
+{
+    size_t have = c->rlen - c->rpos;
+    if (have > n)
+        have = n;
+    memcpy(buf, c->rbuf + c->rpos, have);
+    c->rpos += have;
+    return feapc_readall(c->rfd, (char*) buf + have, n - have);
+}
+
+
+static int c_drain(feapc_t* c, size_t n)
+{
+    char tmp[FEAPC_CHUNK];
+    while (n > 0) {
+        size_t m = (n < sizeof(tmp)) ? n : sizeof(tmp);
+        int rc = c_read(c, tmp, m);
+        if (rc < 0)
+            return rc;
+        n -= m;
+    }
+    return FEAPC_OK;
+}
+
+
+/*@T
+ * Arrays pushed for subscriptions (see [[feappush.c]]) can arrive
+ * whenever FEAP is running, so [[c_getline]] takes them out of the
+ * stream wherever they turn up and passes them to the push routine.
+ * The routine gets the data of a norm or of a whole array, or no data
+ * if the array is missing; without a push routine, the data are
+ * skipped.  Either way, the caller only sees the lines around them.
+ *
+ *@c*/
+static int c_pushed(feapc_t* c)
+{
+    int id, n = 0;
+    long seq;
+    double ttim, val;
+    char kind[16];
+    size_t len = 0;
+    double* x = NULL;
+    int rc;
+
+    if (sscanf(c->line, "MATFEAP PUSH %d %ld %lf %15s %n",
+               &id, &seq, &ttim, kind, &n) < 4)
+        return FEAPC_EPROTO;
+    if (strcmp(kind, "double") == 0) {
+        len = (size_t) atol(c->line + n);
+        if (c->push == NULL)
+            return c_drain(c, len * sizeof(double));
+        if (len > c->pcap) {
+            double* buf = (double*)
+                realloc(c->pbuf, (len+1) * sizeof(double));
+            if (buf == NULL)
+                return c_drain(c, len * sizeof(double));
+            c->pbuf = buf;
+            c->pcap = len;
+        }
+        if ((rc = c_read(c, c->pbuf, len * sizeof(double))) < 0)
+            return rc;
+        feapc_swap(c->pbuf, len, sizeof(double));
+        x = c->pbuf;
+    } else if (strcmp(kind, "missing") != 0) {
+        val = atof(c->line + n);
+        x = &val;
+        len = 1;
+    }
+    if (c->push)
+        c->push(c->push_ctx, id, seq, ttim, x, len);
+    return FEAPC_OK;
+}
+
+
+static int c_getline(feapc_t* c)
+{
+    int rc;
+    while ((rc = c_getline1(c)) == FEAPC_OK &&
+           strncmp(c->line, "MATFEAP PUSH ", 13) == 0 &&
+           (rc = c_pushed(c)) == FEAPC_OK);
+    return rc;
+}
+
+
+/*@T
+ * Sending a line clears the last line received, so that [[c->line]]
+ * always holds the latest reply to what we sent.
+ *
+ *@c*/
+static int c_send(feapc_t* c, const char* s)
+{
+    char buf[FEAPC_LINE];
+    size_t n = strlen(s);
+    c->line[0] = 0;
+    if (n+1 > sizeof(buf))
+        return FEAPC_ESIZE;
+    memcpy(buf, s, n);
+    buf[n] = '\n';
+    return feapc_writeall(c->wfd, buf, n+1);
+}
+
+
+static int c_is_prompt(feapc_t* c)
+{
+    return strstr(c->line, "FEAPSRV>") != NULL;
+}
+
+
+static int c_prompt(feapc_t* c)
+{
+    int rc;
+    while ((rc = c_getline(c)) == FEAPC_OK && !c_is_prompt(c));
+    return rc;
+}
+
+
+/*@T
+ * As in [[feapsync]], a barrier number of zero matches any
+ * synchronization message.
+ *
+ *@c*/
+static int c_sync(feapc_t* c, int barrier)
+{
+    char want[32];
+    int rc;
+    sprintf(want, "MATFEAP SYNC %d", barrier);
+    while ((rc = c_getline(c)) == FEAPC_OK) {
+        if (strstr(c->line, "MATFEAP SYNC") &&
+            (barrier == 0 || strcmp(c->line, want) == 0))
+            break;
+    }
+    return rc;
+}
+
+
+/*@T
+ * \subsection{Opening and closing sessions}
+ *
+ * A new session waits for the first [[FEAPSRV>]] prompt.  Until
+ * [[feapc_start]] has run the file name dialog, the session sits at
+ * that prompt; afterward it sits at a FEAP prompt.  The [[feapc_attach]]
+ * routine makes a session from descriptors that are already connected
+ * (for a pipe, the read and write ends differ), and [[feapc_open_pipe]]
+ * makes one with a server it starts itself; closing such a session
+ * reaps the server.
+ *
+ *@c*/
+int feapc_attach(feapc_t** cp, int rfd, int wfd)
+{
+    feapc_t* c = (feapc_t*) calloc(1, sizeof(feapc_t));
+    int rc;
+    *cp = NULL;
+    if (c == NULL)
+        return FEAPC_ESYS;
+    c->rfd = rfd;
+    c->wfd = wfd;
+    c->pid = -1;
+    if ((rc = c_prompt(c)) < 0) {
+        free(c);
+        return rc;
+    }
+    *cp = c;
+    return FEAPC_OK;
+}
+
+
+int feapc_open_tcp(feapc_t** c, const char* hostname, int port)
+{
+    int rc, fd = feapc_connect_tcp(hostname, port);
+    *c = NULL;
+    if (fd < 0)
+        return fd;
+    if ((rc = feapc_attach(c, fd, fd)) < 0)
+        close(fd);
+    return rc;
+}
+
+
+int feapc_open_unix(feapc_t** c, const char* sockname)
+{
+    int rc, fd = feapc_connect_unix(sockname);
+    *c = NULL;
+    if (fd < 0)
+        return fd;
+    if ((rc = feapc_attach(c, fd, fd)) < 0)
+        close(fd);
+    return rc;
+}
+
+
+int feapc_open_pipe(feapc_t** c, const char* command)
+{
+    pid_t pid;
+    int rc, fd = feapc_spawn(command, &pid);
+    *c = NULL;
+    if (fd < 0)
+        return fd;
+    if ((rc = feapc_attach(c, fd, fd)) < 0) {
+        close(fd);
+        feapc_reap(pid);
+        return rc;
+    }
+    (*c)->pid = pid;
+    return rc;
+}
+
+
+void feapc_close(feapc_t* c)
+{
+    if (c == NULL)
+        return;
+    close(c->rfd);
+    if (c->wfd != c->rfd)
+        close(c->wfd);
+    if (c->pid > 0)
+        feapc_reap(c->pid);
+    free(c->pbuf);
+    free(c);
+}
+
+
+/*@T
+ * The [[feapc_quit]] routine is [[feapquit]]: it runs FEAP's quit
+ * dialog and then closes the session, whether or not the dialog went
+ * through.  Before the input deck is started, there is no dialog, and
+ * the server just exits.  The [[feapc_close]] routine drops the
+ * connection without asking, like [[feapkill]].
+ *
+ *@c*/
+int feapc_quit(feapc_t* c)
+{
+    int rc = FEAPC_OK;
+    if (c == NULL)
+        return rc;
+    if (!c->started)
+        rc = c_send(c, "quit");
+    else if ((rc = c_send(c, "quit")) == FEAPC_OK &&
+             (rc = c_sync(c, 0)) == FEAPC_OK &&
+             (rc = c_send(c, "n")) == FEAPC_OK)
+        rc = c_sync(c, 1);
+    feapc_close(c);
+    return rc;
+}
+
+
+int feapc_fd(feapc_t* c)
+{
+    return c->rfd;
+}
+
+
+/*@T
+ * Everything FEAP prints is passed, a line at a time, to the echo
+ * routine if there is one; this is the library's verbose mode.
+ *
+ *@c*/
+void feapc_echo(feapc_t* c, feapc_echo_t echo, void* ctx)
+{
+    c->echo = echo;
+    c->echo_ctx = ctx;
+}
+
+
+/*@T
+ * Pushed arrays go to the push routine (see [[c_pushed]] above).  The
+ * data pointer is only good until the routine returns.
+ *
+ *@c*/
+void feapc_push(feapc_t* c, feapc_push_t push, void* ctx)
+{
+    c->push = push;
+    c->push_ctx = ctx;
+}
+
+
+/*@T
+ * \subsection{The [[feapsrv]] wrapper}
+ *
+ * Each [[feapsrv]] operation enters the interface with [[serv]] (if
+ * FEAP has started), sends its command, reads the replies it expects,
+ * and then waits for the prompt and resumes FEAP with [[start]].  If
+ * the last line read was already the prompt, we do not wait for
+ * another.  Errors in the operation itself (such as an array that is
+ * not found) still go through the cleanup, so the session stays
+ * usable; a broken connection does not.
+ *
+ *@c*/
+static int srv_begin(feapc_t* c)
+{
+    int rc;
+    if (!c->started)
+        return FEAPC_OK;
+    if ((rc = c_send(c, "serv")) < 0)
+        return rc;
+    return c_prompt(c);
+}
+
+
+static int srv_done(feapc_t* c, int rc)
+{
+    int rc2 = FEAPC_OK;
+    if (rc == FEAPC_ESYS || rc == FEAPC_ECLOSED)
+        return rc;
+    if (!c_is_prompt(c))
+        rc2 = c_prompt(c);
+    if (rc2 == FEAPC_OK && c->started &&
+        (rc2 = c_send(c, "start")) == FEAPC_OK)
+        rc2 = c_sync(c, 0);
+    return (rc2 < 0) ? rc2 : rc;
+}
+
+
+static void c_name(char* dst, const char* src, size_t n, int upper)
+{
+    size_t k;
+    for (k = 0; k+1 < n && src[k]; ++k)
+        dst[k] = upper ? toupper((unsigned char) src[k])
+                       : tolower((unsigned char) src[k]);
+    dst[k] = 0;
+}
+
+
+int feapc_serv(feapc_t* c, const char* cmd, char* reply, size_t n)
+{
+    int rc = srv_begin(c);
+    if (rc < 0)
+        return rc;
+    if ((rc = c_send(c, cmd)) == FEAPC_OK)
+        rc = c_getline(c);
+    if (rc == FEAPC_OK && reply != NULL && n > 0) {
+        reply[0] = 0;
+        if (!c_is_prompt(c))
+            strncat(reply, c->line, n-1);
+    }
+    return srv_done(c, rc);
+}
+
+
+int feapc_param(feapc_t* c, const char* name, double val)
+{
+    char cmd[FEAPC_LINE];
+    int rc;
+    if (c->started)
+        return FEAPC_ESTATE;
+    snprintf(cmd, sizeof(cmd), "param %s %.17g", name, val);
+    if ((rc = c_send(c, cmd)) < 0)
+        return rc;
+    return srv_done(c, rc);
+}
+
+
+int feapc_chdir(feapc_t* c, const char* dir)
+{
+    char cmd[FEAPC_LINE];
+    int rc = srv_begin(c);
+    if (rc < 0)
+        return rc;
+    snprintf(cmd, sizeof(cmd), "cd %s", dir);
+    if ((rc = c_send(c, cmd)) < 0)
+        return rc;
+    c->cd_done = 1;
+    return srv_done(c, rc);
+}
+
+
+/*@T
+ * \subsection{Starting the input deck}
+ *
+ * The [[feapc_start]] routine follows [[feapstart]].  Unless the caller
+ * has already picked a directory with [[feapc_chdir]], the server
+ * changes to the client's working directory, and then to the directory
+ * part of the deck name, if any.  Then it answers the file name dialog:
+ * the deck name, blank lines for the other file names, and [[y]] to
+ * confirm.  If FEAP reports an error, we ask it to quit and return
+ * [[FEAPC_EDECK]]; the caller should then close the session.
+ *
+ *@c*/
+int feapc_start(feapc_t* c, const char* deck)
+{
+    char dir[FEAPC_LINE];
+    const char* slash = strrchr(deck, '/');
+    int rc;
+
+    if (c->started)
+        return FEAPC_ESTATE;
+    if (!c->cd_done && getcwd(dir, sizeof(dir)) != NULL &&
+        (rc = feapc_chdir(c, dir)) < 0)
+        return rc;
+    if (slash != NULL && slash - deck < FEAPC_LINE) {
+        memcpy(dir, deck, slash - deck);
+        dir[slash - deck] = 0;
+        if (slash > deck && (rc = feapc_chdir(c, dir)) < 0)
+            return rc;
+        deck = slash + 1;
+    }
+
+    if ((rc = c_send(c, "start")) < 0 ||
+        (rc = c_sync(c, 0)) < 0 ||
+        (rc = c_send(c, deck)) < 0)
+        return rc;
+    c->started = 1;
+    while ((rc = c_getline(c)) == FEAPC_OK) {
+        if (strstr(c->line, "*ERROR*")) {
+            if ((rc = c_sync(c, 0)) == FEAPC_OK &&
+                (rc = c_send(c, "quit")) == FEAPC_OK)
+                rc = c_sync(c, 0);
+            return (rc < 0) ? rc : FEAPC_EDECK;
+        } else if (strstr(c->line, "Files are set")) {
+            if ((rc = c_sync(c, 0)) == FEAPC_OK &&
+                (rc = c_send(c, "y")) == FEAPC_OK)
+                rc = c_sync(c, 0);
+            return rc;
+        } else if (strstr(c->line, "MATFEAP SYNC")) {
+            if ((rc = c_send(c, "")) < 0)
+                return rc;
+        }
+    }
+    return rc;
+}
+
+
+/*@T
+ * The [[feapc_reset]] routine throws away the model with the server's
+ * [[reset]] command (see [[feapreset.c]]) and leaves the session as it
+ * was just after it was opened, ready for [[feapc_start]] with a new
+ * deck.  If the server cannot reset, the old model is still there and
+ * we return [[FEAPC_EPROTO]].
+ *
+ *@c*/
+int feapc_reset(feapc_t* c)
+{
+    int rc;
+    if ((rc = srv_begin(c)) < 0 ||
+        (rc = c_send(c, "reset")) < 0 ||
+        (rc = c_getline(c)) < 0)
+        return rc;
+    if (!c_is_prompt(c))
+        return srv_done(c, FEAPC_EPROTO);
+    c->started = 0;
+    c->cd_done = 0;
+    return FEAPC_OK;
+}
+
+
+int feapc_cmd(feapc_t* c, const char* macro)
+{
+    int rc;
+    if (!c->started)
+        return FEAPC_ESTATE;
+    if ((rc = c_send(c, macro)) < 0)
+        return rc;
+    return c_sync(c, 0);
+}
+
+
+/*@T
+ * The [[feapc_queue]] routine runs a list of macros through the
+ * server's queue (see [[feapqueue.c]]), labeled one through [[n]], and
+ * waits for the last label; it must be called at the macro prompt.
+ * If [[status]] is not [[NULL]], entry [[k]] is set to 1 if FEAP
+ * printed an error message while running macro [[k]], to $-1$ if the
+ * macro was skipped after an interrupt, and to 0 otherwise.  All the
+ * macros are checked for length before anything is sent.
+ *
+ *@c*/
+int feapc_queue(feapc_t* c, const char* const* macros, int n, int* status)
+{
+    char cmd[FEAPC_LINE];
+    int k, rc, label, skipped = 0;
+
+    if (!c->started)
+        return FEAPC_ESTATE;
+    for (k = 0; k < n; ++k) {
+        if (status)
+            status[k] = 0;
+        if (strlen(macros[k]) + 32 > sizeof(cmd))
+            return FEAPC_ESIZE;
+    }
+    if (n <= 0)
+        return FEAPC_OK;
+
+    if ((rc = srv_begin(c)) < 0)
+        return rc;
+    for (k = 0; k < n; ++k) {
+        sprintf(cmd, "queue %d %s", k+1, macros[k]);
+        if ((rc = c_send(c, cmd)) < 0)
+            return rc;
+    }
+    if ((rc = c_send(c, "start")) < 0 || (rc = c_sync(c, 0)) < 0)
+        return rc;
+
+    k = 1;
+    while (k <= n && (rc = c_getline(c)) == FEAPC_OK) {
+        if (sscanf(c->line, "MATFEAP SYNC %d", &label) == 1) {
+            if (label == k)
+                ++k;
+            else if (label == 0 && skipped)
+                break;
+        } else if (sscanf(c->line, "MATFEAP SKIP %d", &label) == 1) {
+            skipped = 1;
+            if (status && label >= 1 && label <= n)
+                status[label-1] = -1;
+        } else if (status && strstr(c->line, "*ERROR*")) {
+            status[k-1] = 1;
+        }
+    }
+    return rc;
+}
+
+
+/*@T
+ * \subsection{Scalars}
+ *
+ * The server answers [[get]] with the value, or with nothing if there
+ * is no such scalar.  A [[set]] of an unknown name would leave the
+ * value line to be read as a command, so [[feapc_set]] checks the name
+ * with a [[get]] first.
+ *
+ *@c*/
+static int c_get(feapc_t* c, const char* name, double* val)
+{
+    char cmd[FEAPC_LINE], lname[256];
+    char* end;
+    int rc;
+    c_name(lname, name, sizeof(lname), 0);
+    snprintf(cmd, sizeof(cmd), "get %s", lname);
+    if ((rc = c_send(c, cmd)) < 0 || (rc = c_getline(c)) < 0)
+        return rc;
+    if (c_is_prompt(c))
+        return FEAPC_ENOTFOUND;
+    *val = strtod(c->line, &end);
+    return (end == c->line) ? FEAPC_EPROTO : FEAPC_OK;
+}
+
+
+int feapc_get(feapc_t* c, const char* name, double* val)
+{
+    int rc = srv_begin(c);
+    if (rc < 0)
+        return rc;
+    return srv_done(c, c_get(c, name, val));
+}
+
+
+int feapc_set(feapc_t* c, const char* name, double val)
+{
+    char cmd[FEAPC_LINE], lname[256];
+    double old;
+    int rc = srv_begin(c);
+    if (rc < 0)
+        return rc;
+    if ((rc = c_get(c, name, &old)) == FEAPC_OK &&
+        (rc = c_prompt(c)) == FEAPC_OK) {
+        c_name(lname, name, sizeof(lname), 0);
+        snprintf(cmd, sizeof(cmd), "set %s\n%.17g", lname, val);
+        rc = c_send(c, cmd);
+    }
+    return srv_done(c, rc);
+}
+
+
+/*@T
+ * \subsection{Arrays}
+ *
+ * The array routines share one implementation for each direction.  The
+ * [[kind]] argument is [['d']] for doubles, [['i']] for integers in
+ * 32-bit wire format, or [['l']] for integers in 64-bit wire format
+ * (the {\tt binary64} mode).  A transfer of the wrong type or size is
+ * canceled, which leaves the server at its prompt and the array
+ * unchanged.
+ *
+ *@c*/
+static int c_header(feapc_t* c, const char* tag, int kind, size_t* len)
+{
+    char type[16];
+    unsigned long n;
+    size_t taglen = strlen(tag);
+    if (strncmp(c->line, tag, taglen) != 0 ||
+        sscanf(c->line + taglen, "%15s %lu", type, &n) != 2)
+        return FEAPC_ENOTFOUND;
+    *len = n;
+    if (strcmp(type, (kind == 'd') ? "double" : "int") != 0)
+        return FEAPC_ETYPE;
+    return FEAPC_OK;
+}
+
+
+static int c_getm(feapc_t* c, const char* var, void* buf, size_t cap,
+                  size_t* lenp, int kind)
+{
+    char cmd[FEAPC_LINE], uvar[256];
+    size_t len = 0, size = (kind == 'i') ? 4 : 8;
+    int rc = srv_begin(c);
+    if (rc < 0)
+        return rc;
+
+    c_name(uvar, var, sizeof(uvar), 1);
+    snprintf(cmd, sizeof(cmd), "getm %s", uvar);
+    if ((rc = c_send(c, cmd)) < 0 || (rc = c_getline(c)) < 0)
+        return rc;
+    if ((rc = c_header(c, "Send ", kind, &len)) == FEAPC_ENOTFOUND)
+        return srv_done(c, rc);
+    if (lenp)
+        *lenp = len;
+    if (rc == FEAPC_OK && len > cap)
+        rc = FEAPC_ESIZE;
+    if (rc < 0) {
+        int rc2 = c_send(c, "cancel");
+        return srv_done(c, (rc2 < 0) ? rc2 : rc);
+    }
+
+    if ((rc = c_send(c, (kind == 'l') ? "binary64" : "binary")) < 0 ||
+        (rc = c_read(c, buf, len * size)) < 0)
+        return rc;
+    feapc_swap(buf, len, size);
+    return srv_done(c, rc);
+}
+
+
+int feapc_getm(feapc_t* c, const char* var,
+               double* buf, size_t cap, size_t* len)
+{
+    return c_getm(c, var, buf, cap, len, 'd');
+}
+
+
+int feapc_getmi(feapc_t* c, const char* var,
+                int* buf, size_t cap, size_t* len)
+{
+    return c_getm(c, var, buf, cap, len, 'i');
+}
+
+
+int feapc_getml(feapc_t* c, const char* var,
+                int64_t* buf, size_t cap, size_t* len)
+{
+    return c_getm(c, var, buf, cap, len, 'l');
+}
+
+
+static int c_setm(feapc_t* c, const char* var, const void* buf, size_t len,
+                  int kind)
+{
+    char cmd[FEAPC_LINE], uvar[256];
+    size_t want = 0;
+    int rc = srv_begin(c);
+    if (rc < 0)
+        return rc;
+
+    c_name(uvar, var, sizeof(uvar), 1);
+    snprintf(cmd, sizeof(cmd), "setm %s", uvar);
+    if ((rc = c_send(c, cmd)) < 0 || (rc = c_getline(c)) < 0)
+        return rc;
+    if ((rc = c_header(c, "Recv ", kind, &want)) == FEAPC_ENOTFOUND)
+        return srv_done(c, rc);
+    if (rc == FEAPC_OK && want != len)
+        rc = FEAPC_ESIZE;
+    if (rc < 0) {
+        int rc2 = c_send(c, "cancel");
+        return srv_done(c, (rc2 < 0) ? rc2 : rc);
+    }
+
+    if ((rc = c_send(c, (kind == 'l') ? "binary64" : "binary")) < 0 ||
+        (rc = feapc_write_array(c->wfd, buf, len,
+                                (kind == 'i') ? 4 : 8)) < 0)
+        return rc;
+    return srv_done(c, rc);
+}
+
+
+int feapc_setm(feapc_t* c, const char* var, const double* buf, size_t len)
+{
+    return c_setm(c, var, buf, len, 'd');
+}
+
+
+int feapc_setmi(feapc_t* c, const char* var, const int* buf, size_t len)
+{
+    return c_setm(c, var, buf, len, 'i');
+}
+
+
+int feapc_setml(feapc_t* c, const char* var, const int64_t* buf,
+                size_t len)
+{
+    return c_setm(c, var, buf, len, 'l');
+}
+
+
+/*@T
+ * \subsection{Sparse matrices}
+ *
+ * The [[feapc_sparse]] routine fetches a matrix in coordinate form:
+ * [[ijv]] receives [[nnz]] triples of doubles (row, column, value, with
+ * one-based indices), exactly as they come off the wire.  The server
+ * sends the triples right after the count, with no chance to cancel,
+ * so if the buffer holds fewer than [[nnz]] triples the data are read
+ * and thrown away before [[FEAPC_ESIZE]] is returned.  A matrix FEAP
+ * does not have comes back with no entries.
+ *
+ *@c*/
+int feapc_sparse(feapc_t* c, const char* var,
+                 double* ijv, size_t cap, size_t* nnzp)
+{
+    char cmd[FEAPC_LINE], lvar[256];
+    unsigned long long nnz;
+    int rc = srv_begin(c);
+    if (rc < 0)
+        return rc;
+
+    c_name(lvar, var, sizeof(lvar), 0);
+    snprintf(cmd, sizeof(cmd), "sparse binary %s", lvar);
+    if ((rc = c_send(c, cmd)) < 0 || (rc = c_getline(c)) < 0)
+        return rc;
+    if (sscanf(c->line, "nnz %llu", &nnz) != 1)
+        return srv_done(c, FEAPC_EPROTO);
+    if (nnzp)
+        *nnzp = nnz;
+    if (nnz > cap) {
+        if ((rc = c_drain(c, 3 * nnz * sizeof(double))) < 0)
+            return rc;
+        return srv_done(c, FEAPC_ESIZE);
+    }
+    if ((rc = c_read(c, ijv, 3 * nnz * sizeof(double))) < 0)
+        return rc;
+    feapc_swap(ijv, 3 * nnz, sizeof(double));
+    return srv_done(c, rc);
+}
+
+
+/*@T
+ * \subsection{Element matrices}
+ *
+ * The [[feapc_elmat]] routine runs the [[elmat]] command and hands
+ * each batch to a callback as it arrives, with the batch's element
+ * number [[first]] and count, and with the equation numbers, tangents
+ * (by columns) and residuals already in host order.  The [[what]]
+ * argument is [[FEAPC_TANG]], [[FEAPC_RESID]], or both; a block that
+ * was not asked for is passed as [[NULL]].  A [[first]], [[last]] or
+ * [[batch]] of zero takes the server's default.  The element stream
+ * can be arbitrarily long, so here the library owns the buffers: they
+ * hold one batch and are reused for the next.  If the callback returns
+ * nonzero, the rest of the stream is read and discarded and that value
+ * is returned; running out of memory for the buffers is handled the
+ * same way, with [[FEAPC_ESYS]].  A request the server rejects (such as an element range
+ * out of bounds) gives [[FEAPC_EPROTO]].
+ *
+ *@c*/
+int feapc_elmat(feapc_t* c, int what, int first, int last, int batch,
+                feapc_elmat_t fn, void* ctx)
+{
+    char cmd[FEAPC_LINE];
+    int* ld = NULL;
+    double *s = NULL, *p = NULL;
+    int count, nst, b, elt, cap = 0, stop = 0;
+    int rc = srv_begin(c);
+    if (rc < 0)
+        return rc;
+
+    snprintf(cmd, sizeof(cmd), "elmat %s",
+             (what == FEAPC_TANG)  ? "tang"  :
+             (what == FEAPC_RESID) ? "resid" : "both");
+    if (first > 0)
+        sprintf(cmd + strlen(cmd), " %d", first);
+    if (first > 0 && last > 0)
+        sprintf(cmd + strlen(cmd), " %d", last);
+    if (batch > 0)
+        sprintf(cmd + strlen(cmd), " batch %d", batch);
+    if ((rc = c_send(c, cmd)) < 0 || (rc = c_getline(c)) < 0)
+        return rc;
+    if (sscanf(c->line, "Elements %d %d", &count, &nst) != 2)
+        return srv_done(c, FEAPC_EPROTO);
+    if ((rc = c_send(c, "binary")) < 0)
+        return rc;
+
+    elt = (first > 0) ? first : 1;
+    while ((rc = c_getline(c)) == FEAPC_OK) {
+        size_t nld, ns;
+        if (sscanf(c->line, "Batch %d", &b) != 1) {
+            rc = FEAPC_EPROTO;
+            break;
+        }
+        if (b == 0)
+            break;
+        nld = (size_t) b * nst;
+        ns  = nld * nst;
+        if (!stop && b > cap) {
+            free(ld);
+            free(s);
+            free(p);
+            ld = (int*)    malloc(nld * sizeof(int));
+            s  = (double*) malloc(ns  * sizeof(double));
+            p  = (double*) malloc(nld * sizeof(double));
+            cap = b;
+            if (!ld || !s || !p)
+                stop = FEAPC_ESYS;
+        }
+        if (stop) {
+            size_t n = nld * sizeof(int);
+            if (what & FEAPC_TANG)
+                n += ns * sizeof(double);
+            if (what & FEAPC_RESID)
+                n += nld * sizeof(double);
+            if ((rc = c_drain(c, n)) < 0)
+                break;
+        } else {
+            if ((rc = c_read(c, ld, nld * sizeof(int))) < 0 ||
+                ((what & FEAPC_TANG) &&
+                 (rc = c_read(c, s, ns * sizeof(double))) < 0) ||
+                ((what & FEAPC_RESID) &&
+                 (rc = c_read(c, p, nld * sizeof(double))) < 0))
+                break;
+            feapc_swap(ld, nld, sizeof(int));
+            if (what & FEAPC_TANG)
+                feapc_swap(s, ns, sizeof(double));
+            if (what & FEAPC_RESID)
+                feapc_swap(p, nld, sizeof(double));
+            stop = fn(ctx, elt, b, nst, ld,
+                      (what & FEAPC_TANG)  ? s : NULL,
+                      (what & FEAPC_RESID) ? p : NULL);
+        }
+        elt += b;
+    }
+    free(ld);
+    free(s);
+    free(p);
+    if (rc == FEAPC_ESYS || rc == FEAPC_ECLOSED || rc == FEAPC_EPROTO)
+        return rc;
+    rc = srv_done(c, rc);
+    return (rc == FEAPC_OK) ? stop : rc;
+}
+
+
+/*@T
+ * \subsection{Subscriptions}
+ *
+ * The [[feapc_subscribe]] routine runs the [[subscribe]] command, with
+ * the options (if any) as a string in the command's syntax, such as
+ * [["reduced every 10"]].  The [[feapc_unsubscribe]] routine drops the
+ * subscription [[id]], or all of them if [[id]] is not positive.
+ *
+ *@c*/
+int feapc_subscribe(feapc_t* c, int id, const char* var, const char* opts)
+{
+    char cmd[FEAPC_LINE], reply[FEAPC_LINE], name[64];
+    int rc;
+    c_name(name, var, sizeof(name), 1);
+    snprintf(cmd, sizeof(cmd), "subscribe %d %s %s", id, name,
+             opts ? opts : "");
+    if ((rc = feapc_serv(c, cmd, reply, sizeof(reply))) < 0)
+        return rc;
+    return (strncmp(reply, "Subscribed", 10) == 0) ? FEAPC_OK : FEAPC_EPROTO;
+}
+
+
+int feapc_unsubscribe(feapc_t* c, int id)
+{
+    char cmd[64];
+    if (id > 0)
+        sprintf(cmd, "unsubscribe %d", id);
+    else
+        strcpy(cmd, "unsubscribe all");
+    return feapc_serv(c, cmd, NULL, 0);
+}
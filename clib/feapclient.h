@@ -0,0 +1,94 @@
+#ifndef FEAPCLIENT_H
+#define FEAPCLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FEAPC_OK        0
+#define FEAPC_ESYS     -1   /* System call failed; see errno        */
+#define FEAPC_ECLOSED  -2   /* Connection closed by the server      */
+#define FEAPC_EPROTO   -3   /* Unexpected reply from the server     */
+#define FEAPC_ENOTFOUND -4  /* No such array or scalar              */
+#define FEAPC_ETYPE    -5   /* Array has a different type           */
+#define FEAPC_ESIZE    -6   /* Buffer or array has the wrong size   */
+#define FEAPC_EDECK    -7   /* FEAP rejected the input deck         */
+#define FEAPC_EHOST    -8   /* Unknown host                         */
+#define FEAPC_ESTATE   -9   /* Not allowed before / after start     */
+
+#define FEAPC_TANG      1    /* Element tangents                     */
+#define FEAPC_RESID     2    /* Element residuals                    */
+
+typedef struct feapc_t feapc_t;
+typedef void (*feapc_echo_t)(void* ctx, const char* line);
+typedef int  (*feapc_elmat_t)(void* ctx, int first, int count, int nst,
+                              const int* ld, const double* s,
+                              const double* p);
+typedef void (*feapc_push_t)(void* ctx, int id, long seq, double ttim,
+                             const double* x, size_t n);
+
+const char* feapc_strerror(int err);
+
+/* Wire layer */
+int  feapc_connect_tcp(const char* hostname, int port);
+int  feapc_connect_unix(const char* sockname);
+int  feapc_spawn(const char* command, pid_t* pid);
+int  feapc_reap(pid_t pid);
+int  feapc_readall(int fd, void* buf, size_t n);
+int  feapc_writeall(int fd, const void* buf, size_t n);
+int  feapc_readline(int fd, char* buf, size_t n);
+void feapc_ntoh(void* buf, size_t n, size_t size);
+int  feapc_read_darray(int fd, double*  buf, size_t len);
+int  feapc_read_iarray(int fd, int*     buf, size_t len);
+int  feapc_read_larray(int fd, int64_t* buf, size_t len);
+int  feapc_write_darray(int fd, const double*  buf, size_t len);
+int  feapc_write_iarray(int fd, const int*     buf, size_t len);
+int  feapc_write_larray(int fd, const int64_t* buf, size_t len);
+
+/* Sessions */
+int  feapc_open_tcp(feapc_t** c, const char* hostname, int port);
+int  feapc_open_unix(feapc_t** c, const char* sockname);
+int  feapc_open_pipe(feapc_t** c, const char* command);
+int  feapc_attach(feapc_t** c, int rfd, int wfd);
+void feapc_close(feapc_t* c);
+int  feapc_quit(feapc_t* c);
+int  feapc_fd(feapc_t* c);
+void feapc_echo(feapc_t* c, feapc_echo_t echo, void* ctx);
+void feapc_push(feapc_t* c, feapc_push_t push, void* ctx);
+
+int  feapc_param(feapc_t* c, const char* name, double val);
+int  feapc_chdir(feapc_t* c, const char* dir);
+int  feapc_start(feapc_t* c, const char* deck);
+int  feapc_reset(feapc_t* c);
+int  feapc_cmd(feapc_t* c, const char* macro);
+int  feapc_queue(feapc_t* c, const char* const* macros, int n, int* status);
+int  feapc_serv(feapc_t* c, const char* cmd, char* reply, size_t n);
+
+int  feapc_get(feapc_t* c, const char* name, double* val);
+int  feapc_set(feapc_t* c, const char* name, double val);
+int  feapc_getm(feapc_t* c, const char* var,
+                double* buf, size_t cap, size_t* len);
+int  feapc_getmi(feapc_t* c, const char* var,
+                 int* buf, size_t cap, size_t* len);
+int  feapc_getml(feapc_t* c, const char* var,
+                 int64_t* buf, size_t cap, size_t* len);
+int  feapc_setm(feapc_t* c, const char* var, const double* buf, size_t len);
+int  feapc_setmi(feapc_t* c, const char* var, const int* buf, size_t len);
+int  feapc_setml(feapc_t* c, const char* var, const int64_t* buf,
+                 size_t len);
+int  feapc_sparse(feapc_t* c, const char* var,
+                  double* ijv, size_t cap, size_t* nnz);
+int  feapc_elmat(feapc_t* c, int what, int first, int last, int batch,
+                 feapc_elmat_t fn, void* ctx);
+int  feapc_subscribe(feapc_t* c, int id, const char* var, const char* opts);
+int  feapc_unsubscribe(feapc_t* c, int id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FEAPCLIENT_H */
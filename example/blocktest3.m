@@ -0,0 +1,31 @@
+% Test the reduced vector order on a deck with renumbered equations
+
+%@t
+% The {\tt Iblock3} deck is {\tt Iblock1} with profile optimization
+% turned on, so the equation numbers in FEAP's {\tt ID} array no
+% longer run in node order.  The reduced vectors that {\tt feapgetu},
+% {\tt feapsetu}, {\tt feapaddu}, and {\tt feapresid} pass back and forth
+% must all use the same order regardless, so each check below should
+% print zero.
+%
+%@c
+params.n = 20;
+p = feapstart('Iblock3', params);
+
+u0 = feapgetu(p);
+du = (1:length(u0))';
+feapaddu(p, du, 2);
+u1 = feapgetu(p);
+fprintf('norm(addu - (u0+2*du)) = %g\n', norm(u1-(u0+2*du)));
+
+u  = u0;
+u(1) = 1;
+R1 = feapresid(p,u);
+u1 = feapgetu(p);
+fprintf('norm(u after resid - u) = %g\n', norm(u1-u));
+
+feapsetu(p,u);
+R2 = feapresid(p);
+fprintf('norm(R with u - R after setu) = %g\n', norm(R1-R2));
+
+feapquit(p);
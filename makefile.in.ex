@@ -12,6 +12,10 @@ MFEAPVER=$(VER8)
 # This should be uncommented for FEAPpv
 #MFEAPPV=pv
 
+# Compiler flag for OpenMP, used by the parallel sparse export
+# (leave empty to build the server without threads)
+OPENMP=-fopenmp
+
 # Set to your MEX script and any needed socket libraries (MEX version only)
 MEX=mex
 #MEX=mkoctfile --mex
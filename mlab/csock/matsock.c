@@ -3,6 +3,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
 
 #include <signal.h>
 #include <sys/types.h>
@@ -15,165 +16,165 @@
 #include <netdb.h>
 
 #include "matsock.h"
+#include "feapclient.h"
 #include <mex.h>
 
 
 /* Error check macro */
 #define ec(cmd) \
     do {\
-        char ec_error_string_buf[128]; \
-        sprintf(ec_error_string_buf, "%s (%d)", __FILE__, __LINE__); \
-        if ((cmd) < 0) { \
-            mexErrMsgTxt(ec_error_string_buf); \
+        int ec_rc = (cmd); \
+        if (ec_rc < 0) { \
+            mexErrMsgTxt(feapc_strerror(ec_rc)); \
         } \
     } \
     while (0)
 
 
-static double ntohd(double x)
+/*@T
+ * \section{Connections}
+ *
+ * The MEX routines are thin wrappers over the wire layer of the C
+ * client library (see [[feapclient.c]]), which does the connecting,
+ * the byte order conversions, and the array transfers.  The only thing
+ * added here is that errors are reported to MATLAB.
+ *
+ *@c*/
+int matsock_new_tcp(const char* hostname, int port)
 {
-    double one = 1;
-    if (*((char*) &one) == 0) {
-        double tmp;
-        char* src = (char*) &x;
-        char* dst = (char*) &tmp;
-        dst[0] = src[7];
-        dst[1] = src[6];
-        dst[2] = src[5];
-        dst[3] = src[4];
-        dst[4] = src[3];
-        dst[5] = src[2];
-        dst[6] = src[1];
-        dst[7] = src[0];
-        return tmp;
-    } else {
-        return x;
-    }
+    int sockfd;
+    ec(sockfd = feapc_connect_tcp(hostname, port));
+    return sockfd;
 }
 
 
-static double htond(double x)
+int matsock_new_unix(const char* sockname)
 {
-    return ntohd(x);
+    int sockfd;
+    ec(sockfd = feapc_connect_unix(sockname));
+    return sockfd;
 }
 
 
-int matsock_new_tcp(const char* hostname, int port)
-{
-    int sockfd;                        /* socket file descriptor */
-    struct sockaddr_in addr;           /* address information    */
-    struct hostent* hp;                /* host information       */
+/*@T
+ * A pipe connection is a FEAP server ([[feapp]]) started as a child
+ * with [[feapc_spawn]], which needs neither a daemon nor Java.  We
+ * remember the child for each such descriptor, so that closing the
+ * connection also reaps the server.
+ *
+ *@c*/
+#define MAX_CHILDREN 64
 
-    if ((hp = gethostbyname(hostname)) == NULL)
-        mexErrMsgTxt("Unknown host");
+static int   child_fd[MAX_CHILDREN];
+static pid_t child_pid[MAX_CHILDREN];
+static int   nchildren = 0;
 
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    memcpy(&addr.sin_addr, hp->h_addr_list[0], hp->h_length);
+int matsock_new_pipe(const char* command)
+{
+    int fd;
+    pid_t pid;
+    if (nchildren == MAX_CHILDREN)
+        mexErrMsgTxt("Too many pipe connections");
+    ec(fd = feapc_spawn(command, &pid));
+    child_fd[nchildren]  = fd;
+    child_pid[nchildren] = pid;
+    ++nchildren;
+    return fd;
+}
 
-    ec(sockfd = socket(AF_INET, SOCK_STREAM, 0));
-    ec(connect(sockfd, (struct sockaddr*) &addr, sizeof(addr)));
-    return sockfd;
+
+void matsock_close(int fd)
+{
+    int k, rc = close(fd);
+    for (k = 0; k < nchildren; ++k) {
+        if (child_fd[k] == fd) {
+            feapc_reap(child_pid[k]);
+            child_fd[k]  = child_fd[nchildren-1];
+            child_pid[k] = child_pid[nchildren-1];
+            --nchildren;
+            break;
+        }
+    }
+    if (rc < 0)
+        ec(FEAPC_ESYS);
 }
 
 
-int matsock_new_unix(const char* sockname)
+void matsock_recv(int fd, char* buf, int buflen)
 {
-    int sockfd;                           /* socket file descriptor */
-    struct sockaddr_un addr;              /* my address information */
-    int len;
+    ec(feapc_readline(fd, buf, buflen));
+}
 
-    memset(&addr, 0, sizeof(addr));
-    addr.sun_family = AF_UNIX;
-    strcpy(addr.sun_path, sockname);
-    len = sizeof(addr.sun_family) + strlen(addr.sun_path) + 1;
 
-    ec(sockfd = socket(AF_UNIX, SOCK_STREAM, 0));
-    ec(connect(sockfd, (struct sockaddr*) &addr, len));
-    return sockfd;
+void matsock_send(int fd, char* s)
+{
+    if (*s)
+        ec(feapc_writeall(fd, s, strlen(s)));
+    ec(feapc_writeall(fd, "\n", 1));
 }
 
 
-void matsock_close(int fd)
+int matsock_urgent(int fd)
 {
-    ec(close(fd));
+    return send(fd, "!", 1, MSG_OOB) == 1;
 }
 
 
-void matsock_recv(int fd, char* buf, int buflen)
+/*@T
+ * \section{Array transfers}
+ *
+ * Array lengths are [[size_t]], and the byte counts are computed in
+ * [[size_t]] as well, so that arrays of more than $2^{31}$ bytes (a
+ * quarter billion doubles) go through.  Received arrays are read
+ * directly into the MATLAB array and converted in place.  Integer
+ * arrays can travel either as 32-bit or as 64-bit wire format
+ * integers; the 64-bit versions ([[recvlarray]] and [[sendlarray]])
+ * hold the values in doubles on the MATLAB side, which represent
+ * integers exactly up to $2^{53}$.
+ *
+ *@c*/
+void matsock_recvdarray(int fd, double* buf, size_t len)
 {
-    int i;
-    for (i = 0; i < buflen; ++i) {
-        ec(recv(fd, buf+i, 1, 0));
-        if (buf[i] == '\n') {
-            buf[i] = 0;
-            return;
-        }
-    }
-    buf[buflen-1] = 0;
+    ec(feapc_read_darray(fd, buf, len));
 }
 
 
-void matsock_send(int fd, char* s)
+void matsock_recviarray(int fd, int* buf, size_t len)
 {
-    if (*s)
-        ec(send(fd, s, strlen(s), 0));
-    ec(send(fd, "\n", 1, 0));
+    ec(feapc_read_iarray(fd, buf, len));
 }
 
 
-void matsock_recvdarray(int fd, double* buf, int len)
+void matsock_recvlarray(int fd, double* buf, size_t len)
 {
-    int i;
-    int n = len * sizeof(double);
-    char* p = (char*) buf;
-    while (n > 0) {
-        int m;
-        ec(m = recv(fd, p, n, 0));
-        p += m;
-        n -= m;
+    size_t i;
+    ec(feapc_read_larray(fd, (int64_t*) buf, len));
+    for (i = 0; i < len; ++i) {
+        int64_t datum;
+        memcpy(&datum, buf+i, sizeof(int64_t));
+        buf[i] = (double) datum;
     }
-    for (i = 0; i < len; ++i)
-        buf[i] = ntohd(buf[i]);
 }
 
 
-void matsock_recviarray(int fd, int* buf, int len)
+void matsock_senddarray(int fd, double* buf, size_t len)
 {
-    int i;
-    int n = len * sizeof(int32_t);
-    int32_t* tmp = mxMalloc(n);
-    char* p = (char*) tmp;
-    while (n > 0) {
-        int m;
-        ec(m = recv(fd, p, n, 0));
-        p += m;
-        n -= m;
-    }
-    for (i = 0; i < len; ++i)
-        buf[i] = ntohl(tmp[i]);
-    mxFree(tmp);
+    ec(feapc_write_darray(fd, buf, len));
 }
 
 
-void matsock_senddarray(int fd, double* buf, int len)
+void matsock_sendiarray(int fd, int* buf, size_t len)
 {
-    int i;
-    double* tmp = mxMalloc(len * sizeof(double));
-    for (i = 0; i < len; ++i)
-        tmp[i] = htond(buf[i]);
-    ec(send(fd, tmp, len * sizeof(double), 0));
-    mxFree(tmp);
+    ec(feapc_write_iarray(fd, buf, len));
 }
 
 
-void matsock_sendiarray(int fd, int* buf, int len)
+void matsock_sendlarray(int fd, double* buf, size_t len)
 {
-    int i;
-    int32_t* tmp = mxMalloc(len * sizeof(int32_t));
+    size_t i;
+    int64_t* tmp = mxMalloc(len * sizeof(int64_t));
     for (i = 0; i < len; ++i)
-        tmp[i] = htonl(buf[i]);
-    ec(send(fd, tmp, len * sizeof(int32_t), 0));
+        tmp[i] = (int64_t) buf[i];
+    ec(feapc_write_larray(fd, tmp, len));
     mxFree(tmp);
 }
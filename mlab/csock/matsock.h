@@ -1,14 +1,20 @@
 #ifndef MATSOCK_H
 #define MATSOCK_H
 
+#include <stddef.h>
+
 int matsock_new_tcp(const char* hostname, int port);
 int matsock_new_unix(const char* sockname);
+int matsock_new_pipe(const char* command);
 void matsock_close(int fd);
 void matsock_recv(int fd, char* buf, int buflen);
 void matsock_send(int fd, char* s);
-void matsock_recvdarray(int fd, double* buf, int len);
-void matsock_recviarray(int fd, int*    buf, int len);
-void matsock_senddarray(int fd, double* buf, int len);
-void matsock_sendiarray(int fd, int*    buf, int len);
+int  matsock_urgent(int fd);
+void matsock_recvdarray(int fd, double* buf, size_t len);
+void matsock_recviarray(int fd, int*    buf, size_t len);
+void matsock_recvlarray(int fd, double* buf, size_t len);
+void matsock_senddarray(int fd, double* buf, size_t len);
+void matsock_sendiarray(int fd, int*    buf, size_t len);
+void matsock_sendlarray(int fd, double* buf, size_t len);
 
 #endif /* MATSOCK_H */
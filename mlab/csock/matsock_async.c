@@ -0,0 +1,487 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "matsock_async.h"
+#include "feapclient.h"
+#include <mex.h>
+
+/*@T
+ * \section{Asynchronous multi-session requests}
+ *
+ * The ordinary [[matsock]] routines block on a single file
+ * descriptor, so a client driving several FEAP sessions has to wait
+ * for each reply before it can talk to the next server.  The routines
+ * here let the client start a request on each of many sessions and
+ * then multiplex the replies with [[poll]].
+ *
+ * Each request is a {\em job}, identified by a small integer handle.
+ * A job is a little state machine that walks through exactly the
+ * same protocol as the corresponding MATLAB routine ([[feapcmd]],
+ * [[feapgetm]], or [[feapgetsparse]]): it sends a line, waits for
+ * a [[FEAPSRV>]] prompt or a [[MATFEAP SYNC]] line, reads a
+ * [[Send]] or [[csc]] header, and then reads the binary payload.
+ * Lines sent to the server are short, so we send them with the
+ * blocking [[feapc_writeall]] from the C client library; only the
+ * reads are driven by [[poll]].  The library has no non-blocking read,
+ * so the jobs keep their own read buffers, but payloads are converted
+ * from wire format with [[feapc_ntoh]], as everywhere else.
+ *
+ * There should be at most one unfinished job per session at a time,
+ * since the replies on a session are not labeled by job.
+ *
+ *@c*/
+#define MAX_JOBS  256
+#define RBUF_SIZ  4096
+#define LINE_SIZ  1024
+
+#define S_FREE        0
+#define S_CMD_SEND    1  /* Send next macro command                 */
+#define S_CMD_SYNC    2  /* Wait for sync after macro command       */
+#define S_SRV_PROMPT  3  /* Wait for prompt after 'serv'            */
+#define S_HEADER      4  /* Wait for Send / csc header (or prompt)  */
+#define S_DATA        5  /* Read binary payload                     */
+#define S_END_PROMPT  6  /* Wait for prompt after transfer          */
+#define S_END_SYNC    7  /* Wait for sync after 'start'             */
+#define S_DONE        8
+#define S_ERROR       9
+
+typedef struct matsock_job {
+    int    state;
+    int    fd;
+    int    kind;            /* 0 = commands, else getm / sparse      */
+    char*  cmds;            /* Remaining newline-separated commands  */
+    char*  cmdp;
+    char   var[64];
+
+    char   rbuf[RBUF_SIZ];  /* Bytes received but not yet consumed   */
+    int    rlen;
+    char   line[LINE_SIZ];  /* Partial line being assembled          */
+    int    llen;
+
+    int    type;            /* MATSOCK_ASYNC_* result type           */
+    size_t len;             /* Number of values in the result        */
+    size_t m, n;            /* Sparse matrix dimensions              */
+    char*  data;            /* Raw (wire format) payload             */
+    size_t need;            /* Payload size in bytes                 */
+    size_t have;            /* Payload bytes received so far         */
+} matsock_job;
+
+static matsock_job jobs[MAX_JOBS];
+
+
+static matsock_job* job_get(int h)
+{
+    if (h < 0 || h >= MAX_JOBS || jobs[h].state == S_FREE)
+        mexErrMsgTxt("Invalid asynchronous job handle");
+    return jobs + h;
+}
+
+
+static int job_new(int fd, int kind, const char* var)
+{
+    int h;
+    for (h = 0; h < MAX_JOBS; ++h) {
+        if (jobs[h].state == S_FREE) {
+            matsock_job* job = jobs + h;
+            memset(job, 0, sizeof(*job));
+            job->fd   = fd;
+            job->kind = kind;
+            if (var) {
+                strncpy(job->var, var, sizeof(job->var)-1);
+                job->var[sizeof(job->var)-1] = 0;
+            }
+            return h;
+        }
+    }
+    mexErrMsgTxt("Too many outstanding asynchronous jobs");
+    return -1;
+}
+
+
+static void job_send(matsock_job* job, const char* s)
+{
+    size_t n = strlen(s);
+    if ((n > 0 && feapc_writeall(job->fd, s, n) < 0) ||
+        feapc_writeall(job->fd, "\n", 1) < 0)
+        job->state = S_ERROR;
+}
+
+
+/*@T
+ * The [[job_fill]] routine pulls whatever is available on the
+ * socket into the job's read buffer without blocking.  It returns
+ * zero if the connection has failed.  Payload bytes bypass the read
+ * buffer once the buffered bytes are used up, so large arrays are
+ * received directly into their final location.
+ *@c*/
+static int job_fill(matsock_job* job)
+{
+    ssize_t m;
+    if (job->state == S_DATA && job->rlen == 0) {
+        m = recv(job->fd, job->data + job->have, job->need - job->have,
+                 MSG_DONTWAIT);
+        if (m > 0)
+            job->have += m;
+    } else {
+        if (job->rlen == RBUF_SIZ)
+            return 1;
+        m = recv(job->fd, job->rbuf + job->rlen, RBUF_SIZ - job->rlen,
+                 MSG_DONTWAIT);
+        if (m > 0)
+            job->rlen += m;
+    }
+    if (m == 0)
+        return 0;
+    if (m < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        return 0;
+    return 1;
+}
+
+
+/* Take one complete line out of the read buffer; return 0 if none */
+static int job_line(matsock_job* job)
+{
+    int i;
+    for (i = 0; i < job->rlen; ++i) {
+        char c = job->rbuf[i];
+        if (c == '\n') {
+            job->line[job->llen] = 0;
+            job->llen = 0;
+            job->rlen -= i+1;
+            memmove(job->rbuf, job->rbuf+i+1, job->rlen);
+            return 1;
+        }
+        if (job->llen < LINE_SIZ-1)
+            job->line[job->llen++] = c;
+    }
+    job->rlen = 0;
+    return 0;
+}
+
+
+/*@T
+ * A sparse matrix payload is the column pointers, row indices, and
+ * values of the compressed column form, each eight bytes wide, so
+ * for an $m \times n$ matrix we need $n+1+2\,\mathrm{nnz}$ words
+ * (and nothing at all if $n$ is zero).
+ *@c*/
+static void job_start_data(matsock_job* job, int type, size_t len)
+{
+    size_t width = (type == MATSOCK_ASYNC_INT) ? sizeof(int32_t) :
+                                                 sizeof(double);
+
+    job->type = type;
+    job->len  = len;
+    job->need = width * len;
+    if (type == MATSOCK_ASYNC_SPARSE)
+        job->need = (job->n > 0) ? width * (job->n + 1 + 2*len) : 0;
+    job->have = 0;
+    job->data = malloc(job->need ? job->need : 1);
+    if (!job->data) {
+        job_send(job, "cancel");
+        job->type = MATSOCK_ASYNC_NONE;
+        job->len  = 0;
+        job->n    = 0;
+        job->state = S_END_PROMPT;
+        return;
+    }
+    if (type != MATSOCK_ASYNC_SPARSE)
+        job_send(job, "binary");
+    job->state = S_DATA;
+}
+
+
+/* Move buffered bytes into the payload */
+static void job_data(matsock_job* job)
+{
+    size_t n = job->need - job->have;
+    if (n > (size_t) job->rlen)
+        n = job->rlen;
+    memcpy(job->data + job->have, job->rbuf, n);
+    job->have += n;
+    job->rlen -= n;
+    memmove(job->rbuf, job->rbuf+n, job->rlen);
+    if (job->have == job->need)
+        job->state = S_END_PROMPT;
+}
+
+
+/*@T
+ * The [[job_step]] routine advances a job as far as it can with
+ * the data that has already been received.
+ *@c*/
+static void job_step(matsock_job* job)
+{
+    char cmd[LINE_SIZ];
+    while (1) {
+        if (job->state == S_CMD_SEND) {
+            char* nl;
+            if (!job->cmdp || !*job->cmdp) {
+                job->state = S_DONE;
+                return;
+            }
+            nl = strchr(job->cmdp, '\n');
+            if (nl)
+                *nl = 0;
+            job_send(job, job->cmdp);
+            job->cmdp = nl ? nl+1 : job->cmdp + strlen(job->cmdp);
+            if (job->state != S_ERROR)
+                job->state = S_CMD_SYNC;
+        } else if (job->state == S_DATA) {
+            if (job->have == job->need)
+                job->state = S_END_PROMPT;
+            else if (job->rlen == 0)
+                return;
+            else
+                job_data(job);
+        } else if (job->state == S_DONE || job->state == S_ERROR) {
+            return;
+        } else if (!job_line(job)) {
+            return;
+        } else if (job->state == S_CMD_SYNC) {
+            if (strstr(job->line, "MATFEAP SYNC"))
+                job->state = S_CMD_SEND;
+        } else if (job->state == S_SRV_PROMPT) {
+            if (strstr(job->line, "FEAPSRV>")) {
+                if (job->kind == MATSOCK_ASYNC_SPARSE)
+                    sprintf(cmd, "sparse csc %s", job->var);
+                else
+                    sprintf(cmd, "getm %s", job->var);
+                job_send(job, cmd);
+                if (job->state != S_ERROR)
+                    job->state = S_HEADER;
+            }
+        } else if (job->state == S_HEADER) {
+            char datatype[32];
+            long long len, m, n;
+            if (sscanf(job->line, "Send %31s %lld", datatype, &len) == 2) {
+                if (strcmp(datatype, "int") == 0)
+                    job_start_data(job, MATSOCK_ASYNC_INT, len);
+                else if (strcmp(datatype, "double") == 0)
+                    job_start_data(job, MATSOCK_ASYNC_DOUBLE, len);
+                else {
+                    job_send(job, "cancel");
+                    job->state = S_END_PROMPT;
+                }
+            } else if (sscanf(job->line, "csc %lld %lld %lld",
+                              &m, &n, &len) == 3) {
+                job->m = m;
+                job->n = n;
+                job_start_data(job, MATSOCK_ASYNC_SPARSE, len);
+            } else if (strstr(job->line, "FEAPSRV>")) {
+                job_send(job, "start");
+                if (job->state != S_ERROR)
+                    job->state = S_END_SYNC;
+            }
+        } else if (job->state == S_END_PROMPT) {
+            if (strstr(job->line, "FEAPSRV>")) {
+                job_send(job, "start");
+                if (job->state != S_ERROR)
+                    job->state = S_END_SYNC;
+            }
+        } else if (job->state == S_END_SYNC) {
+            if (strstr(job->line, "MATFEAP SYNC"))
+                job->state = S_DONE;
+        }
+    }
+}
+
+
+/*@T
+ * \subsection{Starting jobs}
+ *
+ * A command job sends each line of [[cmds]] as a FEAP macro command
+ * and waits for the synchronization message after each one, just as
+ * [[feapcmd]] does.  Array and sparse matrix jobs go through the
+ * [[feapsrv]] interface.
+ *@c*/
+int matsock_async_cmd(int fd, const char* cmds)
+{
+    int h = job_new(fd, 0, NULL);
+    matsock_job* job = jobs + h;
+    job->cmds = malloc(strlen(cmds)+1);
+    if (!job->cmds)
+        mexErrMsgTxt("Out of memory");
+    strcpy(job->cmds, cmds);
+    job->cmdp  = job->cmds;
+    job->state = S_CMD_SEND;
+    job_step(job);
+    return h;
+}
+
+
+static int matsock_async_srv(int fd, int kind, const char* var)
+{
+    int h = job_new(fd, kind, var);
+    matsock_job* job = jobs + h;
+    job->state = S_SRV_PROMPT;
+    job_send(job, "serv");
+    return h;
+}
+
+
+int matsock_async_getm(int fd, const char* var)
+{
+    return matsock_async_srv(fd, MATSOCK_ASYNC_DOUBLE, var);
+}
+
+
+int matsock_async_sparse(int fd, const char* var)
+{
+    return matsock_async_srv(fd, MATSOCK_ASYNC_SPARSE, var);
+}
+
+
+/*@T
+ * \subsection{Waiting for jobs}
+ *
+ * The [[matsock_async_wait]] routine polls all the sessions with
+ * unfinished jobs in the list, advancing each job as data arrives.
+ * It returns when every listed job is finished or when the timeout
+ * (in milliseconds) expires.  A negative timeout means wait for all
+ * the jobs; a zero timeout just makes whatever progress is possible
+ * without blocking.  The return value is the number of finished jobs.
+ *@c*/
+static double wall_ms()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return 1e3*tv.tv_sec + 1e-3*tv.tv_usec;
+}
+
+
+int matsock_async_wait(int* hs, int njobs, int timeout_ms)
+{
+    struct pollfd* fds = mxMalloc(njobs * sizeof(struct pollfd));
+    int* ids = mxMalloc(njobs * sizeof(int));
+    double deadline = wall_ms() + timeout_ms;
+    int ndone;
+
+    while (1) {
+        int i, nfds = 0, wait_ms = timeout_ms;
+        ndone = 0;
+        for (i = 0; i < njobs; ++i) {
+            matsock_job* job = job_get(hs[i]);
+            job_step(job);
+            if (job->state == S_DONE || job->state == S_ERROR) {
+                ++ndone;
+            } else {
+                fds[nfds].fd      = job->fd;
+                fds[nfds].events  = POLLIN;
+                fds[nfds].revents = 0;
+                ids[nfds++] = hs[i];
+            }
+        }
+        if (nfds == 0 || timeout_ms == 0)
+            break;
+        if (timeout_ms > 0) {
+            wait_ms = (int) (deadline - wall_ms());
+            if (wait_ms <= 0)
+                break;
+        }
+
+        i = poll(fds, nfds, wait_ms);
+        if (i < 0 && errno == EINTR)
+            continue;
+        if (i <= 0)
+            break;
+        for (i = 0; i < nfds; ++i) {
+            matsock_job* job = jobs + ids[i];
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                if (!job_fill(job))
+                    job->state = S_ERROR;
+                else
+                    job_step(job);
+            }
+        }
+    }
+
+    mxFree(ids);
+    mxFree(fds);
+    return ndone;
+}
+
+
+/*@T
+ * \subsection{Collecting results}
+ *
+ * Once a job is done, its result can be queried and copied out as
+ * an array of doubles (integer arrays are converted), or, for a sparse
+ * matrix, built by [[matsock_async_fetch_sparse]] from its dimensions
+ * and raw payload.  Fetching a result releases the job handle.
+ *@c*/
+int matsock_async_done(int h)
+{
+    matsock_job* job = job_get(h);
+    if (job->state == S_ERROR)
+        mexErrMsgTxt("Asynchronous job failed");
+    return (job->state == S_DONE);
+}
+
+
+int matsock_async_type(int h)
+{
+    return job_get(h)->type;
+}
+
+
+size_t matsock_async_len(int h)
+{
+    return job_get(h)->len;
+}
+
+
+void matsock_async_shape(int h, size_t* m, size_t* n, size_t* nnz)
+{
+    matsock_job* job = job_get(h);
+    *m   = job->m;
+    *n   = job->n;
+    *nnz = job->len;
+}
+
+
+void matsock_async_fetch(int h, double* buf, size_t len)
+{
+    matsock_job* job = job_get(h);
+    size_t i;
+    if (job->state != S_DONE)
+        mexErrMsgTxt("Asynchronous job is not finished");
+    if (len > job->len)
+        len = job->len;
+    if (job->type == MATSOCK_ASYNC_INT) {
+        int32_t* idata = (int32_t*) job->data;
+        feapc_ntoh(idata, len, sizeof(int32_t));
+        for (i = 0; i < len; ++i)
+            buf[i] = idata[i];
+    } else if (job->data) {
+        feapc_ntoh(job->data, len, sizeof(double));
+        memcpy(buf, job->data, len * sizeof(double));
+    }
+    matsock_async_free(h);
+}
+
+
+const double* matsock_async_data(int h)
+{
+    matsock_job* job = job_get(h);
+    if (job->state != S_DONE)
+        mexErrMsgTxt("Asynchronous job is not finished");
+    return (const double*) job->data;
+}
+
+
+void matsock_async_free(int h)
+{
+    matsock_job* job = job_get(h);
+    free(job->cmds);
+    free(job->data);
+    memset(job, 0, sizeof(*job));
+}
@@ -0,0 +1,23 @@
+#ifndef MATSOCK_ASYNC_H
+#define MATSOCK_ASYNC_H
+
+#include <stddef.h>
+
+#define MATSOCK_ASYNC_NONE   0
+#define MATSOCK_ASYNC_INT    1
+#define MATSOCK_ASYNC_DOUBLE 2
+#define MATSOCK_ASYNC_SPARSE 3
+
+int  matsock_async_cmd(int fd, const char* cmds);
+int  matsock_async_getm(int fd, const char* var);
+int  matsock_async_sparse(int fd, const char* var);
+int  matsock_async_wait(int* jobs, int njobs, int timeout_ms);
+int  matsock_async_done(int job);
+int  matsock_async_type(int job);
+size_t matsock_async_len(int job);
+void matsock_async_shape(int job, size_t* m, size_t* n, size_t* nnz);
+void matsock_async_fetch(int job, double* buf, size_t len);
+const double* matsock_async_data(int job);
+void matsock_async_free(int job);
+
+#endif /* MATSOCK_ASYNC_H */
@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "matsock_sparse.h"
+#include "matsock_async.h"
+#include "feapclient.h"
+#include <mex.h>
+
+/*@T
+ * \section{Direct sparse matrix receive}
+ *
+ * For {\tt sparse csc {\it var}}, the server sends a sparse matrix
+ * already in compressed column form (see [[spex_csc]] in the
+ * [[feapspex]] documentation): the column pointers, the zero-based row
+ * indices, and the values, with the columns sorted, duplicates added
+ * together, and zeros dropped.  These are exactly the [[jc]], [[ir]],
+ * and [[pr]] arrays of a MATLAB sparse matrix, so we allocate the
+ * result with [[mxCreateSparse]] and read each block straight into
+ * place.  There is no coordinate buffer and no sort on the client, and
+ * the only memory used is the matrix itself.
+ *
+ * The indices travel as 64-bit integers.  When [[mwIndex]] is also 64
+ * bits wide (the usual case), they are read directly into [[jc]] and
+ * [[ir]]; with the 32-bit compatible array dimensions, they are read a
+ * block at a time and narrowed.
+ *
+ *@c*/
+#define SPARSE_BLOCK 4096
+
+static int sparse_index(mwIndex* dst, const int64_t* src, size_t n)
+{
+    size_t k;
+    for (k = 0; k < n; ++k) {
+        dst[k] = (mwIndex) src[k];
+        if (src[k] < 0 || (int64_t) dst[k] != src[k])
+            return 0;
+    }
+    return 1;
+}
+
+
+static int sparse_recv_index(int fd, mwIndex* dst, size_t n)
+{
+    int64_t block[SPARSE_BLOCK];
+    int rc = FEAPC_OK;
+
+    if (sizeof(mwIndex) == sizeof(int64_t))
+        return feapc_read_larray(fd, (int64_t*) dst, n);
+    while (n > 0 && rc == FEAPC_OK) {
+        size_t m = (n < SPARSE_BLOCK) ? n : SPARSE_BLOCK;
+        rc = feapc_read_larray(fd, block, m);
+        if (rc == FEAPC_OK && !sparse_index(dst, block, m))
+            rc = FEAPC_EPROTO;
+        dst += m;
+        n   -= m;
+    }
+    return rc;
+}
+
+
+/*@T
+ * \subsection{Entry points}
+ *
+ * The [[matsock_recvcsc]] routine reads an $m \times n$ matrix with
+ * {\it nnz} entries from the socket, given the dimensions from the
+ * {\tt csc} header.  Nothing follows the header when $n$ is zero.
+ * The [[matsock_async_fetch_sparse]] routine does the same for the
+ * result of an asynchronous [[sparse]] job, which is already sitting
+ * in a buffer in wire format, and releases the job.
+ *
+ *@c*/
+mxArray* matsock_recvcsc(int fd, size_t m, size_t n, size_t nnz)
+{
+    mxArray* A = mxCreateSparse(m, n, nnz ? nnz : 1, mxREAL);
+    int rc = FEAPC_OK;
+
+    if (n > 0) {
+        rc = sparse_recv_index(fd, mxGetJc(A), n+1);
+        if (rc == FEAPC_OK)
+            rc = sparse_recv_index(fd, mxGetIr(A), nnz);
+        if (rc == FEAPC_OK)
+            rc = feapc_read_darray(fd, mxGetPr(A), nnz);
+    }
+    if (rc != FEAPC_OK) {
+        mxDestroyArray(A);
+        mexErrMsgTxt(feapc_strerror(rc));
+    }
+    return A;
+}
+
+
+mxArray* matsock_async_fetch_sparse(int h)
+{
+    size_t m, n, nnz;
+    const char* data;
+    mxArray* A;
+
+    if (matsock_async_type(h) != MATSOCK_ASYNC_SPARSE)
+        mexErrMsgTxt("Asynchronous job is not a sparse matrix fetch");
+    matsock_async_shape(h, &m, &n, &nnz);
+    data = (const char*) matsock_async_data(h);
+
+    A = mxCreateSparse(m, n, nnz ? nnz : 1, mxREAL);
+    if (n > 0) {
+        int64_t* jc = (int64_t*) data;
+        int64_t* ir = jc + n+1;
+        double*  pr = (double*) (ir + nnz);
+        feapc_ntoh(jc, n+1+nnz, sizeof(int64_t));
+        feapc_ntoh(pr, nnz, sizeof(double));
+        if (!sparse_index(mxGetJc(A), jc, n+1) ||
+            !sparse_index(mxGetIr(A), ir, nnz)) {
+            matsock_async_free(h);
+            mxDestroyArray(A);
+            mexErrMsgTxt("Invalid sparse matrix index from server");
+        }
+        memcpy(mxGetPr(A), pr, nnz * sizeof(double));
+    }
+    matsock_async_free(h);
+    return A;
+}
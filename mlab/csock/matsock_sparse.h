@@ -0,0 +1,9 @@
+#ifndef MATSOCK_SPARSE_H
+#define MATSOCK_SPARSE_H
+
+#include <mex.h>
+
+mxArray* matsock_recvcsc(int fd, size_t m, size_t n, size_t nnz);
+mxArray* matsock_async_fetch_sparse(int job);
+
+#endif /* MATSOCK_SPARSE_H */
@@ -0,0 +1,134 @@
+% results = feapbench(sizes, reps, params)
+%
+% Time MATFEAP transfers through the current MATLAB bindings.  Run
+% this against the stand-in server built by 'make bench' in srv, e.g.
+%
+%   feaps_pipe([pwd, '/srv/feapbp']);   % Java pipe
+%   r = feapbench;
+%
+%   feaps_unix('/tmp/feapbench');       % UNIX socket
+%   r = feapbench(4.^(5:12), 20);
+%
+% where for the second run the socket server was started from the
+% shell with 'MATFEAP_SOCKNAME=/tmp/feapbench srv/feapbs'.
+%
+% The sizes argument lists payload sizes in bytes (default 1K to 64M
+% by factors of four), and reps gives the number of timed calls of
+% each kind per size (default 20; fewer are made for big payloads).
+% The params argument is passed to feapstart.  The result is a
+% structure array with fields op, bytes, reps, mbs, p50, and p99
+% (latencies in seconds), and the same table is printed.
+
+%@T
+% \section{Benchmarking the MATLAB bindings}
+%
+% The [[feapload]] driver measures the socket and pipe transports from
+% C, but what a MATLAB user sees also depends on the bindings: the C
+% MEX file, the Java helper class, or the Java pipe.  The [[feapbench]]
+% routine runs the same operations as [[feapload]] through the
+% ordinary user-level calls ([[feapget]], [[feapgetm]], [[feapsetm]],
+% and [[feapgetsparse]]) against the stand-in server, whichever
+% bindings and connection mode are active.
+%@c
+function results = feapbench(sizes, reps, params)
+
+if nargin < 1, sizes  = []; end
+if nargin < 2, reps   = []; end
+if nargin < 3, params = []; end
+if isempty(sizes), sizes = 4.^(5:13); end
+if isempty(reps),  reps  = 20;        end
+
+%@T
+% We label the results with the bindings in use and the connection
+% mode, which is decided by [[params]] and [[matfeap_globals]] the
+% same way [[feapstart]] decides it.
+%@c
+global matfeap_globals;
+if exist('csockmex')
+  binding = 'C';
+else
+  binding = 'Java';
+end
+mode = 'tcp';
+opts = {'sockname', 'command'};
+names = {'unix', 'pipe'};
+for k = 1:2
+  if isstruct(params) & isfield(params, opts{k})
+    val = getfield(params, opts{k});
+  elseif isstruct(matfeap_globals) & isfield(matfeap_globals, opts{k})
+    val = getfield(matfeap_globals, opts{k});
+  else
+    val = [];
+  end
+  if ~isempty(val), mode = names{k}; end
+end
+
+p = feapstart('Ibench', params);
+if isempty(p), error('Could not start the benchmark server'); end
+
+%@T
+% Each call is timed separately with [[tic]] and [[toc]], so that we
+% can report percentiles as well as throughput.  The small-command
+% latency is measured once, with [[feapget]].
+%@c
+results = [];
+t = zeros(reps, 1);
+for k = 1:reps
+  tic; feapget(p, 'neq'); t(k) = toc;
+end
+results = feapbench_add(results, 'serv', 0, t, 0);
+
+for bytes = sizes
+  n = ceil(bytes/8);
+  nrep = max(3, min(reps, floor(2^28/bytes)));
+  feapcmd(p, sprintf('size %d', n));
+  x = rand(n, 1);
+  t = zeros(nrep, 1);
+
+  for k = 1:nrep
+    tic; x = feapgetm(p, 'X'); t(k) = toc;
+  end
+  results = feapbench_add(results, 'getm', bytes, t, 8*n);
+
+  for k = 1:nrep
+    tic; feapsetm(p, 'X', x); t(k) = toc;
+  end
+  results = feapbench_add(results, 'setm', bytes, t, 8*n);
+
+  for k = 1:nrep
+    tic; K = feapgetsparse(p, 'tang'); t(k) = toc;
+  end
+  [i, j] = find(K);
+  results = feapbench_add(results, 'sparse', bytes, t, 24*length(i));
+end
+
+feapquit(p);
+
+fprintf('# %s %s\n', binding, mode);
+fprintf('# op bytes reps MB/s p50_us p99_us\n');
+for k = 1:length(results)
+  r = results(k);
+  fprintf('%-7s %10d %5d %9.1f %9.1f %9.1f\n', r.op, r.bytes, r.reps, ...
+          r.mbs, 1e6*r.p50, 1e6*r.p99);
+end
+
+%@T
+% The sparse matrix bytes are counted as coordinate triples, though
+% for the tangent [[feapgetsparse]] actually moves the smaller profile
+% form; the throughput is then what the user effectively gets.
+%@c
+function results = feapbench_add(results, op, bytes, t, moved)
+
+t = sort(t);
+r = [];
+r.op    = op;
+r.bytes = bytes;
+r.reps  = length(t);
+r.mbs   = moved * length(t) / sum(t) / 1e6;
+r.p50   = t(ceil(0.50*length(t)));
+r.p99   = t(ceil(0.99*length(t)));
+if isempty(results)
+  results = r;
+else
+  results(end+1) = r;
+end
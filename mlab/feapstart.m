@@ -18,6 +18,11 @@
 %   command  - If defined, connect to the indicated FEAP via a pipe
 %   server   - Host name for FEAP server (default: '127.0.0.1') 
 %   port     - Port for FEAP server (default: 3490)
+%   console  - Where FEAP's console output goes once the deck is read
+%              ('inline', 'discard', 'ring', 'ring N', or 'file PATH')
+%   int64    - Transfer integer arrays as 64-bit values (see feapwire64)
+%   reset    - A handle from an earlier feapstart; reset that session
+%              for the new deck instead of opening a new connection
 %
 % Parameters can also be passed through a global variable called
 % matfeap_globals.  feapstart reads control parameters from matfeap_globals
@@ -89,6 +94,19 @@ end
 %   \item [[dir]]: the starting directory to change to after
 %     connecting to the FEAP server.  By default we use the
 %     client's present working directory.
+%   \item [[console]]: if defined, a console mode for [[feapconsole]]
+%     (e.g.~[[discard]] or [[ring 65536]]), applied once the input
+%     deck has been accepted.  The file name dialog itself depends on
+%     FEAP's console messages, so it always runs inline.
+%   \item [[int64]]: if true, integer arrays and profile column
+%     pointers are transferred as 64-bit integers (see [[feapwire64]]).
+%   \item [[reset]]: a handle returned by an earlier [[feapstart]].
+%     Instead of opening a new connection, we [[reset]] that session
+%     (see [[feapreset.c]]) and run the new deck in the same process.
+%     This is not taken from [[matfeap_globals]].
+%   \item [[cachesize]]: the size of the client-side array cache, which
+%     [[feapcache]] reads from [[matfeap_globals]].  It is not a FEAP
+%     parameter, so we just drop it here.
 % \end{itemize}
 %
 % At the same time we process these parameters, we remove them
@@ -103,6 +121,9 @@ port    = 3490;        % Port where FEAP is located
 dir     = pwd;         % Base directory to use for rel paths
 command = [];          % Command string to use with pipe interface
 sockname = [];         % UNIX domain socket name
+console = [];          % Console output mode
+wide64  = 0;           % Use 64-bit integer transfers?
+reuse   = [];          % Session to reset
 
 if ~isempty(params)
   if isfield(params, 'verbose')
@@ -129,6 +150,21 @@ if ~isempty(params)
     dir = params.dir;
     params = rmfield(params, 'dir');
   end
+  if isfield(params, 'console')
+    console = params.console;
+    params = rmfield(params, 'console');
+  end
+  if isfield(params, 'int64')
+    wide64 = params.int64;
+    params = rmfield(params, 'int64');
+  end
+  if isfield(params, 'reset')
+    reuse = params.reset;
+    params = rmfield(params, 'reset');
+  end
+  if isfield(params, 'cachesize')
+    params = rmfield(params, 'cachesize');
+  end
 end
 
 
@@ -166,24 +202,49 @@ end
 % we save the relevant Java helper (or C handle) and the verbosity flag 
 % together in a handle structure.  This structure is the first argument 
 % to all the high-level MATFEAP interface functions.
+%
+% When resetting an existing session, we keep its connection.  After
+% the [[reset]] command, the first thing the server sends should be the
+% prompt of the new image; anything else is an error message, and the
+% old session is still there at its [[feapsrv]] prompt.  The session's
+% subscriptions are gone, so we forget their pushed data.
 
 %@c
-try
-  if ~isempty(sockname)
-    fd = sock_new(sockname);
-  elseif ~isempty(command)
-    fd = sock_new(command);
-  else
-    fd = sock_new(server, port);
+if ~isempty(reuse)
+  fd = reuse.fd;
+  sock_send(fd, 'serv');
+  feapsrvp(reuse);
+  sock_send(fd, 'reset');
+  s = sock_recv(fd);
+  if isempty(strfind(s, 'FEAPSRV>'))
+    feapsrvp(reuse);
+    sock_send(fd, 'start');
+    feapsync(reuse);
+    error(s);
+  end
+  global matfeap_push;
+  if ~isempty(matfeap_push)
+    matfeap_push = matfeap_push([matfeap_push.fd] ~= fd);
+  end
+else
+  try
+    if ~isempty(sockname)
+      fd = sock_new(sockname);
+    elseif ~isempty(command)
+      fd = sock_spawn(command);
+    else
+      fd = sock_new(server, port);
+    end
+  catch
+    fprintf('Could not open connection -- is the FEAP server running?\n');
+    error(lasterr);
   end
-catch
-  fprintf('Could not open connection -- is the FEAP server running?\n');
-  error(lasterr);
 end
 
 p = [];
 p.fd = fd;
 p.verb = verb;
+p.int64 = wide64;
 
 %@T -----------------------------------------------------------
 % \subsection{Passing parameters}
@@ -194,7 +255,7 @@ p.verb = verb;
 % simply ignored.
 
 %@c
-feapsrvp(p);
+if isempty(reuse), feapsrvp(p); end
 if ~isempty(params)
   pnames = fieldnames(params);
   for k = 1:length(pnames)
@@ -284,6 +345,9 @@ while 1
     feapsync(p);
     sock_send(fd, 'y')
     feapsync(p);
+    if ~isempty(console)
+      feapconsole(p, console);
+    end
     return;
   elseif strfind(s, 'MATFEAP SYNC')
     sock_send(fd, '');
@@ -0,0 +1,173 @@
+% results = feapsweep(fname, grid, cmds, vars, params)
+%
+% Run a parameter sweep over the input deck fname on the FEAP server.
+% The grid argument is a structure whose fields are the deck parameters
+% to vary; each field holds a vector of values, and the sweep covers
+% every combination.  For each run, the macro commands in the cell
+% array cmds are executed and the arrays named in the cell array vars
+% are collected.  For example,
+%
+%   grid.n = [10 20 40];
+%   grid.e = [1e3 1e4];
+%   r = feapsweep('Iblock2', grid, {'tang,,1'}, {'u'});
+%
+% runs six simulations and returns a 1-by-6 structure array with
+% fields n, e, ok, and u.  The optional params argument has the same
+% connection fields as in feapstart (verbose, sockname, server, port,
+% command, dir), plus a workers field giving the number of simultaneous
+% runs on the server.
+
+%@T
+% \section{Parameter sweeps}
+%
+% The [[feapsweep]] command sends a whole parameter study to the
+% server as a single [[sweep]] job (see the [[feapsrv]] documentation)
+% and collects the results as the server streams them back.  The runs
+% are spread over a pool of FEAP processes on the server, so there
+% is no per-run connection setup or macro round trip on the client.
+%@c
+function results = feapsweep(fname, grid, cmds, vars, params)
+
+if nargin < 3, cmds = {};   end
+if nargin < 4, vars = {};   end
+if nargin < 5, params = []; end
+if ~ischar(fname),  error('Expected filename as string'); end
+if ~isstruct(grid), error('Expected grid as struct');     end
+if ischar(cmds), cmds = {cmds}; end
+if ischar(vars), vars = {vars}; end
+
+%@T -----------------------------------------------------------
+% \subsection{Connecting}
+%
+% Connection parameters are handled as in [[feapstart]]: fields
+% of [[matfeap_globals]] provide defaults for anything not given
+% in [[params]].
+%@c
+global matfeap_globals;
+
+verb     = 0;
+server   = '127.0.0.1';
+port     = 3490;
+dir      = pwd;
+command  = [];
+sockname = [];
+workers  = [];
+
+opts = {'verbose', 'server', 'port', 'dir', 'command', 'sockname', 'workers'};
+for k = 1:length(opts)
+  if isstruct(params) & isfield(params, opts{k})
+    val = getfield(params, opts{k});
+  elseif isstruct(matfeap_globals) & isfield(matfeap_globals, opts{k})
+    val = getfield(matfeap_globals, opts{k});
+  else
+    continue;
+  end
+  switch opts{k}
+    case 'verbose',  verb     = val;
+    case 'server',   server   = val;
+    case 'port',     port     = val;
+    case 'dir',      dir      = val;
+    case 'command',  command  = val;
+    case 'sockname', sockname = val;
+    case 'workers',  workers  = val;
+  end
+end
+
+try
+  if ~isempty(sockname)
+    fd = sock_new(sockname);
+  elseif ~isempty(command)
+    fd = sock_spawn(command);
+  else
+    fd = sock_new(server, port);
+  end
+catch
+  fprintf('Could not open connection -- is the FEAP server running?\n');
+  error(lasterr);
+end
+
+p = [];
+p.fd = fd;
+p.verb = verb;
+feapsrvp(p);
+if ~isempty(dir)
+  sock_send(fd, ['cd ', dir]);
+  feapsrvp(p);
+end
+
+%@T -----------------------------------------------------------
+% \subsection{Sending the job}
+%
+% The parameter grid is sent one [[param]] line per field.  The
+% server numbers the runs with the first parameter varying fastest,
+% and we use the same ordering to label the results.
+%@c
+pnames = fieldnames(grid);
+nvals  = zeros(1, length(pnames));
+
+sock_send(fd, 'sweep');
+sock_send(fd, ['deck ', fname]);
+for k = 1:length(pnames)
+  pval = getfield(grid, pnames{k});
+  nvals(k) = length(pval);
+  sock_send(fd, ['param ', pnames{k}, sprintf(' %.17g', pval)]);
+end
+for k = 1:length(cmds)
+  sock_send(fd, ['macro ', cmds{k}]);
+end
+for k = 1:length(vars)
+  sock_send(fd, ['getm ', upper(vars{k})]);
+end
+if ~isempty(workers)
+  sock_send(fd, sprintf('workers %d', workers));
+end
+sock_send(fd, 'end');
+
+%@T -----------------------------------------------------------
+% \subsection{Collecting results}
+%
+% Results arrive in order of completion, so we label each one by
+% its run number as it comes in.
+%@c
+nruns = prod(nvals);
+results = [];
+for r = 1:nruns
+  rr = r-1;
+  for k = 1:length(pnames)
+    pval = getfield(grid, pnames{k});
+    results = setfield(results, {r}, pnames{k}, pval(mod(rr, nvals(k))+1));
+    rr = floor(rr / nvals(k));
+  end
+  results(r).ok = 0;
+end
+
+run = 0;
+while 1
+  s = sock_recv(fd);
+  [tok, resp] = strtok(s);
+  if strcmp(tok, 'Run')
+    run = str2num(resp)+1;
+  elseif strcmp(tok, 'Result')
+    [var,      resp] = strtok(resp);
+    [datatype, resp] = strtok(resp);
+    len = str2num(resp);
+    val = [];
+    if strcmp(datatype, 'int')
+      val = sock_recviarray(fd, len);
+    elseif strcmp(datatype, 'double')
+      val = sock_recvdarray(fd, len);
+    end
+    results = setfield(results, {run}, lower(var), val);
+  elseif strcmp(tok, 'Done')
+    results(run).ok = 1;
+    feapdispv(p, s);
+  elseif strcmp(tok, 'Sweep') & strcmp(strtok(resp), 'done')
+    break;
+  else
+    feapdispv(p, s);
+  end
+end
+
+feapsrvp(p);
+sock_send(fd, 'quit');
+sock_close(fd);
@@ -70,6 +70,14 @@ public class FeapClientHelper {
         return iarray;
     }
 
+    public double[] getLarray(int size)
+        throws IOException {
+        double[] larray = new double[size];
+        for (int j = 0; j < size; ++j)
+            larray[j] = (double) in.readLong();
+        return larray;
+    }
+
     public void setIarray(double[] x) 
         throws IOException {
         int size = x.length;
@@ -78,6 +86,14 @@ public class FeapClientHelper {
         out.flush();
     }
 
+    public void setLarray(double[] x)
+        throws IOException {
+        int size = x.length;
+        for (int j = 0; j < size; ++j)
+            out.writeLong((long) x[j]);
+        out.flush();
+    }
+
     public void setDarray(double[] x) 
         throws IOException {
         int size = x.length;
@@ -86,5 +102,13 @@ public class FeapClientHelper {
         out.flush();
     }
 
+    public boolean urgent()
+        throws IOException {
+        if (socket == null)
+            return false;
+        socket.sendUrgentData('!');
+        return true;
+    }
+
 }
 
@@ -12,6 +12,8 @@ function feapjsock;
 % \begin{itemize}
 % \item [[sock_new(hostname,port)]] - start a socket connection
 % \item [[sock_new(command)]] - start a pipe connection
+% \item [[sock_spawn(command)]] - the same, under the name the C
+%   interface uses for pipe connections
 % \item [[sock_close(js)]] - close a socket
 % \item [[sock_recv(js)]] - read a line of data
 % \item [[sock_send(js)]] - send a line of data
@@ -21,7 +23,19 @@ function feapjsock;
 %   into an array
 % \item [[sock_senddarray(js, array)]] - send an array of 64-bit doubles
 % \item [[sock_sendiarray(js, array)]] - send an array of 32-bit integers
+% \item [[sock_recvlarray(js, len)]] - read [[len]] 64-bit integers
+%   into an array of doubles
+% \item [[sock_sendlarray(js, array)]] - send an array as 64-bit integers
+% \item [[sock_recvcsc(js, m, n, nnz)]] - read an [[m]] by [[n]] sparse
+%   matrix with [[nnz]] entries in compressed column form
+% \item [[sock_urgent(js)]] - send a byte of urgent data to interrupt
+%   the server; returns false (and does nothing) for a pipe
 % \end{itemize}
+%
+% Java arrays are indexed by 32-bit integers, so the helper cannot
+% move more than $2^{31}-1$ values in one call.  The receive and send
+% routines split longer arrays into blocks of [[sock_jblock]] values
+% and put the pieces together on the MATLAB side.
 
 %@o sock_new.m
 function p = sock_new(hostname, port)
@@ -33,6 +47,11 @@ else
 end
 %@o
 
+%@o sock_spawn.m
+function p = sock_spawn(command)
+p = sock_new(command);
+%@o
+
 %@o sock_close.m
 function sock_close(p)
 p.helper.close();
@@ -48,22 +67,86 @@ function sock_send(p, msg)
 p.helper.send(msg);
 %@o
 
+%@o sock_urgent.m
+function ok = sock_urgent(p)
+ok = p.helper.urgent();
+%@o
+
+%@o sock_jblock.m
+function n = sock_jblock
+n = 2^26;
+%@o
+
 %@o sock_recvdarray.m
 function val = sock_recvdarray(p, len)
-val = p.helper.getDarray(int32(len));
+if len <= sock_jblock
+  val = p.helper.getDarray(int32(len));
+else
+  val = zeros(len, 1);
+  for k = 1:sock_jblock:len
+    n = min(sock_jblock, len-k+1);
+    val(k:k+n-1) = p.helper.getDarray(int32(n));
+  end
+end
 %@o
 
 %@o sock_recviarray.m
 function val = sock_recviarray(p, len)
-val = p.helper.getIarray(int32(len));
+if len <= sock_jblock
+  val = p.helper.getIarray(int32(len));
+else
+  val = zeros(len, 1, 'int32');
+  for k = 1:sock_jblock:len
+    n = min(sock_jblock, len-k+1);
+    val(k:k+n-1) = p.helper.getIarray(int32(n));
+  end
+end
+%@o
+
+%@o sock_recvlarray.m
+function val = sock_recvlarray(p, len)
+if len <= sock_jblock
+  val = p.helper.getLarray(int32(len));
+else
+  val = zeros(len, 1);
+  for k = 1:sock_jblock:len
+    n = min(sock_jblock, len-k+1);
+    val(k:k+n-1) = p.helper.getLarray(int32(n));
+  end
+end
+%@o
+
+%@o sock_recvcsc.m
+function val = sock_recvcsc(p, m, n, nnz)
+if n == 0
+  val = sparse(m, n);
+  return;
+end
+jc  = sock_recvlarray(p, n+1);
+ir  = sock_recvlarray(p, nnz);
+pr  = sock_recvdarray(p, nnz);
+nzc = find(diff(jc(:)));
+J   = cumsum(full(sparse(jc(nzc)+1, 1, diff([0; nzc]), nnz, 1)));
+val = sparse(ir(:)+1, J, pr(:), m, n);
 %@o
 
 %@o sock_senddarray.m
 function sock_senddarray(p, x)
-p.helper.setDarray(x);
+for k = 1:sock_jblock:numel(x)
+  p.helper.setDarray(x(k:min(k+sock_jblock-1, numel(x))));
+end
 %@o
 
 %@o sock_sendiarray.m
 function sock_sendiarray(p, x)
-p.helper.setIarray(x);
+for k = 1:sock_jblock:numel(x)
+  p.helper.setIarray(x(k:min(k+sock_jblock-1, numel(x))));
+end
+%@o
+
+%@o sock_sendlarray.m
+function sock_sendlarray(p, x)
+for k = 1:sock_jblock:numel(x)
+  p.helper.setLarray(x(k:min(k+sock_jblock-1, numel(x))));
+end
 %@o
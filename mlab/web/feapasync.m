@@ -0,0 +1,95 @@
+function feapasync;
+
+% @T ===========================
+% \section {Driving several FEAP sessions at once}
+%
+% These routines start requests on FEAP sessions without waiting for
+% the replies, so that one MATLAB process can keep many FEAP servers
+% busy at the same time.  They are only available with the C socket
+% interface, which multiplexes the replies with [[poll]].  Each
+% routine returns a job handle; a session should have at most one
+% unfinished job at a time.
+%
+% A typical sweep over several sessions looks like
+% \begin{verbatim}
+%   for k = 1:n, h(k) = feapcmd_async(p{k}, 'tang,,1'); end
+%   feapwait(h);
+%   for k = 1:n, h(k) = feapgetm_async(p{k}, 'u'); end
+%   u = feapwait(h);
+% \end{verbatim}
+%
+% @q ===========================
+
+% @T --------------------------------------------
+% \subsection{Starting requests}
+%
+% The [[feapcmd_async]] routine is the asynchronous analogue of
+% [[feapcmd]]; the [[feapgetm_async]] and [[feapgetsparse_async]]
+% routines are the analogues of [[feapgetm]] and [[feapgetsparse]].
+
+%@o feapcmd_async.m
+% h = feapcmd_async(feap, c1, c2, c3, ...)
+%
+% Start running the FEAP macro commands c1, ... without waiting.
+
+%@c
+function h = feapcmd_async(p, varargin)
+
+h = sock_async_cmd(p.fd, varargin);
+%@o
+
+%@o feapgetm_async.m
+% h = feapgetm_async(feap, array_name)
+%
+% Start fetching a dynamically allocated FEAP array without waiting.
+
+%@c
+function h = feapgetm_async(p, var)
+
+if nargin < 2,   error('Missing required argument');      end
+if ~ischar(var), error('Variable name must be a string'); end
+h = sock_async_getm(p.fd, upper(var));
+%@o
+
+%@o feapgetsparse_async.m
+% h = feapgetsparse_async(feap, vname)
+%
+% Start fetching a FEAP sparse matrix without waiting.
+
+%@c
+function h = feapgetsparse_async(p, var)
+
+if nargin < 2,   error('Missing required argument');      end
+if ~ischar(var), error('Variable name must be a string'); end
+h = sock_async_sparse(p.fd, lower(var));
+%@o
+
+% @T --------------------------------------------
+% \subsection{Collecting results}
+%
+% The [[feapwait]] routine waits for all the listed jobs to finish
+% and returns their results in a cell array (empty for command jobs).
+% With a timeout argument (in milliseconds), it instead waits at most
+% that long and returns the number of finished jobs; the results can
+% then be fetched with [[sock_async_result]].
+
+%@o feapwait.m
+% vals = feapwait(h)
+% ndone = feapwait(h, timeout)
+%
+% Wait for asynchronous MATFEAP jobs.
+
+%@c
+function vals = feapwait(h, timeout)
+
+if nargin == 2
+  vals = sock_async_wait(h, timeout);
+  return;
+end
+
+sock_async_wait(h, -1);
+vals = cell(size(h));
+for k = 1:prod(size(h))
+  vals{k} = sock_async_result(h(k));
+end
+%@o
@@ -50,6 +50,120 @@ sock_send(p.fd, 'start');
 feapsync(p);
 %@o
 
+% @T --------------------------------------------
+% \subsection{Getting and setting all scalars}
+%
+% The [[feapgetall]] routine fetches every scalar exported by the
+% server in a single [[getall]] request, and returns them as the
+% fields of a structure.  The server lists the names and types first,
+% then sends the values through the usual array protocol.  The
+% [[feapsetall]] routine is the reverse: it asks for the current
+% list, fills in any fields given in its argument, and sends the whole
+% record back with [[setall]].
+
+%@o feapgetall.m
+% s = feapgetall(feap)
+%
+% Get all exported FEAP common block scalars as fields of a structure.
+% Ex:
+%  s = feapgetall(p);
+%  neq = s.neq;
+
+%@c
+function s = feapgetall(p)
+
+sock_send(p.fd, 'serv');
+feapsrvp(p);
+s = feaprecvall(p);
+feapsrvp(p);
+sock_send(p.fd, 'start');
+feapsync(p);
+%@o
+
+%@o feaprecvall.m
+% s = feaprecvall(feap)
+%
+% Issue a getall request from the feapsrv prompt and receive the result.
+
+%@c
+function s = feaprecvall(p)
+
+feapdispv(p, 'getall');
+sock_send(p.fd, 'getall');
+
+s = [];
+names = feaprecvnames(p);
+resp = sock_recv(p.fd);
+if strncmp(resp, 'Send', 4) & ~isempty(names)
+  sock_send(p.fd, 'binary');
+  vals = sock_recvdarray(p.fd, length(names));
+  for k = 1:length(names)
+    s = setfield(s, names{k}, vals(k));
+  end
+elseif strncmp(resp, 'Send', 4)
+  sock_send(p.fd, 'cancel');
+end
+%@o
+
+%@o feapsetall.m
+% feapsetall(feap, s)
+%
+% Set FEAP common block scalars from the fields of a structure.
+% Scalars that are not fields of s keep their current values.
+% Ex:
+%  s.dt = 0.01;
+%  feapsetall(p, s);
+
+%@c
+function feapsetall(p, s)
+
+cur = feapgetall(p);
+
+sock_send(p.fd, 'serv');
+feapsrvp(p);
+feapdispv(p, 'setall');
+sock_send(p.fd, 'setall');
+
+names = feaprecvnames(p);
+resp = sock_recv(p.fd);
+if strncmp(resp, 'Recv', 4)
+  vals = zeros(length(names), 1);
+  for k = 1:length(names)
+    if isfield(s, names{k})
+      vals(k) = getfield(s, names{k});
+    else
+      vals(k) = getfield(cur, names{k});
+    end
+  end
+  sock_send(p.fd, 'binary');
+  sock_senddarray(p.fd, vals);
+end
+
+feapsrvp(p);
+sock_send(p.fd, 'start');
+feapsync(p);
+%@o
+
+%@o feaprecvnames.m
+% names = feaprecvnames(feap)
+%
+% Read the scalar name list sent before a getall or setall transfer.
+
+%@c
+function names = feaprecvnames(p)
+
+names = {};
+resp = sock_recv(p.fd);
+[s, resp] = strtok(resp);
+if strcmp(s, 'Scalars')
+  n = str2num(resp);
+  names = cell(n, 1);
+  for k = 1:n
+    names{k} = lower(strtok(sock_recv(p.fd)));
+  end
+end
+%@o
+
 % @T --------------------------------------------
 % \subsection{Getting arrays}
 %
@@ -76,6 +190,20 @@ if ~ischar(var), error('Variable name must be a string'); end
 
 sock_send(p.fd, 'serv');
 feapsrvp(p);
+val = feaprecvm(p, var);
+feapsrvp(p);
+sock_send(p.fd, 'start')
+feapsync(p);
+%@o
+
+%@o feaprecvm.m
+% array_val = feaprecvm(feap, array_name)
+%
+% Issue a getm request from the feapsrv prompt and receive the array.
+
+%@c
+function val = feaprecvm(p, var)
+
 cmd = sprintf('getm %s', upper(var));
 feapdispv(p, cmd);
 sock_send(p.fd, cmd);
@@ -87,7 +215,11 @@ if strcmp(s, 'Send')
   [datatype, resp] = strtok(resp);  % Data type (int | double)
   [len,      resp] = strtok(resp);  % Number of entries
   len = str2num(len);
-  if strcmp(datatype, 'int')
+  if strcmp(datatype, 'int') & feapwire64(p)
+    feapdispv(p, sprintf('Receive %d ints (64-bit)...', len));
+    sock_send(p.fd, 'binary64')
+    val = sock_recvlarray(p.fd, len);
+  elseif strcmp(datatype, 'int')
     feapdispv(p, sprintf('Receive %d ints...', len));
     sock_send(p.fd, 'binary')
     val = sock_recviarray(p.fd, len);
@@ -100,6 +232,262 @@ if strcmp(s, 'Send')
     sock_send(p.fd, 'cancel')
   end
 end
+%@o
+
+% @T --------------------------------------------
+% \subsection{Cached gets}
+%
+% The server keeps a generation number and a content hash for each
+% array (see the [[stat]] command in the [[feapsrv]] documentation).
+% The [[feapgetmc]] and [[feapgetallc]] routines are versions of
+% [[feapgetm]] and [[feapgetall]] that keep recently fetched values in
+% the global [[matfeap_cache]] and only transfer the data again if
+% the generation or the hash reported by the server has changed.
+% The cache holds at most [[matfeap_globals.cachesize]] entries
+% (16 by default); when it is full, the least recently used entry is
+% dropped.  The [[feapstat]] routine returns the raw generation
+% information for a list of arrays.
+
+%@o feapstat.m
+% st = feapstat(feap, names)
+%
+% Get the generation numbers and content hashes of FEAP arrays.
+% The names argument is a string or a cell array of strings; the
+% special name 'scalars' refers to the scalars returned by feapgetall.
+% The result is a structure array with fields name, gen, and hash.
+% Arrays that do not exist have gen = 0.
+
+%@c
+function st = feapstat(p, names)
+
+if ischar(names), names = {names}; end
+sock_send(p.fd, 'serv');
+feapsrvp(p);
+st = feaprecvstat(p, names);
+feapsrvp(p);
+sock_send(p.fd, 'start');
+feapsync(p);
+%@o
+
+%@o feaprecvstat.m
+% st = feaprecvstat(feap, names)
+%
+% Issue a stat request from the feapsrv prompt and parse the reply.
+
+%@c
+function st = feaprecvstat(p, names)
+
+cmd = 'stat';
+for k = 1:length(names)
+  if strcmpi(names{k}, 'scalars')
+    cmd = [cmd, ' scalars'];
+  else
+    cmd = [cmd, ' ', upper(names{k})];
+  end
+end
+feapdispv(p, cmd);
+sock_send(p.fd, cmd);
+
+st = [];
+[s, resp] = strtok(sock_recv(p.fd));
+if strcmp(s, 'Stat')
+  n = str2num(resp);
+  for k = 1:n
+    [name, resp] = strtok(sock_recv(p.fd));
+    [gen,  resp] = strtok(resp);
+    st(k).name = lower(name);
+    st(k).gen  = str2num(gen);
+    st(k).hash = strtok(resp);
+  end
+end
+%@o
+
+%@o feapgetmc.m
+% array_val = feapgetmc(feap, array_name)
+%
+% Get a dynamically allocated FEAP array by name, using the client
+% cache when the array has not changed since it was last fetched.
+
+%@c
+function val = feapgetmc(p, var)
+
+if nargin < 2,   error('Missing required argument');      end
+if ~ischar(var), error('Variable name must be a string'); end
+
+sock_send(p.fd, 'serv');
+feapsrvp(p);
+st = feaprecvstat(p, {var});
+[val, hit] = feapcache(p, st);
+if ~hit
+  val = feaprecvm(p, var);
+  feapcache(p, st, val);
+end
+feapsrvp(p);
+sock_send(p.fd, 'start')
+feapsync(p);
+%@o
+
+%@o feapgetallc.m
+% s = feapgetallc(feap)
+%
+% Get all exported FEAP scalars, using the client cache when they
+% have not changed since they were last fetched.
+
+%@c
+function s = feapgetallc(p)
+
+sock_send(p.fd, 'serv');
+feapsrvp(p);
+st = feaprecvstat(p, {'scalars'});
+[s, hit] = feapcache(p, st);
+if ~hit
+  s = feaprecvall(p);
+  feapcache(p, st, s);
+end
+feapsrvp(p);
+sock_send(p.fd, 'start');
+feapsync(p);
+%@o
+
+%@o feapcache.m
+% [val, hit] = feapcache(feap, st)
+% feapcache(feap, st, val)
+%
+% Look up or store an entry in the MATFEAP client cache.  Entries are
+% keyed by connection and array name, and are valid only for the
+% generation and hash given in st (as returned by feapstat).
+
+%@c
+function [val, hit] = feapcache(p, st, newval)
+
+global matfeap_globals;
+global matfeap_cache;
+
+val = [];
+hit = 0;
+if isempty(st), return; end
+if st.gen == 0, return; end
+
+if isempty(matfeap_cache)
+  matfeap_cache = struct('fd', {}, 'name', {}, 'gen', {}, ...
+                         'hash', {}, 'val', {}, 'used', {});
+end
+
+tick = 1;
+k = 0;
+for j = 1:length(matfeap_cache)
+  tick = max(tick, matfeap_cache(j).used+1);
+  if matfeap_cache(j).fd == p.fd & strcmp(matfeap_cache(j).name, st.name)
+    k = j;
+  end
+end
+
+if nargin < 3
+  if k > 0 & matfeap_cache(k).gen == st.gen & ...
+     strcmp(matfeap_cache(k).hash, st.hash)
+    val = matfeap_cache(k).val;
+    hit = 1;
+    matfeap_cache(k).used = tick;
+    feapdispv(p, ['Cached ', st.name]);
+  end
+  return;
+end
+
+if k == 0
+  cachesize = 16;
+  if isstruct(matfeap_globals) & isfield(matfeap_globals, 'cachesize')
+    cachesize = matfeap_globals.cachesize;
+  end
+  if cachesize <= 0, return; end
+  if length(matfeap_cache) < cachesize
+    k = length(matfeap_cache)+1;
+  else
+    [junk, k] = min([matfeap_cache.used]);
+  end
+end
+matfeap_cache(k).fd   = p.fd;
+matfeap_cache(k).name = st.name;
+matfeap_cache(k).gen  = st.gen;
+matfeap_cache(k).hash = st.hash;
+matfeap_cache(k).val  = newval;
+matfeap_cache(k).used = tick;
+%@o
+
+% @T --------------------------------------------
+% \subsection{Reductions}
+%
+% The [[feapreduce]] routine asks the server for a norm, sum, extreme
+% value, or dot product of an array (see the [[reduce]] command in the
+% [[feapsrv]] documentation), so that checking convergence does not
+% mean fetching the whole array.  The extra arguments may be given in
+% any order: [['reduced']] or [['neq']] restricts the reduction to the
+% active degrees of freedom of a nodal array or to the first [[neq]]
+% entries of an array in equation order, and for [['dot']] the other
+% vector is either the name of a FEAP array or a MATLAB vector.
+
+%@o feapreduce.m
+% [val, idx] = feapreduce(feap, op, array_name, ...)
+%
+% Reduce a dynamically allocated FEAP array on the server.  The op
+% argument is 'norm2', 'norminf', 'sum', 'min', 'max', or 'dot'.
+% The optional arguments are 'reduced' or 'neq' to reduce over a
+% subset, and for 'dot' the other array name or vector.  For 'min' and
+% 'max', idx is the (one-based) index of the entry, or the equation
+% number in the reduced case.  The result is empty if the array is
+% not found.
+
+%@c
+function [val, idx] = feapreduce(p, op, var, varargin)
+
+cmd  = sprintf('reduce %s %s', op, upper(var));
+y    = [];
+for k = 1:length(varargin)
+  arg = varargin{k};
+  if ischar(arg) & (strcmpi(arg, 'reduced') | strcmpi(arg, 'neq'))
+    cmd = [cmd, ' ', lower(arg)];
+  elseif ischar(arg)
+    cmd = [cmd, ' ', upper(arg)];
+  else
+    cmd = [cmd, ' -'];
+    y   = arg;
+  end
+end
+
+sock_send(p.fd, 'serv');
+feapsrvp(p);
+feapdispv(p, cmd);
+sock_send(p.fd, cmd);
+
+%@T
+% A vector from MATLAB is sent with the [[setm]] protocol before the
+% reply comes back.
+%@c
+line = sock_recv(p.fd);
+[s, resp] = strtok(line);
+if strcmp(s, 'Recv')
+  [datatype, resp] = strtok(resp);
+  len = str2num(strtok(resp));
+  if len ~= prod(size(y))
+    feapdispv(p, sprintf('Expected size %d; bailing', len));
+    sock_send(p.fd, 'cancel');
+  else
+    feapdispv(p, sprintf('Sending %d doubles...', len));
+    sock_send(p.fd, 'binary')
+    sock_senddarray(p.fd, y);
+  end
+  line = sock_recv(p.fd);
+  [s, resp] = strtok(line);
+end
+
+val = [];
+idx = [];
+if strcmp(s, 'Reduce')
+  r   = sscanf(resp, '%g');
+  val = r(1);
+  if length(r) > 1, idx = r(2); end
+else
+  feapdispv(p, line);
+end
 
 feapsrvp(p);
 sock_send(p.fd, 'start')
@@ -141,6 +529,10 @@ if strcmp(s, 'Recv')
   if len ~= prod(size(val))
     feapdispv(p, sprintf('Expected size %d; bailing', len));
     sock_send(p.fd, 'cancel');
+  elseif strcmp(datatype, 'int') & feapwire64(p)
+    feapdispv(p, sprintf('Sending %d ints (64-bit)...', len));
+    sock_send(p.fd, 'binary64')
+    sock_sendlarray(p.fd, val);
   elseif strcmp(datatype, 'int')
     feapdispv(p, sprintf('Sending %d ints...', len));
     sock_send(p.fd, 'binary')
@@ -160,15 +552,113 @@ sock_send(p.fd, 'start')
 feapsync(p);
 %@o
 
+% @T --------------------------------------------
+% \subsection{Accumulating into arrays}
+%
+% The [[feapaddm]] routine is the client side of the [[addm]]
+% command: FEAP adds [[alpha]] times the vector [[du]] into the
+% named array in place, so only the increment crosses the wire.
+% With no index argument, [[du]] must have as many entries as the
+% array.  With the string [['reduced']], [[du]] has [[neq]] entries
+% and is scattered into the active degrees of freedom through the
+% [[ID]] array, which is what a Newton update of [[U]] wants.  With a
+% vector of (one-based) indices, [[du]] gives the increments for just
+% those entries; the indices go first and then the values.
+
+%@o feapaddm.m
+% feapaddm(feap, array_name, alpha, du, id)
+%
+% Add alpha*du to a dynamically allocated FEAP array in place.
+% If id is omitted, du must have as many entries as the array;
+% if id is 'reduced', du is an increment to the active degrees of
+% freedom; otherwise id lists the array entries to update.
+
+%@c
+function feapaddm(p, var, alpha, du, id)
+
+if nargin < 4, error('Wrong number of arguments'); end
+
+cmd = sprintf('addm %s %.17g', upper(var), alpha);
+if nargin < 5
+  sends = {du};
+elseif ischar(id) & strcmpi(id, 'reduced')
+  cmd   = [cmd, ' reduced'];
+  sends = {du};
+else
+  if length(id) ~= length(du(:))
+    error('Index and increment lengths differ');
+  end
+  cmd   = sprintf('%s index %d', cmd, length(id));
+  sends = {id, du};
+end
+
+sock_send(p.fd, 'serv');
+feapsrvp(p);
+feapdispv(p, cmd);
+sock_send(p.fd, cmd);
+
+%@T
+% Each transfer follows the [[setm]] protocol; if the server asks for
+% a different amount than we have, or says it cannot find the array,
+% we stop sending and the array is left as it was.
+%@c
+for k = 1:length(sends)
+  val = sends{k};
+  line = sock_recv(p.fd);
+  [s, resp] = strtok(line);
+  if ~strcmp(s, 'Recv')
+    feapdispv(p, line);
+    break;
+  end
+  [datatype, resp] = strtok(resp);
+  [len, resp] = strtok(resp);
+  len = str2num(len);
+  if len ~= prod(size(val))
+    feapdispv(p, sprintf('Expected size %d; bailing', len));
+    sock_send(p.fd, 'cancel');
+    break;
+  elseif strcmp(datatype, 'int') & feapwire64(p)
+    feapdispv(p, sprintf('Sending %d ints (64-bit)...', len));
+    sock_send(p.fd, 'binary64')
+    sock_sendlarray(p.fd, val);
+  elseif strcmp(datatype, 'int')
+    feapdispv(p, sprintf('Sending %d ints...', len));
+    sock_send(p.fd, 'binary')
+    sock_sendiarray(p.fd, val);
+  else
+    feapdispv(p, sprintf('Sending %d doubles...', len));
+    sock_send(p.fd, 'binary')
+    sock_senddarray(p.fd, val);
+  end
+end
+
+feapsrvp(p);
+sock_send(p.fd, 'start')
+feapsync(p);
+%@o
+
 % @T --------------------------------------------
 % \subsection{Getting sparse matrices}
 %
 % This routine implements the client side of the sparse matrix fetch
 % protocol described in the [[feapsrv]] documentation.  We start
 % the [[feapsrv]] command interface, request the array, read the
-% number of nonzero entries, and either fetch a block of binary
-% data and convert it to a sparse matrix, or bail if we saw
-% something unexpected.
+% dimensions and number of nonzero entries, and either fetch the
+% matrix in compressed column form, or bail if we saw something
+% unexpected.
+%
+% For the tangent matrices ([[tang]] and [[utan]]), we first ask for
+% the matrix in profile form.  If FEAP is using the profile solver,
+% the server sends its column pointers and profiles as raw blocks,
+% which is about a third of the data of the coordinate form, and we
+% expand them with [[feapprof2sparse]].  Otherwise the server says so
+% and we fall back to the compressed column transfer.  The server
+% sorts the entries and adds duplicates together, so with the C socket
+% interface [[sock_recvcsc]] reads the data straight into the arrays of
+% the result, with no coordinate copy and no sort on the client.
+% On the fallback, the prompt that follows the empty profile reply is
+% read before the second request goes out; on either path, the prompt
+% after the matrix is read once at the end.
 
 %@o feapgetsparse.m
 % val = feapgetsparse(feap, vname)
@@ -185,20 +675,206 @@ if length(var) < 1, error('Variable name must be at least one char'); end
 
 sock_send(p.fd, 'serv');
 feapsrvp(p);
-cmd = sprintf('sparse binary %s', lower(var));
+
+val  = [];
+prof = [];
+if strcmpi(var, 'tang') | strcmpi(var, 'utan')
+  prof = feaprecvprofile(p, var);
+  if isempty(prof)
+    feapsrvp(p);
+  else
+    val = feapprof2sparse(prof);
+  end
+end
+
+if isempty(prof)
+  cmd = sprintf('sparse csc %s', lower(var));
+  feapdispv(p, cmd);
+  sock_send(p.fd, cmd);
+
+  resp = sock_recv(p.fd);
+  [s, resp] = strtok(resp);
+  if strcmp(s, 'csc')
+    dims = sscanf(resp, '%d');
+    feapdispv(p, sprintf('Receive %d matrix entries...', dims(3)));
+    val = sock_recvcsc(p.fd, dims(1), dims(2), dims(3));
+  end
+end
+
+feapsrvp(p);
+sock_send(p.fd, 'start')
+feapsync(p);
+%@o
+
+% @T --------------------------------------------
+% \subsection{Getting profile matrices}
+%
+% The [[feapgetprofile]] routine fetches a profile-stored tangent in
+% FEAP's own format, for clients that want to factor or solve with it
+% directly in skyline or banded form.  The result has fields [[jp]]
+% (column pointers), [[ad]] (diagonal), [[au]] (upper profile), and
+% [[al]] (lower profile).  For the upper profile, column [[j]] holds
+% rows [[j-h(j)]] through [[j-1]] in entries [[jp(j-1)+1:jp(j)]],
+% where [[h(j) = jp(j)-jp(j-1)]]; the lower profile holds the
+% transposed entries.  If FEAP is not using the profile solver, the
+% result is empty.
+%
+% The [[feapprof2sparse]] routine converts the profile form to a
+% MATLAB sparse matrix without any loops over columns: a cumulative
+% sum over the column starts gives the column index of each profile
+% entry, and the row index follows from its offset in the column.
+
+%@o feapgetprofile.m
+% prof = feapgetprofile(feap, vname)
+%
+% Get the FEAP tangent ('tang' or 'utan') in profile form.
+
+%@c
+function prof = feapgetprofile(p, var)
+
+if nargin < 2,   error('Wrong number of arguments'); end
+if ~ischar(var), error('Variable name must be a string'); end
+
+sock_send(p.fd, 'serv');
+feapsrvp(p);
+prof = feaprecvprofile(p, var);
+feapsrvp(p);
+sock_send(p.fd, 'start')
+feapsync(p);
+%@o
+
+%@o feaprecvprofile.m
+% prof = feaprecvprofile(feap, vname)
+%
+% Issue a profile request from the feapsrv prompt and receive the data.
+
+%@c
+function prof = feaprecvprofile(p, var)
+
+if feapwire64(p)
+  cmd = sprintf('sparse profile64 %s', lower(var));
+else
+  cmd = sprintf('sparse profile %s', lower(var));
+end
 feapdispv(p, cmd);
 sock_send(p.fd, cmd);
 
-resp = sock_recv(p.fd);
-[s, resp] = strtok(resp);
-val = [];
-if strcmp(s, 'nnz')
-  [len, resp] = strtok(resp);
-  len = str2num(len);
-  feapdispv(p, sprintf('Receive %d matrix entries...', len));
-  val = sock_recvdarray(p.fd, 3*len);
-  val = reshape(val, 3, len);
-  val = sparse(val(1,:), val(2,:), val(3,:));
+prof = [];
+[s, resp] = strtok(sock_recv(p.fd));
+if strcmp(s, 'profile')
+  dims = sscanf(resp, '%d');
+  neq  = dims(1);
+  nup  = dims(2);
+  if neq > 0
+    feapdispv(p, sprintf('Receive profile with %d entries...', nup));
+    if feapwire64(p)
+      prof.jp = sock_recvlarray(p.fd, neq);
+    else
+      prof.jp = sock_recviarray(p.fd, neq);
+    end
+    ad      = sock_recvdarray(p.fd, neq+nup);
+    prof.ad = ad(1:neq);
+    prof.au = ad(neq+1:end);
+    if dims(3)
+      prof.al = prof.au;
+    else
+      prof.al = sock_recvdarray(p.fd, nup);
+    end
+  end
+end
+%@o
+
+%@o feapprof2sparse.m
+% K = feapprof2sparse(prof)
+%
+% Convert a FEAP profile matrix (from feapgetprofile) to sparse form.
+
+%@c
+function K = feapprof2sparse(prof)
+
+jp  = prof.jp(:);
+neq = length(jp);
+nup = jp(neq);
+h   = diff([0; jp]);
+js  = [0; jp(1:neq-1)] + 1;   % First profile entry in each column
+
+nzc = find(h > 0);
+J   = cumsum(full(sparse(js(nzc), 1, diff([0; nzc]), nup, 1)));
+I   = J - h(J) + (1:nup)' - js(J);
+
+d = (1:neq)';
+K = sparse([d; I; J], [d; J; I], ...
+           [prof.ad(:); prof.au(:); prof.al(:)], neq, neq);
+%@o
+
+% @T --------------------------------------------
+% \subsection{Getting element matrices}
+%
+% The [[feapelmat]] routine runs FEAP's element routines through the
+% [[elmat]] command and collects the element tangents, residuals, and
+% local equation numbers, for matrix-free products or for building
+% preconditioners element by element.  The server streams the elements
+% in batches; each batch is a block of equation numbers followed by a
+% block of tangents and a block of residuals, which we reshape straight
+% into slices of the result.  Equation numbers that are zero or
+% negative belong to degrees of freedom with essential boundary
+% conditions.  If FEAP rejects the request, the result is empty.
+
+%@o feapelmat.m
+% e = feapelmat(feap, what, first, last)
+%
+% Get element matrices from FEAP.  The what argument is 'tang',
+% 'resid', or 'both' (the default); first and last select a range of
+% elements (by default, all of them).  The result has fields ld
+% (nst-by-nel equation numbers), K (nst-by-nst-by-nel tangents), and
+% R (nst-by-nel residuals).
+
+%@c
+function e = feapelmat(p, what, first, last)
+
+if nargin < 2, what = 'both'; end
+if ~ischar(what), error('Element matrix type must be a string'); end
+
+cmd = sprintf('elmat %s', lower(what));
+if nargin > 2, cmd = sprintf('%s %d', cmd, first); end
+if nargin > 3, cmd = sprintf('%s %d', cmd, last);  end
+
+sock_send(p.fd, 'serv');
+feapsrvp(p);
+feapdispv(p, cmd);
+sock_send(p.fd, cmd);
+
+e = [];
+[s, resp] = strtok(sock_recv(p.fd));
+if strcmp(s, 'Elements')
+  dims  = sscanf(resp, '%d');
+  nel   = dims(1);
+  nst   = dims(2);
+  tang  = ~strcmpi(what, 'resid');
+  resid = ~strcmpi(what, 'tang');
+  feapdispv(p, sprintf('Receive %d element matrices...', nel));
+
+  e.ld = zeros(nst, nel);
+  if tang,  e.K = zeros(nst, nst, nel); end
+  if resid, e.R = zeros(nst, nel);      end
+  sock_send(p.fd, 'binary');
+
+  k = 0;
+  [s, resp] = strtok(sock_recv(p.fd));
+  b = sscanf(resp, '%d');
+  while strcmp(s, 'Batch') & b > 0
+    idx = k+1:k+b;
+    e.ld(:,idx) = reshape(sock_recviarray(p.fd, nst*b), nst, b);
+    if tang
+      e.K(:,:,idx) = reshape(sock_recvdarray(p.fd, nst*nst*b), nst, nst, b);
+    end
+    if resid
+      e.R(:,idx) = reshape(sock_recvdarray(p.fd, nst*b), nst, b);
+    end
+    k = k+b;
+    [s, resp] = strtok(sock_recv(p.fd));
+    b = sscanf(resp, '%d');
+  end
 end
 
 feapsrvp(p);
@@ -376,6 +1052,36 @@ u1(id) = u;
 feapsetm(p, 'u', u1);
 %@o
 
+% @T --------------------------------------------
+% \subsection{Updating the displacement}
+%
+% A Newton step $u \leftarrow u + \alpha \, du$ through [[feapsetu]]
+% fetches all of [[U]], updates it in MATLAB, and sends it back.  The
+% [[feapaddu]] command sends only the reduced increment and lets the
+% server do the update with [[addm]].  The reduced increment is in
+% the same order as the vectors that [[feapgetu]] and [[feapsetu]]
+% exchange, so [[du]] can be computed from them directly.  As with
+% [[feapsetu]], an explicit index vector selects entries of the full
+% [[U]] array instead of the active degrees of freedom.
+
+%@o feapaddu.m
+% feapaddu(feap, du, alpha, id)
+%
+% Add alpha*du to the displacement vector in FEAP.  The alpha argument
+% defaults to one.  If id is omitted, du is an increment to the active
+% degrees of freedom.
+
+%@c
+function feapaddu(p, du, alpha, id)
+
+if nargin < 3, alpha = 1; end
+if nargin < 4
+  feapaddm(p, 'u', alpha, du, 'reduced');
+else
+  feapaddm(p, 'u', alpha, du, id);
+end
+%@o
+
 % @T --------------------------------------------
 % \subsection{Getting the nodal positions}
 %
@@ -396,14 +1102,15 @@ feapsetm(p, 'u', u1);
 function [xx, uu] = feapgetx(p,u)
 
 % Get mesh parameters
-nnp  = feapget(p,'numnp'); % Number of nodal points
-nneq = feapget(p,'nneq');  % Number of unreduced dof
-neq  = feapget(p,'neq');   % Number of dof
-ndm  = feapget(p,'ndm');   % Number of spatial dimensions
-ndf  = feapget(p,'ndf');   % Maximum dof per node
+sc   = feapgetallc(p);
+nnp  = sc.numnp;  % Number of nodal points
+nneq = sc.nneq;   % Number of unreduced dof
+neq  = sc.neq;    % Number of dof
+ndm  = sc.ndm;    % Number of spatial dimensions
+ndf  = sc.ndf;    % Maximum dof per node
 
 % Get node coordinates from FEAP
-xx = feapgetm(p,'x');
+xx = feapgetmc(p,'x');
 xx = reshape(xx, ndm, length(xx)/ndm);
 
 if nargout > 1
@@ -412,7 +1119,7 @@ if nargout > 1
   if nargin < 1, u = feapgetu(p); end
 
   % Find out how to map reduced to full dof set
-  id   = feapgetm(p,'id');
+  id   = feapgetmc(p,'id');
   id   = reshape(id(1:nneq), ndf, nnp);
   idnz = find(id > 0);
 
@@ -437,9 +1144,22 @@ end
 % step since the previous request for a residual form.  But when we
 % modify the displacements and boundary conditions behind FEAP's back,
 % we typically invalidate the current residual, whatever it may be.
-% So before requesting that FEAP form a new residual, we use the 
-% [[feapsrv]] interface to clear the flag that says that the residual has
-% already been formed.
+% So the residual must be formed after clearing the flag that says
+% that the residual has already been formed.
+%
+% All of this is handled on the server by the [[resid]] command in
+% the [[feapsrv]] interface: it optionally receives the reduced
+% displacement vector, clears the flag, forms the residual, and sends
+% back exactly [[neq]] entries of [[DR]].  That makes a residual
+% evaluation a single trip through the [[feapsrv]] interface.  The
+% server wants one entry of [[u]] for each active degree of freedom,
+% in the same order as [[feapsetu]] uses by default.  If [[u]] is the
+% wrong size, we cancel both transfers, finish the conversation so
+% that the server is left at its prompt, and raise an error rather
+% than hand back the residual at the old displacement.  If the caller
+% provides an explicit index vector [[id]], we still go through
+% [[feapsetu]] first, since the server only knows how to scatter
+% into the active degrees of freedom.
 
 %@o feapresid.m
 % R = feapresid(feap, u, id)
@@ -455,21 +1175,57 @@ end
 %@c
 function R = feapresid(p, u, id)
 
-if nargin == 2
-  feapsetu(p,u);
-elseif nargin == 3
+if nargin == 3
   feapsetu(p,u, id);
 end
 
 sock_send(p.fd,'serv');
 feapsrvp(p);
-feapdispv(p, 'clear_isformed');
-sock_send(p.fd, 'clear_isformed');
+if nargin == 2
+  cmd = 'resid u';
+else
+  cmd = 'resid';
+end
+feapdispv(p, cmd);
+sock_send(p.fd, cmd);
+
+badlen = [];
+resp = sock_recv(p.fd);
+[s, resp] = strtok(resp);
+if strcmp(s, 'Recv')
+  [datatype, resp] = strtok(resp);
+  [len, resp] = strtok(resp);
+  len = str2num(len);
+  if len ~= prod(size(u))
+    feapdispv(p, sprintf('Expected size %d; not setting u', len));
+    sock_send(p.fd, 'cancel');
+    badlen = len;
+  else
+    feapdispv(p, sprintf('Sending %d doubles...', len));
+    sock_send(p.fd, 'binary');
+    sock_senddarray(p.fd, u);
+  end
+  resp = sock_recv(p.fd);
+  [s, resp] = strtok(resp);
+end
+
+R = [];
+if strcmp(s, 'Send') & ~isempty(badlen)
+  sock_send(p.fd, 'cancel');
+elseif strcmp(s, 'Send')
+  [datatype, resp] = strtok(resp);
+  [len,      resp] = strtok(resp);
+  len = str2num(len);
+  feapdispv(p, sprintf('Receive %d doubles...', len));
+  sock_send(p.fd, 'binary');
+  R = sock_recvdarray(p.fd, len);
+end
+
 feapsrvp(p);
 sock_send(p.fd, 'start');
 feapsync(p);
 
-feapcmd(p,'form');
-R = feapgetm(p,'dr');
-R = R(1:feapget(p,'neq'));
+if ~isempty(badlen)
+  error(sprintf('Expected %d entries in u; got %d', badlen, prod(size(u))));
+end
 %@o
@@ -9,10 +9,11 @@
 % @T -------------------------------------------------------------------
 % \subsection{Setting up pipe communication}
 %
-% The [[feaps_pipe]] function tells MATFEAP to manage communication
-% over a bidirectional pipe managed by Java.  This method is not
-% available in the C interface -- there the prefered connection method is
-% a UNIX-domain socket.
+% The [[feaps_pipe]] function tells MATFEAP to start a private FEAP
+% process and talk to it over its standard input and output.  With the
+% Java interface the process is managed by Java; the C interface starts
+% it directly (see [[sock_spawn]]), so pipe mode works with Octave as
+% well.  A UNIX-domain socket remains the default for the C interface.
 %
 % The default location for the FEAP executable used by in pipe mode is
 % {\tt {\it MATFEAP}/srv/feapp}.  The location of the [[feaps_pipe.m]]
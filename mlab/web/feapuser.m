@@ -33,6 +33,65 @@ for k = 1:length(varargin)
 end
 %@o
 
+% @T --------------------------------------------
+% \subsection{Queueing macro commands}
+%
+% The [[feapcmd]] routine pays a full round trip for each command.
+% The [[feapqueue]] routine instead queues the whole list on the server
+% with labels $1, \ldots, n$ (see [[feapqueue.c]]) and then waits for
+% the synchronization message with the last label, so a long list runs
+% at FEAP's speed even over a slow connection.  Since the queue is set
+% up through the [[serv]] macro, FEAP must be at the macro prompt
+% rather than, say, a plot prompt.  The labels also tell us which
+% command printed what: the optional output has one entry per command,
+% which is 1 if FEAP printed an error message while running it, $-1$
+% if it was skipped because an earlier command was interrupted, and 0
+% otherwise.
+
+%@o feapqueue.m
+% err = feapqueue(feap, c1, c2, c3, ...)
+%
+% Run the FEAP macro commands c1, ... without waiting for each one.
+% The optional output flags commands that reported errors (1) or were
+% skipped (-1).
+
+%@c
+function varargout = feapqueue(p, varargin)
+
+n   = length(varargin);
+err = zeros(1, n);
+if n > 0
+  sock_send(p.fd, 'serv');
+  feapsrvp(p);
+  for k = 1:n
+    sock_send(p.fd, sprintf('queue %d %s', k, varargin{k}));
+  end
+  sock_send(p.fd, 'start');
+  feapsync(p);
+end
+
+k = 1;
+while k <= n
+  s = sock_recv(p.fd);
+  if strfind(s, 'MATFEAP SYNC')
+    label = sscanf(s, 'MATFEAP SYNC %d');
+    if label == k
+      k = k+1;
+    elseif label == 0 & any(err < 0)
+      break;
+    end
+  elseif strfind(s, 'MATFEAP SKIP')
+    err(sscanf(s, 'MATFEAP SKIP %d')) = -1;
+  elseif strfind(s, 'MATFEAP PUSH')
+    feappushrecv(p, s);
+  else
+    feapdispv(p, s);
+    if strfind(s, '*ERROR*'), err(k) = 1; end
+  end
+end
+if nargout > 0, varargout{1} = err; end
+%@o
+
 % @T --------------------------------------------
 % \subsection{Exiting FEAP}
 %
@@ -69,6 +128,476 @@ function feapkill(p)
 sock_close(p.fd);
 %@o
 
+% @T --------------------------------------------
+% \subsection{Starting over with a new deck}
+%
+% The [[feapreset]] routine runs a new input deck in an existing
+% session, without the cost of a new connection and a new FEAP process
+% (see [[feapreset.c]]).  It takes the same arguments as [[feapstart]],
+% with the session in front, and returns the handle for the new run,
+% or an empty handle if FEAP rejects the deck:
+% \begin{verbatim}
+%   p = feapstart('Iblock1');
+%   ...
+%   p = feapreset(p, 'Iblock2', struct('n', 20));
+% \end{verbatim}
+% Connection parameters ([[server]], [[command]], and so on) are
+% ignored, since the connection stays the same.
+
+%@o feapreset.m
+% feap = feapreset(feap, fname, params)
+%
+% Discard the current model and start FEAP on a new input deck in the
+% same process.  The arguments are as for feapstart.
+
+%@c
+function p = feapreset(p, fname, params)
+
+if nargin < 3, params = []; end
+params.reset = p;
+p = feapstart(fname, params);
+%@o
+
+
+% @T --------------------------------------------
+% \subsection{Interrupting commands}
+%
+% A slow macro can be stopped without killing FEAP, provided the
+% server was told beforehand to keep a spare copy of itself at each
+% prompt (see [[feapintr.c]]).  The [[feapguard]] routine turns this
+% on or off, and also records the process group that
+% [[feapinterrupt]] signals when the connection has no urgent data
+% (UNIX domain sockets and pipes); it returns the updated handle.
+% After an interrupt, FEAP is back at the prompt in the state it had
+% before the command, and the client sees the usual synchronization
+% message, so the command's job (or a [[feapsync]], if the wait was
+% broken off with Ctrl-C) finishes normally:
+% \begin{verbatim}
+%   p = feapguard(p);
+%   h = feapcmd_async(p, 'tang,,1');
+%   ...
+%   feapinterrupt(p);
+%   feapwait(h);
+%   p = feapguard(p, 0);
+% \end{verbatim}
+
+%@o feapguard.m
+% feap = feapguard(feap, on)
+%
+% Allow (on = 1, the default) or disallow interrupting FEAP commands.
+
+%@c
+function p = feapguard(p, on)
+
+if nargin < 2, on = 1; end
+if on
+  cmd = 'guard on';
+else
+  cmd = 'guard off';
+end
+
+sock_send(p.fd, 'serv');
+feapsrvp(p);
+feapdispv(p, cmd);
+sock_send(p.fd, cmd);
+feapsrvp(p);
+sock_send(p.fd, 'pid');
+msg = sock_recv(p.fd);
+feapdispv(p, msg);
+p.pid = sscanf(msg, 'PID %d');
+feapsrvp(p);
+sock_send(p.fd, 'start');
+feapsync(p);
+%@o
+
+%@o feapinterrupt.m
+% feapinterrupt(feap)
+%
+% Interrupt the FEAP command that is running.
+
+%@c
+function feapinterrupt(p)
+
+if sock_urgent(p.fd), return; end
+if ~isfield(p, 'pid') | isempty(p.pid)
+  error('Process group unknown; use feapguard first');
+end
+system(sprintf('kill -INT -- -%d', p.pid));
+%@o
+
+% @T --------------------------------------------
+% \subsection{Checkpoint and restore}
+%
+% The [[feapcheckpoint]] routine saves the state of the FEAP process
+% to a binary file on the server machine, and [[feaprestore]] loads it
+% back.  The session that restores need not have read the same input
+% deck; arrays that are missing or have changed size are allocated
+% again from the checkpoint, e.g.
+% \begin{verbatim}
+%   p = feapstart('Iblock');
+%   feapcmd(p, 'tang,,1');
+%   feapcheckpoint(p, 'block.ckpt');
+%   ...
+%   q = feapstart('Iblock1');
+%   feaprestore(q, 'block.ckpt');
+% \end{verbatim}
+% Both routines return the server's one-line report, and raise an
+% error if the server could not do the job.
+
+%@o feapcheckpoint.m
+% msg = feapcheckpoint(feap, path)
+%
+% Save the FEAP state to a file on the server.
+
+%@c
+function msg = feapcheckpoint(p, path)
+
+msg = feapckptcmd(p, 'checkpoint', path);
+%@o
+
+%@o feaprestore.m
+% msg = feaprestore(feap, path)
+%
+% Restore the FEAP state from a file on the server.
+
+%@c
+function msg = feaprestore(p, path)
+
+msg = feapckptcmd(p, 'restore', path);
+%@o
+
+%@o feapckptcmd.m
+% msg = feapckptcmd(feap, cmd, path)
+%
+% Run a checkpoint or restore command on the server.
+
+%@c
+function msg = feapckptcmd(p, cmd, path)
+
+if nargin < 3,    error('Missing required argument'); end
+if ~ischar(path), error('Path must be a string');     end
+
+sock_send(p.fd, 'serv');
+feapsrvp(p);
+feapdispv(p, [cmd, ' ', path]);
+sock_send(p.fd, [cmd, ' ', path]);
+msg = sock_recv(p.fd);
+feapdispv(p, msg);
+feapsrvp(p);
+sock_send(p.fd, 'start');
+feapsync(p);
+
+if ~strncmpi(msg, cmd, length(cmd))
+  error(msg);
+end
+%@o
+
+
+% @T --------------------------------------------
+% \subsection{Routing console output}
+%
+% By default, everything FEAP prints to the console comes back over
+% the MATFEAP connection, and [[feapsync]] reads and (unless we are in
+% verbose mode) discards it.  The [[feapconsole]] routine asks the
+% server to send that output elsewhere, so that only protocol messages
+% cross the connection:
+% \begin{verbatim}
+%   feapconsole(p, 'discard');          % Throw it away
+%   feapconsole(p, 'ring', 65536);      % Keep the last 64K on the server
+%   feapconsole(p, 'file', 'feap.log'); % Append it to a server file
+%   feapconsole(p, 'inline');           % Back to the default
+%   txt = feapconsole(p, 'dump');       % Fetch and clear the ring
+% \end{verbatim}
+% For [[dump]], the result is a cell array with one entry per line;
+% otherwise it is the mode the server reports.
+
+%@o feapconsole.m
+% result = feapconsole(feap, mode, arg)
+%
+% Route FEAP console output (inline, discard, ring, file, or dump).
+
+%@c
+function result = feapconsole(p, mode, arg)
+
+if nargin < 2,    error('Missing required argument'); end
+if ~ischar(mode), error('Mode must be a string');     end
+
+cmd = ['console ', mode];
+if nargin > 2
+  if isnumeric(arg), arg = sprintf('%d', arg); end
+  cmd = [cmd, ' ', arg];
+end
+
+sock_send(p.fd, 'serv');
+feapsrvp(p);
+feapdispv(p, cmd);
+sock_send(p.fd, cmd);
+msg = sock_recv(p.fd);
+feapdispv(p, msg);
+if ~strncmp(msg, 'Console', 7)
+  feapsrvp(p);
+  sock_send(p.fd, 'start');
+  feapsync(p);
+  error(msg);
+end
+
+if strcmp(mode, 'dump')
+  nlines = sscanf(msg, 'Console %d');
+  result = cell(nlines, 1);
+  for k = 1:nlines
+    result{k} = sock_recv(p.fd);
+  end
+else
+  result = deblank(msg(9:end));
+end
+
+feapsrvp(p);
+sock_send(p.fd, 'start');
+feapsync(p);
+%@o
+
+
+% @T --------------------------------------------
+% \subsection{Timing commands}
+%
+% The [[feapprofile]] routine controls the server's timing of FEAP
+% macros and [[feapsrv]] subcommands (see [[feapprof.c]]), which shows
+% how a session's time splits between FEAP's work, MATFEAP transfers,
+% and waiting for the client:
+% \begin{verbatim}
+%   feapprofile(p, 'on');
+%   ...
+%   prof = feapprofile(p);                  % Fetch the table
+%   feapprofile(p, 'trace', 'feap.json');   % Chrome trace on the server
+% \end{verbatim}
+% With no mode (or [[show]]), the result is a struct array with one
+% entry per command and fields [[name]], [[count]], [[total]],
+% [[max]], and [[cpu]] (times in seconds); otherwise it is the
+% server's one-line reply.
+
+%@o feapprofile.m
+% result = feapprofile(feap, mode, path)
+%
+% Time FEAP commands (mode is on, off, clear, show, or trace PATH).
+
+%@c
+function result = feapprofile(p, mode, path)
+
+if nargin < 2, mode = 'show'; end
+if ~ischar(mode), error('Mode must be a string'); end
+
+cmd = ['profile ', mode];
+if nargin > 2, cmd = [cmd, ' ', path]; end
+
+sock_send(p.fd, 'serv');
+feapsrvp(p);
+feapdispv(p, cmd);
+sock_send(p.fd, cmd);
+msg = sock_recv(p.fd);
+feapdispv(p, msg);
+
+if strcmp(mode, 'show')
+  [s, resp] = strtok(msg);
+  nrows  = sscanf(resp, '%d', 1);
+  result = struct('name', {}, 'count', {}, 'total', {}, 'max', {}, ...
+                  'cpu', {});
+  for k = 1:nrows
+    [name, resp] = strtok(sock_recv(p.fd));
+    vals = sscanf(resp, '%f');
+    result(k).name  = name;
+    result(k).count = vals(1);
+    result(k).total = vals(2);
+    result(k).max   = vals(3);
+    result(k).cpu   = vals(4);
+  end
+else
+  result = msg;
+end
+
+feapsrvp(p);
+sock_send(p.fd, 'start');
+feapsync(p);
+%@o
+
+% @T --------------------------------------------
+% \subsection{Subscribing to arrays}
+%
+% Rather than stopping FEAP after each time step to fetch the solution,
+% the client can subscribe to arrays and let the server push them as
+% the run goes on (see [[feappush.c]]).  A subscription fires at each
+% [[serv,push]] macro, which goes inside a FEAP [[loop]], or with the
+% [[after]] option, whenever a given console command finishes:
+% \begin{verbatim}
+%   feapsubscribe(p, 1, 'u', 'every 10', @(id,seq,t,u) plot(u));
+%   feapsubscribe(p, 2, 'dr', 'norm2');
+%   feapcmd(p, 'loop,,100', 'time', 'tang,,1', 'serv,push', 'next');
+%   [rnorm, t] = feappushed(p, 2);
+%   feapunsubscribe(p);
+% \end{verbatim}
+% The options are those of the [[subscribe]] command: [[reduced]],
+% [[norm2]] or [[norminf]], [[every K]], and [[after MACRO]].  Pushed
+% data are picked up by [[feapsync]] while it waits, so they are handled
+% during whatever MATFEAP call is running when they arrive, and FEAP
+% does not wait for the client in between.  If a callback is given, it
+% is called with the subscription id, the push count, FEAP's time, and
+% the data; otherwise the latest push is kept in the global
+% [[matfeap_push]] for [[feappushed]].
+
+%@o feapsubscribe.m
+% feapsubscribe(feap, id, var, opts, fn)
+%
+% Subscribe to a FEAP array under a positive integer id.  The optional
+% opts string may contain reduced, norm2, norminf, every K, and
+% after MACRO.  If fn is given, it is called as fn(id, seq, ttim, val)
+% for each push; otherwise use feappushed to get the latest push.
+
+%@c
+function feapsubscribe(p, id, var, opts, fn)
+
+if nargin < 3,   error('Missing required argument');      end
+if ~ischar(var), error('Variable name must be a string'); end
+if nargin < 4, opts = ''; end
+if nargin < 5, fn = [];   end
+
+cmd = sprintf('subscribe %d %s %s', id, upper(var), opts);
+sock_send(p.fd, 'serv');
+feapsrvp(p);
+feapdispv(p, cmd);
+sock_send(p.fd, cmd);
+msg = sock_recv(p.fd);
+feapdispv(p, msg);
+feapsrvp(p);
+sock_send(p.fd, 'start');
+feapsync(p);
+
+if ~strcmp(strtok(msg), 'Subscribed'), error(msg); end
+feappushentry(p, id, fn);
+%@o
+
+%@o feapunsubscribe.m
+% feapunsubscribe(feap, id)
+%
+% Drop the subscription with the given id, or all subscriptions if
+% no id is given.
+
+%@c
+function feapunsubscribe(p, id)
+
+global matfeap_push;
+
+if nargin < 2
+  cmd = 'unsubscribe all';
+else
+  cmd = sprintf('unsubscribe %d', id);
+end
+sock_send(p.fd, 'serv');
+feapsrvp(p);
+feapdispv(p, cmd);
+sock_send(p.fd, cmd);
+feapsrvp(p);
+sock_send(p.fd, 'start');
+feapsync(p);
+
+keep = [];
+for k = 1:length(matfeap_push)
+  if matfeap_push(k).fd ~= p.fd | (nargin > 1 & matfeap_push(k).id ~= id)
+    keep = [keep, k];
+  end
+end
+matfeap_push = matfeap_push(keep);
+%@o
+
+%@o feappushed.m
+% [val, ttim, seq] = feappushed(feap, id)
+%
+% Get the latest data pushed for a subscription, FEAP's time when it
+% was sent, and the number of pushes so far.  If nothing has been
+% pushed, val is empty and seq is zero.
+
+%@c
+function [val, ttim, seq] = feappushed(p, id)
+
+global matfeap_push;
+
+k = feappushentry(p, id);
+val  = matfeap_push(k).val;
+ttim = matfeap_push(k).ttim;
+seq  = matfeap_push(k).seq;
+%@o
+
+%@o feappushentry.m
+% k = feappushentry(feap, id, fn)
+%
+% Find (or make) the entry for a subscription in matfeap_push.  If fn
+% is given, the entry is reset and fn becomes its callback.
+
+%@c
+function k = feappushentry(p, id, fn)
+
+global matfeap_push;
+
+if isempty(matfeap_push)
+  matfeap_push = struct('fd', {}, 'id', {}, 'fn', {}, 'seq', {}, ...
+                        'ttim', {}, 'val', {});
+end
+
+k = 0;
+for j = 1:length(matfeap_push)
+  if matfeap_push(j).fd == p.fd & matfeap_push(j).id == id
+    k = j;
+  end
+end
+if k == 0 | nargin > 2
+  if k == 0, k = length(matfeap_push)+1; end
+  if nargin < 3, fn = []; end
+  matfeap_push(k).fd   = p.fd;
+  matfeap_push(k).id   = id;
+  matfeap_push(k).fn   = fn;
+  matfeap_push(k).seq  = 0;
+  matfeap_push(k).ttim = 0;
+  matfeap_push(k).val  = [];
+end
+%@o
+
+%@o feappushrecv.m
+% feappushrecv(feap, msg)
+%
+% Receive the data announced by a MATFEAP PUSH line and pass it to
+% the subscription's callback, or keep it for feappushed.
+
+%@c
+function feappushrecv(p, msg)
+
+global matfeap_push;
+
+[s,    resp] = strtok(msg);     % MATFEAP
+[s,    resp] = strtok(resp);    % PUSH
+[id,   resp] = strtok(resp);
+[seq,  resp] = strtok(resp);
+[ttim, resp] = strtok(resp);
+[kind, resp] = strtok(resp);
+id   = str2num(id);
+seq  = str2num(seq);
+ttim = str2num(ttim);
+
+if strcmp(kind, 'double')
+  val = sock_recvdarray(p.fd, str2num(resp));
+elseif strcmp(kind, 'missing')
+  val = [];
+else
+  val = str2num(resp);
+end
+feapdispv(p, sprintf('Push %d (%s)', id, kind));
+
+k = feappushentry(p, id);
+if ~isempty(matfeap_push(k).fn)
+  feval(matfeap_push(k).fn, id, seq, ttim, val);
+else
+  matfeap_push(k).seq  = seq;
+  matfeap_push(k).ttim = ttim;
+  matfeap_push(k).val  = val;
+end
+%@o
 
 % @T --------------------------------------------
 % \subsection{Putting MATFEAP into verbose mode}
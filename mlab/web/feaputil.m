@@ -13,7 +13,9 @@ function feaputil;
 %
 % The [[feapsync]] command is used to wait for a synchronization
 % message sent by the server.  For the moment, we don't use the
-% synchronization labels.
+% synchronization labels.  Arrays pushed by the server for a
+% subscription (see [[feapsubscribe]]) arrive while we wait, and are
+% passed to [[feappushrecv]].
 
 %@o feapsync.m
 % feapsync(feap, barriernum) 
@@ -36,6 +38,8 @@ while 1
       feapdispv(p, 'Unexpected barrier');
       feapdispv(p, s);
     end
+  elseif strfind(s, 'MATFEAP PUSH')
+    feappushrecv(p, s);
   else
     feapdispv(p, s);
   end
@@ -88,6 +92,27 @@ if p.verb
 end
 %@o
 
+% @T --------------------------------------------
+% \subsection{Wide integer transfers}
+%
+% Integer arrays and profile column pointers normally travel as 32-bit
+% integers.  If the [[int64]] option was given to [[feapstart]], the
+% transfer routines ask for the {\tt binary64} and {\tt profile64}
+% forms instead, in which they travel as 64-bit integers.  The
+% [[feapwire64]] routine reports whether that option is on.
+
+%@o feapwire64.m
+% w = feapwire64(feap)
+%
+% Check whether integer data should be transferred as 64-bit values.
+
+%@c
+function w = feapwire64(p)
+
+w = 0;
+if isfield(p, 'int64'), w = p.int64; end
+%@o
+
 % @T --------------------------------------------
 % \subsection{Index mapping}
 % 
@@ -121,12 +146,13 @@ end
 function [full_id, bc_id, reduced_id, id] = map2full(p)
 
 % Get mesh parameters
-nneq  = feapget(p, 'nneq');  % Number of unreduced dof
-numnp = feapget(p, 'numnp'); % Number of dof
-ndf   = feapget(p, 'ndf');   % Maximum dof per node
+sc    = feapgetallc(p);
+nneq  = sc.nneq;   % Number of unreduced dof
+numnp = sc.numnp;  % Number of dof
+ndf   = sc.ndf;    % Maximum dof per node
 
 % Get the index map
-id = feapgetm(p, 'id');
+id = feapgetmc(p, 'id');
 id = reshape(id(1:nneq), ndf, numnp);
 
 % Find the index set for free vars in full and reduced vectors
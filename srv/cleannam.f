@@ -11,4 +11,6 @@
         end if
       end do
 
+      call feaptmpldeck(s)
+
       end
@@ -0,0 +1,571 @@
+/*
+ * FEAP daemon administration socket
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define ADMIN_ENV_VAR "MATFEAP_ADMIN"
+#define MAX_SESSIONS  256
+#define MAX_ADMINS    8
+#define ADMIN_BUFSIZ  256
+
+/*@T
+ * \section{The administration socket}
+ *
+ * The daemon's only report on its own is the ``Connection from'' line it
+ * prints to its terminal.  On a shared compute node, that isn't enough
+ * to see how many FEAP processes are running, who they belong to, or
+ * which one is eating the machine.  If the [[MATFEAP_ADMIN]] environment
+ * variable is set, the daemon also listens on a UNIX domain socket at
+ * that path for administrative connections.  The socket is local so
+ * that only users on the machine (subject to the file permissions on
+ * the socket) can reach it.  The commands are
+ * \begin{itemize}
+ * \item [[list]] -- list the live sessions;
+ * \item [[stats]] -- summarize the daemon state;
+ * \item [[drain]] -- stop accepting new connections (existing sessions
+ *   run to completion);
+ * \item [[resume]] -- start accepting connections again;
+ * \item [[kill PID]] -- send [[SIGTERM]] to a session, or [[SIGKILL]]
+ *   with [[kill PID hard]];
+ * \item [[interrupt PID]] -- interrupt the command a session is running
+ *   (see [[feapintr.c]]);
+ * \item [[templates]] -- list the model templates (see [[feaptmpl.c]]);
+ * \item [[help]] and [[quit]].
+ * \end{itemize}
+ * There is also an [[adopt OLD NEW]] command, which a session sends
+ * when a spare process takes over from it after an interrupt, so that
+ * the table follows the session to its new process ID.
+ * Each reply ends with a line {\tt ADMIN>}, in the same style as the
+ * {\tt FEAPSRV>} prompt, so the socket can be driven by a script or
+ * by hand with a tool such as [[socat]].
+ *
+ * The [[list]] command replies {\tt Sessions {\it n}}, followed by one
+ * line per session with the fields
+ * \begin{verbatim}
+ *   pid client age idle rss_kb cpu_s bytes_in bytes_out
+ * \end{verbatim}
+ * where the age and idle times are in seconds.  The resource figures
+ * come from [[/proc]]: the resident set size from [[statm]], the user
+ * plus system CPU time from [[stat]], and the bytes read and written by
+ * the session process from [[io]].  Since the session's standard input
+ * and output are the client connection, the byte counts are mostly
+ * protocol traffic, though they also include FEAP's own file I/O.  The
+ * idle time is the time since those counts last changed, as seen by the
+ * daemon, which samples them about once a second.  On systems without
+ * [[/proc]], the resource fields are reported as [[-]].
+ *
+ *@c*/
+typedef struct feapadmin_session_t {
+    pid_t  pid;
+    char   client[64];
+    time_t start;
+    time_t active;
+    long long rbytes;
+    long long wbytes;
+} feapadmin_session_t;
+
+typedef struct feapadmin_client_t {
+    int  fd;
+    int  len;
+    char buf[ADMIN_BUFSIZ];
+} feapadmin_client_t;
+
+static feapadmin_session_t feapadmin_sessions[MAX_SESSIONS];
+static feapadmin_client_t  feapadmin_clients[MAX_ADMINS];
+static int    feapadmin_fd = -1;
+static int    feapadmin_drain = 0;
+static long   feapadmin_accepted = 0;
+static volatile long feapadmin_exited = 0;
+static long   feapadmin_untracked = 0;
+static time_t feapadmin_start;
+static time_t feapadmin_sampled;
+
+
+/*@T
+ * \subsection{Setting up}
+ *
+ * The [[feapadmin_setup]] routine opens the administration socket if
+ * [[MATFEAP_ADMIN]] is set.  Failure to open the socket is reported but
+ * is not fatal: the daemon still serves clients.  The socket is made
+ * accessible only to the owner of the daemon.
+ *
+ *@c*/
+void feapadmin_setup()
+{
+    struct sockaddr_un addr;
+    char* sockname = getenv(ADMIN_ENV_VAR);
+    int i, len;
+
+    feapadmin_start = time(NULL);
+    for (i = 0; i < MAX_ADMINS; ++i)
+        feapadmin_clients[i].fd = -1;
+    if (sockname == NULL || strlen(sockname) >= sizeof(addr.sun_path))
+        return;
+
+    unlink(sockname);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sockname);
+    len = sizeof(addr.sun_family) + strlen(addr.sun_path) + 1;
+
+    if ((feapadmin_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        bind(feapadmin_fd, (struct sockaddr*) &addr, len) < 0 ||
+        listen(feapadmin_fd, MAX_ADMINS) < 0) {
+        perror("admin socket");
+        if (feapadmin_fd >= 0)
+            close(feapadmin_fd);
+        feapadmin_fd = -1;
+        return;
+    }
+    chmod(sockname, 0600);
+    printf("Admin socket at %s\n", sockname);
+}
+
+
+/*@T
+ * A session process should not hold on to any of the administration
+ * descriptors, so the child side of the [[fork]] closes them.
+ *
+ *@c*/
+void feapadmin_child()
+{
+    int i;
+    if (feapadmin_fd >= 0)
+        close(feapadmin_fd);
+    for (i = 0; i < MAX_ADMINS; ++i)
+        if (feapadmin_clients[i].fd >= 0)
+            close(feapadmin_clients[i].fd);
+}
+
+
+/*@T
+ * \subsection{The session table}
+ *
+ * The daemon records each session when it forks the child process,
+ * and the [[SIGCHLD]] handler clears the entry when the child is
+ * reaped.  Since the handler can run at any time, it only clears the
+ * process ID field, which marks the slot as free.  If the table is
+ * full, the session still runs, but the daemon logs
+ * {\tt Session table full} and counts it as untracked in the
+ * [[stats]] reply.
+ *
+ *@c*/
+void feapadmin_add(pid_t pid, const char* client)
+{
+    time_t now = time(NULL);
+    int i;
+    ++feapadmin_accepted;
+    for (i = 0; i < MAX_SESSIONS; ++i) {
+        feapadmin_session_t* s = feapadmin_sessions + i;
+        if (s->pid == 0) {
+            memset(s, 0, sizeof(*s));
+            strncpy(s->client, client, sizeof(s->client)-1);
+            s->start  = now;
+            s->active = now;
+            s->pid    = pid;
+            return;
+        }
+    }
+    ++feapadmin_untracked;
+    printf("Session table full -- not tracking pid %d (%s)\n",
+           (int) pid, client);
+    fflush(stdout);
+}
+
+void feapadmin_reaped(pid_t pid)
+{
+    int i;
+    ++feapadmin_exited;
+    for (i = 0; i < MAX_SESSIONS; ++i)
+        if (feapadmin_sessions[i].pid == pid)
+            feapadmin_sessions[i].pid = 0;
+}
+
+/*@T
+ * Sessions cloned from a model template are entered in the table by
+ * the template registry, which looks up the address of the client that
+ * asked for the model with [[feapadmin_client]].  A clone can exit
+ * before it is entered, so the sampling routine also drops any session
+ * whose process is gone.
+ *
+ *@c*/
+const char* feapadmin_client(pid_t pid)
+{
+    int i;
+    for (i = 0; i < MAX_SESSIONS; ++i)
+        if (feapadmin_sessions[i].pid == pid)
+            return feapadmin_sessions[i].client;
+    return "unknown";
+}
+
+
+/*@T
+ * \subsection{Resource sampling}
+ *
+ * The [[/proc/{\it pid}/stat]] line starts with the process ID and the
+ * command name in parentheses; the command name may contain spaces, so
+ * we look for the fields after the last closing parenthesis.  Counting
+ * from there, the user and system times are the twelfth and thirteenth
+ * fields.
+ *
+ *@c*/
+static int feapadmin_cpu(pid_t pid, double* cpu)
+{
+    char path[64], buf[1024];
+    unsigned long utime, stime;
+    char* p;
+    FILE* fp;
+    size_t n;
+
+    sprintf(path, "/proc/%d/stat", (int) pid);
+    if ((fp = fopen(path, "r")) == NULL)
+        return 0;
+    n = fread(buf, 1, sizeof(buf)-1, fp);
+    fclose(fp);
+    buf[n] = 0;
+    if ((p = strrchr(buf, ')')) == NULL)
+        return 0;
+    if (sscanf(p+1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+               &utime, &stime) != 2)
+        return 0;
+    *cpu = (double) (utime + stime) / sysconf(_SC_CLK_TCK);
+    return 1;
+}
+
+static int feapadmin_rss(pid_t pid, long* rss_kb)
+{
+    char path[64];
+    long size, resident;
+    FILE* fp;
+    int ok;
+
+    sprintf(path, "/proc/%d/statm", (int) pid);
+    if ((fp = fopen(path, "r")) == NULL)
+        return 0;
+    ok = (fscanf(fp, "%ld %ld", &size, &resident) == 2);
+    fclose(fp);
+    if (ok)
+        *rss_kb = resident * (sysconf(_SC_PAGESIZE) / 1024);
+    return ok;
+}
+
+static int feapadmin_io(pid_t pid, long long* rbytes, long long* wbytes)
+{
+    char path[64], line[128];
+    int found = 0;
+    FILE* fp;
+
+    sprintf(path, "/proc/%d/io", (int) pid);
+    if ((fp = fopen(path, "r")) == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "rchar: %lld", rbytes) == 1)
+            found |= 1;
+        else if (sscanf(line, "wchar: %lld", wbytes) == 1)
+            found |= 2;
+    }
+    fclose(fp);
+    return (found == 3);
+}
+
+/*@T
+ * The [[feapadmin_sample]] routine updates the byte counts for each
+ * session, and notes the time if they have changed.  The daemon calls
+ * it whenever its [[select]] loop wakes up, but at most once a second.
+ *
+ *@c*/
+void feapadmin_sample()
+{
+    time_t now = time(NULL);
+    int i;
+    if (now == feapadmin_sampled)
+        return;
+    feapadmin_sampled = now;
+    for (i = 0; i < MAX_SESSIONS; ++i) {
+        feapadmin_session_t* s = feapadmin_sessions + i;
+        long long rbytes, wbytes;
+        if (s->pid != 0 && kill(s->pid, 0) < 0 && errno == ESRCH)
+            s->pid = 0;
+        if (s->pid == 0 || !feapadmin_io(s->pid, &rbytes, &wbytes))
+            continue;
+        if (rbytes != s->rbytes || wbytes != s->wbytes)
+            s->active = now;
+        s->rbytes = rbytes;
+        s->wbytes = wbytes;
+    }
+}
+
+
+/*@T
+ * \subsection{Commands}
+ *
+ *@c*/
+static char* FEAPADMIN_HELP =
+    "Commands are:\n"
+    "  list          - List sessions\n"
+    "                  (pid client age idle rss_kb cpu_s bytes_in bytes_out)\n"
+    "  stats         - Summarize daemon state\n"
+    "  drain         - Stop accepting new connections\n"
+    "  resume        - Resume accepting new connections\n"
+    "  kill PID      - Terminate a session (kill PID hard for SIGKILL)\n"
+    "  interrupt PID - Interrupt the command a session is running\n"
+    "  templates     - List model templates (pid age idle hits key)\n"
+    "  help          - Get this message\n"
+    "  quit          - Close this admin connection\n";
+
+static void feapadmin_list(FILE* out)
+{
+    time_t now = time(NULL);
+    int i, n = 0;
+
+    feapadmin_sampled = 0;
+    feapadmin_sample();
+    for (i = 0; i < MAX_SESSIONS; ++i)
+        if (feapadmin_sessions[i].pid)
+            ++n;
+    fprintf(out, "Sessions %d\n", n);
+
+    for (i = 0; i < MAX_SESSIONS; ++i) {
+        feapadmin_session_t* s = feapadmin_sessions + i;
+        double cpu;
+        long rss;
+        if (s->pid == 0)
+            continue;
+        fprintf(out, "%d %s %ld %ld", (int) s->pid, s->client,
+                (long) (now - s->start), (long) (now - s->active));
+        if (feapadmin_rss(s->pid, &rss))
+            fprintf(out, " %ld", rss);
+        else
+            fprintf(out, " -");
+        if (feapadmin_cpu(s->pid, &cpu))
+            fprintf(out, " %.2f", cpu);
+        else
+            fprintf(out, " -");
+        if (s->rbytes || s->wbytes)
+            fprintf(out, " %lld %lld\n", s->rbytes, s->wbytes);
+        else
+            fprintf(out, " - -\n");
+    }
+}
+
+static void feapadmin_stats(FILE* out)
+{
+    int i, n = 0;
+    for (i = 0; i < MAX_SESSIONS; ++i)
+        if (feapadmin_sessions[i].pid)
+            ++n;
+    fprintf(out, "Daemon pid %d\n", (int) getpid());
+    fprintf(out, "Uptime %ld\n", (long) (time(NULL) - feapadmin_start));
+    fprintf(out, "Accepting %s\n", feapadmin_drain ? "no" : "yes");
+    fprintf(out, "Sessions %d\n", n);
+    fprintf(out, "Accepted %ld\n", feapadmin_accepted);
+    fprintf(out, "Exited %ld\n", (long) feapadmin_exited);
+    fprintf(out, "Untracked %ld\n", feapadmin_untracked);
+}
+
+static void feapadmin_kill(FILE* out, char* pidtok, char* how)
+{
+    int i, pid = pidtok ? atoi(pidtok) : 0;
+    int sig = (how && strcmp(how, "hard") == 0) ? SIGKILL : SIGTERM;
+    for (i = 0; pid > 0 && i < MAX_SESSIONS; ++i) {
+        if (feapadmin_sessions[i].pid == pid) {
+            if (kill(pid, sig) < 0)
+                fprintf(out, "Kill failed: %s\n", strerror(errno));
+            else
+                fprintf(out, "Killed %d\n", pid);
+            return;
+        }
+    }
+    fprintf(out, "No such session\n");
+}
+
+static void feapadmin_interrupt(FILE* out, char* pidtok)
+{
+    int i, pid = pidtok ? atoi(pidtok) : 0;
+    for (i = 0; pid > 0 && i < MAX_SESSIONS; ++i) {
+        if (feapadmin_sessions[i].pid == pid) {
+            if (kill(pid, SIGINT) < 0)
+                fprintf(out, "Interrupt failed: %s\n", strerror(errno));
+            else
+                fprintf(out, "Interrupted %d\n", pid);
+            return;
+        }
+    }
+    fprintf(out, "No such session\n");
+}
+
+static void feapadmin_adopt(FILE* out, char* oldtok, char* newtok)
+{
+    int i, old = oldtok ? atoi(oldtok) : 0, pid = newtok ? atoi(newtok) : 0;
+    for (i = 0; old > 0 && pid > 0 && i < MAX_SESSIONS; ++i) {
+        if (feapadmin_sessions[i].pid == old) {
+            feapadmin_sessions[i].pid = pid;
+            fprintf(out, "Adopted %d\n", pid);
+            return;
+        }
+    }
+    fprintf(out, "No such session\n");
+}
+
+/* Run one command line; return zero if the connection should close.
+ * The reply is collected in a memory stream, which grows as needed. */
+static int feapadmin_command(int fd, char* line)
+{
+    char* reply = NULL;
+    FILE* out;
+    char* token = strtok(line, " \t\r\n");
+    int keep = 1;
+    size_t n = 0, sent;
+    ssize_t m;
+
+    out = open_memstream(&reply, &n);
+    if (out == NULL)
+        return 0;
+    if (token == NULL) {
+        /* Empty line -- just send the prompt */
+    } else if (strcmp(token, "list") == 0) {
+        feapadmin_list(out);
+    } else if (strcmp(token, "stats") == 0) {
+        feapadmin_stats(out);
+    } else if (strcmp(token, "drain") == 0) {
+        feapadmin_drain = 1;
+        fprintf(out, "Draining\n");
+    } else if (strcmp(token, "resume") == 0) {
+        feapadmin_drain = 0;
+        fprintf(out, "Accepting\n");
+    } else if (strcmp(token, "kill") == 0) {
+        char* pidtok = strtok(NULL, " \t\r\n");
+        char* how    = strtok(NULL, " \t\r\n");
+        feapadmin_kill(out, pidtok, how);
+    } else if (strcmp(token, "interrupt") == 0) {
+        feapadmin_interrupt(out, strtok(NULL, " \t\r\n"));
+    } else if (strcmp(token, "adopt") == 0) {
+        char* oldtok = strtok(NULL, " \t\r\n");
+        char* newtok = strtok(NULL, " \t\r\n");
+        feapadmin_adopt(out, oldtok, newtok);
+    } else if (strcmp(token, "templates") == 0) {
+        extern void feaptmpl_list(FILE* out);
+        feaptmpl_list(out);
+    } else if (strcmp(token, "help") == 0) {
+        fprintf(out, "%s", FEAPADMIN_HELP);
+    } else if (strcmp(token, "quit") == 0) {
+        keep = 0;
+    } else {
+        fprintf(out, "Unrecognized command: %s\n", token);
+    }
+    if (keep)
+        fprintf(out, "ADMIN>\n");
+    fclose(out);
+
+    for (sent = 0; sent < n; sent += m) {
+        m = send(fd, reply+sent, n-sent, MSG_NOSIGNAL);
+        if (m < 0 && errno == EINTR) {
+            m = 0;
+        } else if (m < 0) {
+            keep = 0;
+            break;
+        }
+    }
+    free(reply);
+    return keep;
+}
+
+
+/*@T
+ * \subsection{Integration with the daemon loop}
+ *
+ * The daemon waits in [[select]] on its listening socket, the
+ * administration socket, and any open administration connections.
+ * The [[feapadmin_fdset]] routine adds the administration descriptors
+ * to the set, and [[feapadmin_handle]] services whichever of them are
+ * ready.  Administration connections are read a chunk at a time and
+ * commands are run when a full line has arrived, so a slow or idle
+ * administrator never holds up the daemon.
+ *
+ *@c*/
+void feapadmin_fdset(fd_set* fds, int* maxfd)
+{
+    int i;
+    if (feapadmin_fd >= 0) {
+        FD_SET(feapadmin_fd, fds);
+        if (feapadmin_fd > *maxfd)
+            *maxfd = feapadmin_fd;
+    }
+    for (i = 0; i < MAX_ADMINS; ++i) {
+        int fd = feapadmin_clients[i].fd;
+        if (fd >= 0) {
+            FD_SET(fd, fds);
+            if (fd > *maxfd)
+                *maxfd = fd;
+        }
+    }
+}
+
+static void feapadmin_read(feapadmin_client_t* c)
+{
+    char* nl;
+    int m = recv(c->fd, c->buf + c->len, ADMIN_BUFSIZ-1 - c->len, 0);
+    if (m <= 0) {
+        close(c->fd);
+        c->fd = -1;
+        return;
+    }
+    c->len += m;
+    c->buf[c->len] = 0;
+    while ((nl = strchr(c->buf, '\n')) != NULL) {
+        *nl = 0;
+        if (!feapadmin_command(c->fd, c->buf)) {
+            close(c->fd);
+            c->fd = -1;
+            return;
+        }
+        c->len -= (nl+1 - c->buf);
+        memmove(c->buf, nl+1, c->len+1);
+    }
+    if (c->len == ADMIN_BUFSIZ-1) {
+        /* Overlong line; discard it */
+        c->len = 0;
+        c->buf[0] = 0;
+    }
+}
+
+void feapadmin_handle(fd_set* fds)
+{
+    int i;
+    feapadmin_sample();
+    if (feapadmin_fd >= 0 && FD_ISSET(feapadmin_fd, fds)) {
+        int fd = accept(feapadmin_fd, NULL, NULL);
+        for (i = 0; fd >= 0 && i < MAX_ADMINS; ++i) {
+            if (feapadmin_clients[i].fd < 0) {
+                feapadmin_clients[i].fd  = fd;
+                feapadmin_clients[i].len = 0;
+                send(fd, "ADMIN>\n", 7, MSG_NOSIGNAL);
+                fd = -1;
+            }
+        }
+        if (fd >= 0)
+            close(fd);
+    }
+    for (i = 0; i < MAX_ADMINS; ++i)
+        if (feapadmin_clients[i].fd >= 0 &&
+            FD_ISSET(feapadmin_clients[i].fd, fds))
+            feapadmin_read(feapadmin_clients + i);
+}
+
+int feapadmin_draining()
+{
+    return feapadmin_drain;
+}
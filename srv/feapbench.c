@@ -0,0 +1,496 @@
+/*
+ * Stand-in FEAP backend for transport benchmarks
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*@T
+ * \section{A stand-in FEAP for benchmarks}
+ *
+ * Measuring what the transports cost should not require a FEAP license
+ * or a model big enough to produce gigabyte arrays.  The [[feapbench]]
+ * program stands in for FEAP: it is linked with the real MATFEAP server
+ * code ([[feapsrv.c]] and friends, and either [[feapsock.c]] or
+ * [[feappipe.c]]), so the daemon, the command dispatcher, and the array
+ * and sparse matrix protocols are exactly the ones a client sees with
+ * FEAP; only the FORTRAN side is replaced by a few routines that serve
+ * synthetic arrays.  The makefile builds [[feapbs]] (socket server) and
+ * [[feapbp]] (pipe server) from it, with no FEAP libraries needed.
+ *
+ * The stand-in goes through the same conversation as FEAP: a
+ * [[feapsrv]] prompt, the file name dialog (any deck name is accepted,
+ * and the file need not exist), and then a macro prompt.  At the macro
+ * prompt it understands
+ * \begin{itemize}
+ * \item [[serv]] -- enter the [[feapsrv]] interface;
+ * \item [[serv,push]] -- send the subscribed arrays (see
+ *   [[feappush.c]]);
+ * \item [[step N]] -- run [[N]] time steps, each of which adds one to
+ *   the time [[ttim]] and to every entry of [[X]] and then acts like
+ *   [[serv,push]], a stand-in for a FEAP [[loop]];
+ * \item [[size N]] -- set the payload size (see below);
+ * \item [[sleep S]] -- zero [[X]] and then wait [[S]] seconds, a slow
+ *   command with a side effect for trying out interrupts (see
+ *   [[feapintr.c]]);
+ * \item [[quit]] -- the ordinary FEAP shutdown dialog.
+ * \end{itemize}
+ * Any other macro is acknowledged with a line of output, which is
+ * enough for measuring the cost of a macro round trip.
+ *
+ * The payload is set by [[size N]], or by the first command line
+ * argument at startup.  After [[size N]],
+ * \begin{itemize}
+ * \item [[getm X]] sends and [[setm X]] receives [[N]] doubles, and
+ *   [[addm X]] accumulates into them;
+ * \item [[reduce OP X]] reduces [[X]], with every entry of [[X]]
+ *   active in the reduced form, and [[X]] as the only other array
+ *   for [[dot]];
+ * \item [[sparse binary tang]] and [[sparse serial tang]] send a
+ *   banded symmetric matrix of about [[N/3]] nonzeros (the same
+ *   number of bytes as [[X]]), and [[sparse profile tang]] sends the
+ *   same matrix in profile form;
+ * \item [[resid]] sends [[neq]] doubles, where [[neq]] is the
+ *   dimension of the matrix, and [[resid u]] first stores the
+ *   displacement it receives into the active entries of [[X]];
+ * \item [[elmat]] streams [[neq]] two-node bar elements, where
+ *   element [[e]] joins equations [[e]] and [[e+1]] (the last node is
+ *   fixed) and has stiffness [[e]];
+ * \item [[subscribe ID X]] pushes [[X]], again with every entry
+ *   active in the reduced form.
+ * \end{itemize}
+ * For [[resid u]] and [[addm X ALPHA reduced]], the entries of [[X]]
+ * play the part of the degrees of freedom.  Their [[ID]] array fixes
+ * every fifth entry and numbers the others backwards, so a client or
+ * server that confuses the order of the full array with equation
+ * order gets visibly wrong answers.
+ *
+ * The scalars [[neq]] and [[ttim]] are registered for [[get]] and
+ * [[set]], so small [[feapsrv]] commands can be timed as well.
+ *
+ *@c*/
+#define BENCH_DEFAULT 1024
+#define BENCH_BAND    4
+
+static double* bench_x;      /* Dense array X                     */
+static long    bench_n;      /* Length of X                       */
+static int     bench_neq;    /* Dimension of tang                 */
+static int*    bench_jp;     /* Profile column pointers for tang  */
+static double* bench_a;      /* Diagonal followed by upper profile */
+static double* bench_r;      /* Residual                          */
+static int*    bench_id;     /* Equation numbers for X            */
+static double  bench_ttim;   /* Time                              */
+
+/*@T
+ * \subsection{Synthetic arrays}
+ *
+ * The tangent has half bandwidth [[BENCH_BAND]], so it has
+ * [[neq + 2*nup]] nonzeros with [[nup]] about [[BENCH_BAND*neq]], and
+ * we choose [[neq]] so that its coordinate form is about as large as
+ * [[X]].  The entries are arbitrary but nonzero, so that nothing is
+ * dropped on the client side.  As in FEAP, the diagonal and the upper
+ * profile are stored contiguously.
+ *
+ *@c*/
+static void bench_size(long n)
+{
+    long j, nup;
+
+    free(bench_x);
+    free(bench_jp);
+    free(bench_a);
+    free(bench_r);
+    free(bench_id);
+
+    bench_n   = (n > 0) ? n : 1;
+    bench_neq = (int) ((bench_n * 8) / (24 * (2*BENCH_BAND+1)));
+    if (bench_neq < 1)
+        bench_neq = 1;
+
+    bench_jp = (int*) malloc(bench_neq * sizeof(int));
+    for (j = 0, nup = 0; j < bench_neq; ++j) {
+        nup += (j < BENCH_BAND) ? j : BENCH_BAND;
+        bench_jp[j] = (int) nup;
+    }
+
+    bench_x = (double*) malloc(bench_n * sizeof(double));
+    bench_a = (double*) malloc((bench_neq + nup) * sizeof(double));
+    bench_r = (double*) malloc(bench_neq * sizeof(double));
+    bench_id = (int*) malloc(bench_n * sizeof(int));
+    if (!bench_x || !bench_a || !bench_r || !bench_jp || !bench_id) {
+        fprintf(stderr, "feapbench: cannot allocate %ld doubles\n", n);
+        exit(-1);
+    }
+
+    for (j = 0; j < bench_n; ++j)
+        bench_x[j] = j+1;
+    for (j = 0; j < bench_neq; ++j) {
+        bench_a[j] = 2*BENCH_BAND+1;
+        bench_r[j] = j+1;
+    }
+    for (j = 0; j < nup; ++j)
+        bench_a[bench_neq+j] = -1;
+
+    for (j = 0, nup = 0; j < bench_n; ++j)
+        if (j % 5 != 4)
+            ++nup;
+    for (j = 0; j < bench_n; ++j)
+        bench_id[j] = (j % 5 != 4) ? (int) nup-- : 0;
+}
+
+/*@T
+ * \subsection{FEAP entry points}
+ *
+ * These replace the FORTRAN routines called from the C side of the
+ * server.  Anything not named here behaves as if FEAP did not have it.
+ *
+ *@c*/
+int servparam_(int* i1, int* i2, double* val)
+{
+    return 0;
+}
+
+int feapreg_()
+{
+    extern int fmregi_(char* name, int* addr);
+    extern int fmregd_(char* name, double* addr);
+    fmregi_("neq ", &bench_neq);
+    fmregd_("ttim ", &bench_ttim);
+    return 0;
+}
+
+int feapflush_()
+{
+    fflush(stdout);
+    return 0;
+}
+
+int feapflushall_()
+{
+    fflush(NULL);
+    return 0;
+}
+
+int feapgetm_(char* var, int len)
+{
+    extern int fmsenddbl_(double* data, int* len);
+    extern int fmnotfound_();
+    int n = (int) bench_n;
+    if (len == 1 && (var[0] == 'X' || var[0] == 'x'))
+        fmsenddbl_(bench_x, &n);
+    else
+        fmnotfound_();
+    return 0;
+}
+
+int feapsetm_(char* var, int len)
+{
+    extern int fmrecvdbl_(double* data, int* len);
+    extern int fmnotfound_();
+    int n = (int) bench_n;
+    if (len == 1 && (var[0] == 'X' || var[0] == 'x'))
+        fmrecvdbl_(bench_x, &n);
+    else
+        fmnotfound_();
+    return 0;
+}
+
+int feapaddm_(char* var, int* reduced, int len)
+{
+    extern int fmadddbl_(double* data, int* len);
+    extern int fmaddred_(double* data, int* len, int* id, int* nneq);
+    extern int fmnotfound_();
+    int n = (int) bench_n;
+    if (len != 1 || (var[0] != 'X' && var[0] != 'x')) {
+        fmnotfound_();
+    } else if (*reduced) {
+        fmaddred_(bench_x, &n, bench_id, &n);
+    } else {
+        fmadddbl_(bench_x, &n);
+    }
+    return 0;
+}
+
+int feapreduce_(char* var, char* other, int* nother, int len, int olen)
+{
+    extern int fmredother_(double* y, int* len);
+    extern int fmreduce_(double* x, int* len, int* id, int* nneq, int* neq);
+    extern int fmnotfound_();
+    int n = (int) bench_n;
+    int* id;
+    int j;
+    if (len != 1 || (var[0] != 'X' && var[0] != 'x') ||
+        (*nother && (olen != 1 || (other[0] != 'X' && other[0] != 'x')))) {
+        fmnotfound_();
+        return 0;
+    }
+    if (*nother)
+        fmredother_(bench_x, &n);
+    id = (int*) malloc(n * sizeof(int));
+    for (j = 0; j < n; ++j)
+        id[j] = j+1;
+    fmreduce_(bench_x, &n, id, &n, &n);
+    free(id);
+    return 0;
+}
+
+int feapstat_(char* var, int len)
+{
+    extern int fmstatdbl_(double* data, int* len);
+    int n = (int) bench_n;
+    if (len == 1 && (var[0] == 'X' || var[0] == 'x'))
+        fmstatdbl_(bench_x, &n);
+    return 0;
+}
+
+int feapckpt_()
+{
+    extern int fmckdbl_(char* name, double* data, int* len, int* slot,
+                        int namelen);
+    int n = (int) bench_n, slot = 1;
+    fmckdbl_("X", bench_x, &n, &slot, 1);
+    return 0;
+}
+
+int feaprest_(int* mode)
+{
+    extern int fmrsnext_(char* name, int* prec, int* len, int* slot,
+                         int* more, int namelen);
+    extern int fmrsdbl_(double* data, int* len);
+    extern int fmrsskip_();
+    extern int fmrsbad_(char* name, int namelen);
+    char name[5];
+    int prec, len, slot, more;
+    for (;;) {
+        fmrsnext_(name, &prec, &len, &slot, &more, 5);
+        if (!more)
+            break;
+        if (name[0] != 'X' || name[1] != ' ' || prec != 2 || slot != 1) {
+            if (*mode == 0)
+                fmrsbad_(name, 5);
+            fmrsskip_();
+        } else if (*mode == 0) {
+            fmrsskip_();
+        } else {
+            if (len != bench_n)
+                bench_size(len);
+            fmrsdbl_(bench_x, &len);
+        }
+    }
+    return 0;
+}
+
+int feaptformed_()
+{
+    return 0;
+}
+
+int feapresid_(int* setu)
+{
+    extern int fmrecvred_(double* u, double* work, int* id, int* nneq);
+    extern int fmsenddbl_(double* data, int* len);
+    int n = (int) bench_n;
+    double* work;
+    if (*setu) {
+        work = (double*) malloc(n * sizeof(double));
+        fmrecvred_(bench_x, work, bench_id, &n);
+        free(work);
+    }
+    fmsenddbl_(bench_r, &bench_neq);
+    return 0;
+}
+
+int feapelmat_()
+{
+    extern int fmelbegin_(int* numel, int* nst, int* nneq, double* dr,
+                          int* n1, int* n2, int* isw);
+    extern int fmelmat_(double* s, double* p, int* ld);
+    extern int fmelend_(double* dr);
+    int nst = 2, n1, n2, isw, e;
+    fmelbegin_(&bench_neq, &nst, &bench_neq, bench_r, &n1, &n2, &isw);
+    for (e = n1; e <= n2; ++e) {
+        double s[4] = { e, -e, -e, e };
+        double p[2] = { e, -e };
+        int ld[2] = { e, (e < bench_neq) ? e+1 : 0 };
+        bench_r[e-1] += p[0];  /* FEAP assembles into DR */
+        fmelmat_(s, p, ld);
+    }
+    fmelend_(bench_r);
+    return 0;
+}
+
+int feappush_(char* var, int len)
+{
+    extern int fmpush_(double* x, int* len, int* id, int* nneq, int* neq);
+    extern int fmpushnone_();
+    int n = (int) bench_n;
+    int* id;
+    int j;
+    if (len != 1 || (var[0] != 'X' && var[0] != 'x')) {
+        fmpushnone_();
+        return 0;
+    }
+    id = (int*) malloc(n * sizeof(int));
+    for (j = 0; j < n; ++j)
+        id[j] = j+1;
+    fmpush_(bench_x, &n, id, &n, &n);
+    free(id);
+    return 0;
+}
+
+static int bench_is_tang(char* var)
+{
+    return (strncmp(var, "tang", 4) == 0 || strncmp(var, "utan", 4) == 0);
+}
+
+int matspew_(char* var, int* cnt)
+{
+    extern int writeaij_(int* i, int* j, double* aij, int* count);
+    int i, j, k;
+    if (!bench_is_tang(var))
+        return 0;
+    for (j = 1; j <= bench_neq; ++j) {
+        int top = (j > 1) ? bench_jp[j-2] : 0;
+        writeaij_(&j, &j, bench_a+j-1, cnt);
+        for (k = top; k < bench_jp[j-1]; ++k) {
+            i = j - (bench_jp[j-1] - k);
+            writeaij_(&i, &j, bench_a+bench_neq+k, cnt);
+            writeaij_(&j, &i, bench_a+bench_neq+k, cnt);
+        }
+    }
+    return 0;
+}
+
+int matprof_(char* var, int len)
+{
+    extern int fmprofile_(int* neq, int* jp, double* ad, double* al,
+                          int* sym);
+    extern int fmnoprof_();
+    int sym = 1;
+    if (bench_is_tang(var))
+        fmprofile_(&bench_neq, bench_jp, bench_a, bench_a+bench_neq, &sym);
+    else
+        fmnoprof_();
+    return 0;
+}
+
+int matexp_(char* var, int len)
+{
+    extern int fmspexprof_(int* neq, int* jp, double* ad, double* al);
+    extern int fmspexnone_();
+    if (bench_is_tang(var))
+        fmspexprof_(&bench_neq, bench_jp, bench_a, bench_a+bench_neq);
+    else
+        fmspexnone_();
+    return 0;
+}
+
+/*@T
+ * \subsection{The FEAP conversation}
+ *
+ * The main routine plays the part of the FEAP front end, the
+ * [[filnam]] dialog, and the macro loop, with the same calls to
+ * [[feapsync]], the template hooks, and the interrupt hooks that the
+ * modified FEAP routines make (see [[tinput.f]] and [[cleannam.f]]).
+ * Console lines come from the macro queue when it is not empty.
+ *
+ *@c*/
+static int bench_gets(char* buf, int n)
+{
+    if (fgets(buf, n, stdin) == NULL)
+        return 0;
+    buf[strcspn(buf, "\r\n")] = '\0';
+    return 1;
+}
+
+static int bench_prompt(char* buf, int n)
+{
+    extern int feapsync_(int* marker);
+    extern int feapqlabel_();
+    extern int feapqnext_(char* buf, int len);
+    int label = feapqlabel_();
+    feapsync_(&label);
+    if (feapqnext_(buf, n-1)) {
+        int k = n-1;
+        while (k > 0 && buf[k-1] == ' ')
+            --k;
+        buf[k] = '\0';
+        return 1;
+    }
+    return bench_gets(buf, n);
+}
+
+int main(int argc, char** argv)
+{
+    extern int feapserver_();
+    extern int feapsrv_();
+    extern int feapsync_(int* marker);
+    extern int feaptmpldeck_(char* name, int len);
+    extern int feaptmplparse_();
+    extern int feaptmplready_();
+    extern int feapintrprompt_();
+    extern int feapintrrun_();
+    extern int feapprofbegin_(char* tx1, char* tx2, int len1, int len2);
+    extern int feapprofend_();
+    extern int feapprofwait_();
+    extern int feappushstep_();
+    extern int feappushmacro_(char* name, int len);
+    extern int feappushdone_();
+    char buf[256];
+    int zero = 0, one = 1;
+
+    feapserver_();
+    feapsrv_();
+
+    feapsync_(&zero);
+    if (!bench_gets(buf, sizeof(buf)))
+        return 0;
+    feaptmpldeck_(buf, strlen(buf));
+    feaptmplparse_();
+    bench_size(argc > 1 ? atol(argv[1]) : BENCH_DEFAULT);
+    printf("   Files are set as:   Input  (read ) : %s\n", buf);
+    feapsync_(&zero);
+    if (!bench_gets(buf, sizeof(buf)))
+        return 0;
+
+    for (;;) {
+        feappushdone_();
+        feapprofend_();
+        feaptmplready_();
+        feapintrprompt_();
+        feapprofwait_();
+        if (!bench_prompt(buf, sizeof(buf)))
+            return 0;
+        feapprofbegin_(buf, "", strlen(buf), 0);
+        feappushmacro_(buf, strcspn(buf, " ,"));
+        feapintrrun_();
+        if (strcmp(buf, "serv") == 0) {
+            feapsrv_();
+        } else if (strcmp(buf, "serv,push") == 0) {
+            feappushstep_();
+        } else if (strncmp(buf, "step ", 5) == 0) {
+            long j, k, nstep = atol(buf+5);
+            for (k = 0; k < nstep; ++k) {
+                bench_ttim += 1;
+                for (j = 0; j < bench_n; ++j)
+                    bench_x[j] += 1;
+                feappushstep_();
+            }
+            printf("   Time %g\n", bench_ttim);
+        } else if (strncmp(buf, "size ", 5) == 0) {
+            bench_size(atol(buf+5));
+            printf("   Size %ld\n", bench_n);
+        } else if (strncmp(buf, "sleep ", 6) == 0) {
+            memset(bench_x, 0, bench_n * sizeof(double));
+            sleep(atoi(buf+6));
+        } else if (strcmp(buf, "quit") == 0 || strcmp(buf, "q") == 0) {
+            bench_prompt(buf, sizeof(buf));
+            feapsync_(&one);
+            return 0;
+        } else {
+            printf("   Macro %s\n", buf);
+        }
+    }
+}
@@ -0,0 +1,357 @@
+/*
+ * FEAP checkpoint / restore
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+
+#define CKPT_MAGIC   "MATFEAPC"
+#define CKPT_VERSION 2
+#define CKPT_BUFSIZ  (1 << 22)
+
+/*@T
+ * \section{Checkpoint and restore}
+ *
+ * Rebuilding a large model from its input deck can take much longer
+ * than the computation the client actually wants to do.  The
+ * [[checkpoint PATH]] command in the [[feapsrv]] interface writes the
+ * state of a running FEAP process to a binary image, and
+ * [[restore PATH]] reads it back into a running process, which need
+ * not have read the same input deck (any deck will do to get FEAP to
+ * its macro prompt).  The image holds
+ * \begin{enumerate}
+ * \item a header with a magic string, a format version, and the sizes
+ *   of integers and doubles on the writing machine;
+ * \item every scalar in the [[feapsrv]] registry, as a name and a
+ *   double value;
+ * \item every array in FEAP's dynamic memory dictionary, as a name,
+ *   a precision (1 for integer, 2 for double), the FEAP pointer slot
+ *   that holds it, a length, and the raw data; and
+ * \item an end record.
+ * \end{enumerate}
+ * Data are written in host format, since a checkpoint is only useful
+ * to a FEAP binary built the same way.  The arrays are moved with
+ * single large [[fwrite]] and [[fread]] calls directly from and to
+ * FEAP's memory, through a large stream buffer.
+ *
+ * On restore, each array in the image is matched by name against the
+ * arrays of the current process.  Arrays that are missing, or whose
+ * length or precision differ, are allocated again in their slot before
+ * the data are read; arrays of the current process that are not in the
+ * image are left alone.  The image is checked before anything is
+ * changed, and if some array cannot be rebuilt (its slot is unknown, or
+ * its length does not fit in a FEAP integer), the restore is refused
+ * with {\tt Cannot restore {\it name}}.  The scalars are restored
+ * before the arrays, except for the I/O unit numbers [[ior]] and
+ * [[iow]], which belong to the current process.  The server reports
+ * the outcome in one line: {\tt Checkpoint {\it narrays} {\it nbytes}}
+ * or {\tt Restore {\it narrays} {\it nskipped}}, or an error message.
+ *
+ * The FORTRAN routines [[feapckpt]] and [[feaprest]] walk the FEAP
+ * memory dictionary; the C routines below handle the file.
+ *
+ *@c*/
+typedef struct ckpt_header_t {
+    char    magic[8];
+    int32_t version;
+    int32_t sizeof_int;
+    int32_t sizeof_double;
+    int32_t nscalars;
+} ckpt_header_t;
+
+typedef struct ckpt_array_t {
+    char    name[8];
+    int32_t prec;
+    int32_t slot;             /* np index > 0, -(up index) < 0, or 0 */
+    int64_t len;
+} ckpt_array_t;
+
+static FILE* ckpt_fp;
+static char* ckpt_buf;
+static int   ckpt_count;
+static int   ckpt_skipped;
+static int   ckpt_bad;
+static int   ckpt_short;
+static char  ckpt_badname[8];
+static long long ckpt_bytes;
+static ckpt_array_t ckpt_rec;   /* Record being restored */
+
+static int ckpt_open(const char* path, const char* mode)
+{
+    ckpt_fp = fopen(path, mode);
+    if (ckpt_fp == NULL) {
+        printf("Could not open %s\n", path);
+        return 0;
+    }
+    ckpt_buf = malloc(CKPT_BUFSIZ);
+    if (ckpt_buf)
+        setvbuf(ckpt_fp, ckpt_buf, _IOFBF, CKPT_BUFSIZ);
+    ckpt_count   = 0;
+    ckpt_skipped = 0;
+    ckpt_bad     = 0;
+    ckpt_short   = 0;
+    ckpt_bytes   = 0;
+    return 1;
+}
+
+static int ckpt_close()
+{
+    int ok = (ferror(ckpt_fp) == 0);
+    if (fclose(ckpt_fp) != 0)
+        ok = 0;
+    free(ckpt_buf);
+    ckpt_fp  = NULL;
+    ckpt_buf = NULL;
+    return ok;
+}
+
+static size_t ckpt_width(int prec)
+{
+    return (prec == 1) ? sizeof(int) : sizeof(double);
+}
+
+static void ckpt_name(char* dst, const char* src, int n)
+{
+    int i;
+    memset(dst, 0, 8);
+    for (i = 0; i < 8 && i < n && src[i] != ' ' && src[i] != '\0'; ++i)
+        dst[i] = src[i];
+}
+
+/*@T
+ * \subsection{Writing a checkpoint}
+ *
+ * The [[fmckint]] and [[fmckdbl]] routines are called from
+ * [[feapckpt]] once for each integer or double array in the FEAP
+ * dictionary.  A length that FEAP could not hand back on restore (a
+ * negative one) spoils the checkpoint rather than being written.
+ *
+ *@c*/
+static void ckpt_write_array(char* name, int namelen, int prec,
+                             void* data, int* len, int* slot)
+{
+    ckpt_array_t rec;
+    size_t nbytes;
+
+    memset(&rec, 0, sizeof(rec));
+    ckpt_name(rec.name, name, namelen);
+    if (*len < 0) {
+        if (!ckpt_bad++)
+            memcpy(ckpt_badname, rec.name, 8);
+        return;
+    }
+    nbytes = ckpt_width(prec) * (size_t) *len;
+    rec.prec = prec;
+    rec.slot = *slot;
+    rec.len  = *len;
+    fwrite(&rec, sizeof(rec), 1, ckpt_fp);
+    fwrite(data, 1, nbytes, ckpt_fp);
+    ++ckpt_count;
+    ckpt_bytes += nbytes;
+}
+
+int fmckint_(char* name, int* data, int* len, int* slot, int namelen)
+{
+    ckpt_write_array(name, namelen, 1, data, len, slot);
+    return 0;
+}
+
+int fmckdbl_(char* name, double* data, int* len, int* slot, int namelen)
+{
+    ckpt_write_array(name, namelen, 2, data, len, slot);
+    return 0;
+}
+
+void feapsrv_checkpoint(const char* path)
+{
+    extern int feapckpt_();
+    extern int feapsrv_scalar_count();
+    extern const char* feapsrv_scalar_name(int i);
+    extern double feapsrv_scalar_value(int i);
+    ckpt_header_t hdr;
+    ckpt_array_t  end;
+    int i;
+
+    if (!ckpt_open(path, "wb"))
+        return;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CKPT_MAGIC, 8);
+    hdr.version       = CKPT_VERSION;
+    hdr.sizeof_int    = sizeof(int);
+    hdr.sizeof_double = sizeof(double);
+    hdr.nscalars      = feapsrv_scalar_count();
+    fwrite(&hdr, sizeof(hdr), 1, ckpt_fp);
+    for (i = 0; i < hdr.nscalars; ++i) {
+        char name[8];
+        double val = feapsrv_scalar_value(i);
+        const char* sname = feapsrv_scalar_name(i);
+        ckpt_name(name, sname, strlen(sname));
+        fwrite(name, 8, 1, ckpt_fp);
+        fwrite(&val, sizeof(double), 1, ckpt_fp);
+    }
+
+    feapckpt_();
+
+    memset(&end, 0, sizeof(end));
+    fwrite(&end, sizeof(end), 1, ckpt_fp);
+    if (!ckpt_close())
+        printf("Error writing %s\n", path);
+    else if (ckpt_bad)
+        printf("Cannot checkpoint %.8s\n", ckpt_badname);
+    else
+        printf("Checkpoint %d %lld\n", ckpt_count, ckpt_bytes);
+}
+
+/*@T
+ * \subsection{Restoring a checkpoint}
+ *
+ * Restoring is driven from the FORTRAN side: [[feaprest]] calls
+ * [[fmrsnext]] to get the name, precision, slot, and length of the
+ * next array in the image (the returned flag is zero at the end
+ * record), looks the array up with [[pgetd]], and then calls
+ * [[fmrsint]] or [[fmrsdbl]] to read the data into place, or
+ * [[fmrsskip]] to pass over it.  In the checking pass, it calls
+ * [[fmrsbad]] for each array it could not rebuild.  A length that does
+ * not fit in a FEAP integer is caught here and counts as bad.
+ *
+ *@c*/
+int fmrsnext_(char* name, int* prec, int* len, int* slot, int* more,
+              int namelen)
+{
+    int i;
+    *more = 0;
+    if (fread(&ckpt_rec, sizeof(ckpt_rec), 1, ckpt_fp) != 1) {
+        ckpt_short = 1;
+        return 0;
+    }
+    if (ckpt_rec.name[0] == '\0')
+        return 0;
+    for (i = 0; i < namelen; ++i)
+        name[i] = (i < 8 && ckpt_rec.name[i]) ? ckpt_rec.name[i] : ' ';
+    *prec = ckpt_rec.prec;
+    *slot = ckpt_rec.slot;
+    if (ckpt_rec.len < 0 || ckpt_rec.len > INT_MAX ||
+        (ckpt_rec.prec != 1 && ckpt_rec.prec != 2)) {
+        *len  = 0;
+        *slot = 0;
+        *prec = 0;
+    } else {
+        *len  = (int) ckpt_rec.len;
+    }
+    *more = 1;
+    return 0;
+}
+
+int fmrsbad_(char* name, int namelen)
+{
+    if (!ckpt_bad++)
+        ckpt_name(ckpt_badname, name, namelen);
+    return 0;
+}
+
+static void ckpt_read_array(void* data, size_t nbytes)
+{
+    if (fread(data, 1, nbytes, ckpt_fp) == nbytes) {
+        ++ckpt_count;
+        ckpt_bytes += nbytes;
+    }
+}
+
+int fmrsint_(int* data, int* len)
+{
+    ckpt_read_array(data, sizeof(int) * (size_t) *len);
+    return 0;
+}
+
+int fmrsdbl_(double* data, int* len)
+{
+    ckpt_read_array(data, sizeof(double) * (size_t) *len);
+    return 0;
+}
+
+int fmrsskip_()
+{
+    if (ckpt_rec.len > 0)
+        fseeko(ckpt_fp, (off_t) (ckpt_width(ckpt_rec.prec) * ckpt_rec.len),
+               SEEK_CUR);
+    ++ckpt_skipped;
+    return 0;
+}
+
+/*@T
+ * The image is read twice: once to check it, with the scalars read
+ * but not yet assigned, and once to restore it.
+ *
+ *@c*/
+void feapsrv_restore(const char* path)
+{
+    extern int feaprest_(int* mode);
+    extern int feapsrv_scalar_assign(const char* name, double val);
+    ckpt_header_t hdr;
+    char (*names)[9] = NULL;
+    double* vals = NULL;
+    int i, nscalars = 0, mode;
+    off_t start;
+
+    if (!ckpt_open(path, "rb"))
+        return;
+
+    if (fread(&hdr, sizeof(hdr), 1, ckpt_fp) != 1 ||
+        memcmp(hdr.magic, CKPT_MAGIC, 8) != 0 ||
+        hdr.version != CKPT_VERSION ||
+        hdr.sizeof_int != sizeof(int) ||
+        hdr.sizeof_double != sizeof(double) ||
+        hdr.nscalars < 0) {
+        printf("Not a compatible checkpoint: %s\n", path);
+        ckpt_close();
+        return;
+    }
+    names = malloc((hdr.nscalars+1) * sizeof(*names));
+    vals  = malloc((hdr.nscalars+1) * sizeof(double));
+    for (i = 0; names && vals && i < hdr.nscalars; ++i) {
+        names[i][8] = 0;
+        if (fread(names[i], 8, 1, ckpt_fp) != 1 ||
+            fread(vals+i, sizeof(double), 1, ckpt_fp) != 1)
+            break;
+    }
+    nscalars = i;
+
+    start = ftello(ckpt_fp);
+    mode = 0;
+    if (names && vals && nscalars == hdr.nscalars)
+        feaprest_(&mode);
+    else
+        ckpt_short = 1;
+    if (ckpt_short || ckpt_bad) {
+        if (ckpt_short)
+            printf("Not a compatible checkpoint: %s\n", path);
+        else
+            printf("Cannot restore %.8s from %s\n", ckpt_badname, path);
+        ckpt_close();
+        free(names);
+        free(vals);
+        return;
+    }
+
+    for (i = 0; i < nscalars; ++i)
+        if (strcmp(names[i], "ior") && strcmp(names[i], "iow"))
+            feapsrv_scalar_assign(names[i], vals[i]);
+    free(names);
+    free(vals);
+
+    fseeko(ckpt_fp, start, SEEK_SET);
+    ckpt_count   = 0;
+    ckpt_skipped = 0;
+    ckpt_bytes   = 0;
+    mode = 1;
+    feaprest_(&mode);
+
+    if (ckpt_close())
+        printf("Restore %d %d\n", ckpt_count, ckpt_skipped);
+    else
+        printf("Error reading %s\n", path);
+}
@@ -0,0 +1,398 @@
+/*
+ * FEAP console output routing
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+
+/*@T
+ * \section{Console output}
+ *
+ * Ordinarily FEAP's console output (everything FEAP writes to the
+ * FORTRAN unit [[*]]) goes down the same stream as the MATFEAP
+ * protocol, and the client has to read and discard every line of it
+ * while it waits for a synchronization message.  For long transient
+ * runs, that can be megabytes per step.  The
+ * \begin{verbatim}
+ *   console MODE [ARG]
+ * \end{verbatim}
+ * command in the [[feapsrv]] interface sends the console output
+ * somewhere else, so that the control stream carries only protocol
+ * messages.  The modes are
+ * \begin{itemize}
+ * \item [[inline]] -- console output goes to the control stream
+ *   (the default);
+ * \item [[discard]] -- console output is thrown away;
+ * \item [[ring N]] -- the last [[N]] bytes of console output
+ *   (64 KB by default) are kept in a ring buffer on the server,
+ *   and can be fetched with [[console dump]];
+ * \item [[file PATH]] -- console output is appended to a file, which
+ *   may also be a named pipe or a terminal device read by some other
+ *   process.
+ * \end{itemize}
+ * The server answers each [[console]] command with a single line
+ * {\tt Console {\it mode}}, or an error message.
+ *
+ * The file name dialog at the start of a run relies on FEAP's console
+ * messages, so a client should switch the console only after the
+ * input deck has been accepted.  MATFEAP's own FORTRAN messages (such
+ * as the ``Not found'' response to [[getm]]) go through C routines
+ * and so stay on the control stream in every mode.
+ *
+ *@c*/
+#define CONS_INLINE  0
+#define CONS_DISCARD 1
+#define CONS_RING    2
+#define CONS_FILE    3
+
+#define CONS_RING_DEFAULT 65536
+#define CONS_LINE_MAX     1000
+
+static const char* cons_names[] = { "inline", "discard", "ring", "file" };
+
+static int cons_mode = CONS_INLINE;
+static int cons_ctl  = -1;
+
+
+/*@T
+ * \subsection{Separating the streams}
+ *
+ * Both C and FORTRAN write to file descriptor 1.  To separate them, we
+ * make a duplicate of the control descriptor and point the C [[stdout]]
+ * stream at the duplicate, which frees descriptor 1 to be pointed at
+ * whatever sink the console is going to.  The C stream has to be
+ * flushed first so that nothing already written ends up in the wrong
+ * place.  This is done the first time the console mode is changed;
+ * after that, switching modes only moves descriptor 1.
+ *
+ *@c*/
+static int cons_separate()
+{
+    FILE* ctl;
+    if (cons_ctl >= 0)
+        return 1;
+    fflush(stdout);
+    cons_ctl = dup(1);
+    if (cons_ctl < 0)
+        return 0;
+    ctl = fdopen(cons_ctl, "w");
+    if (ctl == NULL) {
+        close(cons_ctl);
+        cons_ctl = -1;
+        return 0;
+    }
+    stdout = ctl;
+    return 1;
+}
+
+
+/*@T
+ * \subsection{The ring buffer}
+ *
+ * In ring mode, descriptor 1 is the write end of a pipe, and a
+ * helper thread reads from the other end into a circular buffer.
+ * We cannot count on seeing end of file on the pipe when the ring is
+ * stopped, since a forked process (such as the interrupt spare in
+ * [[feapintr.c]]) may still hold a copy of the write end.  Instead,
+ * the thread also watches a second pipe, and [[cons_ring_stop]] wakes
+ * it by writing a byte there.
+ *
+ * The read end of the console pipe is non-blocking, and every read
+ * from it happens in [[cons_drain]] with the lock held.  The helper
+ * thread waits in [[poll]] without the lock, so [[console dump]] can
+ * drain the pipe itself and know that no bytes are in flight.
+ *
+ *@c*/
+static pthread_t       cons_thread;
+static pthread_mutex_t cons_lock = PTHREAD_MUTEX_INITIALIZER;
+static char*  cons_ring;
+static size_t cons_size;
+static size_t cons_head;
+static size_t cons_fill;
+static int    cons_pipe = -1;
+static int    cons_wake[2] = { -1, -1 };
+
+/* Read what is in the pipe; return 0 at end of file */
+static int cons_drain()
+{
+    char buf[4096];
+    ssize_t n, k;
+    while ((n = read(cons_pipe, buf, sizeof(buf))) != 0) {
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return 1;
+        for (k = 0; k < n; ++k) {
+            cons_ring[cons_head] = buf[k];
+            cons_head = (cons_head + 1) % cons_size;
+        }
+        cons_fill = (cons_fill + n > cons_size) ? cons_size : cons_fill + n;
+    }
+    return 0;
+}
+
+static void* cons_reader(void* arg)
+{
+    struct pollfd fds[2];
+    int more = 1;
+
+    fds[0].fd     = cons_pipe;
+    fds[0].events = POLLIN;
+    fds[1].fd     = cons_wake[0];
+    fds[1].events = POLLIN;
+    while (more) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        pthread_mutex_lock(&cons_lock);
+        more = cons_drain();
+        pthread_mutex_unlock(&cons_lock);
+    }
+    return NULL;
+}
+
+static void cons_ring_stop()
+{
+    if (cons_pipe < 0)
+        return;
+    write(cons_wake[1], "", 1);
+    pthread_join(cons_thread, NULL);
+    close(cons_pipe);
+    close(cons_wake[0]);
+    close(cons_wake[1]);
+    cons_pipe = -1;
+}
+
+static int cons_ring_start(size_t size, int* sink)
+{
+    int fds[2];
+    char* ring = (char*) malloc(size);
+    if (ring == NULL || pipe(fds) < 0) {
+        free(ring);
+        return 0;
+    }
+    if (pipe(cons_wake) < 0) {
+        free(ring);
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    free(cons_ring);
+    cons_ring = ring;
+    cons_size = size;
+    cons_head = 0;
+    cons_fill = 0;
+    cons_pipe = fds[0];
+    if (pthread_create(&cons_thread, NULL, cons_reader, NULL) != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        close(cons_wake[0]);
+        close(cons_wake[1]);
+        cons_pipe = -1;
+        return 0;
+    }
+    *sink = fds[1];
+    return 1;
+}
+
+
+/*@T
+ * The [[console dump]] command sends the contents of the ring buffer
+ * as {\tt Console {\it nlines}} followed by that many lines of text,
+ * and then empties the buffer.  Long lines are broken into pieces so
+ * that clients with a fixed line buffer stay in step.  The FORTRAN
+ * side is asked to flush its console unit first, and whatever that
+ * put in the pipe is drained before the ring is copied, so the dump
+ * is up to date.
+ *
+ *@c*/
+static void cons_dump()
+{
+    extern int feapflush_();
+    size_t start, k, len, nlines = 0;
+    char* text;
+
+    if (cons_mode != CONS_RING) {
+        printf("Console 0\n");
+        return;
+    }
+    feapflush_();
+
+    pthread_mutex_lock(&cons_lock);
+    cons_drain();
+    len   = cons_fill;
+    start = (cons_head + cons_size - cons_fill) % cons_size;
+    text  = (char*) malloc(len+1);
+    for (k = 0; text && k < len; ++k)
+        text[k] = cons_ring[(start + k) % cons_size];
+    cons_fill = 0;
+    pthread_mutex_unlock(&cons_lock);
+    if (text == NULL) {
+        printf("Console 0\n");
+        return;
+    }
+
+    /* Count the output lines, splitting long ones */
+    for (k = 0, start = 0; k < len; ++k) {
+        if (text[k] == '\n' || k-start == CONS_LINE_MAX) {
+            ++nlines;
+            start = (text[k] == '\n') ? k+1 : k;
+        }
+    }
+    if (start < len)
+        ++nlines;
+
+    printf("Console %d\n", (int) nlines);
+    for (k = 0, start = 0; k < len; ++k) {
+        if (text[k] == '\n' || k-start == CONS_LINE_MAX) {
+            fwrite(text+start, 1, k-start, stdout);
+            putchar('\n');
+            start = (text[k] == '\n') ? k+1 : k;
+        }
+    }
+    if (start < len) {
+        fwrite(text+start, 1, len-start, stdout);
+        putchar('\n');
+    }
+    free(text);
+}
+
+
+/*@T
+ * \subsection{Switching modes}
+ *
+ * A switch to ring mode points descriptor 1 at [[/dev/null]] and stops
+ * any old ring before starting the new one.  If the new ring cannot be
+ * started, the console is left discarded.
+ *
+ *@c*/
+void feapsrv_console(const char* mode, const char* arg)
+{
+    extern int feapflush_();
+    int sink = -1, newmode;
+
+    if (mode == NULL) {
+        printf("Console %s\n", cons_names[cons_mode]);
+        return;
+    } else if (strcmp(mode, "dump") == 0) {
+        cons_dump();
+        return;
+    } else if (strcmp(mode, "inline") == 0) {
+        newmode = CONS_INLINE;
+    } else if (strcmp(mode, "discard") == 0) {
+        newmode = CONS_DISCARD;
+    } else if (strcmp(mode, "ring") == 0) {
+        newmode = CONS_RING;
+    } else if (strcmp(mode, "file") == 0 && arg != NULL) {
+        newmode = CONS_FILE;
+    } else {
+        printf("Unknown console mode\n");
+        return;
+    }
+
+    if (!cons_separate()) {
+        printf("Could not separate console output\n");
+        return;
+    }
+
+    if (newmode == CONS_INLINE)
+        sink = dup(cons_ctl);
+    else if (newmode == CONS_DISCARD)
+        sink = open("/dev/null", O_WRONLY);
+    else if (newmode == CONS_FILE)
+        sink = open(arg, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (sink < 0 && newmode != CONS_RING) {
+        perror("console");
+        printf("Could not open console sink\n");
+        return;
+    }
+
+    feapflush_();
+    if (newmode == CONS_RING) {
+        size_t size = arg ? (size_t) atol(arg) : 0;
+        int devnull = open("/dev/null", O_WRONLY);
+        /* Let go of the old sink and ring before starting a new one */
+        if (devnull >= 0) {
+            dup2(devnull, 1);
+            close(devnull);
+        }
+        cons_ring_stop();
+        if (!cons_ring_start(size > 0 ? size : CONS_RING_DEFAULT, &sink)) {
+            cons_mode = CONS_DISCARD;
+            printf("Could not start console ring buffer\n");
+            return;
+        }
+    }
+    dup2(sink, 1);
+    close(sink);
+    if (newmode != CONS_RING)
+        cons_ring_stop();
+
+    cons_mode = newmode;
+    printf("Console %s\n", cons_names[cons_mode]);
+}
+
+
+/*@T
+ * A forked process has only the thread that called [[fork]], so the
+ * interrupt spare (see [[feapintr.c]]) starts out with nobody reading
+ * the console pipe, and with [[cons_lock]] in whatever state the
+ * reader left it.  Once the pipe filled up, the first large write
+ * would block the new session for good.  When a spare takes over, it
+ * calls [[feapcons_takeover]] to reset the lock and start a reader of
+ * its own.  The wake pipe is replaced as well, since the old session
+ * holds the same one.  The ring keeps whatever it held at the fork.
+ * If the reader cannot be started, the console falls back to discard
+ * mode, as when [[console ring]] fails.
+ *
+ *@c*/
+void feapcons_takeover()
+{
+    if (cons_mode != CONS_RING || cons_pipe < 0)
+        return;
+    pthread_mutex_init(&cons_lock, NULL);
+    close(cons_wake[0]);
+    close(cons_wake[1]);
+    if (pipe(cons_wake) < 0 ||
+        pthread_create(&cons_thread, NULL, cons_reader, NULL) != 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, 1);
+            close(devnull);
+        }
+        close(cons_pipe);
+        cons_pipe = -1;
+        cons_mode = CONS_DISCARD;
+        printf("Could not restart console ring buffer\n");
+    }
+}
+
+
+/*@T
+ * The [[reset]] command (see [[feapreset.c]]) calls [[feapcons_restore]]
+ * to put the control stream back on descriptor 1 before it replaces
+ * the process image, since the new image writes its protocol there.
+ *
+ *@c*/
+void feapcons_restore()
+{
+    extern int feapflush_();
+    if (cons_ctl < 0)
+        return;
+    feapflush_();
+    fflush(stdout);
+    dup2(cons_ctl, 1);
+    cons_ring_stop();
+    cons_mode = CONS_INLINE;
+}
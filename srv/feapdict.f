@@ -0,0 +1,118 @@
+c     @T
+c     \section{Walking the FEAP memory dictionary}
+c
+c     The [[feapckpt]] and [[feaprest]] routines do the FORTRAN side
+c     of the [[checkpoint]] and [[restore]] commands.  FEAP keeps the
+c     names of all its dynamically allocated arrays in a dictionary
+c     ([[dict]], with [[ndict]] entries); we look each one up with
+c     [[pgetd]] and hand the data to the C routines that do the file
+c     I/O.  Along with each array we record its slot, the index of the
+c     pointer that holds it: positive for [[np]], negative for [[up]],
+c     and zero if we cannot find it.
+c
+c     On restore, an array that is missing from the current process,
+c     or that has a different length or precision, is allocated again
+c     in its slot with [[palloc]] (or [[ualloc]] for the user arrays),
+c     and then read back.  [[feaprest]] is called twice: first with
+c     [[mode]] zero, to check that every array can be rebuilt (any one
+c     that cannot is reported through [[fmrsbad]], and nothing is
+c     changed), and then with [[mode]] one to do the work.
+c
+c     As with [[feapgetm]], there are two variants of these routines;
+c     the one in [[feapdict7.f]] is for FEAP versions before 8.0, where
+c     pointers are always 32-bit integers.  Since the older [[pointer.h]]
+c     does not define [[num_nps]] and [[num_ups]], the sizes of [[np]]
+c     and [[up]] are given there as [[mxnp]] and [[mxup]].
+c
+c     @c
+      subroutine feapckpt()
+c     @q
+
+      implicit  none
+
+      include 'allotd.h'
+      include 'allotn.h'
+      include 'comblk.h'
+      include 'pointer.h'
+      include 'p_point.h'
+
+      logical flag
+      integer i, j, lengt, prec, slot
+
+      save
+
+c     @c
+      do i = 1,ndict
+        call pgetd( dict(i), point, lengt, prec, flag )
+        if(flag) then
+          slot = 0
+          do j = num_ups,1,-1
+            if(up(j).eq.point) slot = -j
+          end do ! j
+          do j = num_nps,1,-1
+            if(np(j).eq.point) slot = j
+          end do ! j
+          if(prec.eq.1) then
+            call fmckint(dict(i), mr(point), lengt, slot)
+          else
+            call fmckdbl(dict(i), hr(point), lengt, slot)
+          endif
+        endif
+      end do ! i
+
+      end
+
+      subroutine feaprest(mode)
+c     @q
+
+      implicit  none
+
+      include 'comblk.h'
+      include 'pointer.h'
+      include 'p_point.h'
+
+      character name*5
+      logical flag, same, setvar, palloc, ualloc
+      integer mode, lengt, prec, slot, lcur, pcur, more
+
+      save
+
+c     @c
+100   call fmrsnext(name, prec, lengt, slot, more)
+      if(more.ne.0) then
+        call pgetd( name, point, lcur, pcur, flag )
+        same = flag .and. lcur.eq.lengt .and. pcur.eq.prec
+        if(mode.eq.0) then
+          if(.not.same .and. (slot.eq.0 .or. slot.gt.num_nps
+     &                        .or. -slot.gt.num_ups)) then
+            call fmrsbad(name)
+          endif
+        elseif(.not.same) then
+          if(flag .and. pcur.ne.prec) then
+            if(slot.gt.0) then
+              setvar = palloc( slot, name, 0, pcur)
+            else
+              setvar = ualloc(-slot, name, 0, pcur)
+            endif
+          endif
+          if(slot.gt.0) then
+            setvar = palloc( slot, name, lengt, prec)
+          else
+            setvar = ualloc(-slot, name, lengt, prec)
+          endif
+          call pgetd( name, point, lcur, pcur, flag )
+          same = flag .and. lcur.eq.lengt .and. pcur.eq.prec
+        endif
+        if(mode.ne.0 .and. same) then
+          if(prec.eq.1) then
+            call fmrsint(mr(point), lengt)
+          else
+            call fmrsdbl(hr(point), lengt)
+          endif
+        else
+          call fmrsskip()
+        endif
+        go to 100
+      endif
+
+      end
@@ -0,0 +1,93 @@
+      subroutine feapckpt()
+c     @q
+
+      implicit  none
+
+      include 'allotd.h'
+      include 'allotn.h'
+      include 'comblk.h'
+      include 'pointer.h'
+
+      logical flag
+      integer i, j, lengt, prec, slot, point
+      integer mxnp, mxup
+      parameter (mxnp = 200, mxup = 200)
+
+      save
+
+c     @c
+      do i = 1,ndict
+        call pgetd( dict(i), point, lengt, prec, flag )
+        if(flag) then
+          slot = 0
+          do j = mxup,1,-1
+            if(up(j).eq.point) slot = -j
+          end do ! j
+          do j = mxnp,1,-1
+            if(np(j).eq.point) slot = j
+          end do ! j
+          if(prec.eq.1) then
+            call fmckint(dict(i), mr(point), lengt, slot)
+          else
+            call fmckdbl(dict(i), hr(point), lengt, slot)
+          endif
+        endif
+      end do ! i
+
+      end
+
+      subroutine feaprest(mode)
+c     @q
+
+      implicit  none
+
+      include 'comblk.h'
+      include 'pointer.h'
+
+      character name*5
+      logical flag, same, setvar, palloc, ualloc
+      integer mode, lengt, prec, slot, lcur, pcur, more, point
+      integer mxnp, mxup
+      parameter (mxnp = 200, mxup = 200)
+
+      save
+
+c     @c
+100   call fmrsnext(name, prec, lengt, slot, more)
+      if(more.ne.0) then
+        call pgetd( name, point, lcur, pcur, flag )
+        same = flag .and. lcur.eq.lengt .and. pcur.eq.prec
+        if(mode.eq.0) then
+          if(.not.same .and. (slot.eq.0 .or. slot.gt.mxnp
+     &                        .or. -slot.gt.mxup)) then
+            call fmrsbad(name)
+          endif
+        elseif(.not.same) then
+          if(flag .and. pcur.ne.prec) then
+            if(slot.gt.0) then
+              setvar = palloc( slot, name, 0, pcur)
+            else
+              setvar = ualloc(-slot, name, 0, pcur)
+            endif
+          endif
+          if(slot.gt.0) then
+            setvar = palloc( slot, name, lengt, prec)
+          else
+            setvar = ualloc(-slot, name, lengt, prec)
+          endif
+          call pgetd( name, point, lcur, pcur, flag )
+          same = flag .and. lcur.eq.lengt .and. pcur.eq.prec
+        endif
+        if(mode.ne.0 .and. same) then
+          if(prec.eq.1) then
+            call fmrsint(mr(point), lengt)
+          else
+            call fmrsdbl(hr(point), lengt)
+          endif
+        else
+          call fmrsskip()
+        endif
+        go to 100
+      endif
+
+      end
@@ -0,0 +1,63 @@
+c     @T
+c     \section{The element loop}
+c
+c     The [[feapelmat]] routine does the FEAP side of the [[elmat]]
+c     command in the [[feapsrv]] interface (see [[feapelmat.c]]).  We
+c     call [[formfe]] one element at a time, the same way FEAP's
+c     [[tang]] and [[form]] macros call it for the whole mesh, and
+c     after each call hand FEAP's element arrays to [[fmelmat]]: the
+c     tangent [[S]] ([[np(36)]]), the residual [[P]] ([[np(35)]]), and
+c     the local equation numbers [[LD]] ([[np(34)]]).  The arrays are
+c     cleared first, so an element that FEAP skips (for instance, one
+c     in an inactive material set) is sent as zeros.
+c
+c     [[formfe]] also assembles the element residuals into [[DR]] (as
+c     in [[feapresid]], but without the nodal loads), so [[fmelbegin]]
+c     saves a copy of [[DR]] and [[fmelend]] puts it back, and we keep
+c     the ``residual formed'' flag [[fl(8)]] as it was.  A residual the
+c     user formed before the export is still there afterward.  Nothing
+c     is assembled into the tangent.
+c
+c     The call uses the [[formfe]] argument list of FEAP 8.0 and later
+c     (and FEAPpv): pointers to the solution and the three assembly
+c     arrays, the three assembly flags, the element switch, and the
+c     element range with its stride.  It is the same call that
+c     [[feapresid]] makes.  Both files are built only for FEAP 8.0
+c     and later; the FEAP 7.x builds ([[MFEAPVER=$(VER7)]]) get the
+c     stubs in [[feapelem7.f]] instead.
+c
+c     @c
+      subroutine feapelmat()
+c     @q
+
+      implicit  none
+
+      include  'cdata.h'
+      include  'comblk.h'
+      include  'fdata.h'
+      include  'pointer.h'
+      include  'sdata.h'
+
+      integer   n, n1, n2, isw
+      logical   fl8
+
+      save
+
+c     @c
+      fl8 = fl(8)
+      call fmelbegin(numel, nst, nneq, hr(np(26)), n1, n2, isw)
+      if(n2.ge.n1) then
+        call pzero(hr(np(26)), nneq)
+        do n = n1,n2
+          call pzeroi(mr(np(34)), nst)
+          call pzero(hr(np(35)), nst)
+          call pzero(hr(np(36)), nst*nst)
+          call formfe(np(40), np(26), np(26), np(26),
+     &                .false., .true., .false., isw, n, n, 1)
+          call fmelmat(hr(np(36)), hr(np(35)), mr(np(34)))
+        end do ! n
+      endif
+      call fmelend(hr(np(26)))
+      fl(8) = fl8
+
+      end
@@ -0,0 +1,33 @@
+c     @T
+c     \section{Element and residual stubs for FEAP 7.x}
+c
+c     The [[resid]] and [[elmat]] commands call [[formfe]] with the
+c     argument list of FEAP 8.0 and later (see [[feapresid.f]] and
+c     [[feapelem.f]]).  FEAP 7.x builds ([[MFEAPVER=$(VER7)]]) link
+c     these stubs instead, which answer on the control stream that the
+c     command is not available.  The client sees that line in place of
+c     the {\tt Recv}, {\tt Send}, or {\tt Elements} line it expected.
+c
+c     @c
+      subroutine feapresid(setu)
+c     @q
+
+      implicit  none
+
+      integer   setu
+
+c     @c
+      call fmnotver()
+
+      end
+
+c     @c
+      subroutine feapelmat()
+c     @q
+
+      implicit  none
+
+c     @c
+      call fmnotver()
+
+      end
@@ -0,0 +1,254 @@
+/*
+ * Streaming element matrices
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+
+/*@T
+ * \section{Element matrices}
+ *
+ * Matrix-free and domain decomposition solvers on the client side do
+ * not want the assembled tangent; they want the element matrices and
+ * the equation numbers that say where each one goes.  The [[elmat]]
+ * command runs FEAP's element routines over a range of elements and
+ * streams the results:
+ * \begin{verbatim}
+ *   elmat [tang | resid | both] [FIRST [LAST]] [batch B]
+ * \end{verbatim}
+ * With [[tang]], each element contributes its [[nst]] by [[nst]]
+ * tangent; with [[resid]], its residual vector of length [[nst]]; and
+ * with [[both]] (the default), both.  The range defaults to all the
+ * elements, or to [[FIRST]] through the last element.  [[B]] is the
+ * number of elements per batch (default [[ELMAT_BATCH]]).  The
+ * exchange is
+ * \begin{enumerate}
+ * \item Server sends: {\tt Elements {\it count} {\it nst}}.
+ * \item Client sends: {\tt binary}, {\tt text}, or {\tt cancel}.
+ * \item For each batch of {\it b} elements, the server sends
+ *   {\tt Batch {\it b}} followed by three blocks: the local equation
+ *   numbers ({\it b}$\times${\it nst} 32-bit integers), the tangents
+ *   ({\it b}$\times${\it nst}$\times${\it nst} doubles, each one
+ *   stored by columns), and the residuals ({\it b}$\times${\it nst}
+ *   doubles).  The tangent or residual block is left out if it was not
+ *   asked for.  The data are in wire format, or one number per line
+ *   in the text case.
+ * \item Server sends: {\tt Batch 0}.
+ * \end{enumerate}
+ * The elements come in order, starting from [[FIRST]], so the client
+ * can tell which element is which by counting.  Equation numbers are
+ * one-based, as in FEAP; a non-positive number marks a degree of
+ * freedom with an essential boundary condition (its row and column of
+ * the tangent are still sent).  If the range is empty or out of
+ * bounds, the server sends {\tt Bad element range} instead of the
+ * {\tt Elements} line.
+ *
+ * Keeping each block contiguous lets the client hand a whole batch to
+ * a vectorized kernel, and batching keeps the number of header lines
+ * and write calls down when the elements are small.
+ *
+ *@c*/
+#define ELMAT_TANG  1
+#define ELMAT_RESID 2
+#define ELMAT_BATCH 256
+
+static int      elmat_what  = ELMAT_TANG | ELMAT_RESID;
+static int      elmat_first = 0;
+static int      elmat_last  = 0;
+static int      elmat_batch = ELMAT_BATCH;
+static int      elmat_text  = 0;
+static int      elmat_nst   = 0;
+static int      elmat_count = 0;     /* Elements in the current batch */
+static int32_t* elmat_ld    = NULL;
+static double*  elmat_s     = NULL;
+static double*  elmat_p     = NULL;
+static double*  elmat_dr    = NULL;  /* Saved copy of DR */
+static size_t   elmat_ndr   = 0;
+
+static void elmat_free()
+{
+    free(elmat_ld);
+    free(elmat_s);
+    free(elmat_p);
+    free(elmat_dr);
+    elmat_ld = NULL;
+    elmat_s  = NULL;
+    elmat_p  = NULL;
+    elmat_dr = NULL;
+}
+
+/*@T
+ * \subsection{Writing batches}
+ *
+ * The batch buffers hold data already converted to wire format, so a
+ * binary batch goes out with one [[fwrite]] per block.
+ *
+ *@c*/
+static void elmat_flush()
+{
+    extern double ntohd(double x);
+    size_t nld = (size_t) elmat_count * elmat_nst;
+    size_t ns  = nld * elmat_nst;
+    size_t i;
+
+    if (elmat_count == 0)
+        return;
+    printf("Batch %d\n", elmat_count);
+    if (elmat_text) {
+        for (i = 0; i < nld; ++i)
+            printf("%d\n", (int) ntohl(elmat_ld[i]));
+        if (elmat_what & ELMAT_TANG)
+            for (i = 0; i < ns; ++i)
+                printf("%.17g\n", ntohd(elmat_s[i]));
+        if (elmat_what & ELMAT_RESID)
+            for (i = 0; i < nld; ++i)
+                printf("%.17g\n", ntohd(elmat_p[i]));
+    } else {
+        fwrite(elmat_ld, sizeof(int32_t), nld, stdout);
+        if (elmat_what & ELMAT_TANG)
+            fwrite(elmat_s, sizeof(double), ns, stdout);
+        if (elmat_what & ELMAT_RESID)
+            fwrite(elmat_p, sizeof(double), nld, stdout);
+    }
+    elmat_count = 0;
+}
+
+/*@T
+ * \subsection{Entry points}
+ *
+ * The FORTRAN routine [[feapelmat]] calls [[fmelbegin]] with the
+ * number of elements, the element array size, and FEAP's residual
+ * array [[DR]] (of length [[nneq]]).  We check the range, set up the
+ * buffers, save a copy of [[DR]], and run the handshake; on return,
+ * [[n1]] through [[n2]] is the range to compute (empty if there is
+ * nothing to do) and [[isw]] is the FEAP element switch to use: 3
+ * (tangent and residual) or 6 (residual only).  Each element is then
+ * passed to [[fmelmat]], with its tangent [[s]], residual [[p]], and
+ * equation numbers [[ld]], and [[fmelend]] finishes the stream and
+ * puts [[DR]] back the way it was.
+ *
+ *@c*/
+int fmelbegin_(int* numel, int* nst, int* nneq, double* dr,
+               int* n1, int* n2, int* isw)
+{
+    char buf[256];
+    char* token;
+    int first = elmat_first ? elmat_first : 1;
+    int last  = elmat_last  ? elmat_last  : *numel;
+    size_t nld = (size_t) elmat_batch * (*nst);
+
+    *n1 = 1;
+    *n2 = 0;
+    *isw = (elmat_what & ELMAT_TANG) ? 3 : 6;
+    elmat_nst   = *nst;
+    elmat_count = 0;
+
+    if (first < 1 || last > *numel || first > last || *nst < 1) {
+        printf("Bad element range\n");
+        return 0;
+    }
+
+    elmat_ld = (int32_t*) malloc(nld * sizeof(int32_t));
+    elmat_s  = (double*)  malloc(nld * (*nst) * sizeof(double));
+    elmat_p  = (double*)  malloc(nld * sizeof(double));
+    elmat_ndr = (*nneq > 0) ? (size_t) *nneq : 0;
+    elmat_dr = (double*)  malloc((elmat_ndr+1) * sizeof(double));
+    if (!elmat_ld || !elmat_s || !elmat_p || !elmat_dr) {
+        elmat_free();
+        printf("Out of memory\n");
+        return 0;
+    }
+
+    printf("Elements %d %d\n", last-first+1, *nst);
+    fflush(stdout);
+    if (fgets(buf, sizeof(buf), stdin) == NULL ||
+        (token = strtok(buf, " \t\r\n")) == NULL ||
+        (strcmp(token, "binary") && strcmp(token, "text"))) {
+        elmat_free();
+        return 0;
+    }
+
+    memcpy(elmat_dr, dr, elmat_ndr * sizeof(double));
+    elmat_text = (strcmp(token, "text") == 0);
+    *n1 = first;
+    *n2 = last;
+    return 0;
+}
+
+int fmelmat_(double* s, double* p, int* ld)
+{
+    extern double htond(double x);
+    int nst = elmat_nst;
+    size_t off = (size_t) elmat_count * nst;
+    int i;
+
+    if (elmat_ld == NULL)
+        return 0;
+    for (i = 0; i < nst; ++i)
+        elmat_ld[off+i] = htonl(ld[i]);
+    if (elmat_what & ELMAT_TANG)
+        for (i = 0; i < nst*nst; ++i)
+            elmat_s[off*nst+i] = htond(s[i]);
+    if (elmat_what & ELMAT_RESID)
+        for (i = 0; i < nst; ++i)
+            elmat_p[off+i] = htond(p[i]);
+    if (++elmat_count == elmat_batch)
+        elmat_flush();
+    return 0;
+}
+
+int fmelend_(double* dr)
+{
+    if (elmat_ld == NULL)
+        return 0;
+    memcpy(dr, elmat_dr, elmat_ndr * sizeof(double));
+    elmat_flush();
+    printf("Batch 0\n");
+    fflush(stdout);
+    elmat_free();
+    return 0;
+}
+
+/*@T
+ * The dispatcher passes the words after [[elmat]] to
+ * [[feapsrv_elmat]].  The options persist only for the one command.
+ *
+ *@c*/
+void feapsrv_elmat(char** args, int n)
+{
+    extern int feapelmat_();
+    int j, nrange = 0;
+
+    elmat_what  = ELMAT_TANG | ELMAT_RESID;
+    elmat_first = 0;
+    elmat_last  = 0;
+    elmat_batch = ELMAT_BATCH;
+    for (j = 0; j < n; ++j) {
+        if (strcmp(args[j], "tang") == 0)
+            elmat_what = ELMAT_TANG;
+        else if (strcmp(args[j], "resid") == 0)
+            elmat_what = ELMAT_RESID;
+        else if (strcmp(args[j], "both") == 0)
+            elmat_what = ELMAT_TANG | ELMAT_RESID;
+        else if (strcmp(args[j], "batch") == 0 && j+1 < n) {
+            elmat_batch = atoi(args[++j]);
+            if (elmat_batch < 1) {
+                printf("Bad batch size\n");
+                return;
+            }
+        } else if (nrange < 2 && atoi(args[j]) > 0) {
+            if (nrange++ == 0)
+                elmat_first = atoi(args[j]);
+            else
+                elmat_last = atoi(args[j]);
+        } else {
+            printf("Unexpected argument: %s\n", args[j]);
+            return;
+        }
+    }
+    feapelmat_();
+    fflush(stdout);
+}
@@ -0,0 +1,30 @@
+c     @T
+c     \section{Flushing console output}
+c
+c     The [[feapflush]] routine flushes the FORTRAN console unit, so
+c     that everything FEAP has written so far reaches its sink before
+c     the server moves the sink elsewhere or dumps the ring buffer.
+c
+c     @c
+      subroutine feapflush()
+
+      implicit  none
+
+      call flush(6)
+
+      end
+
+c     @T
+c     The [[feapflushall]] routine flushes every open unit, FEAP's
+c     output files included.  It is for the [[reset]] command (see
+c     [[feapreset.c]]), which replaces the process image without going
+c     through FEAP's own shutdown.
+c
+c     @c
+      subroutine feapflushall()
+
+      implicit  none
+
+      call flush()
+
+      end
@@ -0,0 +1,248 @@
+/*
+ * FEAP array generations and content hashes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+
+#define MAX_GEN_ARRAYS 128
+
+/*@T
+ * \section{Array generations}
+ *
+ * Client scripts tend to fetch the same arrays over and over: the
+ * node coordinates [[X]], the equation numbers [[ID]], the element
+ * connectivity [[IX]], and the scalar record almost never change after
+ * the mesh is read, but helpers such as [[feapgetx]] ask for them on
+ * every call.  To let clients cache these arrays, the server keeps a
+ * {\em generation} number and a content hash for each array it has
+ * been asked about.  The command
+ * \begin{verbatim}
+ *   stat NAME1 NAME2 ...
+ * \end{verbatim}
+ * replies with a line {\tt Stat {\it n}} followed by one line per
+ * name of the form {\tt {\it name} {\it gen} {\it hash}}, where the
+ * hash is printed as sixteen hexadecimal digits.  An array that does
+ * not exist is reported with generation and hash both zero.  The
+ * special name [[scalars]] stands for the record of registered
+ * scalars that [[getall]] returns.
+ *
+ * The generation of an array changes whenever
+ * \begin{itemize}
+ * \item the client overwrites it with [[setm]];
+ * \item FEAP reallocates it, so that its address, length, or type
+ *   changes; or
+ * \item its contents are different from the last time it was hashed.
+ * \end{itemize}
+ * Re-hashing every array on every request would defeat the purpose,
+ * so the server also keeps an {\em epoch} counter that is bumped each
+ * time control goes back to FEAP to run macros (and by the other
+ * commands that can modify FEAP state, such as [[resid]] and
+ * [[restore]]).  A cached hash is only recomputed when the epoch has
+ * changed since it was taken, so a run of [[stat]] requests between
+ * macros costs one table lookup per array.
+ *
+ * A client that has a cached copy of an array with the same
+ * generation and hash can use it without fetching the data.
+ *
+ *@c*/
+typedef struct feapgen_t {
+    char     name[8];
+    void*    addr;
+    int      len;
+    int      prec;
+    int      epoch;
+    int      gen;
+    uint64_t hash;
+} feapgen_t;
+
+static feapgen_t feapgen_table[MAX_GEN_ARRAYS];
+static int feapgen_count = 0;
+static int feapgen_epoch = 1;
+static int feapgen_next  = 1;
+
+static void* feapgen_addr;
+static int   feapgen_len;
+static int   feapgen_prec;
+
+
+/*@T
+ * \subsection{Content hash}
+ *
+ * The hash runs four independent multiply--xorshift lanes over
+ * consecutive 64-bit words, so that the loop has no serial dependence
+ * from one word to the next and the compiler is free to unroll or
+ * vectorize it.  Left over bytes are folded into the first lane, and
+ * the lanes and the byte count are mixed together at the end.  This
+ * is not a cryptographic hash; it only needs to make accidental
+ * collisions between successive versions of an array unlikely.
+ *
+ *@c*/
+#define GEN_PRIME1 0x9E3779B97F4A7C15ULL
+#define GEN_PRIME2 0xC2B2AE3D27D4EB4FULL
+
+static uint64_t feapgen_hash(const void* data, size_t nbytes)
+{
+    const unsigned char* p = (const unsigned char*) data;
+    uint64_t h0 = GEN_PRIME1, h1 = GEN_PRIME2;
+    uint64_t h2 = GEN_PRIME1 ^ GEN_PRIME2, h3 = ~GEN_PRIME1;
+    uint64_t h;
+    size_t i, nblocks = nbytes / 32;
+
+    for (i = 0; i < nblocks; ++i, p += 32) {
+        uint64_t w[4];
+        memcpy(w, p, 32);
+        h0 = (h0 ^ w[0]) * GEN_PRIME1;  h0 ^= h0 >> 29;
+        h1 = (h1 ^ w[1]) * GEN_PRIME1;  h1 ^= h1 >> 29;
+        h2 = (h2 ^ w[2]) * GEN_PRIME1;  h2 ^= h2 >> 29;
+        h3 = (h3 ^ w[3]) * GEN_PRIME1;  h3 ^= h3 >> 29;
+    }
+    for (i = nblocks * 32; i < nbytes; ++i, ++p)
+        h0 = (h0 ^ *p) * GEN_PRIME2;
+
+    h = (uint64_t) nbytes * GEN_PRIME2;
+    h = (h ^ h0) * GEN_PRIME1;  h ^= h >> 32;
+    h = (h ^ h1) * GEN_PRIME1;  h ^= h >> 32;
+    h = (h ^ h2) * GEN_PRIME1;  h ^= h >> 32;
+    h = (h ^ h3) * GEN_PRIME1;  h ^= h >> 32;
+    return h;
+}
+
+
+/*@T
+ * \subsection{Table maintenance}
+ *
+ * The FORTRAN routine [[feapstat]] looks the array up with [[pgetd]]
+ * and passes its location back through [[fmstatint]] or
+ * [[fmstatdbl]].  If the array is not found, neither routine is
+ * called, and the recorded address stays [[NULL]].
+ *
+ *@c*/
+int fmstatint_(int* data, int* len)
+{
+    feapgen_addr = data;
+    feapgen_len  = *len;
+    feapgen_prec = 1;
+    return 0;
+}
+
+int fmstatdbl_(double* data, int* len)
+{
+    feapgen_addr = data;
+    feapgen_len  = *len;
+    feapgen_prec = 2;
+    return 0;
+}
+
+static feapgen_t* feapgen_lookup(const char* name)
+{
+    feapgen_t* g;
+    int i;
+    for (i = 0; i < feapgen_count; ++i)
+        if (strcasecmp(feapgen_table[i].name, name) == 0)
+            return feapgen_table + i;
+    if (feapgen_count == MAX_GEN_ARRAYS)
+        return NULL;
+    g = feapgen_table + feapgen_count++;
+    memset(g, 0, sizeof(*g));
+    strncpy(g->name, name, sizeof(g->name)-1);
+    return g;
+}
+
+static void feapgen_update(feapgen_t* g, void* addr, int len, int prec)
+{
+    size_t nbytes = (size_t) len * (prec == 1 ? sizeof(int) : sizeof(double));
+    uint64_t hash;
+
+    if (g->gen != 0 && g->epoch == feapgen_epoch &&
+        g->addr == addr && g->len == len && g->prec == prec)
+        return;
+
+    hash = feapgen_hash(addr, nbytes);
+    if (g->gen == 0 || g->addr != addr || g->len != len ||
+        g->prec != prec || g->hash != hash)
+        g->gen = feapgen_next++;
+    g->addr  = addr;
+    g->len   = len;
+    g->prec  = prec;
+    g->hash  = hash;
+    g->epoch = feapgen_epoch;
+}
+
+/*@T
+ * The scalar record is hashed from the same values that [[getall]]
+ * sends, so a client can compare it against a cached [[getall]]
+ * result.
+ *
+ *@c*/
+static void feapgen_scalars(feapgen_t* g)
+{
+    extern int feapsrv_scalar_count();
+    extern double feapsrv_scalar_value(int i);
+    static double vals[MAX_GEN_ARRAYS];
+    int i, n = feapsrv_scalar_count();
+    if (n > MAX_GEN_ARRAYS)
+        n = MAX_GEN_ARRAYS;
+    for (i = 0; i < n; ++i)
+        vals[i] = feapsrv_scalar_value(i);
+    g->epoch = 0;
+    feapgen_update(g, vals, n, 2);
+}
+
+static void feapgen_stat(const char* name)
+{
+    extern int feapstat_(const char* var, int len);
+    feapgen_t* g;
+
+    if (strcasecmp(name, "scalars") == 0) {
+        g = feapgen_lookup("scalars");
+        if (g)
+            feapgen_scalars(g);
+    } else {
+        feapgen_addr = NULL;
+        feapstat_(name, strlen(name));
+        g = (feapgen_addr == NULL) ? NULL : feapgen_lookup(name);
+        if (g)
+            feapgen_update(g, feapgen_addr, feapgen_len, feapgen_prec);
+    }
+
+    if (g)
+        printf("%s %d %016llx\n", name, g->gen, (unsigned long long) g->hash);
+    else
+        printf("%s 0 0000000000000000\n", name);
+}
+
+
+/*@T
+ * \subsection{Entry points}
+ *
+ * The dispatcher in [[feapsrv]] calls [[feapsrv_stat]] to handle a
+ * [[stat]] request, [[feapsrv_touch]] after an array is written by
+ * [[setm]], and [[feapsrv_epoch]] whenever FEAP may have modified its
+ * own state.  Touching an array clears its recorded address, so the
+ * next [[stat]] sees it as reallocated and assigns a new generation.
+ *
+ *@c*/
+void feapsrv_stat(char** names, int n)
+{
+    int i;
+    printf("Stat %d\n", n);
+    for (i = 0; i < n; ++i)
+        feapgen_stat(names[i]);
+}
+
+void feapsrv_touch(const char* name)
+{
+    int i;
+    for (i = 0; i < feapgen_count; ++i)
+        if (strcasecmp(feapgen_table[i].name, name) == 0)
+            feapgen_table[i].addr = NULL;
+}
+
+void feapsrv_epoch()
+{
+    ++feapgen_epoch;
+}
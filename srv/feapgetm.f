@@ -36,7 +36,121 @@ c     @c
           call fmsenddbl(hr(point), lengt)
         endif
       else
-        print *, 'Not found'
+        call fmnotfound()
+      endif
+
+      end
+
+c     @T
+c     The [[feapstat(var)]] routine is used by the [[stat]] command.
+c     It looks up the array in the same way, but instead of sending
+c     the data it passes the array location to [[fmstatint]] or
+c     [[fmstatdbl]] so that the server can hash it in place.
+c
+c     @c
+      subroutine feapstat(var)
+
+      implicit  none
+
+      include 'comblk.h'
+      include 'pointer.h'
+      include 'p_point.h'
+
+      character var*(*)
+      logical flag
+      integer lengt, prec
+
+      save
+
+      call pgetd( var, point, lengt, prec, flag )
+      if(flag) then
+        if(prec.eq.1) then
+          call fmstatint(mr(point), lengt)
+        else
+          call fmstatdbl(hr(point), lengt)
+        endif
+      endif
+
+      end
+
+c     @T
+c     The [[feapreduce(var, other, nother)]] routine is used by the
+c     [[reduce]] command.  It looks up the array and passes it to
+c     [[fmreduce]] along with the [[ID]] array and the equation counts,
+c     which the reduced forms need.  For a dot product with another
+c     FEAP array ([[nother]] nonzero), the other array is looked up
+c     first and handed to [[fmredother]], so that a single pointer
+c     variable suffices.  Only double precision arrays are reduced.
+c
+c     @c
+      subroutine feapreduce(var, other, nother)
+
+      implicit  none
+
+      include 'cdata.h'
+      include 'comblk.h'
+      include 'pointer.h'
+      include 'p_point.h'
+      include 'sdata.h'
+
+      character var*(*), other*(*)
+      integer nother
+      logical flag
+      integer lengt, prec
+
+      save
+
+      if(nother.ne.0) then
+        call pgetd( other, point, lengt, prec, flag )
+        if(.not.flag) then
+          call fmnotfound()
+          return
+        elseif(prec.eq.1) then
+          call fmnotdbl()
+          return
+        endif
+        call fmredother(hr(point), lengt)
+      endif
+
+      call pgetd( var, point, lengt, prec, flag )
+      if(.not.flag) then
+        call fmnotfound()
+      elseif(prec.eq.1) then
+        call fmnotdbl()
+      else
+        call fmreduce(hr(point), lengt, mr(np(31)), nneq, neq)
+      endif
+
+      end
+
+c     @T
+c     The [[feappush(var)]] routine sends an array the client has
+c     subscribed to (see [[feappush.c]]).  Like [[feapreduce]], it
+c     passes the [[ID]] array and the equation counts along for the
+c     reduced form.  Only double precision arrays are pushed.
+c
+c     @c
+      subroutine feappush(var)
+
+      implicit  none
+
+      include 'cdata.h'
+      include 'comblk.h'
+      include 'pointer.h'
+      include 'p_point.h'
+      include 'sdata.h'
+
+      character var*(*)
+      logical flag
+      integer lengt, prec
+
+      save
+
+      call pgetd( var, point, lengt, prec, flag )
+      if(.not.flag .or. prec.eq.1) then
+        call fmpushnone()
+      else
+        call fmpush(hr(point), lengt, mr(np(31)), nneq, neq)
       endif
 
       end
@@ -20,7 +20,97 @@
           call fmsenddbl(hr(point), lengt)
         endif
       else
-        print *, 'Not found'
+        call fmnotfound()
+      endif
+
+      end
+
+      subroutine feapstat(var)
+
+      implicit  none
+
+      include 'comblk.h'
+      include 'pointer.h'
+
+      character var*(*)
+      logical flag
+      integer lengt, prec
+      integer point
+
+      save
+
+      call pgetd( var, point, lengt, prec, flag )
+      if(flag) then
+        if(prec.eq.1) then
+          call fmstatint(mr(point), lengt)
+        else
+          call fmstatdbl(hr(point), lengt)
+        endif
+      endif
+
+      end
+
+      subroutine feapreduce(var, other, nother)
+
+      implicit  none
+
+      include 'cdata.h'
+      include 'comblk.h'
+      include 'pointer.h'
+      include 'sdata.h'
+
+      character var*(*), other*(*)
+      integer nother
+      logical flag
+      integer lengt, prec
+      integer point
+
+      save
+
+      if(nother.ne.0) then
+        call pgetd( other, point, lengt, prec, flag )
+        if(.not.flag) then
+          call fmnotfound()
+          return
+        elseif(prec.eq.1) then
+          call fmnotdbl()
+          return
+        endif
+        call fmredother(hr(point), lengt)
+      endif
+
+      call pgetd( var, point, lengt, prec, flag )
+      if(.not.flag) then
+        call fmnotfound()
+      elseif(prec.eq.1) then
+        call fmnotdbl()
+      else
+        call fmreduce(hr(point), lengt, mr(np(31)), nneq, neq)
+      endif
+
+      end
+
+      subroutine feappush(var)
+
+      implicit  none
+
+      include 'cdata.h'
+      include 'comblk.h'
+      include 'pointer.h'
+      include 'sdata.h'
+
+      character var*(*)
+      logical flag
+      integer lengt, prec
+      integer point
+
+      save
+
+      call pgetd( var, point, lengt, prec, flag )
+      if(.not.flag .or. prec.eq.1) then
+        call fmpushnone()
+      else
+        call fmpush(hr(point), lengt, mr(np(31)), nneq, neq)
       endif
 
       end
@@ -0,0 +1,340 @@
+/*
+ * Interrupting FEAP commands
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef __GLIBC__
+#include <stdio_ext.h>
+#define feapintr_purge(fp) __fpurge(fp)
+#else
+#define feapintr_purge(fp) fpurge(fp)
+#endif
+
+#define ADMIN_ENV_VAR "MATFEAP_ADMIN"
+
+/*@T
+ * \section{Interrupting commands}
+ *
+ * Once the client has sent a slow macro -- a factorization, or a long
+ * [[loop]] of time steps -- the only way to get FEAP's attention used
+ * to be to close the connection, which throws away the whole model.
+ * Instead, the client can {\em interrupt} the session:
+ * \begin{itemize}
+ * \item over TCP, by sending a byte of urgent (out-of-band) data on the
+ *   connection, which the server sees as [[SIGURG]];
+ * \item over a UNIX domain socket or a pipe, by sending [[SIGINT]] to
+ *   the session's process group, which the [[pid]] command reports;
+ * \item through the daemon's administration socket, with
+ *   [[interrupt PID]] (see [[feapadmin.c]]).
+ * \end{itemize}
+ *
+ * We do not have FEAP's macro interpreter, so we cannot make it stop
+ * between the commands of a loop, and a factorization has no natural
+ * stopping point at all.  What we can do is make sure there is
+ * something to go back to.  With [[guard on]], the session forks a
+ * {\em spare} each time FEAP is about to prompt for a command on the
+ * console.  The spare is a copy of the session as it stands at the
+ * prompt, sharing the session's memory copy-on-write, and it sits
+ * waiting.  If the session is interrupted while it runs the command,
+ * it wakes the spare and exits; the spare says
+ * {\tt MATFEAP INTERRUPTED}, takes over the connection, and goes on to
+ * the prompt, so the client sees the usual synchronization message and
+ * FEAP is in the state it was in before the command.  If the command
+ * finishes, the spare is thrown away at the next prompt and a new one
+ * is made.
+ *
+ * Guarding has a cost: a [[fork]] per prompt, plus a page fault for
+ * each page of memory the command writes while the spare shares it.
+ * That is why it is off by default and is meant to be turned on around
+ * commands that might need to be stopped.  A few other things to know:
+ * \begin{itemize}
+ * \item The process ID of the session changes when the spare takes
+ *   over, but the process group does not.  If the daemon has an
+ *   administration socket, the spare tells it about the change.
+ * \item FEAP's output files are shared with the spare, so they may
+ *   contain output from the interrupted command.
+ * \item For a command entered over several lines (such as a [[loop]]
+ *   typed at the console), the spare goes back to the prompt for the
+ *   last line.
+ * \item Anything the client sent after the interrupted command is
+ *   dropped.
+ * \end{itemize}
+ *
+ * Without the guard, an interrupt only sets a flag.  User routines can
+ * check it at their own iteration boundaries with [[feapintr]] (which
+ * also clears it) and return early.  If nobody looks at the flag before
+ * the next prompt, the session says so.
+ *
+ *@c*/
+static volatile sig_atomic_t intr_flag    = 0;  /* Interrupt pending       */
+static volatile sig_atomic_t intr_running = 0;  /* Running a command       */
+static volatile int          intr_spare   = -1; /* Channel to spare        */
+static pid_t intr_spare_pid = -1;
+static int   intr_guard = 0;
+static int   intr_setup_done = 0;
+
+
+/*@T
+ * \subsection{Catching interrupts}
+ *
+ * The handler consumes the urgent byte, if there is one.  If a command
+ * is running and there is a spare, it hands over to the spare and waits
+ * for the spare to say it is ready (or to die) before exiting, so that
+ * the daemon hears about the new process before it reaps the old one.
+ * Everything here is async-signal-safe.  Interrupts that arrive while
+ * the session is idle at a prompt are ignored.
+ *
+ *@c*/
+static void intr_handler(int sig)
+{
+    int saved = errno;
+    char c;
+
+    if (sig == SIGURG)
+        recv(0, &c, 1, MSG_OOB);
+    if (intr_running) {
+        if (intr_spare >= 0 &&
+            send(intr_spare, "g", 1, MSG_NOSIGNAL) == 1) {
+            while (read(intr_spare, &c, 1) < 0 && errno == EINTR);
+            _exit(0);
+        }
+        intr_flag = 1;
+    }
+    errno = saved;
+}
+
+static void intr_catch(void (*handler)(int))
+{
+    struct sigaction sa;
+    sa.sa_handler = handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGURG, &sa, NULL);
+}
+
+/*@T
+ * Each session is put in a process group of its own, so that the
+ * group ID stays valid after a spare takes over, and so that an
+ * interrupt meant for one session does not reach anything else.  The
+ * connection's urgent data notifications go to the current process.
+ * The [[feapsrv]] dispatcher calls [[feapintr_setup]] when it first
+ * starts; a session cloned from a model template calls
+ * [[feapintr_reset]], since the clone is a new session.
+ *
+ *@c*/
+void feapintr_reset()
+{
+    setpgid(0, 0);
+    fcntl(0, F_SETOWN, getpid());
+    intr_catch(intr_handler);
+    intr_flag = 0;
+    intr_running = 0;
+    intr_guard = 0;
+    intr_setup_done = 1;
+}
+
+void feapintr_setup()
+{
+    if (!intr_setup_done)
+        feapintr_reset();
+}
+
+
+/*@T
+ * \subsection{Commands}
+ *
+ * The [[feapsrv]] dispatcher handles [[guard on]], [[guard off]], and
+ * [[pid]] by calling these routines.
+ *
+ *@c*/
+void feapintr_guard(const char* mode)
+{
+    if (mode && strcmp(mode, "on") == 0)
+        intr_guard = 1;
+    else if (mode && strcmp(mode, "off") == 0)
+        intr_guard = 0;
+    else if (mode)
+        printf("Unrecognized guard mode: %s\n", mode);
+    printf("Guard %s\n", intr_guard ? "on" : "off");
+}
+
+void feapintr_pid()
+{
+    printf("PID %d\n", (int) getpgrp());
+}
+
+int feapintr_(int* flag)
+{
+    *flag = intr_flag;
+    intr_flag = 0;
+    return 0;
+}
+
+
+/*@T
+ * \subsection{The spare}
+ *
+ * When a spare is woken, it first reports to the administration socket
+ * (if there is one), then tells the old session it may go.  The report
+ * is a single [[adopt OLD NEW]] command; we read the two prompts that
+ * come back (one on connecting and one after the command) so that the
+ * daemon has done its bookkeeping before we go on.
+ *
+ *@c*/
+static void intr_adopt(pid_t old)
+{
+    struct sockaddr_un addr;
+    char* sockname = getenv(ADMIN_ENV_VAR);
+    char buf[256];
+    int sock, prompts = 0, n;
+
+    if (sockname == NULL || strlen(sockname) >= sizeof(addr.sun_path))
+        return;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sockname);
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return;
+    if (connect(sock, (struct sockaddr*) &addr, sizeof(addr)) == 0) {
+        sprintf(buf, "adopt %d %d\nquit\n", (int) old, (int) getpid());
+        if (send(sock, buf, strlen(buf), MSG_NOSIGNAL) > 0) {
+            while (prompts < 2 &&
+                   (n = recv(sock, buf, sizeof(buf)-1, 0)) > 0) {
+                char* p = buf;
+                buf[n] = 0;
+                while ((p = strstr(p, "ADMIN>")) != NULL) {
+                    ++prompts;
+                    ++p;
+                }
+            }
+        }
+    }
+    close(sock);
+}
+
+/*@T
+ * The spare ignores interrupts while it waits.  End of file on the
+ * channel means the session finished its command (or exited), and the
+ * spare is no longer needed.  Otherwise it becomes the session: it
+ * drops whatever was in its input buffer when it was forked (the old
+ * session read it already), takes over the urgent data notifications,
+ * restarts the console reader if the console is in ring mode (see
+ * [[feapcons.c]]), drops any queued macros (see [[feapqueue.c]]), and
+ * returns to the prompt.
+ *
+ *@c*/
+static void intr_spare_wait(int chan)
+{
+    extern void feapqueue_drop();
+    extern void feapcons_takeover();
+    pid_t old = getppid();
+    ssize_t n;
+    char c;
+
+    signal(SIGINT, SIG_IGN);
+    signal(SIGURG, SIG_IGN);
+    do
+        n = read(chan, &c, 1);
+    while (n < 0 && errno == EINTR);
+    if (n != 1)
+        _exit(0);
+
+    intr_adopt(old);
+    send(chan, "r", 1, MSG_NOSIGNAL);
+    close(chan);
+
+    feapintr_purge(stdin);
+    clearerr(stdin);
+    fcntl(0, F_SETOWN, getpid());
+    feapcons_takeover();
+    intr_catch(intr_handler);
+    intr_flag = 0;
+    printf("\n MATFEAP INTERRUPTED\n");
+    feapqueue_drop();
+    fflush(stdout);
+}
+
+static void intr_drop_spare()
+{
+    if (intr_spare < 0)
+        return;
+    close(intr_spare);
+    intr_spare = -1;
+    waitpid(intr_spare_pid, NULL, 0);
+    intr_spare_pid = -1;
+}
+
+/*@T
+ * \subsection{Hooks at the prompt}
+ *
+ * The [[tinput]] routine calls [[feapintrprompt]] before each console
+ * prompt and [[feapintrrun]] once the command has been read.  Output is
+ * flushed before forking, so that the spare doesn't repeat it.  A
+ * spare that takes over returns through the same call; it then makes
+ * a spare of its own, if the guard is still on.
+ *
+ *@c*/
+int feapintrprompt_()
+{
+    extern int feapflush_();
+    int chan[2];
+    pid_t pid;
+
+    intr_running = 0;
+    if (intr_flag) {
+        intr_flag = 0;
+        printf(" Interrupt ignored (use 'guard on' to allow interrupts)\n");
+    }
+    intr_drop_spare();
+    if (!intr_guard)
+        return 0;
+
+    feapflush_();
+    fflush(stdout);
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, chan) < 0)
+        return 0;
+    if ((pid = fork()) == 0) {
+        close(chan[0]);
+        intr_spare_wait(chan[1]);
+        return feapintrprompt_();
+    }
+    close(chan[1]);
+    if (pid < 0) {
+        close(chan[0]);
+        return 0;
+    }
+    intr_spare_pid = pid;
+    intr_spare = chan[0];
+    return 0;
+}
+
+int feapintrrun_()
+{
+    intr_running = 1;
+    return 0;
+}
+
+/*@T
+ * The [[reset]] command (see [[feapreset.c]]) calls [[feapintr_release]]
+ * to let go of the spare before it replaces the process image; the
+ * new image would not know to reap it.
+ *
+ *@c*/
+void feapintr_release()
+{
+    intr_drop_spare();
+    intr_guard = 0;
+}
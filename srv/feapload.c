@@ -0,0 +1,775 @@
+/*
+ * MATFEAP transport benchmark driver
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/*@T
+ * \section{Transport benchmarks}
+ *
+ * The [[feapload]] program measures what a MATFEAP connection costs.
+ * It opens one or more sessions to a MATFEAP server (normally the
+ * [[feapbench]] stand-in, so that all the time goes to the transport
+ * and the protocol), and then for each operation and payload size runs
+ * the same exchange a MATLAB client would, in every session at once:
+ * \begin{itemize}
+ * \item [[serv]] -- a small [[feapsrv]] command ([[get neq]]) and
+ *   its prompt, timed inside one [[serv]] block;
+ * \item [[getm]] and [[setm]] -- a whole [[feapgetm]] or [[feapsetm]]
+ *   call, from [[serv]] through the array transfer to [[start]] and
+ *   the following synchronization message;
+ * \item [[sparse]] -- the same for [[sparse binary tang]];
+ * \item [[profile]] -- the same for [[sparse profile tang]].
+ * \end{itemize}
+ * Payload sizes go from the minimum to the maximum by factors of four.
+ * For each operation and size, the program prints the aggregate
+ * throughput over all sessions, the median and 99th percentile latency
+ * of a single operation, and the CPU time spent per byte and per
+ * operation, counting both the client and the server processes.
+ *
+ * The usage is
+ * \begin{verbatim}
+ *   feapload [-t host:port | -u sockname | -p command] [-x server]
+ *            [-a adminsock] [-n sessions] [-r reps] [-s min] [-m max]
+ *            [-b budget] [-o ops]
+ * \end{verbatim}
+ * where
+ * \begin{itemize}
+ * \item [[-t]], [[-u]], and [[-p]] select a TCP server, a UNIX-domain
+ *   socket server, or a pipe server started once per session (with
+ *   [[/bin/sh -c]]);
+ * \item [[-x]] starts the given socket server for the duration of the
+ *   run, listening at the address given by [[-t]] or [[-u]];
+ * \item [[-a]] names the admin socket of an already running daemon,
+ *   which is used to find the session processes for CPU accounting
+ *   (with [[-x]] or [[-p]], we know them already);
+ * \item [[-n]] is the number of concurrent sessions (default 1);
+ * \item [[-r]] is the number of operations per session for each
+ *   operation and size (default 100); fewer are done for large
+ *   payloads, so that no more than the [[-b]] budget (default 256M)
+ *   is moved per session, but never fewer than three;
+ * \item [[-s]] and [[-m]] are the smallest and largest payloads
+ *   (default 1K and 64M), with an optional [[K]], [[M]], or [[G]]
+ *   suffix;
+ * \item [[-o]] is a comma-separated list of operations
+ *   (default [[serv,getm,setm,sparse,profile]]).
+ * \end{itemize}
+ * Server CPU time is read from [[/proc]], so the CPU columns are only
+ * filled in on Linux.
+ *
+ *@c*/
+#define LOAD_BUF    65536
+#define LOAD_LINE   1024
+
+#define OP_SERV     0
+#define OP_GETM     1
+#define OP_SETM     2
+#define OP_SPARSE   3
+#define OP_PROFILE  4
+#define OP_QUIT     5
+#define OP_COUNT    5
+
+static const char* load_opnames[] =
+    { "serv", "getm", "setm", "sparse", "profile" };
+
+typedef struct load_sess_t {
+    int     rfd, wfd;       /* Read and write descriptors    */
+    pid_t   pid;            /* Pipe server process, if any   */
+    char    rbuf[LOAD_BUF]; /* Read buffer                   */
+    size_t  rpos, rlen;
+    char*   data;           /* Payload buffer                */
+    size_t  cap;
+    double* lat;            /* Latencies for this phase      */
+    int     nlat;
+    long long bytes;        /* Payload bytes for this phase  */
+} load_sess_t;
+
+static char*  load_tcp;
+static char*  load_sockname;
+static char*  load_command;
+static char*  load_server;
+static char*  load_admin;
+static int    load_nsess  = 1;
+static int    load_reps   = 100;
+static size_t load_min    = 1024;
+static size_t load_max    = 64 << 20;
+static size_t load_budget = 256 << 20;
+static int    load_ops[OP_COUNT] = { 1, 1, 1, 1, 1 };
+static pid_t  load_daemon;
+
+static void load_die(const char* msg)
+{
+    fprintf(stderr, "feapload: %s\n", msg);
+    exit(-1);
+}
+
+static double load_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/*@T
+ * \subsection{Talking to the server}
+ *
+ * Each session has its own read buffer, so that the protocol lines
+ * can be picked off without a system call per character; payloads go
+ * straight from the buffer and the descriptor into the session's data
+ * buffer, as they would into a MATLAB array.
+ *
+ *@c*/
+static void load_write(load_sess_t* s, const void* buf, size_t n)
+{
+    const char* p = (const char*) buf;
+    while (n > 0) {
+        ssize_t m = write(s->wfd, p, n);
+        if (m < 0 && errno == EINTR)
+            continue;
+        if (m <= 0)
+            load_die("write to server failed");
+        p += m;
+        n -= m;
+    }
+}
+
+static void load_send(load_sess_t* s, const char* line)
+{
+    char buf[LOAD_LINE];
+    size_t n = strlen(line);
+    memcpy(buf, line, n);
+    buf[n++] = '\n';
+    load_write(s, buf, n);
+}
+
+static void load_fill(load_sess_t* s)
+{
+    ssize_t m;
+    do {
+        m = read(s->rfd, s->rbuf, LOAD_BUF);
+    } while (m < 0 && errno == EINTR);
+    if (m <= 0)
+        load_die("connection closed by server");
+    s->rpos = 0;
+    s->rlen = m;
+}
+
+static char* load_line(load_sess_t* s, char* line)
+{
+    size_t n = 0;
+    for (;;) {
+        char c;
+        if (s->rpos == s->rlen)
+            load_fill(s);
+        c = s->rbuf[s->rpos++];
+        if (c == '\n')
+            break;
+        if (n < LOAD_LINE-1)
+            line[n++] = c;
+    }
+    line[n] = '\0';
+    return line;
+}
+
+static void load_waitfor(load_sess_t* s, const char* tag)
+{
+    char line[LOAD_LINE];
+    while (strstr(load_line(s, line), tag) == NULL);
+}
+
+static void load_read(load_sess_t* s, size_t n)
+{
+    char* p;
+    if (n > s->cap) {
+        free(s->data);
+        if ((s->data = (char*) malloc(n)) == NULL)
+            load_die("out of memory");
+        s->cap = n;
+    }
+    p = s->data;
+    if (s->rpos < s->rlen) {
+        size_t m = s->rlen - s->rpos;
+        if (m > n)
+            m = n;
+        memcpy(p, s->rbuf + s->rpos, m);
+        s->rpos += m;
+        p += m;
+        n -= m;
+    }
+    while (n > 0) {
+        ssize_t m = read(s->rfd, p, n);
+        if (m < 0 && errno == EINTR)
+            continue;
+        if (m <= 0)
+            load_die("connection closed during transfer");
+        p += m;
+        n -= m;
+    }
+}
+
+/*@T
+ * \subsection{Opening sessions}
+ *
+ * Socket sessions connect to the server; pipe sessions start a server
+ * process of their own, connected by a pair of pipes, as the Java
+ * client does.  The shell is asked to [[exec]] the server command, so
+ * that the process we started is the one whose CPU time we measure.  Either way, we then go through the file name dialog
+ * that [[feapstart]] does, and end up at the macro prompt.
+ *
+ *@c*/
+static int load_connect()
+{
+    int fd = -1;
+    if (load_sockname) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, load_sockname, sizeof(addr.sun_path)-1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr*) &addr,
+                               sizeof(addr)) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        struct addrinfo hints, *res, *ai;
+        char host[256];
+        char* port;
+        strncpy(host, load_tcp, sizeof(host)-1);
+        host[sizeof(host)-1] = '\0';
+        if ((port = strrchr(host, ':')) == NULL)
+            load_die("TCP address should be host:port");
+        *port++ = '\0';
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host, port, &hints, &res) != 0)
+            load_die("cannot resolve server address");
+        for (ai = res; ai && fd < 0; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(res);
+    }
+    return fd;
+}
+
+static void load_spawn(load_sess_t* s)
+{
+    char cmd[LOAD_LINE];
+    int to[2], from[2];
+    snprintf(cmd, sizeof(cmd), "exec %s", load_command);
+    if (pipe(to) < 0 || pipe(from) < 0)
+        load_die("cannot create pipes");
+    s->pid = fork();
+    if (s->pid < 0)
+        load_die("cannot start server");
+    if (s->pid == 0) {
+        dup2(to[0], 0);
+        dup2(from[1], 1);
+        close(to[0]);
+        close(to[1]);
+        close(from[0]);
+        close(from[1]);
+        execl("/bin/sh", "sh", "-c", cmd, (char*) NULL);
+        _exit(127);
+    }
+    close(to[0]);
+    close(from[1]);
+    s->wfd = to[1];
+    s->rfd = from[0];
+}
+
+static void load_open(load_sess_t* s)
+{
+    char line[LOAD_LINE];
+
+    memset(s, 0, sizeof(*s));
+    if (load_command) {
+        load_spawn(s);
+    } else {
+        s->rfd = s->wfd = load_connect();
+        if (s->rfd < 0)
+            load_die("cannot connect to server");
+    }
+
+    load_waitfor(s, "FEAPSRV>");
+    load_send(s, "start");
+    load_waitfor(s, "MATFEAP SYNC");
+    load_send(s, "Ibench");
+    for (;;) {
+        load_line(s, line);
+        if (strstr(line, "*ERROR*")) {
+            load_die("server did not accept the input deck");
+        } else if (strstr(line, "Files are set")) {
+            load_waitfor(s, "MATFEAP SYNC");
+            load_send(s, "y");
+            load_waitfor(s, "MATFEAP SYNC");
+            return;
+        } else if (strstr(line, "MATFEAP SYNC")) {
+            load_send(s, "");
+        }
+    }
+}
+
+static void load_close(load_sess_t* s)
+{
+    load_send(s, "quit");
+    load_waitfor(s, "MATFEAP SYNC");
+    load_send(s, "n");
+    load_waitfor(s, "MATFEAP SYNC 1");
+    close(s->rfd);
+    if (s->wfd != s->rfd)
+        close(s->wfd);
+    if (s->pid > 0)
+        waitpid(s->pid, NULL, 0);
+    free(s->data);
+    free(s->lat);
+}
+
+/*@T
+ * \subsection{Operations}
+ *
+ * Each operation starts and ends at the macro prompt.  The payload
+ * byte count is what crossed the connection as array data; the
+ * protocol lines are not counted.
+ *
+ *@c*/
+static void load_array(load_sess_t* s, int op)
+{
+    char line[LOAD_LINE];
+    char kind[16];
+    long long n = 0, neq = 0, nup = 0;
+    int sym = 1;
+
+    load_send(s, "serv");
+    load_waitfor(s, "FEAPSRV>");
+    if (op == OP_GETM || op == OP_SETM) {
+        load_send(s, op == OP_GETM ? "getm X" : "setm X");
+        load_line(s, line);
+        if (sscanf(line, "%15s double %lld", kind, &n) != 2)
+            load_die("unexpected reply to array transfer");
+        load_send(s, "binary");
+        if (op == OP_GETM) {
+            load_read(s, 8*n);
+        } else {
+            if ((size_t) (8*n) > s->cap) {
+                free(s->data);
+                s->data = (char*) calloc(8*n, 1);
+                s->cap  = 8*n;
+            }
+            load_write(s, s->data, 8*n);
+        }
+        s->bytes += 8*n;
+    } else if (op == OP_SPARSE) {
+        load_send(s, "sparse binary tang");
+        load_line(s, line);
+        if (sscanf(line, "nnz %lld", &n) != 1)
+            load_die("unexpected reply to sparse transfer");
+        load_read(s, 24*n);
+        s->bytes += 24*n;
+    } else if (op == OP_PROFILE) {
+        load_send(s, "sparse profile tang");
+        load_line(s, line);
+        if (sscanf(line, "profile %lld %lld %d", &neq, &nup, &sym) != 3)
+            load_die("unexpected reply to profile transfer");
+        n = 4*neq + 8*(neq+nup) + (sym ? 0 : 8*nup);
+        load_read(s, n);
+        s->bytes += n;
+    }
+    load_waitfor(s, "FEAPSRV>");
+    load_send(s, "start");
+    load_waitfor(s, "MATFEAP SYNC");
+}
+
+static void load_size(load_sess_t* s, size_t bytes)
+{
+    char cmd[64];
+    sprintf(cmd, "size %lu", (unsigned long) ((bytes+7)/8));
+    load_send(s, cmd);
+    load_waitfor(s, "MATFEAP SYNC");
+}
+
+/*@T
+ * \subsection{Running a phase}
+ *
+ * Each session runs in its own thread.  The threads and the main
+ * thread meet at a barrier before each phase (after which the sessions
+ * set the payload size), at the start of the timed part, and at its
+ * end, so the wall clock time and CPU samples taken by the main thread
+ * bracket exactly the timed operations.  The main thread moves on to
+ * the next phase as soon as the last barrier is passed, so each thread
+ * keeps its own copy of the operation.
+ *
+ *@c*/
+static pthread_barrier_t load_barrier;
+static int    load_op;
+static size_t load_bytes;
+static int    load_nrep;
+
+static void* load_thread(void* arg)
+{
+    load_sess_t* s = (load_sess_t*) arg;
+    for (;;) {
+        int k, op;
+        pthread_barrier_wait(&load_barrier);
+        op = load_op;
+        if (op == OP_QUIT)
+            break;
+        if (op == OP_SERV) {
+            load_send(s, "serv");
+            load_waitfor(s, "FEAPSRV>");
+        } else {
+            load_size(s, load_bytes);
+        }
+        s->lat   = (double*) realloc(s->lat, load_nrep * sizeof(double));
+        s->nlat  = 0;
+        s->bytes = 0;
+
+        pthread_barrier_wait(&load_barrier);
+        for (k = 0; k < load_nrep; ++k) {
+            double t = load_now();
+            if (op == OP_SERV) {
+                load_send(s, "get neq");
+                load_waitfor(s, "FEAPSRV>");
+            } else {
+                load_array(s, op);
+            }
+            s->lat[s->nlat++] = load_now() - t;
+        }
+        pthread_barrier_wait(&load_barrier);
+
+        if (op == OP_SERV) {
+            load_send(s, "start");
+            load_waitfor(s, "MATFEAP SYNC");
+        }
+    }
+    return NULL;
+}
+
+/*@T
+ * \subsection{CPU accounting}
+ *
+ * Client CPU time comes from [[getrusage]].  For the server side we
+ * need the session processes: pipe sessions started them, and for a
+ * daemon we ask its admin socket for the session list.  Their user and
+ * system times are read from [[/proc/PID/stat]] before and after each
+ * phase.
+ *
+ *@c*/
+static pid_t load_pids[1024];
+static int   load_npids;
+
+static void load_find_sessions(load_sess_t* sess)
+{
+    struct sockaddr_un addr;
+    char buf[LOAD_BUF];
+    size_t len = 0;
+    ssize_t m;
+    char* line;
+    int i, fd;
+
+    load_npids = 0;
+    if (load_command) {
+        for (i = 0; i < load_nsess && i < 1024; ++i)
+            load_pids[load_npids++] = sess[i].pid;
+        return;
+    }
+    if (load_admin == NULL)
+        return;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, load_admin, sizeof(addr.sun_path)-1);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "feapload: cannot reach admin socket\n");
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    write(fd, "list\nquit\n", 10);
+    while (len < sizeof(buf)-1 &&
+           (m = read(fd, buf+len, sizeof(buf)-1-len)) > 0)
+        len += m;
+    buf[len] = '\0';
+    close(fd);
+
+    for (line = strtok(buf, "\n"); line; line = strtok(NULL, "\n"))
+        if (line[0] >= '0' && line[0] <= '9' && load_npids < 1024)
+            load_pids[load_npids++] = (pid_t) atol(line);
+}
+
+static double load_server_cpu()
+{
+    double ticks = 0;
+    int i;
+    for (i = 0; i < load_npids; ++i) {
+        char path[64], buf[1024];
+        char* p;
+        FILE* fp;
+        unsigned long ut, st;
+        sprintf(path, "/proc/%d/stat", (int) load_pids[i]);
+        if ((fp = fopen(path, "r")) == NULL)
+            continue;
+        if (fgets(buf, sizeof(buf), fp) && (p = strrchr(buf, ')')) &&
+            sscanf(p+2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                   &ut, &st) == 2)
+            ticks += ut + st;
+        fclose(fp);
+    }
+    return ticks / sysconf(_SC_CLK_TCK);
+}
+
+static double load_client_cpu()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + 1e-6 * ru.ru_utime.tv_usec +
+           ru.ru_stime.tv_sec + 1e-6 * ru.ru_stime.tv_usec;
+}
+
+static int load_cmp(const void* a, const void* b)
+{
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+/*@T
+ * \subsection{Reporting}
+ *
+ * There is one line per operation and payload size:
+ * \begin{verbatim}
+ *   transport sessions op bytes reps MB/s p50_us p99_us cpu_ns/B cpu_us/op
+ * \end{verbatim}
+ * where [[reps]] is the number of operations per session, [[MB/s]]
+ * is the total payload over all sessions divided by the wall clock
+ * time, and the CPU columns include both client and server. Columns
+ * that do not apply are printed as [[-]].
+ *
+ *@c*/
+static void load_report(load_sess_t* sess, double wall, double cpu)
+{
+    const char* transport =
+        load_command ? "pipe" : load_sockname ? "unix" : "tcp";
+    double* all = (double*) malloc(load_nsess * load_nrep * sizeof(double));
+    long long bytes = 0;
+    int i, n = 0;
+
+    for (i = 0; i < load_nsess; ++i) {
+        memcpy(all+n, sess[i].lat, sess[i].nlat * sizeof(double));
+        n += sess[i].nlat;
+        bytes += sess[i].bytes;
+    }
+    qsort(all, n, sizeof(double), load_cmp);
+
+    printf("%-4s %3d %-7s %10lu %5d", transport, load_nsess,
+           load_opnames[load_op],
+           (unsigned long) (load_op == OP_SERV ? 0 : load_bytes), load_nrep);
+    if (bytes > 0)
+        printf(" %9.1f", bytes / wall / 1e6);
+    else
+        printf(" %9s", "-");
+    printf(" %9.1f %9.1f", 1e6 * all[n/2], 1e6 * all[(n*99)/100 < n ?
+                                                     (n*99)/100 : n-1]);
+    if (cpu < 0)
+        printf(" %9s %9s\n", "-", "-");
+    else if (bytes > 0)
+        printf(" %9.3f %9.1f\n", 1e9 * cpu / bytes, 1e6 * cpu / n);
+    else
+        printf(" %9s %9.1f\n", "-", 1e6 * cpu / n);
+    fflush(stdout);
+    free(all);
+}
+
+/*@T
+ * \subsection{Starting a daemon}
+ *
+ * With [[-x]], we start the socket server ourselves, tell it where to
+ * listen and where to put its admin socket through the environment,
+ * and wait until it accepts connections.  Its console output is
+ * discarded.  At the end, we give the daemon a moment to reap the
+ * sessions before we stop it.
+ *
+ *@c*/
+static void load_start_daemon()
+{
+    static char admin[64];
+    int k, fd;
+
+    sprintf(admin, "/tmp/feapload-admin-%d", (int) getpid());
+    load_admin = admin;
+    load_daemon = fork();
+    if (load_daemon < 0)
+        load_die("cannot start server");
+    if (load_daemon == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (load_sockname) {
+            unlink(load_sockname);
+            setenv("MATFEAP_SOCKNAME", load_sockname, 1);
+        } else {
+            setenv("MATFEAP_PORT", strrchr(load_tcp, ':')+1, 1);
+        }
+        setenv("MATFEAP_ADMIN", admin, 1);
+        dup2(null, 1);
+        execl(load_server, load_server, (char*) NULL);
+        _exit(127);
+    }
+    for (k = 0; k < 100; ++k) {
+        usleep(50000);
+        if ((fd = load_connect()) >= 0) {
+            close(fd);
+            return;
+        }
+    }
+    load_die("server did not start");
+}
+
+static size_t load_parse_size(const char* s)
+{
+    char* end;
+    double v = strtod(s, &end);
+    if (*end == 'K' || *end == 'k')
+        v *= 1024;
+    else if (*end == 'M' || *end == 'm')
+        v *= 1024*1024;
+    else if (*end == 'G' || *end == 'g')
+        v *= 1024.0*1024*1024;
+    return (size_t) v;
+}
+
+static void load_parse_ops(char* s)
+{
+    char* tok;
+    int i;
+    memset(load_ops, 0, sizeof(load_ops));
+    for (tok = strtok(s, ","); tok; tok = strtok(NULL, ",")) {
+        for (i = 0; i < OP_COUNT && strcmp(tok, load_opnames[i]); ++i);
+        if (i == OP_COUNT)
+            load_die("unknown operation");
+        load_ops[i] = 1;
+    }
+}
+
+/*@T
+ * \subsection{Main routine}
+ *
+ *@c*/
+int main(int argc, char** argv)
+{
+    load_sess_t* sess;
+    pthread_t* threads;
+    int i, c;
+
+    while ((c = getopt(argc, argv, "t:u:p:x:a:n:r:s:m:b:o:")) != -1) {
+        switch (c) {
+        case 't': load_tcp      = optarg; break;
+        case 'u': load_sockname = optarg; break;
+        case 'p': load_command  = optarg; break;
+        case 'x': load_server   = optarg; break;
+        case 'a': load_admin    = optarg; break;
+        case 'n': load_nsess    = atoi(optarg); break;
+        case 'r': load_reps     = atoi(optarg); break;
+        case 's': load_min      = load_parse_size(optarg); break;
+        case 'm': load_max      = load_parse_size(optarg); break;
+        case 'b': load_budget   = load_parse_size(optarg); break;
+        case 'o': load_parse_ops(optarg); break;
+        default:
+            fprintf(stderr,
+                    "Usage: feapload [-t host:port | -u sockname | -p cmd]"
+                    " [-x server]\n"
+                    "         [-a adminsock] [-n sessions] [-r reps]"
+                    " [-s min] [-m max]\n"
+                    "         [-b budget] [-o ops]\n");
+            return -1;
+        }
+    }
+    if (!load_tcp && !load_sockname && !load_command)
+        load_die("need one of -t, -u, or -p");
+    if (load_server && load_command)
+        load_die("-x is for socket servers");
+    if (load_nsess < 1 || load_reps < 1 || load_min < 8)
+        load_die("bad session count, repetition count, or size");
+
+    signal(SIGPIPE, SIG_IGN);
+    if (load_server)
+        load_start_daemon();
+
+    sess    = (load_sess_t*) calloc(load_nsess, sizeof(load_sess_t));
+    threads = (pthread_t*)   calloc(load_nsess, sizeof(pthread_t));
+    for (i = 0; i < load_nsess; ++i)
+        load_open(sess+i);
+    load_find_sessions(sess);
+
+    pthread_barrier_init(&load_barrier, NULL, load_nsess+1);
+    for (i = 0; i < load_nsess; ++i)
+        pthread_create(threads+i, NULL, load_thread, sess+i);
+
+    printf("# transport sessions op bytes reps MB/s p50_us p99_us"
+           " cpu_ns/B cpu_us/op\n");
+    for (load_op = 0; load_op < OP_COUNT; ++load_op) {
+        size_t bytes;
+        if (!load_ops[load_op])
+            continue;
+        for (bytes = load_min; bytes <= load_max; bytes *= 4) {
+            double t0, t1, cpu0, cpu1;
+            load_bytes = bytes;
+            load_nrep  = load_reps;
+            if (load_op != OP_SERV &&
+                load_budget / bytes < (size_t) load_nrep)
+                load_nrep = (load_budget / bytes > 3) ?
+                    (int) (load_budget / bytes) : 3;
+
+            pthread_barrier_wait(&load_barrier);
+            pthread_barrier_wait(&load_barrier);
+            t0   = load_now();
+            cpu0 = load_client_cpu() + load_server_cpu();
+            pthread_barrier_wait(&load_barrier);
+            t1   = load_now();
+            cpu1 = load_client_cpu() + load_server_cpu();
+
+            load_report(sess, t1-t0, load_npids ? cpu1-cpu0 : -1);
+            if (load_op == OP_SERV)
+                break;
+        }
+    }
+
+    load_op = OP_QUIT;
+    pthread_barrier_wait(&load_barrier);
+    for (i = 0; i < load_nsess; ++i) {
+        pthread_join(threads[i], NULL);
+        load_close(sess+i);
+    }
+
+    if (load_daemon > 0) {
+        for (i = 0; i < 40 && load_npids > 0; ++i) {
+            usleep(50000);
+            load_find_sessions(sess);
+        }
+        kill(load_daemon, SIGTERM);
+        waitpid(load_daemon, NULL, 0);
+        unlink(load_admin);
+        if (load_sockname)
+            unlink(load_sockname);
+    }
+    free(threads);
+    free(sess);
+    return 0;
+}
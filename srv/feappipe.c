@@ -2,8 +2,10 @@
  * FEAP pipe server
  */
 
+#include <stdlib.h>
+
 int feapserver_()
 {
+    unsetenv("MATFEAP_RESET");
     return 0;
 }
-
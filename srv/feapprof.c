@@ -0,0 +1,408 @@
+/*
+ * Timing profile of FEAP commands
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PROFILE_ENV_VAR "MATFEAP_PROFILE"
+
+/*@T
+ * \section{Command timing}
+ *
+ * To see where the time in a session goes -- FEAP computing, MATFEAP
+ * moving data, or the server sitting at a prompt while the client
+ * thinks -- the server can time each command it runs.  The hooks are
+ * the places where the server already notices commands starting and
+ * stopping: [[tinput]] for FEAP macros typed at the console prompt
+ * (including [[serv]] itself), and the [[feapsrv]] dispatcher for
+ * each of its subcommands.  The profile is controlled with
+ * \begin{verbatim}
+ *   profile [on | off | clear | show | trace PATH]
+ * \end{verbatim}
+ * [[on]] starts recording (from a clean slate) and [[off]] stops;
+ * [[clear]] throws away what has been recorded so far.  [[show]] (or
+ * no argument) prints a table:
+ * \begin{verbatim}
+ *   Profile ROWS ELAPSED
+ *   NAME COUNT TOTAL MAX CPU
+ *   ...
+ * \end{verbatim}
+ * with one row per distinct command, giving the number of times it
+ * ran, its total and longest wall clock times, and its total CPU time
+ * (summed over threads), all in seconds.  FEAP macros are listed by
+ * name and option, as in {\tt mass,lump}, and [[feapsrv]] subcommands
+ * as {\tt serv:getm} and so on; their time is also part of the time of
+ * the [[serv]] macro that entered the interface.  The row [[(wait)]]
+ * is the time spent at either prompt waiting for the client.
+ * [[ELAPSED]] is the time since recording started.
+ *
+ * [[trace PATH]] writes the recorded commands as a Chrome trace-event
+ * file, which can be opened in [[chrome://tracing]] or Perfetto; each
+ * command is one complete event, with [[feapsrv]] subcommands nested
+ * inside their [[serv]] macro.  If the environment variable
+ * [[MATFEAP_PROFILE]] names a file when the server starts, recording
+ * starts at once and the trace is written to that file when the
+ * process exits.  Sessions forked by the daemon and sessions cloned
+ * from a template (see [[feaptmpl.c]]) all inherit the setting, so
+ * each process writes its own file: a [[%p]] in the path is replaced
+ * by the process ID, and if there is none, {\tt .{\it pid}} is added
+ * at the end.  A [[%p]] in the path given to [[trace]] is replaced the
+ * same way.
+ *
+ * FEAP reads the body of a [[loop]] (and all the commands of a
+ * [[batch]] block) before running any of it, so those commands are not
+ * seen one at a time; they are timed together as part of the command
+ * that started the loop.
+ *
+ *@c*/
+#define PROF_DEPTH   4
+#define PROF_NAME    32
+#define PROF_ROWS    256
+#define PROF_EVENTS  (1 << 20)
+
+typedef struct prof_row_t {
+    char   name[PROF_NAME];
+    long   count;
+    double total, max, cpu;
+} prof_row_t;
+
+typedef struct prof_event_t {
+    char   name[PROF_NAME];
+    double t0, t1, cpu;
+} prof_event_t;
+
+static int           prof_on = 0;
+static double        prof_origin;
+static prof_row_t    prof_rows[PROF_ROWS];
+static int           prof_nrows = 0;
+static prof_event_t* prof_events = NULL;
+static size_t        prof_nevents = 0;
+static size_t        prof_cap = 0;
+static long          prof_dropped = 0;
+
+static int    prof_depth = 0;            /* Open commands              */
+static char   prof_stack[PROF_DEPTH][PROF_NAME];
+static double prof_t0[PROF_DEPTH];
+static double prof_c0[PROF_DEPTH];
+static double prof_wait0 = -1;           /* Start of wait, if waiting  */
+
+static char*  prof_trace_path = NULL;
+
+static double prof_clock(clockid_t id)
+{
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static double prof_now()
+{
+    return prof_clock(CLOCK_MONOTONIC) - prof_origin;
+}
+
+static void prof_clear()
+{
+    prof_nrows   = 0;
+    prof_nevents = 0;
+    prof_dropped = 0;
+    prof_depth   = 0;
+    prof_wait0   = -1;
+    prof_origin  = prof_clock(CLOCK_MONOTONIC);
+}
+
+/*@T
+ * \subsection{Recording}
+ *
+ * Each finished command adds to its row of the table and, until
+ * [[PROF_EVENTS]] events have been stored, to the event list for the
+ * trace.  After that, the table is still kept up to date, and the
+ * trace notes how many events were dropped.  The lookup in the table
+ * is linear, but a session uses only a few dozen distinct commands.
+ *
+ *@c*/
+static prof_row_t* prof_row(const char* name)
+{
+    int i;
+    for (i = 0; i < prof_nrows; ++i)
+        if (strcmp(prof_rows[i].name, name) == 0)
+            return prof_rows + i;
+    if (prof_nrows == PROF_ROWS)
+        return NULL;
+    memset(prof_rows + i, 0, sizeof(prof_row_t));
+    strncpy(prof_rows[i].name, name, PROF_NAME-1);
+    return prof_rows + prof_nrows++;
+}
+
+static void prof_add(const char* name, double t0, double t1, double cpu)
+{
+    prof_row_t* row = prof_row(name);
+    if (row) {
+        row->count++;
+        row->total += t1-t0;
+        row->cpu   += (cpu > 0) ? cpu : 0;
+        if (t1-t0 > row->max)
+            row->max = t1-t0;
+    }
+    if (cpu < 0)
+        return;
+    if (prof_nevents == prof_cap && prof_cap < PROF_EVENTS) {
+        size_t cap = prof_cap ? 2*prof_cap : 1024;
+        prof_event_t* e = (prof_event_t*)
+            realloc(prof_events, cap * sizeof(prof_event_t));
+        if (e) {
+            prof_events = e;
+            prof_cap = cap;
+        }
+    }
+    if (prof_nevents < prof_cap) {
+        prof_event_t* e = prof_events + prof_nevents++;
+        strcpy(e->name, row ? row->name : "?");
+        e->t0  = t0;
+        e->t1  = t1;
+        e->cpu = cpu;
+    } else {
+        ++prof_dropped;
+    }
+}
+
+/*@T
+ * The hooks are [[feapprof_wait]], called just before the server
+ * blocks for a command, [[feapprof_begin]], called once the command has
+ * been read, and [[feapprof_end]], called when it is done.  Commands
+ * nest (a [[feapsrv]] subcommand inside [[serv]]) up to [[PROF_DEPTH]]
+ * levels.  A wait is recorded with a negative CPU time as a flag, so
+ * that it goes in the table but not in the trace.  Clearing the
+ * profile forgets the commands that are still running, and their ends
+ * are ignored.
+ *
+ *@c*/
+void feapprof_wait()
+{
+    if (prof_on && prof_wait0 < 0)
+        prof_wait0 = prof_now();
+}
+
+void feapprof_begin(const char* cat, const char* name)
+{
+    double t;
+    if (!prof_on)
+        return;
+    t = prof_now();
+    if (prof_wait0 >= 0) {
+        prof_add("(wait)", prof_wait0, t, -1);
+        prof_wait0 = -1;
+    }
+    if (prof_depth < PROF_DEPTH) {
+        if (cat)
+            snprintf(prof_stack[prof_depth], PROF_NAME, "%s:%s", cat, name);
+        else
+            snprintf(prof_stack[prof_depth], PROF_NAME, "%s", name);
+        prof_t0[prof_depth] = t;
+        prof_c0[prof_depth] = prof_clock(CLOCK_PROCESS_CPUTIME_ID);
+    }
+    ++prof_depth;
+}
+
+void feapprof_end()
+{
+    if (!prof_on || prof_depth == 0)
+        return;
+    --prof_depth;
+    if (prof_depth < PROF_DEPTH)
+        prof_add(prof_stack[prof_depth], prof_t0[prof_depth], prof_now(),
+                 prof_clock(CLOCK_PROCESS_CPUTIME_ID) - prof_c0[prof_depth]);
+}
+
+/*@T
+ * On the FORTRAN side, [[tinput]] passes the first two text fields of
+ * the command line, which hold the macro name and its option, as far
+ * as the caller asked for them.  Console input with no text fields
+ * (answers to FEAP's numeric prompts) is listed as [[(input)]].
+ *
+ *@c*/
+static void prof_field(char* dst, const char* src, int len)
+{
+    int i, n = 0;
+    for (i = 0; i < len && src[i] == ' '; ++i);
+    for (; i < len && src[i] != ' ' && n < 15; ++i)
+        dst[n++] = src[i];
+    dst[n] = 0;
+}
+
+int feapprofbegin_(char* tx1, char* tx2, int len1, int len2)
+{
+    char name[PROF_NAME], opt[16];
+    if (!prof_on)
+        return 0;
+    prof_field(name, tx1, len1);
+    prof_field(opt,  tx2, len2);
+    if (!name[0])
+        strcpy(name, "(input)");
+    else if (opt[0])
+        sprintf(name + strlen(name), ",%s", opt);
+    feapprof_begin(NULL, name);
+    return 0;
+}
+
+int feapprofend_()
+{
+    feapprof_end();
+    return 0;
+}
+
+int feapprofwait_()
+{
+    feapprof_wait();
+    return 0;
+}
+
+/*@T
+ * \subsection{Output}
+ *
+ * Command names are alphanumeric in practice, but we escape them for
+ * JSON anyway.  Times in the trace are in microseconds, with the
+ * CPU time of each event in its [[args]].
+ *
+ *@c*/
+static void prof_show()
+{
+    int i;
+    printf("Profile %d %.6f\n", prof_nrows, prof_on ? prof_now() : 0.0);
+    for (i = 0; i < prof_nrows; ++i)
+        printf("%-20s %8ld %12.6f %12.6f %12.6f\n",
+               prof_rows[i].name, prof_rows[i].count, prof_rows[i].total,
+               prof_rows[i].max, prof_rows[i].cpu);
+}
+
+static void prof_json_string(FILE* fp, const char* s)
+{
+    fputc('"', fp);
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', fp);
+        if ((unsigned char) *s >= ' ')
+            fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+/* Replace each %p in the path with the process ID, or add .PID */
+static char* prof_path(const char* path, int suffix)
+{
+    char pid[32];
+    const char* s;
+    char* result;
+    size_t n = strlen(path) + 1;
+    int found = 0;
+
+    sprintf(pid, "%d", (int) getpid());
+    for (s = strstr(path, "%p"); s; s = strstr(s+2, "%p"))
+        ++found;
+    n += found * strlen(pid);
+    if (suffix && !found)
+        n += strlen(pid) + 1;
+    if ((result = (char*) malloc(n)) == NULL)
+        return NULL;
+
+    *result = 0;
+    for (s = path; *s; ) {
+        const char* p = strstr(s, "%p");
+        if (p == NULL) {
+            strcat(result, s);
+            break;
+        }
+        strncat(result, s, p-s);
+        strcat(result, pid);
+        s = p+2;
+    }
+    if (suffix && !found) {
+        strcat(result, ".");
+        strcat(result, pid);
+    }
+    return result;
+}
+
+static int prof_trace(const char* name, int suffix)
+{
+    char* path = prof_path(name, suffix);
+    FILE* fp = path ? fopen(path, "w") : NULL;
+    int pid = (int) getpid();
+    size_t i;
+    free(path);
+    if (fp == NULL)
+        return -1;
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\",\n");
+    fprintf(fp, " \"otherData\": {\"dropped\": %ld},\n", prof_dropped);
+    fprintf(fp, " \"traceEvents\": [\n");
+    fprintf(fp, "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, "
+            "\"tid\": 1, \"args\": {\"name\": \"FEAP\"}}", pid);
+    for (i = 0; i < prof_nevents; ++i) {
+        prof_event_t* e = prof_events + i;
+        fprintf(fp, ",\n  {\"name\": ");
+        prof_json_string(fp, e->name);
+        fprintf(fp, ", \"cat\": \"%s\", \"ph\": \"X\", "
+                "\"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": 1, "
+                "\"args\": {\"cpu_ms\": %.3f}}",
+                strncmp(e->name, "serv:", 5) ? "feap" : "serv",
+                1e6 * e->t0, 1e6 * (e->t1 - e->t0), pid, 1e3 * e->cpu);
+    }
+    fprintf(fp, "\n]}\n");
+    return fclose(fp) ? -1 : 0;
+}
+
+/*@T
+ * \subsection{Setup and commands}
+ *
+ * The [[feapsrv]] dispatcher calls [[feapprof_setup]] when it first
+ * starts, and handles [[profile]] by calling [[feapsrv_profile]].
+ *
+ *@c*/
+static void prof_atexit()
+{
+    prof_trace(prof_trace_path, 1);
+}
+
+void feapprof_setup()
+{
+    static int done = 0;
+    char* path = getenv(PROFILE_ENV_VAR);
+    if (done)
+        return;
+    done = 1;
+    if (path && *path) {
+        prof_trace_path = strdup(path);
+        prof_clear();
+        prof_on = 1;
+        atexit(prof_atexit);
+    }
+}
+
+void feapsrv_profile(const char* mode, const char* arg)
+{
+    if (mode == NULL || strcmp(mode, "show") == 0) {
+        prof_show();
+    } else if (strcmp(mode, "on") == 0) {
+        prof_clear();
+        prof_on = 1;
+        printf("Profile on\n");
+    } else if (strcmp(mode, "off") == 0) {
+        prof_on = 0;
+        printf("Profile off\n");
+    } else if (strcmp(mode, "clear") == 0) {
+        prof_clear();
+        printf("Profile cleared\n");
+    } else if (strcmp(mode, "trace") == 0) {
+        if (arg == NULL)
+            printf("Missing path\n");
+        else if (prof_trace(arg, 0) < 0)
+            perror("trace");
+        else
+            printf("Trace %lu events\n", (unsigned long) prof_nevents);
+    } else {
+        printf("Unrecognized profile mode: %s\n", mode);
+    }
+}
@@ -0,0 +1,345 @@
+/*
+ * Pushed array subscriptions
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+/*@T
+ * \section{Array subscriptions}
+ *
+ * In a transient run, a client that wants to watch the solution has to
+ * stop FEAP after every step, fetch what it wants, and start FEAP
+ * again; FEAP sits idle while the client works, and the client sits
+ * idle while FEAP works.  Instead, the client can subscribe to arrays,
+ * and the server sends them as they change without being asked:
+ * \begin{verbatim}
+ *   subscribe ID VAR [full | reduced] [norm2 | norminf]
+ *             [every K] [after MACRO]
+ *   subscribe
+ *   unsubscribe ID | all
+ * \end{verbatim}
+ * The first form adds a subscription to the array [[VAR]] under a
+ * positive integer [[ID]] of the client's choosing, replacing any
+ * earlier subscription with the same [[ID]], and answers
+ * {\tt Subscribed {\it ID}}.  The second lists the subscriptions, one
+ * line each after a {\tt Subscriptions {\it n}} header, and the third
+ * drops one or all of them and answers with the number left.
+ *
+ * A subscription fires on one of two kinds of events.  By default, it
+ * fires at each {\tt serv,push} macro, which goes in the body of a
+ * FEAP [[loop]] (say, after the [[time]] and [[tang]] macros of a time
+ * step); FEAP runs the commands inside a loop without going through
+ * the console, so that is the only place we can get control.  With
+ * [[after MACRO]], it fires instead when a console command whose name
+ * matches [[MACRO]] finishes, with names compared on their first four
+ * characters as FEAP does.  With [[every K]], only every [[K]]th event
+ * sends anything.
+ *
+ * What is sent is the array ([[full]], the default), or its active
+ * degrees of freedom scattered into equation order ([[reduced]], with
+ * [[neq]] entries, as for [[addm]] and [[reduce]]); or, with [[norm2]]
+ * or [[norminf]], just the norm of that vector.  Each push is one line
+ * \begin{verbatim}
+ *   MATFEAP PUSH ID SEQ TTIM double N     (followed by N doubles)
+ *   MATFEAP PUSH ID SEQ TTIM norm2 VALUE
+ *   MATFEAP PUSH ID SEQ TTIM missing
+ * \end{verbatim}
+ * where [[SEQ]] counts the pushes for the subscription, starting from
+ * one, and [[TTIM]] is FEAP's current time.  The doubles are in wire
+ * format, with no handshake: the client reads them directly.  The
+ * last form is for an array that does not exist (yet), or is not
+ * double precision.
+ *
+ * Pushes go out in the console stream, where the client finds them
+ * while it waits for a synchronization message.  A long [[loop]] thus
+ * runs at FEAP's speed while the client takes in the results as they
+ * come; FEAP only waits if the client falls so far behind that the
+ * connection's buffers fill up.  Pushes for console commands are sent
+ * at the next prompt, before its synchronization message.
+ *
+ *@c*/
+#define PUSH_MAX    32
+#define PUSH_NAME   16
+
+#define PUSH_FULL    0
+#define PUSH_REDUCED 1
+
+#define PUSH_DATA    0
+#define PUSH_NORM2   1
+#define PUSH_NORMINF 2
+
+static const char* push_norms[] = { "data", "norm2", "norminf" };
+
+typedef struct push_sub_t {
+    int  id;
+    char var[PUSH_NAME];
+    int  subset;
+    int  norm;
+    int  every;
+    char after[PUSH_NAME];    /* Empty for serv,push */
+    long events;
+    long seq;
+} push_sub_t;
+
+static push_sub_t  push_subs[PUSH_MAX];
+static int         push_nsubs = 0;
+static push_sub_t* push_cur   = NULL;      /* Subscription being sent */
+static char        push_macro[PUSH_NAME];  /* Console command running */
+
+/*@T
+ * \subsection{Sending}
+ *
+ * The FORTRAN routine [[feappush]] looks up the array for the current
+ * subscription and hands it to [[fmpush]], along with the [[ID]] array
+ * and the equation counts for the reduced form, or calls
+ * [[fmpushnone]] if there is nothing to send.
+ *
+ *@c*/
+static double push_ttim()
+{
+    extern int feapsrv_scalar_count();
+    extern const char* feapsrv_scalar_name(int i);
+    extern double feapsrv_scalar_value(int i);
+    int i, n = feapsrv_scalar_count();
+    for (i = 0; i < n; ++i)
+        if (strcasecmp(feapsrv_scalar_name(i), "ttim") == 0)
+            return feapsrv_scalar_value(i);
+    return 0;
+}
+
+static void push_header()
+{
+    printf("MATFEAP PUSH %d %ld %.17g ", push_cur->id, push_cur->seq,
+           push_ttim());
+}
+
+int fmpushnone_()
+{
+    if (push_cur == NULL)
+        return 0;
+    push_header();
+    printf("missing\n");
+    return 0;
+}
+
+int fmpush_(double* x, int* len, int* id, int* nneq, int* neq)
+{
+    extern double htond(double x);
+    double* y = NULL;
+    double s = 0;
+    int i, n = *len;
+
+    if (push_cur == NULL)
+        return 0;
+    if (push_cur->subset == PUSH_REDUCED) {
+        int m = (*nneq < *len) ? *nneq : *len;
+        n = *neq;
+        y = (double*) calloc(n+1, sizeof(double));
+        if (y == NULL)
+            return fmpushnone_();
+        for (i = 0; i < m; ++i)
+            if (id[i] > 0 && id[i] <= n)
+                y[id[i]-1] = x[i];
+    } else if (push_cur->norm == PUSH_DATA) {
+        y = (double*) malloc((n+1) * sizeof(double));
+        if (y == NULL)
+            return fmpushnone_();
+        memcpy(y, x, n * sizeof(double));
+    } else {
+        y = x;
+    }
+
+    push_header();
+    if (push_cur->norm == PUSH_DATA) {
+        printf("double %d\n", n);
+        for (i = 0; i < n; ++i)
+            y[i] = htond(y[i]);
+        fwrite(y, sizeof(double), n, stdout);
+    } else {
+        for (i = 0; i < n; ++i) {
+            if (push_cur->norm == PUSH_NORM2)
+                s += y[i]*y[i];
+            else if (fabs(y[i]) > s)
+                s = fabs(y[i]);
+        }
+        if (push_cur->norm == PUSH_NORM2)
+            s = sqrt(s);
+        printf("%s %.17g\n", push_norms[push_cur->norm], s);
+    }
+    if (y != x)
+        free(y);
+    return 0;
+}
+
+/*@T
+ * \subsection{Events}
+ *
+ * Both kinds of event go through [[push_fire]], which counts the event
+ * for each subscription it applies to and sends the ones that are due.
+ * Whatever FEAP has written to the console so far is flushed first, so
+ * that a push lands after the output of the command it follows.
+ *
+ *@c*/
+static int push_match(const char* a, const char* b)
+{
+    return (*a && *b && strncasecmp(a, b, 4) == 0);
+}
+
+static void push_fire(const char* macro)
+{
+    extern int feapflush_();
+    extern int feappush_(char* var, int len);
+    int k, flushed = 0;
+
+    for (k = 0; k < push_nsubs; ++k) {
+        push_sub_t* sub = push_subs + k;
+        if (macro ? !push_match(sub->after, macro) : sub->after[0] != 0)
+            continue;
+        if (++sub->events % sub->every != 0)
+            continue;
+        if (!flushed) {
+            feapflush_();
+            flushed = 1;
+        }
+        ++sub->seq;
+        push_cur = sub;
+        feappush_(sub->var, strlen(sub->var));
+        push_cur = NULL;
+    }
+    if (flushed)
+        fflush(stdout);
+}
+
+/*@T
+ * The [[serv,push]] macro calls [[feappushstep]].  The [[tinput]]
+ * routine calls [[feappushmacro]] with the name of each console command
+ * it reads, and [[feappushdone]] at the next prompt.
+ *
+ *@c*/
+int feappushstep_()
+{
+    push_fire(NULL);
+    return 0;
+}
+
+int feappushmacro_(char* name, int len)
+{
+    int n = 0;
+    while (n < len && n < PUSH_NAME-1 && name[n] != ' ')
+        ++n;
+    memcpy(push_macro, name, n);
+    push_macro[n] = 0;
+    return 0;
+}
+
+int feappushdone_()
+{
+    if (push_macro[0])
+        push_fire(push_macro);
+    push_macro[0] = 0;
+    return 0;
+}
+
+/*@T
+ * \subsection{The [[subscribe]] and [[unsubscribe]] commands}
+ *
+ * The dispatcher passes the words after [[subscribe]] or
+ * [[unsubscribe]] to [[feapsrv_subscribe]] or [[feapsrv_unsubscribe]].
+ * Replacing a subscription starts its count of events and pushes over.
+ *
+ *@c*/
+static void push_list()
+{
+    int k;
+    printf("Subscriptions %d\n", push_nsubs);
+    for (k = 0; k < push_nsubs; ++k) {
+        push_sub_t* sub = push_subs + k;
+        printf("%d %s %s %s every %d %s%s\n", sub->id, sub->var,
+               sub->subset == PUSH_REDUCED ? "reduced" : "full",
+               push_norms[sub->norm], sub->every,
+               sub->after[0] ? "after " : "push", sub->after);
+    }
+}
+
+void feapsrv_subscribe(char** args, int n)
+{
+    push_sub_t sub;
+    char* end;
+    long id;
+    int j, k;
+
+    if (n == 0) {
+        push_list();
+        return;
+    }
+    if (n < 2) {
+        printf("Usage: subscribe ID VAR [full | reduced] [norm2 | norminf]"
+               " [every K] [after MACRO]\n");
+        return;
+    }
+    id = strtol(args[0], &end, 10);
+    if (*end || id <= 0 || id != (int) id) {
+        printf("Bad subscription: %s\n", args[0]);
+        return;
+    }
+
+    memset(&sub, 0, sizeof(sub));
+    sub.id    = (int) id;
+    sub.every = 1;
+    strncpy(sub.var, args[1], PUSH_NAME-1);
+    for (j = 2; j < n; ++j) {
+        if (strcmp(args[j], "full") == 0)
+            sub.subset = PUSH_FULL;
+        else if (strcmp(args[j], "reduced") == 0)
+            sub.subset = PUSH_REDUCED;
+        else if (strcmp(args[j], "norm2") == 0)
+            sub.norm = PUSH_NORM2;
+        else if (strcmp(args[j], "norminf") == 0)
+            sub.norm = PUSH_NORMINF;
+        else if (strcmp(args[j], "every") == 0 && j+1 < n) {
+            sub.every = atoi(args[++j]);
+            if (sub.every < 1) {
+                printf("Bad count: %s\n", args[j]);
+                return;
+            }
+        } else if (strcmp(args[j], "after") == 0 && j+1 < n)
+            strncpy(sub.after, args[++j], PUSH_NAME-1);
+        else {
+            printf("Unexpected argument: %s\n", args[j]);
+            return;
+        }
+    }
+
+    for (k = 0; k < push_nsubs && push_subs[k].id != sub.id; ++k);
+    if (k == PUSH_MAX) {
+        printf("Too many subscriptions\n");
+        return;
+    }
+    if (k == push_nsubs)
+        ++push_nsubs;
+    push_subs[k] = sub;
+    printf("Subscribed %d\n", sub.id);
+}
+
+void feapsrv_unsubscribe(const char* which)
+{
+    int j, k;
+    if (which == NULL) {
+        printf("Missing subscription\n");
+        return;
+    }
+    if (strcmp(which, "all") == 0)
+        push_nsubs = 0;
+    else {
+        int id = atoi(which);
+        for (j = 0, k = 0; j < push_nsubs; ++j)
+            if (push_subs[j].id != id)
+                push_subs[k++] = push_subs[j];
+        push_nsubs = k;
+    }
+    printf("Subscriptions %d\n", push_nsubs);
+}
@@ -0,0 +1,158 @@
+/*
+ * Queued macro commands
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*@T
+ * \section{Queued macro commands}
+ *
+ * Running a list of macros one at a time costs a round trip per
+ * macro: the client sends a command, waits for the synchronization
+ * message at the next prompt, and only then sends the next one.  The
+ * client cannot simply send the whole list ahead, because FEAP reads
+ * the console through the FORTRAN runtime, whose input buffer would
+ * swallow lines meant for the [[feapsrv]] interface.  Instead, the
+ * client queues the macros on the server,
+ * \begin{verbatim}
+ *   queue LABEL MACRO
+ *   queue
+ *   queue clear
+ * \end{verbatim}
+ * The first form adds a macro to the end of the queue, with a positive
+ * integer label of the client's choosing; the client can send any
+ * number of these lines (and the [[start]] after them) in one go,
+ * since the [[feapsrv]] interface reads them through one buffer.  The
+ * second form prints {\tt Queue {\it n}}, the number of macros
+ * waiting.  The third empties the queue.
+ *
+ * While the queue is not empty, [[tinput]] takes each console command
+ * from the queue instead of the connection.  When a queued macro is
+ * done, the next prompt sends {\tt MATFEAP SYNC {\it label}} with the
+ * macro's label in place of the usual label 0, so the client can wait
+ * for the last label and attribute everything FEAP printed in between
+ * to the right macro.  Anything that reads a console line (say, the
+ * confirmation that [[quit]] asks for) also takes it from the queue, so
+ * a queued list behaves exactly like the same list typed in order.
+ *
+ * Macros that will not run are reported with
+ * {\tt MATFEAP SKIP {\it label}}: this happens for the queue contents
+ * on [[queue clear]], and when an interrupt aborts a queued macro (see
+ * [[feapintr.c]]), for that macro and all the ones after it.
+ *
+ *@c*/
+#define QUEUE_LINE 256
+
+typedef struct queue_item_t {
+    int  label;
+    char text[QUEUE_LINE];
+} queue_item_t;
+
+static queue_item_t* queue_items = NULL;
+static size_t        queue_head  = 0;
+static size_t        queue_tail  = 0;
+static size_t        queue_cap   = 0;
+static int           queue_done  = 0;   /* Label to report at next prompt */
+
+/*@T
+ * \subsection{Queue operations}
+ *
+ * The queue is an array that is reset whenever it runs empty, so it
+ * only grows as long as the client keeps it full.
+ *
+ *@c*/
+static int queue_push(int label, const char* text)
+{
+    if (queue_head == queue_tail)
+        queue_head = queue_tail = 0;
+    if (queue_tail == queue_cap) {
+        size_t cap = queue_cap ? 2*queue_cap : 64;
+        queue_item_t* items = (queue_item_t*)
+            realloc(queue_items, cap * sizeof(queue_item_t));
+        if (items == NULL)
+            return -1;
+        queue_items = items;
+        queue_cap = cap;
+    }
+    queue_items[queue_tail].label = label;
+    strncpy(queue_items[queue_tail].text, text, QUEUE_LINE-1);
+    queue_items[queue_tail].text[QUEUE_LINE-1] = 0;
+    ++queue_tail;
+    return 0;
+}
+
+void feapqueue_drop()
+{
+    for (; queue_head < queue_tail; ++queue_head)
+        printf("MATFEAP SKIP %d\n", queue_items[queue_head].label);
+    queue_head = queue_tail = 0;
+    queue_done = 0;
+    fflush(stdout);
+}
+
+/*@T
+ * \subsection{Hooks at the prompt}
+ *
+ * Before each console prompt, [[tinput]] calls [[feapqlabel]] for the
+ * label to put in the synchronization message, and then [[feapqnext]],
+ * which copies the next queued macro into [[buf]] (padded with blanks,
+ * FORTRAN style) and returns one, or returns zero if the queue is
+ * empty.
+ *
+ *@c*/
+int feapqlabel_()
+{
+    int label = queue_done;
+    queue_done = 0;
+    return label;
+}
+
+int feapqnext_(char* buf, int len)
+{
+    queue_item_t* item;
+    int n;
+    if (queue_head == queue_tail)
+        return 0;
+    item = queue_items + queue_head++;
+    n = strlen(item->text);
+    if (n > len)
+        n = len;
+    memcpy(buf, item->text, n);
+    memset(buf+n, ' ', len-n);
+    queue_done = item->label;
+    return 1;
+}
+
+/*@T
+ * \subsection{The [[queue]] command}
+ *
+ * The dispatcher passes the label and the rest of the line (the macro,
+ * which may contain blanks) to [[feapsrv_queue]].  A successful
+ * [[queue LABEL MACRO]] prints nothing, so that a long list of them
+ * costs no more than the prompts.
+ *
+ *@c*/
+void feapsrv_queue(const char* label, const char* text)
+{
+    char* end;
+    long n;
+
+    if (label == NULL) {
+        printf("Queue %lu\n", (unsigned long) (queue_tail - queue_head));
+        return;
+    }
+    if (strcmp(label, "clear") == 0) {
+        feapqueue_drop();
+        printf("Queue 0\n");
+        return;
+    }
+    n = strtol(label, &end, 10);
+    if (*end || n <= 0 || n != (int) n)
+        printf("Bad label: %s\n", label);
+    else if (text == NULL)
+        printf("Missing macro\n");
+    else if (queue_push((int) n, text) < 0)
+        printf("Out of memory\n");
+}
@@ -0,0 +1,291 @@
+/*
+ * Reductions over FEAP arrays
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*@T
+ * \section{Reductions}
+ *
+ * A convergence check in MATLAB typically fetches all of [[DR]] or
+ * [[U]] just to take a norm.  The [[reduce]] command computes the
+ * reduction on the server and sends back a line of text:
+ * \begin{verbatim}
+ *   reduce OP VAR [OTHER] [reduced | neq]
+ * \end{verbatim}
+ * where [[OP]] is one of
+ * \begin{itemize}
+ * \item [[norm2]] and [[norminf]] -- the 2-norm and the max-norm;
+ * \item [[sum]] -- the sum of the entries;
+ * \item [[min]] and [[max]] -- the smallest and largest entry, with
+ *   its index;
+ * \item [[dot]] -- the dot product with [[OTHER]], which is either
+ *   another FEAP array or [[-]] for a vector sent by the client.
+ * \end{itemize}
+ * By default the reduction runs over the whole array.  With
+ * [[reduced]], it runs over the active degrees of freedom of a nodal
+ * array such as [[U]] (the entries with a positive equation number in
+ * [[ID]]), and with [[neq]], over the first [[neq]] entries of an array
+ * in equation order such as [[DR]].
+ *
+ * The reply is {\tt Reduce {\it value}}, or
+ * {\tt Reduce {\it value} {\it index}} for [[min]] and [[max]].  The
+ * index is one-based; in the reduced case it is the equation number.
+ * The minimum or maximum of an empty set is NaN with index zero.  When
+ * the client supplies the vector for [[dot]], it is sent with the
+ * {\tt Recv double} exchange before the reply; it has as many entries
+ * as the reduction runs over, except that in the reduced case it is
+ * indexed by equation number and has [[neq]] entries.  If the client
+ * cancels the transfer, the reply is {\tt Canceled}.
+ *
+ * The loops are parallelized with OpenMP when the server is compiled
+ * with OpenMP support (see [[feapspex.c]]), but only for arrays long
+ * enough that the threads pay for themselves.
+ *
+ *@c*/
+#define REDUCE_NORM2   0
+#define REDUCE_NORMINF 1
+#define REDUCE_SUM     2
+#define REDUCE_MIN     3
+#define REDUCE_MAX     4
+#define REDUCE_DOT     5
+
+#define REDUCE_FULL    0
+#define REDUCE_ID      1
+#define REDUCE_NEQ     2
+
+#define REDUCE_PAR_MIN 65536
+
+static const char* reduce_ops[] = {
+    "norm2", "norminf", "sum", "min", "max", "dot", NULL
+};
+
+static int     reduce_op;
+static int     reduce_subset;
+static int     reduce_client;    /* Other vector comes from the client */
+static double* reduce_y;         /* Other FEAP array                   */
+static int     reduce_ylen;
+
+/*@T
+ * \subsection{Kernels}
+ *
+ * Each reduction is a single loop over a set of positions [[i]] in the
+ * array, given either as a range or through the [[ID]] map.  The
+ * [[reduce_at]] macro gives the partner entry for [[dot]]: [[y]] is
+ * indexed by array position, except for a client vector in the reduced
+ * case, which is indexed by equation number.
+ *
+ * For [[min]] and [[max]] each thread keeps its own best entry, and
+ * the threads' results are combined at the end; ties go to the smaller
+ * index, so the answer does not depend on the number of threads.
+ *
+ *@c*/
+#define reduce_at(y, i, id) \
+    ((reduce_client && id) ? y[id[i]-1] : y[i])
+
+static int reduce_skip(int* id, int i)
+{
+    return (id != NULL && id[i] <= 0);
+}
+
+static double reduce_sum(double* x, double* y, int* id, int n, int op)
+{
+    double s = 0;
+    int i;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+:s) if(n > REDUCE_PAR_MIN)
+#endif
+    for (i = 0; i < n; ++i) {
+        if (reduce_skip(id, i))
+            continue;
+        if (op == REDUCE_NORM2)
+            s += x[i]*x[i];
+        else if (op == REDUCE_DOT)
+            s += x[i]*reduce_at(y, i, id);
+        else
+            s += x[i];
+    }
+    return (op == REDUCE_NORM2) ? sqrt(s) : s;
+}
+
+static double reduce_inf(double* x, int* id, int n)
+{
+    double s = 0;
+    int i;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(max:s) if(n > REDUCE_PAR_MIN)
+#endif
+    for (i = 0; i < n; ++i)
+        if (!reduce_skip(id, i) && fabs(x[i]) > s)
+            s = fabs(x[i]);
+    return s;
+}
+
+static int reduce_extreme(double* x, int* id, int n, int op, double* val)
+{
+    int best = -1;
+#ifdef _OPENMP
+#pragma omp parallel if(n > REDUCE_PAR_MIN)
+#endif
+    {
+        int i, mine = -1;
+#ifdef _OPENMP
+#pragma omp for nowait
+#endif
+        for (i = 0; i < n; ++i) {
+            if (reduce_skip(id, i))
+                continue;
+            if (mine < 0 ||
+                (op == REDUCE_MIN && x[i] < x[mine]) ||
+                (op == REDUCE_MAX && x[i] > x[mine]))
+                mine = i;
+        }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+        if (mine >= 0 &&
+            (best < 0 ||
+             (op == REDUCE_MIN && x[mine] < x[best]) ||
+             (op == REDUCE_MAX && x[mine] > x[best]) ||
+             (x[mine] == x[best] && mine < best)))
+            best = mine;
+    }
+    *val = (best >= 0) ? x[best] : NAN;
+    return best;
+}
+
+/*@T
+ * \subsection{Entry points}
+ *
+ * The FORTRAN routine [[feapreduce]] looks up the arrays.  If there is
+ * another FEAP array for [[dot]], it is passed first to [[fmredother]],
+ * and then the main array goes to [[fmreduce]] together with the [[ID]]
+ * array and the equation counts.
+ *
+ *@c*/
+int fmredother_(double* y, int* len)
+{
+    reduce_y    = y;
+    reduce_ylen = *len;
+    return 0;
+}
+
+int fmreduce_(double* x, int* len, int* id, int* nneq, int* neq)
+{
+    extern int fmrecvdbl_(double* data, int* len);
+    double* y = reduce_y;
+    double* buf = NULL;
+    double val;
+    int* map = NULL;
+    int n = *len, best = -1;
+
+    if (reduce_subset == REDUCE_ID) {
+        n = (*nneq < *len) ? *nneq : *len;
+        map = id;
+    } else if (reduce_subset == REDUCE_NEQ) {
+        n = (*neq < *len) ? *neq : *len;
+    }
+
+    if (reduce_op == REDUCE_DOT && reduce_client) {
+        int m = map ? *neq : n;
+        buf = (double*) malloc((m+1) * sizeof(double));
+        if (buf == NULL) {
+            printf("Out of memory\n");
+            return 0;
+        }
+        if (!fmrecvdbl_(buf, &m)) {
+            printf("Canceled\n");
+            free(buf);
+            return 0;
+        }
+        if (map) {
+            int i;
+            for (i = 0; i < n; ++i)
+                if (map[i] > *neq) {
+                    printf("Bad equation number\n");
+                    free(buf);
+                    return 0;
+                }
+        }
+        y = buf;
+    } else if (reduce_op == REDUCE_DOT && reduce_ylen < n) {
+        printf("Length mismatch\n");
+        return 0;
+    }
+
+    if (reduce_op == REDUCE_NORMINF)
+        val = reduce_inf(x, map, n);
+    else if (reduce_op == REDUCE_MIN || reduce_op == REDUCE_MAX)
+        best = reduce_extreme(x, map, n, reduce_op, &val);
+    else
+        val = reduce_sum(x, y, map, n, reduce_op);
+
+    if (reduce_op == REDUCE_MIN || reduce_op == REDUCE_MAX)
+        printf("Reduce %.17g %d\n", val,
+               (best < 0) ? 0 : (map ? map[best] : best+1));
+    else
+        printf("Reduce %.17g\n", val);
+    fflush(stdout);
+    free(buf);
+    return 0;
+}
+
+/*@T
+ * The dispatcher passes the words after [[reduce]] to
+ * [[feapsrv_reduce]].  After the operation and the array name, the
+ * subset keyword and the other vector may come in either order.
+ *
+ *@c*/
+void feapsrv_reduce(char** args, int n)
+{
+    extern int feapreduce_(char* var, char* other, int* nother,
+                           int len, int olen);
+    char* other = NULL;
+    int j, k, nother = 0;
+
+    if (n < 2) {
+        printf("Usage: reduce OP VAR [OTHER] [reduced | neq]\n");
+        return;
+    }
+    for (k = 0; reduce_ops[k] && strcmp(args[0], reduce_ops[k]); ++k);
+    if (!reduce_ops[k]) {
+        printf("Unknown reduction: %s\n", args[0]);
+        return;
+    }
+
+    reduce_subset = REDUCE_FULL;
+    for (j = 2; j < n; ++j) {
+        if (strcmp(args[j], "reduced") == 0)
+            reduce_subset = REDUCE_ID;
+        else if (strcmp(args[j], "neq") == 0)
+            reduce_subset = REDUCE_NEQ;
+        else if (k == REDUCE_DOT && other == NULL)
+            other = args[j];
+        else {
+            printf("Unexpected argument: %s\n", args[j]);
+            return;
+        }
+    }
+    if (k == REDUCE_DOT && other == NULL) {
+        printf("Missing second vector for dot\n");
+        return;
+    }
+
+    reduce_op     = k;
+    reduce_client = (k == REDUCE_DOT && strcmp(other, "-") == 0);
+    reduce_y      = NULL;
+    reduce_ylen   = 0;
+    if (k == REDUCE_DOT && !reduce_client)
+        nother = 1;
+    else
+        other = args[1];
+    feapreduce_(args[1], other, &nother, strlen(args[1]), strlen(other));
+    fflush(stdout);
+}
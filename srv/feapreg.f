@@ -0,0 +1,82 @@
+c     @T
+c     \section{Registering common block scalars}
+c
+c     The [[feapreg]] routine tells the C code where the common block
+c     variables that MATFEAP exports live, by passing each one to
+c     [[fmregi]] (integer or logical) or [[fmregd]] (double precision)
+c     along with its name.  Since FORTRAN passes arguments by reference,
+c     the C code receives the address of the common block entry itself,
+c     and can read or write it directly afterward; the [[get]], [[set]],
+c     [[getall]], and [[setall]] commands in [[feapsrv]] all work from
+c     this registry.  Names are terminated by a space.
+c
+c     To export another variable, include the header that declares it
+c     and add a registration call below.
+c
+c     @c
+      subroutine feapreg()
+c     @q
+
+      implicit  none
+
+      include  'allotd.h'
+      include  'allotn.h'
+      include  'auto2.h'
+      include  'cdata.h'
+      include  'codat.h'
+      include  'comblk.h'
+      include  'comfil.h'
+      include  'conval.h'
+      include  'counts.h'
+      include  'eltran.h'
+      include  'endata.h'
+      include  'evdata.h'
+      include  'fdata.h'
+      include  'hdata.h'
+      include  'hlpdat.h'
+      include  'iodata.h'
+      include  'iofile.h'
+      include  'machnc.h'
+      include  'pathn.h'
+      include  'pdatps.h'
+      include  'plflag.h'
+      include  'pointer.h'
+      include  'prmptd.h'
+      include  'psize.h'
+      include  'rdat1.h'
+      include  'rdata.h'
+      include  'sdata.h'
+      include  'setups.h'
+      include  'tdata.h'
+      include  'vdata.h'
+      include  'x11f.h'
+
+      save
+
+c     @c
+      call fmregi('autcnv ', autcnv)
+      call fmregd('dt ', dt)
+      call fmregd('ttim ', ttim)
+      call fmregi('ior ', ior)
+      call fmregi('iow ', iow)
+      call fmregi('ipr ', ipr)
+      call fmregi('mf ', mf)
+      call fmregi('mq ', mq)
+      call fmregi('nadd ', nadd)
+      call fmregi('ndf ', ndf)
+      call fmregi('ndl ', ndl)
+      call fmregi('ndm ', ndm)
+      call fmregi('nen ', nen)
+      call fmregi('neq ', neq)
+      call fmregi('nh1 ', nh1)
+      call fmregi('nh2 ', nh2)
+      call fmregi('nh3 ', nh3)
+      call fmregi('nneq ', nneq)
+      call fmregi('nnlm ', nnlm)
+      call fmregi('nst ', nst)
+      call fmregi('numel ', numel)
+      call fmregi('nummat ', nummat)
+      call fmregi('numnp ', numnp)
+      call fmregi('solver ', solver)
+
+      end
@@ -0,0 +1,133 @@
+/*
+ * Resetting a session
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#define RESET_ENV_VAR "MATFEAP_RESET"
+#define RESET_ARGS    64
+#define RESET_CMDLINE 65536
+
+/*@T
+ * \section{Resetting a session}
+ *
+ * A batch driver that runs many small decks one after the other pays
+ * for a new connection, a new server process, and FEAP's memory setup
+ * for every deck, since the only way to get rid of a model is to quit.
+ * The [[reset]] command starts over in the same process, on the same
+ * connection:
+ * \begin{verbatim}
+ *   reset
+ * \end{verbatim}
+ * The server answers with a fresh {\tt FEAPSRV>} prompt, just as for a
+ * new connection, and the client goes on with [[param]], [[cd]],
+ * [[start]], and the file name dialog as usual.
+ *
+ * FEAP has no routine to free all of its arrays and put its common
+ * blocks back the way they were; much of that state is set by
+ * [[DATA]] statements and by FEAP's start-up code, and only a fresh
+ * copy of the program has it.  So [[reset]] replaces the process
+ * image: it runs the server binary again with [[execv]], in the same
+ * process and with the connection still on descriptors 0 and 1.  The
+ * new image finds [[MATFEAP_RESET]] in its environment, skips the
+ * daemon (see [[feapsock.c]]), and goes straight to the prompt.  The
+ * cost is that of loading the program, which is much less than a new
+ * connection through the daemon and a new client handshake.
+ *
+ * What survives is what belongs to the process rather than to FEAP:
+ * the process ID and group (so the daemon's session table and the
+ * [[pid]] for interrupts stay right), the working directory, the
+ * environment, and the connection.  Everything else starts over,
+ * including the subscriptions, the macro queue, the profile, the
+ * interrupt guard, and the console mode, which goes back to
+ * [[inline]].  FEAP's output files are flushed, but its scratch files
+ * are not removed as they would be on [[quit]].  Anything the client
+ * sends after [[reset]] and before the new prompt is lost.
+ *
+ * We find the program and its arguments through [[/proc]], so this
+ * only works on Linux.  If the image cannot be replaced, the server
+ * says {\tt Reset failed: {\it reason}} and the session carries on,
+ * with the console back inline and the guard off.
+ *
+ *@c*/
+static int reset_argv(char* buf, size_t n, char** argv)
+{
+    size_t len = 0;
+    ssize_t m;
+    int fd, argc = 0;
+    char* s;
+
+    if ((fd = open("/proc/self/cmdline", O_RDONLY)) < 0)
+        return -1;
+    while (len < n-1 &&
+           ((m = read(fd, buf+len, n-1-len)) > 0 ||
+            (m < 0 && errno == EINTR)))
+        if (m > 0)
+            len += m;
+    close(fd);
+    if (len == 0 || len == n-1)
+        return -1;
+    buf[len] = 0;
+    for (s = buf; s < buf+len && argc < RESET_ARGS-1; s += strlen(s)+1)
+        argv[argc++] = s;
+    argv[argc] = NULL;
+    return argc;
+}
+
+/*@T
+ * Descriptors other than the connection are marked close-on-exec, so
+ * that FEAP's files, the console sink, and the template registry
+ * connection do not leak into the new image.
+ *
+ *@c*/
+static void reset_cloexec()
+{
+    DIR* dir = opendir("/proc/self/fd");
+    struct dirent* e;
+    if (dir == NULL)
+        return;
+    while ((e = readdir(dir)) != NULL) {
+        int fd = atoi(e->d_name);
+        if (fd > 2 && fd != dirfd(dir))
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    closedir(dir);
+}
+
+/*@T
+ * Before replacing the image, we let go of any interrupt spare (see
+ * [[feapintr.c]]), put the console back on descriptor 1 (see
+ * [[feapcons.c]]), and pass along the model template registry, if
+ * there is one (see [[feaptmpl.c]]), so that the next deck can be
+ * served from a template.
+ *
+ *@c*/
+void feapsrv_reset()
+{
+    extern int feapflushall_();
+    extern void feapcons_restore();
+    extern void feapintr_release();
+    extern const char* feaptmpl_registry();
+    static char cmdline[RESET_CMDLINE];
+    char* argv[RESET_ARGS];
+
+    if (reset_argv(cmdline, sizeof(cmdline), argv) <= 0) {
+        printf("Reset failed: cannot read command line\n");
+        return;
+    }
+    feapflushall_();
+    feapintr_release();
+    feapcons_restore();
+    fflush(stdout);
+    setenv(RESET_ENV_VAR, feaptmpl_registry(), 1);
+    reset_cloexec();
+    execv("/proc/self/exe", argv);
+    unsetenv(RESET_ENV_VAR);
+    printf("Reset failed: %s\n", strerror(errno));
+}
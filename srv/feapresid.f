@@ -0,0 +1,62 @@
+c     @T
+c     \section{Fused residual evaluation}
+c
+c     The [[feapresid]] routine does all the work behind the
+c     [[resid]] command in the [[feapsrv]] interface.  On the client
+c     side, evaluating a residual used to mean a [[setm]] of the
+c     displacement, a request to clear the ``residual formed'' flag,
+c     a [[form]] macro, a [[getm]] of the full [[DR]] array, and a
+c     [[get]] of [[neq]] to trim the result.  Here we do all of that
+c     in one step:
+c     \begin{enumerate}
+c     \item If [[setu]] is nonzero, we receive one value for each
+c       active entry of [[U]] and store them with [[fmrecvred]], in
+c       the same order as [[feapsetu]] on the client side.  The
+c       incoming data is staged in [[DR]], since we are about to
+c       overwrite [[DR]] anyway.  If the client cancels the transfer,
+c       [[U]] is left unchanged.
+c     \item We clear [[fl(8)]] (as in [[feaptformed]]), zero [[DR]],
+c       and form the residual the same way FEAP's [[form]] macro does.
+c     \item We send the first [[neq]] entries of [[DR]] to the client.
+c     \end{enumerate}
+c     Both transfers use the same {\tt Recv} / {\tt Send} protocol
+c     as [[setm]] and [[getm]], so the client can reuse its ordinary
+c     array transfer code.
+c
+c     @c
+      subroutine feapresid(setu)
+c     @q
+
+      implicit  none
+
+      include  'arclel.h'
+      include  'cdata.h'
+      include  'comblk.h'
+      include  'fdata.h'
+      include  'pointer.h'
+      include  'prlod.h'
+      include  'sdata.h'
+      include  'tdata.h'
+
+      integer   setu
+
+      save
+
+c     @c
+      if(setu.ne.0) then
+        call fmrecvred(hr(np(40)), hr(np(26)), mr(np(31)), nneq)
+      endif
+
+      fl(8) = .false.
+      call pzero(hr(np(26)), nneq)
+      call ploa1(ttim, dt)
+      call pload(mr(np(31)), hr(np(27)), hr(np(26)), prop*rlnew,
+     &           .true.)
+      call formfe(np(40), np(26), np(26), np(26),
+     &            .false., .true., .false., 6, 1, numel, 1)
+      fl(8) = .true.
+
+      call fmsenddbl(hr(np(26)), neq)
+
+      end
+
@@ -29,7 +29,50 @@ c     @q
           call fmrecvdbl(hr(point), lengt)
         endif
       else
-        print *, 'Not found'
+        call fmnotfound()
+      endif
+
+      end
+
+c     @T
+c     \subsection{Accumulating into arrays}
+c
+c     The [[feapaddm]] routine serves the [[addm]] command.  It looks
+c     up the array and hands it to [[fmadddbl]], which receives the
+c     increment and adds it in place.  For the reduced form,
+c     [[fmaddred]] also gets the [[ID]] array (as [[fmrecvred]]
+c     does in [[feapresid]]) so that it can spread an increment over
+c     the active degrees of freedom.  Only double precision arrays
+c     can be accumulated into.
+c
+c     @c
+      subroutine feapaddm(var, reduced)
+c     @q
+
+      implicit  none
+
+      include 'cdata.h'
+      include 'comblk.h'
+      include 'pointer.h'
+      include 'p_point.h'
+      include 'sdata.h'
+
+      character var*(*)
+      integer reduced
+      logical flag
+      integer lengt, prec
+
+      save
+
+      call pgetd( var, point, lengt, prec, flag )
+      if(.not.flag) then
+        call fmnotfound()
+      elseif(prec.eq.1) then
+        call fmnotdbl()
+      elseif(reduced.ne.0) then
+        call fmaddred(hr(point), lengt, mr(np(31)), nneq)
+      else
+        call fmadddbl(hr(point), lengt)
       endif
 
       end
@@ -9,6 +9,8 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/select.h>
+#include <sys/time.h>
 
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -18,8 +20,22 @@
 #define MYPORT 3490
 #define PORT_ENV_VAR "MATFEAP_PORT"
 #define SOCKNAME_ENV_VAR "MATFEAP_SOCKNAME"
+#define RESET_ENV_VAR "MATFEAP_RESET"
 #define BACKLOG 5
 
+extern void feapadmin_setup();
+extern void feapadmin_child();
+extern void feapadmin_add(pid_t pid, const char* client);
+extern void feapadmin_reaped(pid_t pid);
+extern void feapadmin_fdset(fd_set* fds, int* maxfd);
+extern void feapadmin_handle(fd_set* fds);
+extern int  feapadmin_draining();
+extern void feaptmpl_daemon_setup();
+extern void feaptmpl_child();
+extern void feaptmpl_rejoin(const char* path);
+extern void feaptmpl_fdset(fd_set* fds, int* maxfd);
+extern void feaptmpl_handle(fd_set* fds);
+
 
 /* Error check macro */
 #define ec(cmd) \
@@ -42,12 +58,16 @@
  * status) that checks the exit status of any child processes that are 
  * finished.
  * 
- * This is a standard piece of most UNIX daemons.
+ * This is a standard piece of most UNIX daemons.  Each reaped
+ * process is also dropped from the session table kept for the
+ * administration socket (see [[feapadmin.c]]).
  *
  *@c*/
 static void sigchld_handler(int s)
 {
-    while (waitpid(-1, NULL, WNOHANG) > 0);
+    pid_t pid;
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0)
+        feapadmin_reaped(pid);
 }
 
 static void install_reaper()
@@ -90,21 +110,21 @@ static int tcp_socket_setup(int port)
     return sockfd;
 }
 
-static int tcp_handle_connection(int sockfd)
+static int tcp_handle_connection(int sockfd, char* client)
 {
     struct sockaddr_in their_addr;
     socklen_t sin_size = sizeof(struct sockaddr_in);
-    while (1) {
-        int new_fd = accept(sockfd, (struct sockaddr*) &their_addr, &sin_size);
-        if (new_fd < 0)
-            perror("accept");
-        else {
-            time_t c = time(NULL);
-            printf("Connection from %s -- %s",
-                   inet_ntoa(their_addr.sin_addr), ctime(&c));
-            return new_fd;
-        }
+    int new_fd = accept(sockfd, (struct sockaddr*) &their_addr, &sin_size);
+    if (new_fd < 0)
+        perror("accept");
+    else {
+        time_t c = time(NULL);
+        printf("Connection from %s -- %s",
+               inet_ntoa(their_addr.sin_addr), ctime(&c));
+        sprintf(client, "%s:%d", inet_ntoa(their_addr.sin_addr),
+                ntohs(their_addr.sin_port));
     }
+    return new_fd;
 }
 
 /*@T
@@ -150,20 +170,19 @@ static int local_socket_setup(const char* sockname)
     return sockfd;
 }
 
-static int local_handle_connection(int sockfd)
+static int local_handle_connection(int sockfd, char* client)
 {
     struct sockaddr_un their_addr;
     socklen_t sin_size = sizeof(struct sockaddr_un);
-    while (1) {
-        int new_fd = accept(sockfd, (struct sockaddr*) &their_addr, &sin_size);
-        if (new_fd < 0)
-            perror("accept");
-        else {
-            time_t c = time(NULL);
-            printf("Connection -- %s", ctime(&c));
-            return new_fd;
-        }
+    int new_fd = accept(sockfd, (struct sockaddr*) &their_addr, &sin_size);
+    if (new_fd < 0)
+        perror("accept");
+    else {
+        time_t c = time(NULL);
+        printf("Connection -- %s", ctime(&c));
+        strcpy(client, "local");
     }
+    return new_fd;
 }
 
 /*@T
@@ -195,12 +214,28 @@ static int socket_setup()
         return tcp_socket_setup(port);
 }
 
-static int handle_connection(int sockfd)
+/*@T
+ * When the daemon is drained through the administration socket, we
+ * close the listening socket (and remove the socket file, for a local
+ * socket), so that new clients are refused immediately rather than
+ * waiting in the connection queue.  Resuming sets the socket up again.
+ *
+ *@c*/
+static void socket_close(int sockfd)
+{
+    char* sockname = getenv(SOCKNAME_ENV_VAR);
+    close(sockfd);
+    if (feapsock_local_socket && sockname)
+        unlink(sockname);
+    printf("Server not accepting connections\n");
+}
+
+static int handle_connection(int sockfd, char* client)
 {
     if (feapsock_local_socket)
-        return local_handle_connection(sockfd);
+        return local_handle_connection(sockfd, client);
     else
-        return tcp_handle_connection(sockfd);
+        return tcp_handle_connection(sockfd, client);
 }
 
 /*@T
@@ -233,20 +268,88 @@ static void send_std_to_socket(int new_fd)
  * connections, [[feapserver]] returns control to the calling routine,
  * allowing FEAP to continue running as it usually would.
  *
+ * The daemon waits in [[select]] so that it can serve the
+ * administration socket while it waits for clients.  The wait times
+ * out once a second so that the session statistics are sampled even
+ * when nothing else is happening.  The same loop serves the registry
+ * for model templates (see [[feaptmpl.c]]), if they are turned on.  We block [[SIGCHLD]] while forking,
+ * so that a child that exits right away can't be reaped before it is
+ * entered in the session table.
+ *
+ * A session that has been through [[reset]] (see [[feapreset.c]]) is
+ * already connected when [[feapserver]] is called in its new image, so
+ * it only takes back the template registry and returns.
+ *
  *@c*/
 int feapserver_()
 {
-    int sockfd = socket_setup();
+    int sockfd;
+    sigset_t chld, old;
+    char* reset = getenv(RESET_ENV_VAR);
+    if (reset != NULL) {
+        feaptmpl_rejoin(reset);
+        unsetenv(RESET_ENV_VAR);
+        return 0;
+    }
+    sockfd = socket_setup();
     install_reaper();
+    feapadmin_setup();
+    feaptmpl_daemon_setup();
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
 
     while (1) {
-        int new_fd = handle_connection(sockfd);
-        if (!fork()) {  /* This is the child process */
-            close(sockfd);
-            send_std_to_socket(new_fd);
-            return 0;
+        fd_set fds;
+        int maxfd = -1;
+        struct timeval tv;
+
+        if (feapadmin_draining() && sockfd >= 0) {
+            socket_close(sockfd);
+            sockfd = -1;
+        } else if (!feapadmin_draining() && sockfd < 0) {
+            sockfd = socket_setup();
+        }
+
+        FD_ZERO(&fds);
+        if (sockfd >= 0) {
+            FD_SET(sockfd, &fds);
+            maxfd = sockfd;
+        }
+        feapadmin_fdset(&fds, &maxfd);
+        feaptmpl_fdset(&fds, &maxfd);
+        tv.tv_sec  = 1;
+        tv.tv_usec = 0;
+        if (select(maxfd+1, &fds, NULL, NULL, &tv) < 0) {
+            if (errno != EINTR)
+                perror("select");
+            continue;
+        }
+        feapadmin_handle(&fds);
+        feaptmpl_handle(&fds);
+
+        if (sockfd >= 0 && FD_ISSET(sockfd, &fds)) {
+            char client[64];
+            int new_fd = handle_connection(sockfd, client);
+            pid_t pid;
+            if (new_fd < 0)
+                continue;
+            fflush(stdout);  /* Don't let the child inherit buffered output */
+            sigprocmask(SIG_BLOCK, &chld, &old);
+            if ((pid = fork()) == 0) {  /* This is the child process */
+                sigprocmask(SIG_SETMASK, &old, NULL);
+                close(sockfd);
+                feapadmin_child();
+                feaptmpl_child();
+                send_std_to_socket(new_fd);
+                return 0;
+            }
+            if (pid > 0)
+                feapadmin_add(pid, client);
+            else
+                perror("fork");
+            sigprocmask(SIG_SETMASK, &old, NULL);
+            close(new_fd);  /* Parent doesn't need this */
         }
-        close(new_fd);  /* Parent doesn't need this */
     }
 
     exit(0);
@@ -0,0 +1,615 @@
+/*
+ * Parallel sparse matrix export
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*@T
+ * \section{Parallel sparse export}
+ *
+ * The original sparse transfer calls [[matspew]] twice, once to count
+ * the nonzeros and once to send them, with a call to [[writeaij]] for
+ * every entry.  For large models the count alone takes seconds.  The
+ * export engine in this file replaces both passes.  The FORTRAN
+ * routine [[matexp]] works out which FEAP storage holds the requested
+ * matrix and passes the storage arrays to one of the entry points
+ * below; the engine then
+ * \begin{enumerate}
+ * \item splits the rows (or columns) into blocks of roughly equal
+ *   work, using the row pointer arrays to balance the blocks;
+ * \item has each thread walk its blocks, skip zeros, and append
+ *   coordinate triples to a private buffer;
+ * \item adds up the block counts and sends {\tt nnz {\it count}};
+ *   and
+ * \item writes the block buffers out in block order.
+ * \end{enumerate}
+ * The data on the wire are exactly what the [[matspew]] path sends,
+ * in the same order, so the client side of the protocol is unchanged.
+ * The engine is parallelized with OpenMP when the server is compiled
+ * with OpenMP support (see [[OPENMP]] in [[makefile.in]]), and runs
+ * the same blocks serially otherwise.
+ *
+ * The buffers hold the whole matrix in coordinate form (24 bytes per
+ * entry), which is the price for sending the count before the data
+ * without walking the storage twice.
+ *
+ * The engine can also send the matrix in compressed sparse column
+ * form (see [[spex_csc]] below), so that the client can read it
+ * straight into the arrays of a MATLAB sparse matrix.
+ *
+ *@c*/
+#define SPEX_TEXT   -1
+#define SPEX_BINARY -2
+#define SPEX_CSC    -3
+
+#define SPEX_DIAG   0   /* ad(i) at (i,i)                         */
+#define SPEX_VEC    1   /* ad(i) at (i,1)                         */
+#define SPEX_LASTD  2   /* ad(neq) at (neq,neq) if zero           */
+#define SPEX_LASTV  3   /* ad(neq) at (neq,1) if zero             */
+#define SPEX_PROF   4   /* Profile columns (jp, ad, al)           */
+#define SPEX_SYM    5   /* Symmetric row storage (ir, jc, ad)     */
+#define SPEX_MASS   6   /* Mass / damping row storage, isw = 2, 3 */
+
+#define SPEX_MAXPASS 3
+
+typedef struct spex_buf_t {
+    double* data;
+    size_t  n;
+    size_t  cap;
+    int     failed;
+} spex_buf_t;
+
+typedef struct spex_pass_t {
+    int kind;
+    int lo, hi;
+    int nblocks;
+} spex_pass_t;
+
+typedef struct spex_t {
+    int     mode;
+    int     neq;
+    int*    ptr;
+    int*    jc;
+    double* ad;
+    double* al;
+    int     isw;
+} spex_t;
+
+static int spex_mode = SPEX_BINARY;
+
+void feapsrv_spex_mode(int mode)
+{
+    spex_mode = mode;
+}
+
+
+/*@T
+ * \subsection{Block buffers}
+ *
+ * For binary transfers the triples are converted to wire format as
+ * they are stored, so that the final write is a plain [[fwrite]] of
+ * each buffer.
+ *
+ *@c*/
+extern double htond(double x);
+
+static void spex_emit(spex_buf_t* buf, int mode, int i, int j, double aij)
+{
+    double* t;
+    if (buf->n == buf->cap) {
+        size_t cap = buf->cap ? 2*buf->cap : 1024;
+        double* data = (double*) realloc(buf->data, 3*cap*sizeof(double));
+        if (data == NULL) {
+            buf->failed = 1;
+            return;
+        }
+        buf->data = data;
+        buf->cap  = cap;
+    }
+    t = buf->data + 3*buf->n++;
+    if (mode == SPEX_BINARY) {
+        t[0] = htond(i);
+        t[1] = htond(j);
+        t[2] = htond(aij);
+    } else {
+        t[0] = i;
+        t[1] = j;
+        t[2] = aij;
+    }
+}
+
+
+/*@T
+ * \subsection{Walking the storage}
+ *
+ * An export is a sequence of up to three {\em passes}, each of which
+ * walks one part of the storage over a range of rows or columns
+ * (numbered from 1, as in FORTRAN).  The loops are transcriptions of
+ * the corresponding [[matspew]] routines, and the passes come in the
+ * same order as there: for example, the profile export sends the
+ * diagonal, then the last diagonal entry if it is zero (which fixes
+ * the matrix dimensions on the MATLAB side), then the profile columns.
+ *
+ * For the profile, the upper part of column [[j]] is stored in
+ * [[ad(neq+jp(j-1)+1:neq+jp(j))]] and the lower part in the same
+ * positions of [[al]].  For the symmetric row storage, row [[i]] has
+ * entries [[ir(i-1)+1:ir(i)]] of [[jc]] and [[ad]], with the diagonal
+ * stored once and the off-diagonal entries mirrored.  The mass and
+ * damping storage keeps the diagonal in [[ad(1:neq)]], the upper
+ * triangle in [[ad(neq+1:neq+ir(neq))]], and (for unsymmetric
+ * matrices) the lower triangle after that.
+ *
+ *@c*/
+static void spex_rows(spex_t* s, int kind, spex_buf_t* buf, int lo, int hi)
+{
+    int i, j, ii;
+    int neq = s->neq;
+    int* ptr = s->ptr;
+    double* ad = s->ad;
+
+    if (kind == SPEX_DIAG || kind == SPEX_VEC) {
+        for (i = lo; i <= hi; ++i)
+            if (ad[i-1] != 0.0)
+                spex_emit(buf, s->mode, i, (kind == SPEX_DIAG) ? i : 1,
+                          ad[i-1]);
+
+    } else if (kind == SPEX_LASTD || kind == SPEX_LASTV) {
+        if (ad[neq-1] == 0.0)
+            spex_emit(buf, s->mode, neq, (kind == SPEX_LASTD) ? neq : 1,
+                      0.0);
+
+    } else if (kind == SPEX_PROF) {
+        for (j = lo; j <= hi; ++j) {
+            ii = j - ptr[j-1] + ptr[j-2];
+            for (i = ptr[j-2]+1; i <= ptr[j-1]; ++i, ++ii) {
+                if (ad[neq+i-1] != 0.0)
+                    spex_emit(buf, s->mode, ii, j, ad[neq+i-1]);
+                if (s->al[i-1] != 0.0)
+                    spex_emit(buf, s->mode, j, ii, s->al[i-1]);
+            }
+        }
+
+    } else if (kind == SPEX_SYM) {
+        for (i = lo; i <= hi; ++i) {
+            for (j = (i > 1 ? ptr[i-2]+1 : 1); j <= ptr[i-1]; ++j) {
+                int c = s->jc[j-1];
+                if (ad[j-1] != 0.0) {
+                    spex_emit(buf, s->mode, i, c, ad[j-1]);
+                    if (i != c)
+                        spex_emit(buf, s->mode, c, i, ad[j-1]);
+                }
+            }
+        }
+
+    } else if (kind == SPEX_MASS) {
+        int nup = ptr[neq-1];
+        for (i = lo; i <= hi; ++i) {
+            for (j = (i > 1 ? ptr[i-2]+1 : 1); j <= ptr[i-1]; ++j) {
+                int c = s->jc[j-1];
+                if (ad[j+neq-1] != 0.0) {
+                    spex_emit(buf, s->mode, c, i, ad[j+neq-1]);
+                    if (s->isw == 2)
+                        spex_emit(buf, s->mode, i, c, ad[j+neq-1]);
+                }
+                if (s->isw == 3 && ad[j+neq+nup-1] != 0.0 && i != c)
+                    spex_emit(buf, s->mode, i, c, ad[j+neq+nup-1]);
+            }
+        }
+    }
+}
+
+
+/*@T
+ * \subsection{Blocking}
+ *
+ * Each pass is split into blocks that cover about the same number of
+ * stored entries.  For the pointer-based schemes, the number of stored
+ * entries through row [[i]] is just [[ptr(i)]], so the block
+ * boundaries are found by binary search; diagonal passes are split
+ * evenly.  We use several blocks per thread so that blocks with many
+ * nonzeros do not hold up the others.
+ *
+ *@c*/
+static void spex_split(spex_t* s, spex_pass_t* pass, int* bnd)
+{
+    int b, lo = pass->lo, hi = pass->hi, nblocks = pass->nblocks;
+    bnd[0] = lo;
+    if (pass->kind == SPEX_PROF || pass->kind == SPEX_SYM ||
+        pass->kind == SPEX_MASS) {
+        long long base  = (lo > 1) ? s->ptr[lo-2] : 0;
+        long long total = s->ptr[hi-1] - base;
+        for (b = 1; b < nblocks; ++b) {
+            long long target = base + total * b / nblocks;
+            int l = bnd[b-1], h = hi;
+            while (l < h) {
+                int m = l + (h-l)/2;
+                if (s->ptr[m-1] < target)
+                    l = m+1;
+                else
+                    h = m;
+            }
+            bnd[b] = l;
+        }
+    } else {
+        for (b = 1; b < nblocks; ++b)
+            bnd[b] = lo + (int) ((long long) (hi-lo+1) * b / nblocks);
+    }
+    bnd[nblocks] = hi+1;
+}
+
+
+/*@T
+ * \subsection{Running the export}
+ *
+ * All the blocks of all the passes go into one dynamically scheduled
+ * parallel loop.  Once they are done, the total count is the sum of
+ * the block counts, and the blocks are written in pass order and then
+ * block order, which is the order in which [[matspew]] would have
+ * sent them.  If any buffer could not be grown, we report an empty
+ * matrix rather than sending part of one.
+ *
+ *@c*/
+static void spex_write(spex_buf_t* buf, int mode)
+{
+    size_t k;
+    if (mode == SPEX_BINARY) {
+        fwrite(buf->data, 3*sizeof(double), buf->n, stdout);
+    } else {
+        for (k = 0; k < buf->n; ++k)
+            printf("%d %d %lg\n", (int) buf->data[3*k],
+                   (int) buf->data[3*k+1], buf->data[3*k+2]);
+    }
+}
+
+/*@T
+ * \subsection{Compressed column form}
+ *
+ * For the request {\tt sparse csc {\it var}}, the server does the work
+ * that MATLAB's [[sparse]] would otherwise do on the client: it sorts
+ * the entries into columns, sorts each column by row, adds duplicate
+ * entries together, and drops zeros.  The reply is
+ * {\tt csc {\it m} {\it n} {\it nnz}}, where {\it m} and {\it n} are
+ * the largest row and column indices seen (as for [[sparse(i,j,v)]]),
+ * followed, if {\it n} is positive, by the column pointers as
+ * {\it n}+1 wire format 64-bit integers, the zero-based row indices
+ * as {\it nnz} 64-bit integers, and the values as {\it nnz} doubles.
+ * These are exactly the [[jc]], [[ir]], and [[pr]] arrays of a MATLAB
+ * sparse matrix, so a client can receive each block directly into
+ * place, with no coordinate array and no second copy.
+ *
+ * The column counts are taken from the block buffers, the entries are
+ * dropped into place by a counting sort (freeing each buffer as soon
+ * as it has been moved), and then the columns are sorted and merged in
+ * parallel and slid down over the gaps left by the merge.  The peak
+ * memory on the server is the coordinate buffers plus the compressed
+ * arrays, 40 bytes per entry.  Columns come out of the storage walk
+ * nearly sorted, so we use insertion sort unless a long column is
+ * badly out of order.
+ *
+ *@c*/
+#define SPEX_ISORT  64
+
+typedef struct spex_pair_t {
+    int64_t i;
+    double  v;
+} spex_pair_t;
+
+static int spex_pair_cmp(const void* a, const void* b)
+{
+    int64_t ia = ((const spex_pair_t*) a)->i;
+    int64_t ib = ((const spex_pair_t*) b)->i;
+    return (ia < ib) ? -1 : (ia > ib) ? 1 : 0;
+}
+
+static int spex_sort_column(int64_t* ir, double* pr, int64_t n)
+{
+    int64_t k, l, ninv = 0;
+    spex_pair_t* pairs;
+
+    for (k = 1; k < n; ++k)
+        if (ir[k] < ir[k-1])
+            ++ninv;
+    if (ninv == 0)
+        return 1;
+
+    if (n <= SPEX_ISORT || ninv < n/SPEX_ISORT) {
+        for (k = 1; k < n; ++k) {
+            int64_t ik = ir[k];
+            double  vk = pr[k];
+            for (l = k; l > 0 && ir[l-1] > ik; --l) {
+                ir[l] = ir[l-1];
+                pr[l] = pr[l-1];
+            }
+            ir[l] = ik;
+            pr[l] = vk;
+        }
+        return 1;
+    }
+
+    pairs = (spex_pair_t*) malloc(n * sizeof(spex_pair_t));
+    if (pairs == NULL)
+        return 0;
+    for (k = 0; k < n; ++k) {
+        pairs[k].i = ir[k];
+        pairs[k].v = pr[k];
+    }
+    qsort(pairs, n, sizeof(spex_pair_t), spex_pair_cmp);
+    for (k = 0; k < n; ++k) {
+        ir[k] = pairs[k].i;
+        pr[k] = pairs[k].v;
+    }
+    free(pairs);
+    return 1;
+}
+
+/* Sort, merge, and drop zeros in one column; returns the new length */
+static int64_t spex_merge_column(int64_t* ir, double* pr, int64_t n)
+{
+    int64_t k, dst = 0, keep = 0;
+    for (k = 0; k < n; ++k) {
+        if (dst > 0 && ir[dst-1] == ir[k]) {
+            pr[dst-1] += pr[k];
+        } else {
+            ir[dst] = ir[k];
+            pr[dst] = pr[k];
+            ++dst;
+        }
+    }
+    for (k = 0; k < dst; ++k) {
+        if (pr[k] != 0.0) {
+            ir[keep] = ir[k];
+            pr[keep] = pr[k];
+            ++keep;
+        }
+    }
+    return keep;
+}
+
+static void spex_write_long(int64_t* data, int64_t n)
+{
+    extern int64_t htonll(int64_t x);
+    int64_t k;
+    for (k = 0; k < n; ++k)
+        data[k] = htonll(data[k]);
+    fwrite(data, sizeof(int64_t), n, stdout);
+}
+
+static void spex_write_dbl(double* data, int64_t n)
+{
+    int64_t k;
+    for (k = 0; k < n; ++k)
+        data[k] = htond(data[k]);
+    fwrite(data, sizeof(double), n, stdout);
+}
+
+static int spex_csc(spex_buf_t* bufs, int nbufs, int64_t nnz)
+{
+    int64_t *jc, *ir, *len;
+    double* pr;
+    int64_t m = 0, n = 0, c, k, dst;
+    int b, failed = 0;
+
+    for (b = 0; b < nbufs; ++b) {
+        for (k = 0; k < (int64_t) bufs[b].n; ++k) {
+            int64_t i = (int64_t) bufs[b].data[3*k+0];
+            int64_t j = (int64_t) bufs[b].data[3*k+1];
+            if (i > m) m = i;
+            if (j > n) n = j;
+        }
+    }
+
+    jc  = (int64_t*) calloc(n+2, sizeof(int64_t));
+    len = (int64_t*) malloc((n+1) * sizeof(int64_t));
+    ir  = (int64_t*) malloc((nnz+1) * sizeof(int64_t));
+    pr  = (double*)  malloc((nnz+1) * sizeof(double));
+    if (jc == NULL || len == NULL || ir == NULL || pr == NULL) {
+        free(jc); free(len); free(ir); free(pr);
+        return 0;
+    }
+
+    /* Counting sort by column; jc[c+1] serves as the insertion cursor */
+    for (b = 0; b < nbufs; ++b)
+        for (k = 0; k < (int64_t) bufs[b].n; ++k)
+            jc[(int64_t) bufs[b].data[3*k+1] + 1]++;
+    for (c = 2; c <= n; ++c)
+        jc[c] += jc[c-1];
+    for (b = 0; b < nbufs; ++b) {
+        for (k = 0; k < (int64_t) bufs[b].n; ++k) {
+            int64_t pos = jc[(int64_t) bufs[b].data[3*k+1]]++;
+            ir[pos] = (int64_t) bufs[b].data[3*k+0] - 1;
+            pr[pos] = bufs[b].data[3*k+2];
+        }
+        free(bufs[b].data);
+        bufs[b].data = NULL;
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,256) reduction(||:failed)
+#endif
+    for (c = 0; c < n; ++c) {
+        if (!spex_sort_column(ir+jc[c], pr+jc[c], jc[c+1]-jc[c]))
+            failed = 1;
+        len[c] = spex_merge_column(ir+jc[c], pr+jc[c], jc[c+1]-jc[c]);
+    }
+
+    for (c = 0, dst = 0; !failed && c < n; ++c) {
+        int64_t start = jc[c];
+        if (dst != start) {
+            memmove(ir+dst, ir+start, len[c] * sizeof(int64_t));
+            memmove(pr+dst, pr+start, len[c] * sizeof(double));
+        }
+        jc[c] = dst;
+        dst += len[c];
+    }
+    jc[n] = dst;
+
+    if (!failed) {
+        printf("csc %lld %lld %lld\n", (long long) m, (long long) n,
+               (long long) dst);
+        if (n > 0) {
+            spex_write_long(jc, n+1);
+            spex_write_long(ir, dst);
+            spex_write_dbl(pr, dst);
+        }
+    }
+    free(jc);
+    free(len);
+    free(ir);
+    free(pr);
+    return !failed;
+}
+
+static void spex_empty(int mode)
+{
+    if (mode == SPEX_CSC)
+        printf("csc 0 0 0\n");
+    else
+        printf("nnz 0\n");
+}
+
+static void spex_run(spex_t* s, spex_pass_t* passes, int npass)
+{
+    int nthreads = 1;
+    int p, b, nb, ntotal = 0, failed = 0;
+    int* bnd;
+    int* bpass;
+    spex_buf_t* bufs;
+    long long nnz = 0;
+
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    s->mode = spex_mode;
+    for (p = 0; p < npass; ++p) {
+        nb = passes[p].hi - passes[p].lo + 1;
+        if (passes[p].kind == SPEX_LASTD || passes[p].kind == SPEX_LASTV)
+            nb = 1;
+        else if (nb > 4*nthreads)
+            nb = 4*nthreads;
+        if (s->neq <= 0)
+            nb = 0;
+        passes[p].nblocks = (nb > 0) ? nb : 0;
+        ntotal += passes[p].nblocks;
+    }
+
+    bnd   = (int*) malloc((ntotal+npass) * sizeof(int));
+    bpass = (int*) malloc((ntotal+1) * sizeof(int));
+    bufs  = (spex_buf_t*) calloc(ntotal+1, sizeof(spex_buf_t));
+    if (bnd == NULL || bpass == NULL || bufs == NULL) {
+        spex_empty(s->mode);
+        ntotal = 0;
+        failed = 1;
+    }
+
+    /* Block b of the whole export covers bnd[b+p] to bnd[b+p+1]-1 */
+    for (p = 0, b = 0; !failed && p < npass; ++p) {
+        if (passes[p].nblocks > 0)
+            spex_split(s, passes+p, bnd+b+p);
+        for (nb = 0; nb < passes[p].nblocks; ++nb)
+            bpass[b++] = p;
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1)
+#endif
+    for (b = 0; b < ntotal; ++b) {
+        int lo = bnd[b+bpass[b]], hi = bnd[b+bpass[b]+1]-1;
+        if (lo <= hi)
+            spex_rows(s, passes[bpass[b]].kind, bufs+b, lo, hi);
+    }
+
+    for (b = 0; b < ntotal; ++b) {
+        nnz += bufs[b].n;
+        failed = failed || bufs[b].failed;
+    }
+    if (ntotal > 0 && failed) {
+        spex_empty(s->mode);
+    } else if (!failed && s->mode == SPEX_CSC) {
+        if (!spex_csc(bufs, ntotal, nnz))
+            spex_empty(s->mode);
+    } else if (!failed) {
+        printf("nnz %lld\n", nnz);
+        for (b = 0; b < ntotal; ++b)
+            spex_write(bufs+b, s->mode);
+    }
+    fflush(stdout);
+
+    for (b = 0; bufs && b < ntotal; ++b)
+        free(bufs[b].data);
+    free(bufs);
+    free(bpass);
+    free(bnd);
+}
+
+
+/*@T
+ * \subsection{Entry points}
+ *
+ * These are called from [[matexp]] with the FEAP storage arrays, and
+ * mirror the [[matspew]] routines [[uptang]], [[ustang]], [[usmass]],
+ * [[ulmass]], and [[urform]].  [[fmspexnone]] sends an empty matrix
+ * when the requested array does not exist.
+ *
+ *@c*/
+int fmspexprof_(int* neq, int* jp, double* ad, double* al)
+{
+    spex_t s = { 0, *neq, jp, NULL, ad, al, 0 };
+    spex_pass_t passes[SPEX_MAXPASS] = {
+        { SPEX_DIAG,  1, *neq, 0 },
+        { SPEX_LASTD, 1, *neq, 0 },
+        { SPEX_PROF,  2, *neq, 0 }
+    };
+    spex_run(&s, passes, 3);
+    return 0;
+}
+
+int fmspexsym_(int* neq, int* ir, int* jc, double* ad)
+{
+    spex_t s = { 0, *neq, ir, jc, ad, NULL, 0 };
+    spex_pass_t passes[SPEX_MAXPASS] = {
+        { SPEX_SYM, 1, *neq, 0 }
+    };
+    spex_run(&s, passes, 1);
+    return 0;
+}
+
+int fmspexmass_(int* neq, int* ir, int* jc, double* ad, int* isw)
+{
+    spex_t s = { 0, *neq, ir, jc, ad, NULL, *isw };
+    spex_pass_t passes[SPEX_MAXPASS] = {
+        { SPEX_DIAG,  1, *neq, 0 },
+        { SPEX_LASTD, 1, *neq, 0 },
+        { SPEX_MASS,  1, *neq, 0 }
+    };
+    spex_run(&s, passes, (*isw >= 2) ? 3 : 2);
+    return 0;
+}
+
+int fmspexdiag_(int* neq, double* ad, int* isdiag)
+{
+    spex_t s = { 0, *neq, NULL, NULL, ad, NULL, 0 };
+    spex_pass_t passes[SPEX_MAXPASS] = {
+        { SPEX_DIAG,  1, *neq, 0 },
+        { SPEX_LASTD, 1, *neq, 0 }
+    };
+    if (!*isdiag) {
+        passes[0].kind = SPEX_VEC;
+        passes[1].kind = SPEX_LASTV;
+    }
+    spex_run(&s, passes, 2);
+    return 0;
+}
+
+int fmspexnone_()
+{
+    spex_empty(spex_mode);
+    return 0;
+}
@@ -7,6 +7,9 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <limits.h>
 #include <arpa/inet.h>
 
 
@@ -96,6 +99,33 @@ double htond(double x)
     return ntohd(x);
 }
 
+/*@T
+ * Integer arrays can also be sent as 64-bit integers (see the
+ * {\tt binary64} transfer mode below), for which we need the same
+ * kind of conversion.
+ *
+ *@c*/
+int64_t htonll(int64_t x)
+{
+    double one = 1;
+    if (*((char*) &one) == 0) {
+        int64_t tmp;
+        char* src = (char*) &x;
+        char* dst = (char*) &tmp;
+        int k;
+        for (k = 0; k < 8; ++k)
+            dst[k] = src[7-k];
+        return tmp;
+    } else {
+        return x;
+    }
+}
+
+int64_t ntohll(int64_t x)
+{
+    return htonll(x);
+}
+
 /*@T
  * \section{Sending parameter values}
  * 
@@ -109,6 +139,7 @@ double htond(double x)
 void feapsrv_param(const char* var, double val)
 {
     extern int servparam_(int*, int*, double*);
+    extern void feaptmpl_param(const char* var, double val);
     int i1;
     int i2;
 
@@ -131,9 +162,193 @@ void feapsrv_param(const char* var, double val)
         return;  /* Invalid name */
 
     servparam_(&i1, &i2, &val);
+    feaptmpl_param(var, val);
 }
 
 
+/*@T
+ * \section{Common block scalars}
+ *
+ * The scalars in FEAP's common blocks that MATFEAP exports are kept
+ * in a small registry.  The FORTRAN routine [[feapreg]] calls
+ * [[fmregi]] or [[fmregd]] once for each exported variable, passing
+ * its name and (by reference) its address.  We fill the registry the
+ * first time it is needed; after that, getting or setting a scalar is
+ * just a table lookup and a load or store.  Names are matched without
+ * regard to case, as FEAP's [[pcomp]] does.
+ *
+ *@c*/
+#define MAX_SCALARS 128
+
+#define SCALAR_INT 0
+#define SCALAR_DBL 1
+
+typedef struct feapsrv_scalar_t {
+    char  name[8];
+    int   type;
+    void* addr;
+} feapsrv_scalar_t;
+
+static feapsrv_scalar_t feapsrv_scalars[MAX_SCALARS];
+static int feapsrv_nscalars = -1;
+
+static void scalar_register(const char* name, int type, void* addr)
+{
+    feapsrv_scalar_t* sc;
+    int i;
+    if (feapsrv_nscalars < 0 || feapsrv_nscalars == MAX_SCALARS)
+        return;
+    sc = feapsrv_scalars + feapsrv_nscalars++;
+    for (i = 0; i < 7 && name[i] != ' ' && name[i] != '\0'; ++i)
+        sc->name[i] = name[i];
+    sc->name[i] = '\0';
+    sc->type = type;
+    sc->addr = addr;
+}
+
+int fmregi_(char* name, int* addr)
+{
+    scalar_register(name, SCALAR_INT, addr);
+    return 0;
+}
+
+int fmregd_(char* name, double* addr)
+{
+    scalar_register(name, SCALAR_DBL, addr);
+    return 0;
+}
+
+static void scalar_init()
+{
+    extern int feapreg_();
+    if (feapsrv_nscalars < 0) {
+        feapsrv_nscalars = 0;
+        feapreg_();
+    }
+}
+
+static feapsrv_scalar_t* scalar_lookup(const char* name)
+{
+    int i;
+    scalar_init();
+    for (i = 0; i < feapsrv_nscalars; ++i)
+        if (strcasecmp(feapsrv_scalars[i].name, name) == 0)
+            return feapsrv_scalars + i;
+    return NULL;
+}
+
+static double scalar_value(feapsrv_scalar_t* sc)
+{
+    if (sc->type == SCALAR_INT)
+        return *(int*) sc->addr;
+    else
+        return *(double*) sc->addr;
+}
+
+static void scalar_assign(feapsrv_scalar_t* sc, double val)
+{
+    if (sc->type == SCALAR_INT)
+        *(int*) sc->addr = (int) val;
+    else
+        *(double*) sc->addr = val;
+}
+
+/*@T
+ * The [[get]] command prints the value of a single scalar, and the
+ * [[set]] command reads a new value from the next input line.  If no
+ * such variable is registered, nothing is printed or read.
+ *
+ *@c*/
+static void scalar_get(const char* name)
+{
+    feapsrv_scalar_t* sc = scalar_lookup(name);
+    if (sc && sc->type == SCALAR_INT)
+        printf(" %d\n", *(int*) sc->addr);
+    else if (sc)
+        printf(" %.17g\n", *(double*) sc->addr);
+}
+
+static void scalar_set(const char* name)
+{
+    char buf[256];
+    feapsrv_scalar_t* sc = scalar_lookup(name);
+    if (sc && fgets(buf, sizeof(buf), stdin) != NULL)
+        scalar_assign(sc, atof(buf));
+}
+
+/*@T
+ * The [[getall]] and [[setall]] commands move every registered scalar
+ * in one message.  The server first sends {\tt Scalars {\it count}},
+ * followed by one line per scalar giving its name and type
+ * ({\tt int} or {\tt double}).  The values themselves then go through
+ * the ordinary double array protocol described below, in the same
+ * order as the names: for [[getall]] the server sends them, and for
+ * [[setall]] it receives them.  Integer values are exact in double
+ * precision, so one typed record covers all the scalars.  If the
+ * client cancels a [[setall]], nothing changes.
+ *
+ *@c*/
+static void scalar_list()
+{
+    int i;
+    scalar_init();
+    printf("Scalars %d\n", feapsrv_nscalars);
+    for (i = 0; i < feapsrv_nscalars; ++i)
+        printf("%s %s\n", feapsrv_scalars[i].name,
+               feapsrv_scalars[i].type == SCALAR_INT ? "int" : "double");
+}
+
+static void scalar_getall()
+{
+    extern int fmsenddbl_(double* data, int* len);
+    double vals[MAX_SCALARS];
+    int i;
+    scalar_list();
+    for (i = 0; i < feapsrv_nscalars; ++i)
+        vals[i] = scalar_value(feapsrv_scalars + i);
+    fmsenddbl_(vals, &feapsrv_nscalars);
+}
+
+static void scalar_setall()
+{
+    extern int fmrecvdbl_(double* data, int* len);
+    double vals[MAX_SCALARS];
+    int i;
+    scalar_list();
+    if (fmrecvdbl_(vals, &feapsrv_nscalars))
+        for (i = 0; i < feapsrv_nscalars; ++i)
+            scalar_assign(feapsrv_scalars + i, vals[i]);
+}
+
+/*@T
+ * Other modules (such as the checkpoint code) get at the registry
+ * through the following accessors.
+ *
+ *@c*/
+int feapsrv_scalar_count()
+{
+    scalar_init();
+    return feapsrv_nscalars;
+}
+
+const char* feapsrv_scalar_name(int i)
+{
+    return feapsrv_scalars[i].name;
+}
+
+double feapsrv_scalar_value(int i)
+{
+    return scalar_value(feapsrv_scalars + i);
+}
+
+int feapsrv_scalar_assign(const char* name, double val)
+{
+    feapsrv_scalar_t* sc = scalar_lookup(name);
+    if (sc)
+        scalar_assign(sc, val);
+    return (sc != NULL);
+}
+
 /*@T
  * \section{Sending binary arrays}
  *
@@ -143,39 +358,75 @@ void feapsrv_param(const char* var, double val)
  *   {\it type} is {\tt i} (integer) or {\tt d} (double), and
  *   {\it count} is an integer indicating the number of values to
  *   be sent.
- * \item Client sends: {\tt text} or {\tt binary} or {\tt cancel}.
+ * \item Client sends: {\tt text} or {\tt binary} or {\tt binary64}
+ *   or {\tt cancel}.
  * \item Server sends: nothing if the client requested {\tt cancel}; a
  *   stream of 32-bit integers or 64-bit doubles in wire format if the
  *   client requested {\tt binary}; or ordinary text representations of
  *   the array data, printed one per line, if the client requested
- *   {\tt text}.
+ *   {\tt text}.  The {\tt binary64} request is the same as
+ *   {\tt binary}, except that integers are sent as 64-bit wire format
+ *   integers.
  * \end{enumerate}
  *
  * All this assumes that the array was found -- if not, the server would
  * send {\tt Not found} instead of sending a {\tt Send} line, and the
- * interaction would stop there.
+ * interaction would stop there.  The FORTRAN side reports a missing
+ * array by calling [[fmnotfound]], so that the message goes down the
+ * control stream even when FEAP's own console output has been sent
+ * elsewhere (see [[feapsrv_console]]).  In the same way, a command
+ * that the FEAP version we were built against cannot support answers
+ * with [[fmnotver]].
+ *
+ * FEAP hands us its lengths as FORTRAN integers, but on the C side we
+ * carry them as [[size_t]] (via [[feapsrv_len]], which maps a negative
+ * length to zero), so that byte counts and loop indices never wrap.
  *
  *@c*/
+size_t feapsrv_len(int* len)
+{
+    return (*len > 0) ? (size_t) *len : 0;
+}
+
+int fmnotfound_()
+{
+    printf(" Not found\n");
+    fflush(stdout);
+    return 0;
+}
+
+int fmnotver_()
+{
+    printf(" Not available with this FEAP version\n");
+    fflush(stdout);
+    return 0;
+}
+
 int fmsendint_(int* data, int* len)
 {
     char buf[256];
     char* token;
-    int i;
+    size_t i, n = feapsrv_len(len);
 
-    printf("Send int %d\n", *len);
+    printf("Send int %zu\n", n);
     fflush(stdout);
     if (fgets(buf, sizeof(buf), stdin) == NULL)
         return 0;
 
     token = strtok(buf, " \t\r\n");
     if (strcmp(token, "text") == 0) {
-        for (i = 0; i < *len; ++i)
+        for (i = 0; i < n; ++i)
             printf("%d\n", data[i]);
     } else if (strcmp(token, "binary") == 0) {
-        for (i = 0; i < *len; ++i) {
+        for (i = 0; i < n; ++i) {
             int32_t datum = htonl(data[i]);
             fwrite(&datum, sizeof(int32_t), 1, stdout);
         }
+    } else if (strcmp(token, "binary64") == 0) {
+        for (i = 0; i < n; ++i) {
+            int64_t datum = htonll(data[i]);
+            fwrite(&datum, sizeof(int64_t), 1, stdout);
+        }
     }
     fflush(stdout);
 
@@ -186,19 +437,20 @@ int fmsenddbl_(double* data, int* len)
 {
     char buf[256];
     char* token;
-    int i;
+    size_t i, n = feapsrv_len(len);
 
-    printf("Send double %d\n", *len);
+    printf("Send double %zu\n", n);
     fflush(stdout);
     if (fgets(buf, sizeof(buf), stdin) == NULL)
         return 0;
 
     token = strtok(buf, " \t\r\n");
     if (strcmp(token, "text") == 0) {
-        for (i = 0; i < *len; ++i)
+        for (i = 0; i < n; ++i)
             printf("%g\n", data[i]);
-    } else if (strcmp(token, "binary") == 0) {
-        for (i = 0; i < *len; ++i) {
+    } else if (strcmp(token, "binary") == 0 ||
+               strcmp(token, "binary64") == 0) {
+        for (i = 0; i < n; ++i) {
             double datum = htond(data[i]);
             fwrite(&datum, sizeof(double), 1, stdout);
         }
@@ -218,11 +470,13 @@ int fmsenddbl_(double* data, int* len)
  *   {\it type} is {\tt i} (integer) or {\tt d} (double), and
  *   {\it count} is an integer indicating the number of values to
  *   be sent.
- * \item Client sends: {\tt text} or {\tt binary} or {\tt cancel}.
+ * \item Client sends: {\tt text} or {\tt binary} or {\tt binary64}
+ *   or {\tt cancel}.
  * \item Client sends: nothing if the client requested {\tt cancel}; a
  *   stream of 32-bit integers or 64-bit doubles in wire format if the
- *   client requested {\tt binary}; or ordinary text representations of
- *   the array data, printed one per line, if the client requested
+ *   client requested {\tt binary}; 64-bit integers or doubles if the
+ *   client requested {\tt binary64}; or ordinary text representations
+ *   of the array data, printed one per line, if the client requested
  *   {\tt text}.
  * \end{enumerate}
  *
@@ -230,6 +484,20 @@ int fmsenddbl_(double* data, int* len)
  * send {\tt Not found} instead of sending a {\tt Send} line, and the
  * interaction would stop there.
  *
+ * The receive routines return one if data was read and zero if the
+ * client canceled the transfer, so that callers which go on to use the
+ * received data (e.g.~[[feapresid]]) can tell the difference.
+ *
+ * An integer sent as text or as a 64-bit wire integer may not fit in a
+ * FEAP integer.  Such values are read into a scratch array first, and
+ * if any of them is out of range, the server says
+ * {\tt Value out of range}, leaves the FEAP array alone, and returns
+ * zero as for a canceled transfer.
+ *
+ * After a text transfer we discard the rest of the line holding the
+ * last value, so that a second transfer (as in the index form of
+ * [[addm]] below) can follow directly.
+ *
  * It is much more likely that a receive request will be canceled than
  * that a send request will be canceled.  When the client wants to receive
  * some data, it dynamically allocates as much space as needed to hold
@@ -237,58 +505,329 @@ int fmsenddbl_(double* data, int* len)
  * exactly as much as the FEAP array wants.
  *
  *@c*/
+static void recv_text_done()
+{
+    int c;
+    while ((c = getchar()) != EOF && c != '\n');
+}
+
+static int recv_int_checked(int* data, size_t n, int wide)
+{
+    int* tmp = (int*) malloc((n+1) * sizeof(int));
+    int ok = 1;
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        long long datum = 0;
+        if (wide) {
+            int64_t wdatum = 0;
+            fread(&wdatum, sizeof(int64_t), 1, stdin);
+            datum = ntohll(wdatum);
+        } else {
+            scanf("%lld", &datum);
+        }
+        if (datum < INT_MIN || datum > INT_MAX)
+            ok = 0;
+        else if (tmp)
+            tmp[i] = (int) datum;
+    }
+    if (!wide)
+        recv_text_done();
+
+    if (tmp == NULL) {
+        printf("Out of memory\n");
+        ok = 0;
+    } else if (!ok) {
+        printf("Value out of range\n");
+    } else {
+        memcpy(data, tmp, n * sizeof(int));
+    }
+    free(tmp);
+    return ok;
+}
+
 int fmrecvint_(int* data, int* len)
 {
     char buf[256];
     char* token;
-    int i;
+    size_t i, n = feapsrv_len(len);
 
-    printf("Recv int %d\n", *len);
+    printf("Recv int %zu\n", n);
     fflush(stdout);
     if (fgets(buf, sizeof(buf), stdin) == NULL)
         return 0;
 
     token = strtok(buf, " \t\r\n");
-    if (strcmp(token, "text") == 0) {
-        for (i = 0; i < *len; ++i)
-            scanf("%d", &(data[i]));
+    if (token == NULL) {
+        return 0;
+    } else if (strcmp(token, "text") == 0) {
+        return recv_int_checked(data, n, 0);
     } else if (strcmp(token, "binary") == 0) {
-        for (i = 0; i < *len; ++i) {
+        for (i = 0; i < n; ++i) {
             int32_t datum;
             fread(&datum, sizeof(int32_t), 1, stdin);
             data[i] = ntohl(datum);
         }
+    } else if (strcmp(token, "binary64") == 0) {
+        return recv_int_checked(data, n, 1);
+    } else {
+        return 0;
     }
 
-    return 0;
+    return 1;
 }
 
 int fmrecvdbl_(double* data, int* len)
 {
     char buf[256];
     char* token;
-    int i;
+    size_t i, n = feapsrv_len(len);
 
-    printf("Recv double %d\n", *len);
+    printf("Recv double %zu\n", n);
     fflush(stdout);
     if (fgets(buf, sizeof(buf), stdin) == NULL)
         return 0;
 
     token = strtok(buf, " \t\r\n");
-    if (strcmp(token, "text") == 0) {
-        for (i = 0; i < *len; ++i)
+    if (token == NULL) {
+        return 0;
+    } else if (strcmp(token, "text") == 0) {
+        for (i = 0; i < n; ++i)
             scanf("%lg", &(data[i]));
-    } else if (strcmp(token, "binary") == 0) {
-        for (i = 0; i < *len; ++i) {
+        recv_text_done();
+    } else if (strcmp(token, "binary") == 0 ||
+               strcmp(token, "binary64") == 0) {
+        for (i = 0; i < n; ++i) {
             double datum;
             fread(&datum, sizeof(double), 1, stdin);
             data[i] = ntohd(datum);
         }
+    } else {
+        return 0;
     }
 
+    return 1;
+}
+
+/*@T
+ * The [[fmrecvred]] routine receives a vector with one entry for each
+ * active degree of freedom and stores it into the active entries of
+ * [[u]].  The entries come in the order of [[full_id]] from
+ * [[map2full]] on the client side -- by position in the full array,
+ * not by equation number -- which is the order that [[feapsetu]] and
+ * [[feapgetu]] use.  The [[work]] array holds the incoming values, so
+ * it must have room for one double per active entry.  If the client
+ * cancels the transfer, [[u]] is left alone.
+ *
+ *@c*/
+int fmrecvred_(double* u, double* work, int* id, int* nneq)
+{
+    size_t i, k, n = feapsrv_len(nneq);
+    int nfree = 0;
+
+    for (i = 0; i < n; ++i)
+        if (id[i] > 0)
+            ++nfree;
+    if (!fmrecvdbl_(work, &nfree))
+        return 0;
+    for (i = k = 0; i < n; ++i)
+        if (id[i] > 0)
+            u[i] = work[k++];
+    return 1;
+}
+
+/*@T
+ * \section{Accumulating into arrays}
+ *
+ * A Newton update $u \leftarrow u + \alpha \, du$ done with [[getm]]
+ * and [[setm]] moves the whole array twice and costs an extra round
+ * trip.  The [[addm VAR ALPHA]] command instead receives only the
+ * increment and adds [[ALPHA]] times it into the FEAP array in place.
+ * There are three forms:
+ * \begin{itemize}
+ * \item [[addm VAR ALPHA]] -- the server asks for as many doubles as
+ *   the array holds, with the same {\tt Recv double} exchange used by
+ *   [[setm]];
+ * \item [[addm VAR ALPHA index N]] -- the server asks for [[N]]
+ *   (one-based) integer indices and then for [[N]] doubles, and adds
+ *   each value into the indexed entry;
+ * \item [[addm VAR ALPHA reduced]] -- the server asks for one
+ *   double for each active degree of freedom and adds them into the
+ *   active entries in the order of the full array, as [[fmrecvred]]
+ *   does for [[resid u]]; this is the order of [[feapsetu]] and
+ *   [[feapgetu]], not equation order.
+ * \end{itemize}
+ * If any index is out of range, nothing is changed and the server
+ * prints {\tt Index out of range}.  A canceled transfer also leaves
+ * the array alone.
+ *
+ * The FORTRAN routine [[feapaddm]] looks up the array and passes it to
+ * [[fmadddbl]] or [[fmaddred]]; the scale factor and the form of the
+ * request are stashed here by the dispatcher beforehand.
+ *
+ *@c*/
+#define ADDM_FULL    0
+#define ADDM_INDEX   1
+#define ADDM_REDUCED 2
+#define ADDM_CHUNK   4096
+
+static double addm_alpha = 1;
+static int    addm_form  = ADDM_FULL;
+static int    addm_count = 0;
+
+int fmnotdbl_()
+{
+    printf(" Not a double array\n");
+    fflush(stdout);
     return 0;
 }
 
+/*@T
+ * In the full form we read the increment a chunk at a time and add
+ * it in as we go, so we never need a second copy of a large array.
+ *
+ *@c*/
+static int addm_full(double* data, size_t len)
+{
+    char buf[256];
+    char* token;
+    double x[ADDM_CHUNK];
+    double alpha = addm_alpha;
+    size_t i, k, m;
+
+    printf("Recv double %zu\n", len);
+    fflush(stdout);
+    if (fgets(buf, sizeof(buf), stdin) == NULL)
+        return 0;
+
+    token = strtok(buf, " \t\r\n");
+    if (token == NULL) {
+        return 0;
+    } else if (strcmp(token, "text") == 0) {
+        for (i = 0; i < len; ++i) {
+            double datum = 0;
+            scanf("%lg", &datum);
+            data[i] += alpha * datum;
+        }
+        recv_text_done();
+    } else if (strcmp(token, "binary") == 0 ||
+               strcmp(token, "binary64") == 0) {
+        for (i = 0; i < len; i += m) {
+            m = (len-i < ADDM_CHUNK) ? len-i : ADDM_CHUNK;
+            fread(x, sizeof(double), m, stdin);
+            for (k = 0; k < m; ++k)
+                data[i+k] += alpha * ntohd(x[k]);
+        }
+    } else {
+        return 0;
+    }
+
+    return 1;
+}
+
+static int addm_index(double* data, size_t len)
+{
+    int* idx;
+    double* x;
+    int i, ok = 0;
+
+    idx = (int*) malloc((addm_count+1) * sizeof(int));
+    x   = (double*) malloc((addm_count+1) * sizeof(double));
+    if (idx == NULL || x == NULL) {
+        printf("Out of memory\n");
+    } else if (fmrecvint_(idx, &addm_count) &&
+               fmrecvdbl_(x, &addm_count)) {
+        for (i = 0; i < addm_count; ++i)
+            if (idx[i] < 1 || (size_t) idx[i] > len)
+                break;
+        if (i < addm_count) {
+            printf("Index out of range\n");
+        } else {
+            for (i = 0; i < addm_count; ++i)
+                data[idx[i]-1] += addm_alpha * x[i];
+            ok = 1;
+        }
+    }
+    free(x);
+    free(idx);
+    return ok;
+}
+
+int fmadddbl_(double* data, int* len)
+{
+    if (addm_form == ADDM_INDEX)
+        return addm_index(data, feapsrv_len(len));
+    return addm_full(data, feapsrv_len(len));
+}
+
+int fmaddred_(double* data, int* len, int* id, int* nneq)
+{
+    double* du;
+    size_t i, k, n;
+    int nfree = 0;
+
+    n = (*nneq < *len) ? feapsrv_len(nneq) : feapsrv_len(len);
+    for (i = 0; i < n; ++i)
+        if (id[i] > 0)
+            ++nfree;
+    du = (double*) malloc((nfree+1) * sizeof(double));
+    if (du == NULL) {
+        printf("Out of memory\n");
+        return 0;
+    }
+    if (!fmrecvdbl_(du, &nfree)) {
+        free(du);
+        return 0;
+    }
+    for (i = k = 0; i < n; ++i)
+        if (id[i] > 0)
+            data[i] += addm_alpha * du[k++];
+    free(du);
+    return 1;
+}
+
+/*@T
+ * The dispatcher calls [[addm]] with the rest of the command line.
+ *
+ *@c*/
+static void addm(char* var)
+{
+    extern int feapaddm_(char* var, int* reduced, int len);
+    extern void feapsrv_touch(const char* name);
+    char* alphatok = strtok(NULL, " \t\r\n");
+    char* formtok  = strtok(NULL, " \t\r\n");
+    int reduced;
+
+    if (var == NULL || alphatok == NULL) {
+        printf("Usage: addm VAR ALPHA [reduced | index N]\n");
+        return;
+    }
+
+    addm_alpha = atof(alphatok);
+    addm_form  = ADDM_FULL;
+    addm_count = 0;
+    if (formtok == NULL) {
+        /* Full form */
+    } else if (strcmp(formtok, "reduced") == 0) {
+        addm_form = ADDM_REDUCED;
+    } else if (strcmp(formtok, "index") == 0) {
+        char* counttok = strtok(NULL, " \t\r\n");
+        addm_form  = ADDM_INDEX;
+        addm_count = counttok ? atoi(counttok) : -1;
+        if (addm_count < 0) {
+            printf("Usage: addm VAR ALPHA [reduced | index N]\n");
+            return;
+        }
+    } else {
+        printf("Unrecognized addm form: %s\n", formtok);
+        return;
+    }
+
+    reduced = (addm_form == ADDM_REDUCED);
+    feapaddm_(var, &reduced, strlen(var));
+    feapsrv_touch(var);
+}
+
 /*@T
  * \section{Sending sparse arrays}
  *
@@ -312,7 +851,24 @@ int fmrecvdbl_(double* data, int* len)
  *   the data is sent with one triple per line.
  * \end{enumerate}
  *
+ * The {\tt text} and {\tt binary} requests are now served by the
+ * parallel export engine in [[feapspex.c]], which sends the same data
+ * without the counting pass.  The two-pass [[matspew]] route is still
+ * available as {\tt sparse serial {\it var}} (binary only), mostly as
+ * a reference for checking the engine.  The engine also serves
+ * {\tt sparse csc {\it var}}, which sends the matrix already in
+ * compressed column form.
+ *
+ * Counts are kept in 64 bits throughout, since the number of nonzeros
+ * in a large model's tangent can pass $2^{31}$ even though each of its
+ * dimensions fits in a FORTRAN integer.  The FORTRAN count argument
+ * only selects the mode; the count itself is accumulated on the C side.
+ * The row and column indices in a triple travel as doubles, which
+ * represent integers exactly up to $2^{53}$.
+ *
  *@c*/
+static int64_t writeaij_count;
+
 int writeaij_(int* i, int* j, double* aij, int* count)
 {
     /* Cases:
@@ -321,7 +877,7 @@ int writeaij_(int* i, int* j, double* aij, int* count)
      *  count == -2 -- output as binary
      */
     if (*count >= 0) {
-        ++(*count);
+        ++writeaij_count;
     } else if (*count == -1) {
         printf("%d %d %lg\n", *i, *j, *aij);
     } else if (*count == -2) {
@@ -334,18 +890,117 @@ int writeaij_(int* i, int* j, double* aij, int* count)
     return 0;
 }
 
+/*@T
+ * \subsection{Profile transfer}
+ *
+ * When FEAP uses its profile (skyline) solver, the tangent is stored
+ * as a column pointer array [[jp]], the diagonal, and the upper and
+ * lower profiles.  Expanding this into triplets costs one call through
+ * [[writeaij]] per nonzero and 24 bytes per entry on the wire, and the
+ * client then has to sort everything back into columns.  The request
+ * {\tt sparse profile {\it var}} (where {\it var} is [[tang]] or
+ * [[utan]]) instead ships the profile arrays as they are stored:
+ * \begin{enumerate}
+ * \item The server sends {\tt profile {\it neq} {\it nup} {\it sym}},
+ *   where {\it nup} = [[jp(neq)]] is the length of each profile and
+ *   {\it sym} is 1 if the lower profile is the same as the upper one.
+ *   If the matrix is not stored in profile form, the line is
+ *   {\tt profile 0 0 0} and nothing more is sent.
+ * \item The server sends [[jp]] as {\it neq} wire format 32-bit
+ *   integers, then the diagonal and upper profile as
+ *   {\it neq} + {\it nup} wire format doubles, then (if {\it sym}
+ *   is zero) the lower profile as {\it nup} doubles.
+ * \end{enumerate}
+ * The request {\tt sparse profile64 {\it var}} is the same, except
+ * that [[jp]] is sent as 64-bit integers.
+ * For column [[j]], the upper profile entries
+ * [[jp(j-1)+1]] through [[jp(j)]] hold rows [[j-jp(j)+jp(j-1)]]
+ * through [[j-1]], and the lower profile holds the transposed entries.
+ * The blocks are converted to wire format a chunk at a time and written
+ * with one [[fwrite]] per chunk.
+ *
+ *@c*/
+#define PROFILE_CHUNK 1024
+
+static int profile_wide = 0;
+
+static void profile_write_int(int* data, size_t n)
+{
+    int32_t buf[PROFILE_CHUNK];
+    int64_t wbuf[PROFILE_CHUNK];
+    size_t i, k;
+    for (i = 0; i < n; i += PROFILE_CHUNK) {
+        size_t m = (n-i < PROFILE_CHUNK) ? n-i : PROFILE_CHUNK;
+        if (profile_wide) {
+            for (k = 0; k < m; ++k)
+                wbuf[k] = htonll(data[i+k]);
+            fwrite(wbuf, sizeof(int64_t), m, stdout);
+        } else {
+            for (k = 0; k < m; ++k)
+                buf[k] = htonl(data[i+k]);
+            fwrite(buf, sizeof(int32_t), m, stdout);
+        }
+    }
+}
+
+static void profile_write_dbl(double* data, size_t n)
+{
+    double buf[PROFILE_CHUNK];
+    size_t i, k;
+    for (i = 0; i < n; i += PROFILE_CHUNK) {
+        size_t m = (n-i < PROFILE_CHUNK) ? n-i : PROFILE_CHUNK;
+        for (k = 0; k < m; ++k)
+            buf[k] = htond(data[i+k]);
+        fwrite(buf, sizeof(double), m, stdout);
+    }
+}
+
+int fmprofile_(int* neq, int* jp, double* ad, double* al, int* sym)
+{
+    size_t n = feapsrv_len(neq);
+    size_t nup = (n > 0) ? feapsrv_len(jp+n-1) : 0;
+    printf("profile %zu %zu %d\n", n, nup, *sym);
+    fflush(stdout);
+    profile_write_int(jp, n);
+    profile_write_dbl(ad, n + nup);
+    if (!*sym)
+        profile_write_dbl(al, nup);
+    fflush(stdout);
+    return 0;
+}
+
+int fmnoprof_()
+{
+    printf("profile 0 0 0\n");
+    return 0;
+}
+
 void sparse_write(char* types, char* var)
 {
     extern int matspew_(char* var, int* cnt);
+    extern int matprof_(char* var, int len);
+    extern int matexp_(char* var, int len);
+    extern void feapsrv_spex_mode(int mode);
     int type = 0;
-    if (strcmp(types, "text") == 0)
-        type = -1;
-    else if (strcmp(types, "binary") == 0)
+    if (strcmp(types, "profile") == 0 || strcmp(types, "profile64") == 0) {
+        profile_wide = (strcmp(types, "profile64") == 0);
+        matprof_(var, strlen(var));
+        return;
+    }
+    if (strcmp(types, "text") == 0 || strcmp(types, "binary") == 0 ||
+        strcmp(types, "csc") == 0) {
+        feapsrv_spex_mode(strcmp(types, "text") == 0 ? -1 :
+                          strcmp(types, "csc") == 0 ? -3 : -2);
+        matexp_(var, strlen(var));
+        return;
+    }
+    if (strcmp(types, "serial") == 0)
         type = -2;
-    if (type && var) {
+    if (type) {
         int cnt = 0;
+        writeaij_count = 0;
         matspew_(var, &cnt);
-        printf("nnz %d\n", cnt);
+        printf("nnz %lld\n", (long long) writeaij_count);
         cnt = type;
         matspew_(var, &cnt);
     }
@@ -367,34 +1022,86 @@ char* FEAPSRV_HELP =
     "Commands are:\n"
     "  start           - Start / resume ordinary FEAP interaction\n"
     "  quit            - Terminate this FEAP process\n"
+    "  reset           - Start over with a new input deck in this process\n"
     "  help            - Get this message\n"
     "  cd DIR          - Change to directory DIR\n"
     "  cd              - Print current working directory\n"
     "  param           - Set FEAP parameters\n"
     "  set VAR         - Set FEAP common block variable\n"
     "  get VAR         - Print FEAP common block variable\n"
+    "  getall          - Send all exported common block variables\n"
+    "  setall          - Receive all exported common block variables\n"
     "  getm VAR        - Start get of FEAP array\n"
     "  setm VAR        - Start set FEAP array\n"
-    "  sparse FMT VAR  - Get FEAP sparse matrix as binary or text\n"
+    "  addm VAR A [F]  - Add A times received data to FEAP array\n"
+    "                    (F is 'reduced' or 'index N')\n"
+    "  sparse FMT VAR  - Get sparse matrix (binary, text, csc, profile[64],\n"
+    "                    serial)\n"
     "  clear_isformed  - Clear with the 'resid formed' flag\n"
+    "  resid [u]       - Form residual and send neq entries of DR\n"
+    "  sweep           - Run a parameter sweep (before start only)\n"
+    "  checkpoint PATH - Save FEAP arrays and scalars to a file\n"
+    "  restore PATH    - Restore FEAP arrays and scalars from a file\n"
+    "  stat VAR ...    - Print generation and hash of FEAP arrays\n"
+    "  reduce OP VAR   - Reduce FEAP array (norm2, norminf, sum, min, max,\n"
+    "                    or dot VAR2|-) optionally over 'reduced' or 'neq'\n"
+    "  elmat [WHAT] [FIRST [LAST]] [batch B]\n"
+    "                  - Stream element matrices (tang, resid, or both)\n"
+    "  console MODE    - Route FEAP output (inline, discard, ring, file, dump)\n"
+    "  queue N MACRO   - Queue a FEAP macro with label N (or 'queue' to\n"
+    "                    count, 'queue clear' to drop the queue)\n"
+    "  profile [MODE]  - Time FEAP commands (on, off, clear, show,\n"
+    "                    trace PATH)\n"
+    "  subscribe ID VAR [OPTS]\n"
+    "                  - Push FEAP array at 'serv,push' (or 'after MACRO');\n"
+    "                    OPTS are reduced, norm2, norminf, every K\n"
+    "  unsubscribe ID  - Drop a subscription (or 'all')\n"
+    "  guard [on|off]  - Allow interrupts to abort FEAP commands\n"
+    "  pid             - Print the process group to signal for interrupts\n"
     "\n"
     "You can enter server mode from FEAP using the 'serv' macro.\n"
     "See the source code / documentation for more information on the\n"
     "protocols used to exchange arrays and sparse matrices\n";
 
+static int feapsrv_started = 0;
+
+extern void feapsrv_epoch();
+
 int feapsrv_()
 {
+    extern void feapintr_setup();
+    extern void feapprof_setup();
+    extern void feapprof_wait();
+    extern void feapprof_begin(const char* cat, const char* name);
+    extern void feapprof_end();
     char buf[256];
+    feapintr_setup();
+    feapprof_setup();
     printf("FEAPSRV>\n");
     fflush(stdout);
+    feapprof_wait();
     while (fgets(buf, sizeof(buf), stdin) != NULL) {
         char* token = strtok(buf, " \t\r\n");
+        if (token != NULL)
+            feapprof_begin("serv", token);
+        if (token != NULL && !feapsrv_started &&
+            strcmp(token, "start") && strcmp(token, "param") &&
+            strcmp(token, "cd") && strcmp(token, "help")) {
+            extern void feaptmpl_taint();
+            feaptmpl_taint();
+        }
         if (token == NULL) {
             continue;
         } else if (strcmp(token, "start") == 0) {
+            feapsrv_started = 1;
+            feapsrv_epoch();
+            feapprof_end();
             return 0;
         } else if (strcmp(token, "quit") == 0) {
             exit(0);
+        } else if (strcmp(token, "reset") == 0) {
+            extern void feapsrv_reset();
+            feapsrv_reset();
         } else if (strcmp(token, "help") == 0) {
             printf(FEAPSRV_HELP);
         } else if (strcmp(token, "cd") == 0) {
@@ -409,23 +1116,19 @@ int feapsrv_()
             double val = atof(valtok);
             feapsrv_param(name, val);
         } else if (strcmp(token, "set") == 0) {
-            extern int feapget_(char* var, char* mode);
             token = strtok(NULL, " \t\r\n");
-            if (token) {
-                int n = strlen(token);
-                token[n] = ' ';
-                feapget_(token, "w");
-                token[n] = 0;
-            }
+            if (token)
+                scalar_set(token);
+            feapsrv_epoch();
         } else if (strcmp(token, "get") == 0) {
-            extern int feapget_(char* var, char* mode);
             token = strtok(NULL, " \t\r\n");
-            if (token) {
-                int n = strlen(token);
-                token[n] = ' ';
-                feapget_(token, "r");
-                token[n] = 0;
-            }
+            if (token)
+                scalar_get(token);
+        } else if (strcmp(token, "getall") == 0) {
+            scalar_getall();
+        } else if (strcmp(token, "setall") == 0) {
+            scalar_setall();
+            feapsrv_epoch();
         } else if (strcmp(token, "getm") == 0) {
             extern int feapgetm_(char* var, int len);
             token = strtok(NULL, " \t\r\n");
@@ -433,9 +1136,14 @@ int feapsrv_()
                 feapgetm_(token, strlen(token));
         } else if (strcmp(token, "setm") == 0) {
             extern int feapsetm_(char* var, int len);
+            extern void feapsrv_touch(const char* name);
             token = strtok(NULL, " \t\r\n");
-            if (token)
+            if (token) {
                 feapsetm_(token, strlen(token));
+                feapsrv_touch(token);
+            }
+        } else if (strcmp(token, "addm") == 0) {
+            addm(strtok(NULL, " \t\r\n"));
         } else if (strcmp(token, "sparse") == 0) {
             char* transfertype = strtok(NULL, " \t\r\n");
             char* varname = strtok(NULL, " \t\r\n");
@@ -444,11 +1152,101 @@ int feapsrv_()
         } else if (strcmp(token, "clear_isformed") == 0) {
             extern int feaptformed_();
             feaptformed_();
+        } else if (strcmp(token, "resid") == 0) {
+            extern int feapresid_(int* setu);
+            int setu;
+            token = strtok(NULL, " \t\r\n");
+            setu = (token != NULL && strcmp(token, "u") == 0);
+            feapresid_(&setu);
+            feapsrv_epoch();
+        } else if (strcmp(token, "checkpoint") == 0) {
+            extern void feapsrv_checkpoint(const char* path);
+            token = strtok(NULL, " \t\r\n");
+            if (token)
+                feapsrv_checkpoint(token);
+            else
+                printf("Missing path\n");
+        } else if (strcmp(token, "restore") == 0) {
+            extern void feapsrv_restore(const char* path);
+            token = strtok(NULL, " \t\r\n");
+            if (token)
+                feapsrv_restore(token);
+            else
+                printf("Missing path\n");
+            feapsrv_epoch();
+        } else if (strcmp(token, "stat") == 0) {
+            extern void feapsrv_stat(char** names, int n);
+            char* names[64];
+            int n = 0;
+            while (n < 64 && (token = strtok(NULL, " \t\r\n")) != NULL)
+                names[n++] = token;
+            feapsrv_stat(names, n);
+        } else if (strcmp(token, "reduce") == 0) {
+            extern void feapsrv_reduce(char** args, int n);
+            char* args[4];
+            int n = 0;
+            while (n < 4 && (token = strtok(NULL, " \t\r\n")) != NULL)
+                args[n++] = token;
+            feapsrv_reduce(args, n);
+        } else if (strcmp(token, "elmat") == 0) {
+            extern void feapsrv_elmat(char** args, int n);
+            char* args[8];
+            int n = 0;
+            while (n < 8 && (token = strtok(NULL, " \t\r\n")) != NULL)
+                args[n++] = token;
+            feapsrv_elmat(args, n);
+        } else if (strcmp(token, "console") == 0) {
+            extern void feapsrv_console(const char* mode, const char* arg);
+            char* mode = strtok(NULL, " \t\r\n");
+            char* arg  = strtok(NULL, " \t\r\n");
+            feapsrv_console(mode, arg);
+        } else if (strcmp(token, "queue") == 0) {
+            extern void feapsrv_queue(const char* label, const char* text);
+            char* label = strtok(NULL, " \t\r\n");
+            char* text  = strtok(NULL, "\r\n");
+            if (text != NULL) {
+                text += strspn(text, " \t");
+                if (*text == 0)
+                    text = NULL;
+            }
+            feapsrv_queue(label, text);
+        } else if (strcmp(token, "profile") == 0) {
+            extern void feapsrv_profile(const char* mode, const char* arg);
+            char* mode = strtok(NULL, " \t\r\n");
+            char* arg  = strtok(NULL, " \t\r\n");
+            feapsrv_profile(mode, arg);
+        } else if (strcmp(token, "subscribe") == 0) {
+            extern void feapsrv_subscribe(char** args, int n);
+            char* args[10];
+            int n = 0;
+            while (n < 10 && (token = strtok(NULL, " \t\r\n")) != NULL)
+                args[n++] = token;
+            feapsrv_subscribe(args, n);
+        } else if (strcmp(token, "unsubscribe") == 0) {
+            extern void feapsrv_unsubscribe(const char* which);
+            feapsrv_unsubscribe(strtok(NULL, " \t\r\n"));
+        } else if (strcmp(token, "guard") == 0) {
+            extern void feapintr_guard(const char* mode);
+            feapintr_guard(strtok(NULL, " \t\r\n"));
+        } else if (strcmp(token, "pid") == 0) {
+            extern void feapintr_pid();
+            feapintr_pid();
+        } else if (strcmp(token, "sweep") == 0) {
+            extern int feapsweep();
+            if (feapsrv_started)
+                printf("Sweep must be run before start\n");
+            else if (feapsweep()) {
+                feapsrv_started = 1;
+                feapprof_end();
+                return 0;
+            }
         } else {
             printf("Unrecognized command: %s\n", token);
         }
+        feapprof_end();
         printf("FEAPSRV>\n");
         fflush(stdout);
+        feapprof_wait();
     }
     return 0;
 }
@@ -0,0 +1,507 @@
+/*
+ * FEAP parameter sweep runner
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define SWEEP_MAXPARAM 16
+#define SWEEP_MAXVALS  256
+#define SWEEP_MAXCMD   64
+#define SWEEP_MAXGET   16
+#define SWEEP_MAXRUNNER 256
+#define SWEEP_BUFSIZ   65536
+
+/*@T
+ * \section{Parameter sweeps}
+ *
+ * A parameter study usually means starting the same input deck many
+ * times with different values of the deck parameters, running the same
+ * macro commands on each, and collecting a few arrays at the end.  The
+ * [[sweep]] command in the [[feapsrv]] interface lets the client send
+ * the whole study as one job and get the results back as each run
+ * finishes.  The job description is a sequence of lines ending with
+ * [[end]]:
+ * \begin{itemize}
+ * \item [[deck NAME]] - the input deck
+ * \item [[param VAR v1 v2 ...]] - values for parameter [[VAR]]; the
+ *   runs cover the Cartesian product of all the [[param]] lines
+ * \item [[macro CMD]] - a macro command to run after the deck is read
+ * \item [[getm VAR]] - an array to collect after the macros are done
+ * \item [[workers N]] - number of simultaneous runs (default: the
+ *   number of online processors)
+ * \end{itemize}
+ *
+ * The server answers with [[Sweep runs N]], and then for each run
+ * sends [[Run K]] followed by one [[Result VAR TYPE COUNT]] line and
+ * a binary payload (in the same wire format as [[getm]]) per collected
+ * array, and finally [[Done K]] or [[Failed K]].  Runs are reported in
+ * order of completion.  The job ends with [[Sweep done]].
+ *
+ * A sweep must be started from the initial [[feapsrv]] prompt, before
+ * any input deck has been read.
+ *
+ *@c*/
+typedef struct sweep_t {
+    char   deck[256];
+    int    nparam;
+    char   pname[SWEEP_MAXPARAM][8];
+    int    nvals[SWEEP_MAXPARAM];
+    double vals[SWEEP_MAXPARAM][SWEEP_MAXVALS];
+    int    ncmd;
+    char   cmd[SWEEP_MAXCMD][128];
+    int    nget;
+    char   get[SWEEP_MAXGET][32];
+    int    nworkers;
+} sweep_t;
+
+static sweep_t sweep;
+
+/*@T
+ * \subsection{Reading the job}
+ *
+ * The job description is read with the same [[strtok]]-based parsing
+ * used by the main dispatcher.  Relative deck names are resolved
+ * against the current directory, since each run happens in its own
+ * scratch directory (so that the output files from simultaneous runs
+ * don't collide).
+ *
+ *@c*/
+static int sweep_read(sweep_t* sw)
+{
+    char buf[1024];
+    memset(sw, 0, sizeof(*sw));
+    sw->nworkers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (sw->nworkers < 1)
+        sw->nworkers = 1;
+
+    while (fgets(buf, sizeof(buf), stdin) != NULL) {
+        char* token = strtok(buf, " \t\r\n");
+        char* arg;
+        if (token == NULL) {
+            continue;
+        } else if (strcmp(token, "end") == 0) {
+            return (sw->deck[0] != 0);
+        } else if (strcmp(token, "deck") == 0) {
+            if ((arg = strtok(NULL, " \t\r\n")) == NULL)
+                continue;
+            if (arg[0] == '/' || getcwd(sw->deck, 128) == NULL)
+                sw->deck[0] = 0;
+            else
+                strcat(sw->deck, "/");
+            strncat(sw->deck, arg, 127);
+        } else if (strcmp(token, "param") == 0 &&
+                   sw->nparam < SWEEP_MAXPARAM) {
+            int k = sw->nparam;
+            if ((arg = strtok(NULL, " \t\r\n")) == NULL)
+                continue;
+            strncpy(sw->pname[k], arg, 7);
+            while ((arg = strtok(NULL, " \t\r\n")) != NULL &&
+                   sw->nvals[k] < SWEEP_MAXVALS)
+                sw->vals[k][sw->nvals[k]++] = atof(arg);
+            if (sw->nvals[k] > 0)
+                ++(sw->nparam);
+        } else if (strcmp(token, "macro") == 0 && sw->ncmd < SWEEP_MAXCMD) {
+            if ((arg = strtok(NULL, "\r\n")) != NULL)
+                strncpy(sw->cmd[sw->ncmd++], arg, 127);
+        } else if (strcmp(token, "getm") == 0 && sw->nget < SWEEP_MAXGET) {
+            if ((arg = strtok(NULL, " \t\r\n")) != NULL)
+                strncpy(sw->get[sw->nget++], arg, 31);
+        } else if (strcmp(token, "workers") == 0) {
+            if ((arg = strtok(NULL, " \t\r\n")) != NULL && atoi(arg) > 0)
+                sw->nworkers = atoi(arg);
+        } else {
+            printf("Unrecognized sweep line: %s\n", token);
+        }
+    }
+    return 0;
+}
+
+static int sweep_nruns(sweep_t* sw)
+{
+    int k, n = 1;
+    for (k = 0; k < sw->nparam; ++k)
+        n *= sw->nvals[k];
+    return n;
+}
+
+/*@T
+ * \subsection{Driving one run}
+ *
+ * Each run is handled by a {\em runner} process, which forks a FEAP
+ * worker connected to it by a pair of pipes and then plays the part
+ * of the MATLAB client: it answers the file name prompts the same
+ * way [[feapstart]] does, sends the macro commands one at a time, and
+ * fetches the requested arrays through the [[feapsrv]] interface.
+ * The worker is just the FEAP process itself, with its standard input
+ * and output moved onto the pipes and its parameters set; it returns
+ * from [[feapsweep]] (and so from [[feapsrv]]) and goes on to read
+ * the input deck as usual.
+ *
+ * The runner spools its results to an unlinked file in the scratch
+ * directory, and only when the run is over does it copy the whole
+ * report ([[Run K]] through [[Done K]] or [[Failed K]]) down the pipe
+ * to the coordinating process.  The pipe thus stays empty until the
+ * run is finished, and the reports of different runs never interleave.
+ *
+ *@c*/
+static int sweep_waitfor(FILE* from, const char* s)
+{
+    char buf[1024];
+    while (fgets(buf, sizeof(buf), from) != NULL)
+        if (strstr(buf, s))
+            return 1;
+    return 0;
+}
+
+static void sweep_send(FILE* to, const char* s)
+{
+    fprintf(to, "%s\n", s);
+    fflush(to);
+}
+
+static int sweep_start_deck(FILE* to, FILE* from, const char* deck)
+{
+    char buf[1024];
+    const char* base = strrchr(deck, '/');
+    base = base ? base+1 : deck;
+
+    if (!sweep_waitfor(from, "MATFEAP SYNC"))
+        return 0;
+    sweep_send(to, base);
+    while (fgets(buf, sizeof(buf), from) != NULL) {
+        if (strstr(buf, "*ERROR*")) {
+            return 0;
+        } else if (strstr(buf, "Files are set")) {
+            sweep_waitfor(from, "MATFEAP SYNC");
+            sweep_send(to, "y");
+            return sweep_waitfor(from, "MATFEAP SYNC");
+        } else if (strstr(buf, "MATFEAP SYNC")) {
+            sweep_send(to, "");
+        }
+    }
+    return 0;
+}
+
+static int sweep_getm(FILE* to, FILE* from, FILE* out, const char* var)
+{
+    char buf[1024];
+    char line[256];
+    char datatype[32];
+    int len = 0;
+    size_t nbytes;
+
+    sweep_send(to, "serv");
+    if (!sweep_waitfor(from, "FEAPSRV>"))
+        return 0;
+    sprintf(line, "getm %s", var);
+    sweep_send(to, line);
+    if (fgets(line, sizeof(line), from) == NULL)
+        return 0;
+    if (sscanf(line, "Send %31s %d", datatype, &len) == 2) {
+        sweep_send(to, "binary");
+        fprintf(out, "Result %s %s %d\n", var, datatype, len);
+        nbytes = (size_t) len * (strcmp(datatype, "int") == 0 ? 4 : 8);
+        while (nbytes > 0) {
+            size_t m = nbytes < sizeof(buf) ? nbytes : sizeof(buf);
+            if (fread(buf, 1, m, from) != m)
+                return 0;
+            fwrite(buf, 1, m, out);
+            nbytes -= m;
+        }
+    } else {
+        fprintf(out, "Result %s none 0\n", var);
+    }
+    sweep_waitfor(from, "FEAPSRV>");
+    sweep_send(to, "start");
+    return sweep_waitfor(from, "MATFEAP SYNC");
+}
+
+static int sweep_drive(sweep_t* sw, FILE* to, FILE* from, FILE* out)
+{
+    int k;
+    if (!sweep_start_deck(to, from, sw->deck))
+        return 0;
+    for (k = 0; k < sw->ncmd; ++k) {
+        sweep_send(to, sw->cmd[k]);
+        if (!sweep_waitfor(from, "MATFEAP SYNC"))
+            return 0;
+    }
+    for (k = 0; k < sw->nget; ++k)
+        if (!sweep_getm(to, from, out, sw->get[k]))
+            return 0;
+    sweep_send(to, "quit");
+    sweep_waitfor(from, "MATFEAP SYNC");
+    sweep_send(to, "n");
+    sweep_waitfor(from, "MATFEAP SYNC 1");
+    return 1;
+}
+
+static void sweep_rmdir(const char* dir)
+{
+    char path[1024];
+    struct dirent* ent;
+    DIR* d = opendir(dir);
+    if (d == NULL)
+        return;
+    while ((ent = readdir(d)) != NULL) {
+        if (strcmp(ent->d_name, ".") && strcmp(ent->d_name, "..")) {
+            snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+            unlink(path);
+        }
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+/*@T
+ * The scratch directory gets a copy of every regular file in the
+ * deck's directory, so that [[include]] files and anything else the
+ * deck reads by a relative name are found, while whatever FEAP writes
+ * over goes to the copy.  Subdirectories are linked rather than copied.
+ *
+ *@c*/
+static int sweep_copyfile(const char* src, const char* dst)
+{
+    char buf[8192];
+    ssize_t n;
+    int ok = 1;
+    int in  = open(src, O_RDONLY);
+    int out = open(dst, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (in >= 0 && out >= 0) {
+        while ((n = read(in, buf, sizeof(buf))) > 0)
+            if (write(out, buf, n) != n)
+                ok = 0;
+        if (n < 0)
+            ok = 0;
+    } else {
+        ok = 0;
+    }
+    if (in >= 0)  close(in);
+    if (out >= 0) close(out);
+    return ok;
+}
+
+static int sweep_copydir(const char* deck, const char* dir)
+{
+    char src[1024], dst[1024];
+    struct dirent* ent;
+    struct stat st;
+    const char* base = strrchr(deck, '/');
+    int dlen = base ? (int) (base-deck) : 0;
+    int ok = 1;
+    DIR* d;
+
+    snprintf(src, sizeof(src), "%.*s", dlen, deck);
+    if ((d = opendir(base ? (dlen ? src : "/") : ".")) == NULL)
+        return 0;
+    while ((ent = readdir(d)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+            continue;
+        snprintf(src, sizeof(src), "%.*s/%s", dlen, deck, ent->d_name);
+        snprintf(dst, sizeof(dst), "%s/%s", dir, ent->d_name);
+        if (stat(src, &st) < 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            symlink(src, dst);
+        else if (S_ISREG(st.st_mode) && !sweep_copyfile(src, dst))
+            ok = 0;
+    }
+    closedir(d);
+    return ok;
+}
+
+static void sweep_report(FILE* spool, int run, int ok, int outfd)
+{
+    char buf[SWEEP_BUFSIZ];
+    size_t n;
+    FILE* out = fdopen(outfd, "w");
+    fprintf(out, "Run %d\n", run);
+    if (spool) {
+        rewind(spool);
+        while ((n = fread(buf, 1, sizeof(buf), spool)) > 0)
+            fwrite(buf, 1, n, out);
+        fclose(spool);
+    }
+    fprintf(out, "%s %d\n", ok ? "Done" : "Failed", run);
+    fclose(out);
+}
+
+/*
+ * Returns 1 in the FEAP worker process, which should go on to run FEAP.
+ * The runner process itself never returns.
+ */
+static int sweep_runner(sweep_t* sw, int run, int outfd)
+{
+    extern void feapsrv_param(const char* var, double val);
+    char dir[256];
+    char path[512];
+    const char* tmp = getenv("TMPDIR");
+    int to_feap[2], from_feap[2];
+    int k, r, ok = 0;
+    pid_t pid;
+    FILE* spool = NULL;
+
+    snprintf(dir, sizeof(dir), "%s/feapsweepXXXXXX", tmp ? tmp : "/tmp");
+    if (mkdtemp(dir) == NULL) {
+        sweep_report(NULL, run, 0, outfd);
+        _exit(0);
+    }
+    snprintf(path, sizeof(path), "%s/.sweeprun", dir);
+    if ((spool = fopen(path, "w+")) != NULL)
+        unlink(path);
+    if (spool == NULL || !sweep_copydir(sw->deck, dir) ||
+        pipe(to_feap) < 0 || pipe(from_feap) < 0) {
+        sweep_report(spool, run, 0, outfd);
+        sweep_rmdir(dir);
+        _exit(0);
+    }
+
+    if ((pid = fork()) == 0) {
+        fclose(spool);
+        close(outfd);
+        dup2(to_feap[0], 0);
+        dup2(from_feap[1], 1);
+        close(to_feap[0]);   close(to_feap[1]);
+        close(from_feap[0]); close(from_feap[1]);
+        if (chdir(dir) < 0)
+            _exit(-1);
+        for (k = 0, r = run; k < sw->nparam; ++k) {
+            feapsrv_param(sw->pname[k], sw->vals[k][r % sw->nvals[k]]);
+            r /= sw->nvals[k];
+        }
+        return 1;
+    }
+
+    close(to_feap[0]);
+    close(from_feap[1]);
+    if (pid > 0) {
+        FILE* to   = fdopen(to_feap[1], "w");
+        FILE* from = fdopen(from_feap[0], "r");
+        ok = sweep_drive(sw, to, from, spool);
+        fclose(to);
+        fclose(from);
+        waitpid(pid, NULL, 0);
+    }
+    sweep_report(spool, run, ok, outfd);
+    sweep_rmdir(dir);
+    _exit(0);
+    return 0;
+}
+
+/*@T
+ * \subsection{Coordinating the runs}
+ *
+ * The coordinator keeps up to [[nworkers]] runners going at once.
+ * When a runner's result pipe becomes readable, the run is over and
+ * its whole report is on the way, so the coordinator copies it through
+ * to the client until the pipe closes, reaps the runner, and starts
+ * the next run in its place.  Copying a finished report is quick, so
+ * the other runs are not held up, and the reports go out in order of
+ * completion.  If a runner cannot be started (say [[fork]] fails)
+ * while none are active, we give up on starting more, but each run
+ * that never started is still reported as {\tt Failed}, so the client
+ * hears about every run before [[Sweep done]].  If [[poll]] itself
+ * fails, we read the active runners' reports one at a time instead.
+ * While the sweep is
+ * running, we restore the default [[SIGCHLD]] handling
+ * (the daemon's reaper is inherited across the fork) so that the
+ * coordinator can wait for its own runners.
+ *
+ *@c*/
+int feapsweep()
+{
+    struct sigaction sa, old_sa;
+    struct pollfd fds[SWEEP_MAXRUNNER];
+    pid_t pids[SWEEP_MAXRUNNER];
+    char buf[SWEEP_BUFSIZ];
+    int nruns, next = 0, active = 0;
+
+    if (!sweep_read(&sweep)) {
+        printf("Sweep needs a deck\n");
+        return 0;
+    }
+    nruns = sweep_nruns(&sweep);
+    if (sweep.nworkers > SWEEP_MAXRUNNER)
+        sweep.nworkers = SWEEP_MAXRUNNER;
+    printf("Sweep runs %d\n", nruns);
+    fflush(stdout);
+
+    sa.sa_handler = SIG_DFL;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGCHLD, &sa, &old_sa);
+
+    while (next < nruns || active > 0) {
+        int i, n;
+
+        while (active < sweep.nworkers && next < nruns) {
+            int p[2];
+            if (pipe(p) < 0) {
+                perror("pipe");
+                break;
+            }
+            fflush(stdout);
+            pids[active] = fork();
+            if (pids[active] == 0) {
+                close(p[0]);
+                for (i = 0; i < active; ++i)
+                    close(fds[i].fd);
+                if (sweep_runner(&sweep, next, p[1]))
+                    return 1;
+            }
+            close(p[1]);
+            if (pids[active] < 0) {
+                perror("fork");
+                close(p[0]);
+                break;
+            }
+            fds[active].fd = p[0];
+            fds[active].events = POLLIN;
+            ++active;
+            ++next;
+        }
+        if (active == 0)
+            break;
+
+        if (poll(fds, active, -1) < 0 && errno != EINTR) {
+            perror("poll");
+            for (i = 0; i < active; ++i)
+                fds[i].revents = POLLIN;
+        }
+        for (i = 0; i < active; ++i) {
+            if (fds[i].revents & (POLLIN | POLLHUP)) {
+                while ((n = read(fds[i].fd, buf, sizeof(buf))) > 0 ||
+                       (n < 0 && errno == EINTR))
+                    if (n > 0)
+                        fwrite(buf, 1, n, stdout);
+                fflush(stdout);
+                close(fds[i].fd);
+                waitpid(pids[i], NULL, 0);
+                --active;
+                fds[i] = fds[active];
+                pids[i] = pids[active];
+                fds[i].revents = 0;
+                --i;
+            }
+        }
+    }
+
+    /* Runs we could not start still get a report */
+    for (; next < nruns; ++next)
+        printf("Run %d\nFailed %d\n", next, next);
+
+    sigaction(SIGCHLD, &old_sa, NULL);
+    printf("Sweep done\n");
+    return 0;
+}
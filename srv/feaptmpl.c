@@ -0,0 +1,692 @@
+/*
+ * FEAP model template cache
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#ifdef __GLIBC__
+#include <stdio_ext.h>
+#define feaptmpl_purge(fp) __fpurge(fp)
+#else
+#define feaptmpl_purge(fp) fpurge(fp)
+#endif
+
+#define TEMPLATES_ENV_VAR "MATFEAP_TEMPLATES"
+#define TEMPLATE_TTL_ENV_VAR "MATFEAP_TEMPLATE_TTL"
+#define TEMPLATE_TTL  600
+#define MAX_TEMPLATES 32
+#define MAX_TPARAMS   64
+#define TMPL_KEYSIZ   4096
+#define TMPL_MSGSIZ   (TMPL_KEYSIZ+128)
+
+/*@T
+ * \section{Model templates}
+ *
+ * Every new connection to the daemon pays for starting FEAP and
+ * parsing the input deck, which for a large mesh can take seconds.
+ * Users often start the same deck with the same parameters over and
+ * over, so the daemon can keep a pool of {\em template} processes: FEAP
+ * processes that have already read a given deck and are parked at the
+ * first macro prompt.  A new session for the same model is served by a
+ * fork of the template, which shares the template's memory
+ * copy-on-write and starts at the macro prompt without reading the
+ * deck again.
+ *
+ * Templates are off by default.  Setting [[MATFEAP_TEMPLATES]] to a
+ * positive number turns them on and limits how many the daemon keeps;
+ * when the pool is full, the least recently used template is dropped.
+ * A template that has not been used for [[MATFEAP_TEMPLATE_TTL]]
+ * seconds (600 by default) is also dropped.
+ *
+ * A template is identified by a key made from
+ * \begin{itemize}
+ * \item the full path of the input deck;
+ * \item the modification time and size of the deck; and
+ * \item the [[param]] assignments made before the run was started,
+ *   in sorted order.
+ * \end{itemize}
+ * A session that does anything else to FEAP's state before [[start]]
+ * (e.g.~[[set]] or [[setm]] at the first [[feapsrv]] prompt) is never
+ * matched with a template and never becomes one.  Auxiliary files read
+ * by the deck ([[include]] files, for example) are not part of the key,
+ * and a session cloned from a template shares the template's open
+ * output files, so the cache is best suited to decks whose output files
+ * don't matter to the client.
+ *
+ * The life of a session with templates turned on goes like this:
+ * \begin{enumerate}
+ * \item The session runs the [[feapsrv]] prompt and the file name
+ *   dialog as usual.  The name of the input deck is recorded when
+ *   [[cleannam]] sees it.
+ * \item Just before FEAP reads its first line from the input deck, the
+ *   session asks the daemon for a template with the same key, passing
+ *   along its client connection.  If there is one, the daemon hands the
+ *   connection to the template, and the session exits quietly.
+ * \item Otherwise, the session reads the deck as usual.  When it
+ *   reaches the first macro prompt, it forks: the child becomes a
+ *   template and registers with the daemon, and the parent carries on
+ *   serving its client.
+ * \item When a template is handed a connection, it forks a clone that
+ *   takes over the connection and returns to the macro prompt, where
+ *   it sends the synchronization message that the client is waiting for
+ *   after the file name dialog.
+ * \end{enumerate}
+ * The messages between the sessions, templates, and the daemon go over
+ * a private UNIX domain socket, and the client connections are passed
+ * as file descriptors with [[SCM_RIGHTS]].
+ *
+ *@c*/
+static char feaptmpl_path[108];  /* Registry socket ("" if disabled)  */
+static int  feaptmpl_listen = -1;
+static int  feaptmpl_state  = 0; /* 0 = eligible, 1 = missed, -1 = not */
+static char feaptmpl_deck[1024];
+static char feaptmpl_params[MAX_TPARAMS][64];
+static int  feaptmpl_nparams = 0;
+
+
+/*@T
+ * \subsection{Passing descriptors}
+ *
+ * Registry messages are single lines of text.  A message may carry one
+ * file descriptor along with it; [[feaptmpl_send]] attaches the
+ * descriptor [[fd]] if it is nonnegative, and [[feaptmpl_recv]] reads
+ * up to a newline and returns any descriptor that came along (or $-1$).
+ * The receive routine returns the length of the line, or zero at end
+ * of file.  Reading one byte per [[recvmsg]] is slow, but registry
+ * messages are short and rare, and it keeps us from reading past the
+ * end of one message (and its descriptor) into the next.
+ *
+ *@c*/
+static int feaptmpl_send(int sock, const char* msg, int fd)
+{
+    struct msghdr mh;
+    struct iovec iov;
+    char cbuf[CMSG_SPACE(sizeof(int))];
+
+    memset(&mh, 0, sizeof(mh));
+    iov.iov_base = (void*) msg;
+    iov.iov_len  = strlen(msg);
+    mh.msg_iov    = &iov;
+    mh.msg_iovlen = 1;
+    if (fd >= 0) {
+        struct cmsghdr* cm;
+        memset(cbuf, 0, sizeof(cbuf));
+        mh.msg_control    = cbuf;
+        mh.msg_controllen = sizeof(cbuf);
+        cm = CMSG_FIRSTHDR(&mh);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type  = SCM_RIGHTS;
+        cm->cmsg_len   = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cm), &fd, sizeof(int));
+    }
+    return sendmsg(sock, &mh, MSG_NOSIGNAL) == (ssize_t) iov.iov_len;
+}
+
+static int feaptmpl_recv(int sock, char* msg, int len, int* fd)
+{
+    int n = 0;
+    *fd = -1;
+    while (n < len-1) {
+        struct msghdr mh;
+        struct iovec iov;
+        char cbuf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr* cm;
+        ssize_t m;
+
+        memset(&mh, 0, sizeof(mh));
+        iov.iov_base = msg+n;
+        iov.iov_len  = 1;
+        mh.msg_iov        = &iov;
+        mh.msg_iovlen     = 1;
+        mh.msg_control    = cbuf;
+        mh.msg_controllen = sizeof(cbuf);
+        m = recvmsg(sock, &mh, 0);
+        if (m < 0 && errno == EINTR)
+            continue;
+        if (m <= 0)
+            break;
+        for (cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm))
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS)
+                memcpy(fd, CMSG_DATA(cm), sizeof(int));
+        if (msg[n++] == '\n') {
+            msg[n-1] = 0;
+            return n;
+        }
+    }
+    msg[n] = 0;
+    if (*fd >= 0 && n == 0) {
+        close(*fd);
+        *fd = -1;
+    }
+    return n;
+}
+
+static int feaptmpl_connect()
+{
+    struct sockaddr_un addr;
+    int sock;
+    if (!feaptmpl_path[0])
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, feaptmpl_path);
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    if (connect(sock, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+
+/*@T
+ * \subsection{Session side: building the key}
+ *
+ * The [[feapsrv]] dispatcher reports each [[param]] assignment through
+ * [[feaptmpl_param]], and calls [[feaptmpl_taint]] for any other
+ * command before [[start]] that might change FEAP's state.  The
+ * [[cleannam]] routine passes the input file name through
+ * [[feaptmpldeck]].
+ *
+ *@c*/
+void feaptmpl_param(const char* var, double val)
+{
+    if (feaptmpl_nparams == MAX_TPARAMS) {
+        feaptmpl_state = -1;
+        return;
+    }
+    sprintf(feaptmpl_params[feaptmpl_nparams++], "%.16s=%.17g", var, val);
+}
+
+void feaptmpl_taint()
+{
+    feaptmpl_state = -1;
+}
+
+int feaptmpldeck_(char* name, int len)
+{
+    while (len > 0 && (name[len-1] == ' ' || name[len-1] == 0))
+        --len;
+    if (len >= (int) sizeof(feaptmpl_deck))
+        len = sizeof(feaptmpl_deck)-1;
+    memcpy(feaptmpl_deck, name, len);
+    feaptmpl_deck[len] = 0;
+    return 0;
+}
+
+static int feaptmpl_cmp(const void* a, const void* b)
+{
+    return strcmp((const char*) a, (const char*) b);
+}
+
+static int feaptmpl_key(char* key)
+{
+    char path[1024];
+    struct stat st;
+    int i, n;
+
+    if (!feaptmpl_deck[0])
+        return 0;
+    if (realpath(feaptmpl_deck, path) == NULL || stat(path, &st) < 0)
+        return 0;
+    n = snprintf(key, TMPL_KEYSIZ, "%s %ld %ld", path,
+                 (long) st.st_mtime, (long) st.st_size);
+    qsort(feaptmpl_params, feaptmpl_nparams, sizeof(feaptmpl_params[0]),
+          feaptmpl_cmp);
+    for (i = 0; i < feaptmpl_nparams && n < TMPL_KEYSIZ; ++i)
+        n += snprintf(key+n, TMPL_KEYSIZ-n, " %s", feaptmpl_params[i]);
+    return (n < TMPL_KEYSIZ);
+}
+
+
+/*@T
+ * \subsection{Session side: looking for a template}
+ *
+ * The [[feaptmplparse]] routine is called from [[tinput]] whenever
+ * FEAP reads from the input deck, and does its work on the first call.
+ * Everything FEAP has written so far is flushed before the connection
+ * is handed over, so that nothing from this process arrives after the
+ * clone has started talking.  On a hit we leave with [[_exit]], which
+ * skips FEAP's shutdown (and the final synchronization message).
+ *
+ *@c*/
+int feaptmplparse_()
+{
+    extern int feapflush_();
+    static int called = 0;
+    char key[TMPL_KEYSIZ], msg[TMPL_MSGSIZ];
+    int sock, fd;
+
+    if (called || feaptmpl_state != 0 || !feaptmpl_path[0])
+        return 0;
+    called = 1;
+    if (!feaptmpl_key(key) || (sock = feaptmpl_connect()) < 0) {
+        feaptmpl_state = -1;
+        return 0;
+    }
+
+    feapflush_();
+    fflush(stdout);
+    snprintf(msg, sizeof(msg), "lookup %d %s\n", (int) getpid(), key);
+    if (feaptmpl_send(sock, msg, 0) && feaptmpl_recv(sock, msg, 64, &fd) &&
+        strcmp(msg, "hit") == 0)
+        _exit(0);
+
+    close(sock);
+    feaptmpl_state = 1;
+    return 0;
+}
+
+
+/*@T
+ * \subsection{Template side}
+ *
+ * The [[feaptmplready]] routine is called from [[tinput]] just before
+ * each console prompt, and does its work on the first call in a session
+ * that missed in the cache.  It forks the template, which lets go of
+ * the client connection and registers with the daemon.  The template
+ * then waits for connections.  For each one, it forks an intermediate
+ * process, which forks the clone and exits at once; that way the clone
+ * is adopted by the daemon (see [[feaptmpl_daemon_setup]]), which reaps
+ * it and lists it as a session.  The intermediate process reports the
+ * clone's process ID back to the daemon.
+ *
+ * The clone throws away anything left in the C [[stdin]] buffer,
+ * puts the connection on descriptors 0 and 1, starts a new process
+ * group for interrupts (see [[feapintr.c]]), and returns, so FEAP
+ * carries on at the macro prompt.  The template exits when the daemon
+ * closes its registry connection.
+ *
+ *@c*/
+static void feaptmpl_serve(int sock)
+{
+    extern void feapintr_reset();
+    char msg[TMPL_MSGSIZ];
+    int fd;
+
+    while (feaptmpl_recv(sock, msg, sizeof(msg), &fd) > 0) {
+        pid_t mid, clone;
+        if (fd < 0 || strncmp(msg, "client ", 7) != 0) {
+            if (fd >= 0)
+                close(fd);
+            continue;
+        }
+        if ((mid = fork()) == 0) {
+            if ((clone = fork()) == 0) {
+                close(sock);
+                feaptmpl_purge(stdin);
+                clearerr(stdin);
+                dup2(fd, 0);
+                dup2(fd, 1);
+                close(fd);
+                feaptmpl_state = -1;
+                feapintr_reset();
+                return;
+            }
+            if (clone > 0) {
+                char report[256];
+                snprintf(report, sizeof(report), "clone %d %.200s\n",
+                         (int) clone, msg+7);
+                feaptmpl_send(sock, report, -1);
+            }
+            _exit(0);
+        }
+        close(fd);
+        if (mid > 0)
+            waitpid(mid, NULL, 0);
+    }
+    _exit(0);
+}
+
+int feaptmplready_()
+{
+    extern int feapflush_();
+    char key[TMPL_KEYSIZ], msg[TMPL_MSGSIZ];
+    int sock, devnull;
+
+    if (feaptmpl_state != 1)
+        return 0;
+    feaptmpl_state = -1;
+    if (!feaptmpl_key(key))
+        return 0;
+
+    feapflush_();
+    fflush(stdout);
+    if (fork() != 0)
+        return 0;
+
+    /* Template process */
+    setsid();
+    devnull = open("/dev/null", O_RDWR);
+    dup2(devnull, 0);
+    dup2(devnull, 1);
+    close(devnull);
+    if ((sock = feaptmpl_connect()) < 0)
+        _exit(0);
+    snprintf(msg, sizeof(msg), "template %d %s\n", (int) getpid(), key);
+    if (!feaptmpl_send(sock, msg, -1))
+        _exit(0);
+    feaptmpl_serve(sock);
+    return 0;
+}
+
+
+/*@T
+ * \subsection{Daemon side}
+ *
+ * The daemon keeps a table of registered templates and a list of open
+ * registry connections.  A registry connection is either a short
+ * lookup from a session or the long-lived connection of a template; in
+ * the latter case the template's slot holds the descriptor.
+ *
+ * On Linux, the daemon makes itself a ``child subreaper'', so that the
+ * clones (and templates whose parent session has exited) are adopted
+ * by the daemon instead of [[init]], and the daemon's usual [[SIGCHLD]]
+ * handler reaps them.  This is done even with templates turned off,
+ * since a session's spare process (see [[feapintr.c]]) can also
+ * outlive its parent.
+ *
+ *@c*/
+typedef struct feaptmpl_t {
+    int    fd;
+    pid_t  pid;
+    char   key[TMPL_KEYSIZ];
+    time_t created;
+    time_t used;
+    long   hits;
+} feaptmpl_t;
+
+static feaptmpl_t feaptmpl_table[MAX_TEMPLATES];
+static int feaptmpl_conns[MAX_TEMPLATES];
+static int feaptmpl_max = 0;
+static int feaptmpl_ttl = TEMPLATE_TTL;
+static long feaptmpl_hits = 0;
+static long feaptmpl_misses = 0;
+
+void feaptmpl_daemon_setup()
+{
+    struct sockaddr_un addr;
+    char* env = getenv(TEMPLATES_ENV_VAR);
+    char* ttl = getenv(TEMPLATE_TTL_ENV_VAR);
+    int i;
+
+    for (i = 0; i < MAX_TEMPLATES; ++i) {
+        feaptmpl_table[i].fd = -1;
+        feaptmpl_conns[i] = -1;
+    }
+#ifdef PR_SET_CHILD_SUBREAPER
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+#endif
+    feaptmpl_max = env ? atoi(env) : 0;
+    if (feaptmpl_max > MAX_TEMPLATES)
+        feaptmpl_max = MAX_TEMPLATES;
+    if (feaptmpl_max <= 0)
+        return;
+    if (ttl)
+        feaptmpl_ttl = atoi(ttl);
+
+    snprintf(feaptmpl_path, sizeof(feaptmpl_path), "/tmp/matfeap-tmpl-%d",
+             (int) getpid());
+    unlink(feaptmpl_path);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, feaptmpl_path);
+    if ((feaptmpl_listen = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        bind(feaptmpl_listen, (struct sockaddr*) &addr, sizeof(addr)) < 0 ||
+        listen(feaptmpl_listen, 16) < 0) {
+        perror("template socket");
+        if (feaptmpl_listen >= 0)
+            close(feaptmpl_listen);
+        feaptmpl_listen = -1;
+        feaptmpl_path[0] = 0;
+        return;
+    }
+    chmod(feaptmpl_path, 0600);
+    printf("Keeping up to %d model templates\n", feaptmpl_max);
+}
+
+/*@T
+ * A session keeps the registry path (so that it can connect later), but
+ * closes the daemon's descriptors.
+ *
+ *@c*/
+void feaptmpl_child()
+{
+    int i;
+    if (feaptmpl_listen >= 0)
+        close(feaptmpl_listen);
+    for (i = 0; i < MAX_TEMPLATES; ++i) {
+        if (feaptmpl_conns[i] >= 0)
+            close(feaptmpl_conns[i]);
+        if (feaptmpl_table[i].fd >= 0)
+            close(feaptmpl_table[i].fd);
+    }
+}
+
+/*@T
+ * A session that replaces its own image with [[reset]] (see
+ * [[feapreset.c]]) hands the registry path to the new image, which
+ * takes it back with [[feaptmpl_rejoin]].
+ *
+ *@c*/
+const char* feaptmpl_registry()
+{
+    return feaptmpl_path;
+}
+
+void feaptmpl_rejoin(const char* path)
+{
+    strncpy(feaptmpl_path, path, sizeof(feaptmpl_path)-1);
+    feaptmpl_path[sizeof(feaptmpl_path)-1] = 0;
+}
+
+static void feaptmpl_drop(feaptmpl_t* t)
+{
+    close(t->fd);
+    t->fd = -1;
+}
+
+/*@T
+ * When a template registers, we drop it at once if there is already
+ * a template with the same key (two sessions with the same key can
+ * miss at the same time).  Otherwise it goes in a free slot, or in
+ * place of the least recently used template.
+ *
+ *@c*/
+static void feaptmpl_register(int fd, int pid, const char* key)
+{
+    feaptmpl_t* slot = NULL;
+    int i;
+    for (i = 0; i < feaptmpl_max; ++i) {
+        feaptmpl_t* t = feaptmpl_table + i;
+        if (t->fd >= 0 && strcmp(t->key, key) == 0) {
+            close(fd);
+            return;
+        }
+        if (t->fd < 0 && !slot)
+            slot = t;
+    }
+    if (!slot) {
+        slot = feaptmpl_table;
+        for (i = 1; i < feaptmpl_max; ++i)
+            if (feaptmpl_table[i].used < slot->used)
+                slot = feaptmpl_table + i;
+        feaptmpl_drop(slot);
+    }
+    slot->fd   = fd;
+    slot->pid  = pid;
+    slot->hits = 0;
+    slot->created = slot->used = time(NULL);
+    strncpy(slot->key, key, TMPL_KEYSIZ-1);
+    slot->key[TMPL_KEYSIZ-1] = 0;
+}
+
+static void feaptmpl_lookup(int fd, int pid, const char* key, int client)
+{
+    extern const char* feapadmin_client(pid_t pid);
+    char msg[256];
+    int i;
+    for (i = 0; client >= 0 && i < feaptmpl_max; ++i) {
+        feaptmpl_t* t = feaptmpl_table + i;
+        if (t->fd >= 0 && strcmp(t->key, key) == 0) {
+            snprintf(msg, sizeof(msg), "client %.200s\n",
+                     feapadmin_client(pid));
+            if (!feaptmpl_send(t->fd, msg, client)) {
+                feaptmpl_drop(t);
+                break;
+            }
+            t->used = time(NULL);
+            ++t->hits;
+            ++feaptmpl_hits;
+            feaptmpl_send(fd, "hit\n", -1);
+            close(client);
+            return;
+        }
+    }
+    ++feaptmpl_misses;
+    feaptmpl_send(fd, "miss\n", -1);
+    if (client >= 0)
+        close(client);
+}
+
+/*@T
+ * The daemon's [[select]] loop calls [[feaptmpl_fdset]] and
+ * [[feaptmpl_handle]] in the same way as for the administration socket.
+ * A message on a new connection is either a lookup (after which the
+ * connection is closed) or a template registration (after which the
+ * connection belongs to the template).  Messages on a template's
+ * connection report clones; end of file means the template is gone.
+ *
+ *@c*/
+void feaptmpl_fdset(fd_set* fds, int* maxfd)
+{
+    int i;
+    if (feaptmpl_listen < 0)
+        return;
+    FD_SET(feaptmpl_listen, fds);
+    if (feaptmpl_listen > *maxfd)
+        *maxfd = feaptmpl_listen;
+    for (i = 0; i < 2*MAX_TEMPLATES; ++i) {
+        int fd = (i < MAX_TEMPLATES) ? feaptmpl_conns[i] :
+                                       feaptmpl_table[i-MAX_TEMPLATES].fd;
+        if (fd >= 0) {
+            FD_SET(fd, fds);
+            if (fd > *maxfd)
+                *maxfd = fd;
+        }
+    }
+}
+
+static void feaptmpl_message(int i)
+{
+    char msg[TMPL_MSGSIZ];
+    int fd, pid, n, conn = feaptmpl_conns[i];
+
+    feaptmpl_conns[i] = -1;
+    if (feaptmpl_recv(conn, msg, sizeof(msg), &fd) <= 0) {
+        close(conn);
+        return;
+    }
+    if (sscanf(msg, "lookup %d %n", &pid, &n) == 1) {
+        feaptmpl_lookup(conn, pid, msg+n, fd);
+        close(conn);
+    } else if (sscanf(msg, "template %d %n", &pid, &n) == 1) {
+        if (fd >= 0)
+            close(fd);
+        feaptmpl_register(conn, pid, msg+n);
+    } else {
+        if (fd >= 0)
+            close(fd);
+        close(conn);
+    }
+}
+
+static void feaptmpl_report(feaptmpl_t* t)
+{
+    extern void feapadmin_add(pid_t pid, const char* client);
+    char msg[256], client[256];
+    int fd, pid;
+    if (feaptmpl_recv(t->fd, msg, sizeof(msg), &fd) <= 0) {
+        feaptmpl_drop(t);
+        return;
+    }
+    if (fd >= 0)
+        close(fd);
+    if (sscanf(msg, "clone %d %200[^\n]", &pid, client) == 2) {
+        strcat(client, "*");
+        feapadmin_add(pid, client);
+    }
+}
+
+void feaptmpl_handle(fd_set* fds)
+{
+    time_t now = time(NULL);
+    int i;
+    if (feaptmpl_listen < 0)
+        return;
+
+    for (i = 0; i < MAX_TEMPLATES; ++i) {
+        feaptmpl_t* t = feaptmpl_table + i;
+        if (t->fd >= 0 && FD_ISSET(t->fd, fds))
+            feaptmpl_report(t);
+        if (t->fd >= 0 && feaptmpl_ttl > 0 && now - t->used > feaptmpl_ttl)
+            feaptmpl_drop(t);
+        if (feaptmpl_conns[i] >= 0 && FD_ISSET(feaptmpl_conns[i], fds))
+            feaptmpl_message(i);
+    }
+
+    if (FD_ISSET(feaptmpl_listen, fds)) {
+        int fd = accept(feaptmpl_listen, NULL, NULL);
+        for (i = 0; fd >= 0 && i < MAX_TEMPLATES; ++i) {
+            if (feaptmpl_conns[i] < 0) {
+                feaptmpl_conns[i] = fd;
+                fd = -1;
+            }
+        }
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+/*@T
+ * The administration socket's [[templates]] command lists the pool,
+ * one template per line, as {\tt {\it pid} {\it age} {\it idle}
+ * {\it hits} {\it key}}.  Clones are listed among the sessions, with
+ * a [[*]] after the client address.
+ *
+ *@c*/
+void feaptmpl_list(FILE* out)
+{
+    time_t now = time(NULL);
+    int i, n = 0;
+    for (i = 0; i < MAX_TEMPLATES; ++i)
+        if (feaptmpl_table[i].fd >= 0)
+            ++n;
+    fprintf(out, "Templates %d of %d (hits %ld, misses %ld)\n",
+            n, feaptmpl_max, feaptmpl_hits, feaptmpl_misses);
+    for (i = 0; i < MAX_TEMPLATES; ++i) {
+        feaptmpl_t* t = feaptmpl_table + i;
+        if (t->fd >= 0)
+            fprintf(out, "%d %ld %ld %ld %s\n", (int) t->pid,
+                    (long) (now - t->created), (long) (now - t->used),
+                    t->hits, t->key);
+    }
+}
@@ -173,6 +173,192 @@ c     format
 
       end
 
+c     @T
+c     \subsection{Parallel export}
+c
+c     The [[matexp]] routine has the same dispatch as [[matspew]], but
+c     instead of walking the storage itself it passes the storage
+c     arrays to the C export engine in [[feapspex.c]], which walks them
+c     in parallel and sends the coordinate data in a single pass.
+c
+c     @c
+      subroutine matexp(lct)
+c     @q
+
+      implicit   none
+
+      include   'cdata.h'
+      include   'compas.h'
+      include   'iodata.h'
+      include   'iofile.h'
+      include   'part0.h'
+      include   'umac1.h'
+      include   'pointer.h'
+      include   'comblk.h'
+
+      logical    pcomp
+      character  lct*(*),array*4
+
+      save
+
+c     Hand the storage arrays to the export engine
+
+c       Get array name
+
+        array = lct
+
+c       Tangent terms
+
+        if(pcomp(array,'tang',4)) then
+          if(ittyp.eq.-1 .or. ittyp.eq.-2) then  ! Blocked or Sparse
+            if(max(abs(np(93)),abs(np(94)),abs(np(npart))).eq.0) then
+              go to 400
+            else
+              call fmspexsym(neq,mr(np(93)),mr(np(94)),hr(np(npart)))
+              return
+            endif
+          elseif(ittyp.eq.-3) then               ! Profile
+            if(max(abs(np(20+npart)),abs(np(npart))).eq.0) then
+              go to 400
+            else
+              call fmspexprof(neq,mr(np(20+npart)),hr(np(npart)),
+     &                    hr(np(npart)+neq))
+              return
+            endif
+          endif
+        elseif(pcomp(array,'utan',4)) then
+          if(ittyp.eq.-3) then               ! Profile
+            if(max(abs(np(20+npart)),abs(np(npart)),
+     &                               abs(np(npart+4))).eq.0) then
+              go to 400
+            else
+              call fmspexprof(neq,mr(np(20+npart)),hr(np(npart)),
+     &                    hr(np(npart+4)))
+              return
+            endif
+          endif
+
+c       Mass terms
+
+        elseif(pcomp(array,'lmas',4)) then
+          if(abs(np(npart+12)).eq.0) then
+            go to 400
+          else
+            call fmspexdiag(neq,hr(np(npart+12)),1)
+            return
+          endif
+        elseif(pcomp(array,'mass',4) .or. pcomp(array,'cmas',4)) then
+          if(max(abs(np(90)),abs(np(91)),abs(np(npart+8))).eq.0) then
+            go to 400
+          else
+            call fmspexmass(neq,mr(np(90)),mr(np(91)),
+     &                      hr(np(npart+8)),2)
+            return
+          endif
+        elseif(pcomp(array,'umas',4)) then
+          if(max(abs(np(90)),abs(np(91)),abs(np(npart+8))).eq.0) then
+            go to 400
+          else
+            call fmspexmass(neq,mr(np(90)),mr(np(91)),
+     &                      hr(np(npart+8)),3)
+            return
+          endif
+
+c       Damping terms
+
+        elseif(pcomp(array,'damp',4) .or. pcomp(array,'cdam',4)) then
+          if(max(abs(np(203)),abs(np(204)),abs(np(npart+16))).eq.0) then
+            go to 400
+          else
+            call fmspexmass(neq,mr(np(203)),mr(np(204)),
+     &                      hr(np(npart+16)),2)
+            return
+          endif
+        elseif(pcomp(array,'udam',4)) then
+          if(max(abs(np(203)),abs(np(204)),abs(np(npart+16))).eq.0) then
+            go to 400
+          else
+            call fmspexmass(neq,mr(np(203)),mr(np(204)),
+     &                      hr(np(npart+16)),3)
+            return
+          endif
+
+c       Residual terms
+
+        elseif(pcomp(array,'dr  ',2) .or. pcomp(array,'form',4)) then
+          if(abs(np(26)).eq.0) then
+            go to 400
+          else
+            call fmspexdiag(neq,hr(np(26)),0)
+            return
+          endif
+        endif
+      
+      call fmspexnone()
+      return
+
+c     Error
+
+400   write(iow,4000) array
+      write(ilg,4000) array
+      if(ior.lt.0) then
+        write(*,4000) array
+      endif
+      call fmspexnone()
+
+c     format
+
+4000  format(' *ERROR* Array ',a,' can not be output -- missing data'/)
+
+      end
+
+c     @T
+c     \subsection{Profile output}
+c
+c     The [[matprof]] routine handles the [[sparse profile]] request.
+c     If the tangent is held in profile form, it passes the column
+c     pointers, the diagonal and upper profile, and the lower profile
+c     straight to [[fmprofile]], which writes them as raw blocks.
+c     For the symmetric tangent the upper profile doubles as the lower
+c     one.  Otherwise it calls [[fmnoprof]], and the client falls back
+c     to the coordinate transfer.
+c
+c     @c
+      subroutine matprof(lct)
+c     @q
+
+      implicit   none
+
+      include   'cdata.h'
+      include   'compas.h'
+      include   'part0.h'
+      include   'pointer.h'
+      include   'comblk.h'
+
+      logical    pcomp
+      character  lct*(*),array*4
+
+      save
+
+c     @c
+      array = lct
+
+      if(ittyp.eq.-3 .and. np(20+npart).ne.0
+     &               .and. np(npart).ne.0) then
+        if(pcomp(array,'tang',4)) then
+          call fmprofile(neq,mr(np(20+npart)),hr(np(npart)),
+     &                   hr(np(npart)+neq), 1)
+          return
+        elseif(pcomp(array,'utan',4) .and. np(npart+4).ne.0) then
+          call fmprofile(neq,mr(np(20+npart)),hr(np(npart)),
+     &                   hr(np(npart+4)), 0)
+          return
+        endif
+      endif
+      call fmnoprof()
+
+      end
+
       subroutine uptang(neq,jp,ad, al, cnt)
 
 c-----[--+---------+---------+---------+---------+---------+---------+-]
@@ -7,22 +7,81 @@ c     calls [[feapsync]] to allow the client to sync up with the
 c     server, then calls [[tinput2]], which is generated from the
 c     ordinary [[tinput]] routine in FEAP.
 c
+c     The same place serves as the hook for model templates (see
+c     [[feaptmpl.c]]): [[feaptmplparse]] is called before reads from
+c     the input deck, and [[feaptmplready]] before console prompts.
+c     It is also where interrupts are guarded (see [[feapintr.c]]):
+c     [[feapintrprompt]] is called before each console prompt, and
+c     [[feapintrrun]] once a command has been read.  Finally, it is
+c     where commands are timed (see [[feapprof.c]]): [[feapprofend]]
+c     marks the end of the last command, [[feapprofwait]] the start of
+c     the wait at the prompt, and [[feapprofbegin]] the start of the
+c     command just read.
+c
+c     Console commands may also come from the queue of macros sent
+c     ahead by the client (see [[feapqueue.c]]).  The label of the
+c     queued macro that just finished goes in the synchronization
+c     message.  To hand a queued macro to [[tinput2]], we write it to
+c     a scratch file and point [[ior]] at that file for the one read,
+c     the same way FEAP reads macros from an input file.
+c
+c     Arrays the client has subscribed to (see [[feappush.c]]) may be
+c     due when a console command finishes, so we pass the name of each
+c     command to [[feappushmacro]] and call [[feappushdone]] at the
+c     next prompt.
+c
 c     @c
       logical function tinput(tx,mt,d,nn)
 
       include  'iofile.h'
 
-      logical   tinput2
-      integer   mt,nn,bnum
-      character tx(*)*15
+      logical   tinput2, qopen
+      integer   mt,nn,bnum,iorsv,qunit
+      integer   feapqlabel,feapqnext
+      character tx(*)*15, yyy*256
       real*8    d(*)
 
+      parameter (qunit = 93)
+
       save
 
+      data      qopen /.false./
+
       if(ior.lt.0) then
-        bnum = 0
+        call feappushdone()
+        call feapprofend()
+        call feaptmplready()
+        call feapintrprompt()
+        call feapprofwait()
+        bnum = feapqlabel()
         call feapsync(bnum)
+        if(feapqnext(yyy).ne.0) then
+          if(.not.qopen) then
+            open(unit=qunit, status='scratch', form='formatted')
+            qopen = .true.
+          endif
+          rewind(qunit)
+          write(qunit,'(a)') yyy
+          rewind(qunit)
+          iorsv  = ior
+          ior    = qunit
+          tinput = tinput2(tx,mt,d,nn)
+          ior    = iorsv
+        else
+          tinput = tinput2(tx,mt,d,nn)
+        endif
+        if(mt.ge.2) then
+          call feapprofbegin(tx(1),tx(2))
+        elseif(mt.eq.1) then
+          call feapprofbegin(tx(1),' ')
+        else
+          call feapprofbegin(' ',' ')
+        endif
+        if(mt.ge.1) call feappushmacro(tx(1))
+        call feapintrrun()
+      else
+        call feaptmplparse()
+        tinput = tinput2(tx,mt,d,nn)
       end if
-      tinput = tinput2(tx,mt,d,nn)
 
       end
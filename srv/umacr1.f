@@ -8,6 +8,10 @@ c     use for synchronization.  Otherwise, FEAP will call the [[feapsrv]]
 c     dispatcher routine, which allows the MATLAB client to access most of
 c     the MATFEAP-specific functionality available.
 c
+c     The form [[serv,push]] is for the body of a FEAP [[loop]]: it
+c     sends the arrays the client has subscribed to (see [[feappush.c]])
+c     and returns to the loop without waiting for the client.
+c
 c     @c
       subroutine umacr1(lct,ctl,prt)
 
@@ -54,7 +58,9 @@ c     Set command word
 
       else                              ! Perform user operation
         ival = ctl(1)
-        if(ival.gt.0) then
+        if(pcomp(lct,'push',4)) then
+          call feappushstep()
+        elseif(ival.gt.0) then
           call feapsync(ival)
         else
           call feapsrv()
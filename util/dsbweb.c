@@ -91,8 +91,12 @@ THE SOFTWARE.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #define BUF_SIZ 512
+#define IO_BUF_SIZ 65536
 
 #define IN_CODE      0
 #define IN_TEX       1
@@ -105,7 +109,8 @@ THE SOFTWARE.
 char* DSBWEB_HELP =
     "Syntax:\n"
     "  dsbweb [-help] [-p preamble] [-d output.tex] [-o output.tex]\n"
-    "    [-e envname] [-c] [-m] [-f] [-l] [-mb] [-list] files\n"
+    "    [-e envname] [-j jobs] [-u] [-c] [-m] [-f] [-l] [-mb] [-list]\n"
+    "    files\n"
     "\n"
     "Flags:\n"
     "  -help  See this message\n"
@@ -118,6 +123,9 @@ char* DSBWEB_HELP =
     "  -e     Specify an environment (e.g. listings) for typesetting code.\n"
     "         The default is verbatim.\n"
     "\n"
+    "  -j     Process up to this many files at once (0 for one per CPU).\n"
+    "  -u     Only regenerate TeX output when the sources have changed.\n"
+    "\n"
     "  -c     Specify that following files are in C\n"
     "  -m     Specify that following files are in MATLAB\n"
     "  -l     Specify that following files are in Lua\n"
@@ -178,10 +186,8 @@ int language_type(char* fname)
  * we append [[.tex]] to the entire filename.
  *
  *@c*/
-FILE* open_tex_output(char* fname)
+void tex_output_name(char* fname, char* ofname)
 {
-    FILE* out;
-    char ofname[BUF_SIZ];
     char* p;
     strcpy(ofname, fname);
     for (p = ofname + strlen(ofname); p != ofname && *p != '.'; --p);
@@ -189,14 +195,93 @@ FILE* open_tex_output(char* fname)
         strcpy(p, ".tex");
     else
         strcat(ofname, ".tex");
-    out = fopen(ofname, "w");
+}
+
+FILE* open_output(char* ofname)
+{
+    FILE* out = fopen(ofname, "w");
     if (!out) {
         fprintf(stderr, "Could not open output %s\n", ofname);
         exit(-1);
     }
+    setvbuf(out, NULL, _IOFBF, IO_BUF_SIZ);
     return out;
 }
 
+/*@T
+ * \section{Content hashes}
+ *
+ * With the [[-u]] flag, we only regenerate a \LaTeX\ file when its
+ * sources have changed.  Timestamps are not much use for this, since
+ * version control checkouts and distribution tarballs scramble them, so
+ * instead we hash the contents of the sources (along with the options
+ * that affect the output) and record the hash in a \LaTeX\ comment on
+ * the first line of the output:
+ * \begin{verbatim}
+ *   %% dsbweb 8f0c2e6d1a5b9347
+ * \end{verbatim}
+ * If the hash on the first line of an existing output matches, the
+ * output is left alone.  The hash is the 64-bit FNV-1a hash, which is
+ * simple, fast enough that the cost is dominated by reading the file,
+ * and needs nothing beyond the C library.
+ *
+ *@c*/
+typedef unsigned long long dsb_hash_t;
+
+#define DSB_HASH_INIT 14695981039346656037ULL
+
+dsb_hash_t hash_bytes(dsb_hash_t h, const void* data, size_t n)
+{
+    const unsigned char* p = (const unsigned char*) data;
+    for (; n > 0; --n, ++p) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+dsb_hash_t hash_string(dsb_hash_t h, const char* s)
+{
+    return hash_bytes(h, s ? s : "", s ? strlen(s)+1 : 1);
+}
+
+dsb_hash_t hash_file(dsb_hash_t h, char* fname)
+{
+    char buf[IO_BUF_SIZ];
+    size_t n;
+    FILE* in = fopen(fname, "rb");
+    if (in == NULL) {
+        fprintf(stderr, "Could not open input %s\n", fname);
+        exit(-1);
+    }
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+        h = hash_bytes(h, buf, n);
+    fclose(in);
+    return h;
+}
+
+void write_stamp(FILE* out, dsb_hash_t h)
+{
+    fprintf(out, "%%%% dsbweb %016llx\n", h);
+}
+
+int stamp_matches(char* ofname, dsb_hash_t h)
+{
+    char line[BUF_SIZ];
+    char stamp[BUF_SIZ];
+    int match;
+    FILE* fp = fopen(ofname, "r");
+    if (fp == NULL)
+        return 0;
+    sprintf(stamp, "%%%% dsbweb %016llx\n", h);
+    match = (fgets(line, sizeof(line), fp) != NULL &&
+             strcmp(line, stamp) == 0);
+    fclose(fp);
+    return match;
+}
+
+int update_mode = 0;  /* Skip outputs whose sources have not changed */
+
 /*@T
  * \section{Managing output states}
  *
@@ -463,12 +548,27 @@ void process_file(char* fname, int language, FILE* combined_doc,
     if (language == DSB_NOLANG)
         language = language_type(fname);
 
+    if (!combined_doc && language != DSB_MB && language != DSB_MB_LIST) {
+        char ofname[BUF_SIZ];
+        dsb_hash_t h = DSB_HASH_INIT;
+        tex_output_name(fname, ofname);
+        if (update_mode) {
+            h = hash_bytes(h, &language, sizeof(language));
+            h = hash_string(h, envname);
+            h = hash_file(h, fname);
+            if (stamp_matches(ofname, h))
+                return;
+        }
+        out = open_output(ofname);
+        if (update_mode)
+            write_stamp(out, h);
+    }
+
     if ((in = fopen(fname, "r")) == NULL) {
         fprintf(stderr, "Could not open input %s\n", fname);
         exit(-1);
     }
-    if (!combined_doc && language != DSB_MB && language != DSB_MB_LIST)
-        out = open_tex_output(fname);
+    setvbuf(in, NULL, _IOFBF, IO_BUF_SIZ);
 
     if (language == DSB_C)
         process_simple(in, out, " \t/*", envname);
@@ -492,6 +592,103 @@ void process_file(char* fname, int language, FILE* combined_doc,
     fclose(in);
 }
 
+/*@T
+ * \section{Processing files in parallel}
+ *
+ * Each input file is processed independently of the others, so with
+ * the [[-j]] flag we fork a process for each file, with at most
+ * [[nprocs]] running at once.  When there is a common output file,
+ * each child writes into its own temporary file, and the parent
+ * copies the pieces into the common output in the order the files were
+ * given, so the result is the same as for a serial run.  MATLAB batch
+ * files and batch listings write to other files or to the screen, so
+ * they are processed by the parent in order as they come up.
+ *
+ * A child that hits an error prints a message and exits with a nonzero
+ * status, as [[dsbweb]] always has; the parent waits for the rest of
+ * the children and then exits with an error as well.  Everything is
+ * flushed before each fork so that nothing buffered in the parent is
+ * written twice.
+ *
+ *@c*/
+typedef struct dsb_job_t {
+    char* fname;     /* Input file name                          */
+    int   language;  /* Language flag in effect for the file     */
+    FILE* frag;      /* Temporary output when writing a combined doc */
+} dsb_job_t;
+
+int is_batch_job(dsb_job_t* job)
+{
+    int language = job->language;
+    if (language == DSB_NOLANG)
+        language = language_type(job->fname);
+    return (language == DSB_MB || language == DSB_MB_LIST);
+}
+
+void copy_fragment(FILE* frag, FILE* out)
+{
+    char buf[IO_BUF_SIZ];
+    size_t n;
+    fseek(frag, 0, SEEK_SET);
+    while ((n = fread(buf, 1, sizeof(buf), frag)) > 0)
+        fwrite(buf, 1, n, out);
+    fclose(frag);
+}
+
+void process_jobs(dsb_job_t* jobs, int njobs, FILE* out,
+                  const char* envname, int nprocs)
+{
+    int i;
+    int next    = 0;
+    int running = 0;
+    int failed  = 0;
+
+    if (nprocs <= 1) {
+        for (i = 0; i < njobs; ++i)
+            process_file(jobs[i].fname, jobs[i].language, out, envname);
+        return;
+    }
+
+    while (next < njobs || running > 0) {
+        if (next < njobs && running < nprocs) {
+            dsb_job_t* job = jobs + next++;
+            pid_t pid;
+            if (is_batch_job(job)) {
+                process_file(job->fname, job->language, out, envname);
+                continue;
+            }
+            if (out && (job->frag = tmpfile()) == NULL) {
+                fprintf(stderr, "Could not open temporary output\n");
+                exit(-1);
+            }
+            fflush(NULL);
+            if ((pid = fork()) == 0) {
+                process_file(job->fname, job->language, job->frag, envname);
+                fflush(NULL);
+                _exit(0);
+            } else if (pid < 0) {
+                process_file(job->fname, job->language,
+                             job->frag ? job->frag : out, envname);
+            } else {
+                ++running;
+            }
+        } else {
+            int status;
+            if (wait(&status) < 0)
+                break;
+            --running;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                failed = 1;
+        }
+    }
+    if (failed)
+        exit(-1);
+
+    for (i = 0; i < njobs; ++i)
+        if (jobs[i].frag)
+            copy_fragment(jobs[i].frag, out);
+}
+
 /*@T
  * \section{Document header}
  *
@@ -540,12 +737,19 @@ void write_preamble(FILE* out, char* preamble)
  *   written out from a MATLAB batch to go to be written out the
  *   screen.
  * \item
+ *   A [[-j [n]]] flag saying how many files to process at once, and a
+ *   [[-u]] flag saying that \LaTeX\ outputs should only be rewritten
+ *   when their sources have changed.
+ * \item
  *   Input file names.
  * \end{enumerate}
  *
  * The main routine just processes all the arguments in an appropriate
- * order ([[-o]], [[-d]], and [[-p]] flags first, then all the
- * language flags and file names in the order specified).
+ * order ([[-o]], [[-d]], [[-p]], and [[-j]] flags first, then all the
+ * language flags and file names in the order specified).  The files are
+ * collected into a job list and processed together at the end, so
+ * that with [[-u]] we can check the hash for a common output before
+ * opening (and truncating) it.
  *
  *@c*/
 int main(int argc, char** argv)
@@ -553,9 +757,13 @@ int main(int argc, char** argv)
     int i;
     int full_doc      = 0;          /* Is this a full LaTeX document?   */
     FILE* out         = NULL;       /* Pointer for a common output file */
+    char* ofname      = NULL;       /* Name of the common output file   */
     int language_flag = DSB_NOLANG; /* Current specified langauge       */
     char* preamble    = NULL;       /* File to include in TeX preamble  */
     char* envname     = "verbatim"; /* TeX environment for code         */
+    int nprocs        = 1;          /* Number of files to do at once    */
+    dsb_job_t* jobs;                /* Input files to process           */
+    int njobs         = 0;
 
     for (i = 1; i < argc; ++i) {
 
@@ -568,12 +776,13 @@ int main(int argc, char** argv)
         }
 
         /*
-         * Check for -d, -o, -p, or -e output specifications
+         * Check for -d, -o, -p, -e, or -j output specifications
          */
         if (strcmp(argv[i], "-d") == 0 || 
             strcmp(argv[i], "-o") == 0 ||
             strcmp(argv[i], "-p") == 0 ||
-            strcmp(argv[i], "-e") == 0) {
+            strcmp(argv[i], "-e") == 0 ||
+            strcmp(argv[i], "-j") == 0) {
 
             if (i+1 == argc) {
                 fprintf(stderr, "Flag %s requires an argument\n", argv[i]);
@@ -592,24 +801,28 @@ int main(int argc, char** argv)
                 continue;
             } 
 
+            /* Handle job count directives */
+            if (argv[i][1] == 'j') {
+                nprocs = atoi(argv[i+1]);
+                if (nprocs <= 0)
+                    nprocs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+                continue;
+            }
+
             /* Handle -d and -o */
             full_doc = (argv[i][1] == 'd');
-            if (out != NULL) {
+            if (ofname != NULL) {
                 fprintf(stderr, "Cannot specify multiple explicit outputs\n");
                 exit(-1);
-            } else if ((out = fopen(argv[i+1], "w")) == NULL) {
-                fprintf(stderr, "Could not open output %s\n", argv[i+1]);
-                exit(-1);
             }
+            ofname = argv[i+1];
         }
     }
 
-    if (full_doc)
-        write_preamble(out, preamble);
-
     /*
-     * Process files and language specification flags
+     * Collect files and language specification flags
      */
+    jobs = (dsb_job_t*) calloc(argc, sizeof(dsb_job_t));
     for (--argc, ++argv; argc > 0; --argc, ++argv) {
         if (strcmp(argv[0], "-c") == 0) {
             language_flag = DSB_C;
@@ -625,19 +838,55 @@ int main(int argc, char** argv)
             language_flag = DSB_SH;
         } else if (strcmp(argv[0], "-list") == 0) {
             language_flag = DSB_MB_LIST;
+        } else if (strcmp(argv[0], "-u") == 0) {
+            update_mode = 1;
         } else if (strcmp(argv[0], "-d") == 0 ||
                    strcmp(argv[0], "-o") == 0 ||
                    strcmp(argv[0], "-p") == 0 ||
-                   strcmp(argv[0], "-e") == 0) {
+                   strcmp(argv[0], "-e") == 0 ||
+                   strcmp(argv[0], "-j") == 0) {
             --argc, ++argv;
         } else if (argv[0][0] == '-') {
             fprintf(stderr, "Unrecognized flag: %s\n", argv[0]);
             return -1;
         } else {
-            process_file(argv[0], language_flag, out, envname);
+            jobs[njobs].fname    = argv[0];
+            jobs[njobs].language = language_flag;
+            ++njobs;
+        }
+    }
+
+    /*
+     * Open the common output, unless it is already up to date
+     */
+    if (ofname) {
+        dsb_hash_t h = DSB_HASH_INIT;
+        if (update_mode) {
+            h = hash_bytes(h, &full_doc, sizeof(full_doc));
+            h = hash_string(h, envname);
+            if (full_doc)
+                h = hash_string(h, preamble ? preamble : getenv(PREAMBLE_VAR));
+            for (i = 0; i < njobs; ++i) {
+                h = hash_string(h, jobs[i].fname);
+                h = hash_bytes(h, &jobs[i].language, sizeof(int));
+                h = hash_file(h, jobs[i].fname);
+            }
+            if (stamp_matches(ofname, h)) {
+                free(jobs);
+                return 0;
+            }
         }
+        out = open_output(ofname);
+        if (update_mode)
+            write_stamp(out, h);
     }
 
+    if (full_doc)
+        write_preamble(out, preamble);
+
+    process_jobs(jobs, njobs, out, envname, nprocs);
+    free(jobs);
+
     if (full_doc)
         fprintf(out, "\\end{document}\n");
     if (out)